@@ -55,6 +55,7 @@ static long opt_optimize = 1;
 static int opt_show_types;
 static int opt_dump_refs;
 static int opt_dump_macros;
+static int opt_insn_count;
 
 static int64_t elapsed_expand;
 static int64_t elapsed_compile;
@@ -110,6 +111,7 @@ print_usage(int status)
     fprintf(fp, "  -r  --return-vals   return field values for the tree root\n");
     fprintf(fp, "  -0, --optimize=0    do not optimize (check syntax)\n");
     fprintf(fp, "      --types         show field value types\n");
+    fprintf(fp, "      --insn-count    print the number of instructions before and after optimization\n");
     /* NOTE: References are loaded during runtime and dftest only does compilation.
      * Unless some static reference data is hard-coded at compile time during
      * development the --refs option to dftest is useless because it will just
@@ -184,6 +186,15 @@ print_elapsed(void)
             elapsed_compile);
 }
 
+static void
+print_insn_count(dfilter_t *df)
+{
+    unsigned count, unoptimized;
+
+    count = dfilter_get_insn_count(df, &unoptimized);
+    printf("\nInstruction count: %u (%u before optimization)\n", count, unoptimized);
+}
+
 static char *
 expand_filter(const char *text)
 {
@@ -204,7 +215,7 @@ expand_filter(const char *text)
 static bool
 compile_filter(const char *text, dfilter_t **dfp)
 {
-    unsigned df_flags = 0;
+    unsigned df_flags = DF_SET_FILES;
     bool ok;
     df_error_t *df_err = NULL;
     int64_t start;
@@ -295,6 +306,9 @@ test_filter(const char *text)
 
     print_warnings(df);
 
+    if (opt_insn_count)
+        print_insn_count(df);
+
     if (opt_timer)
         print_elapsed();
 
@@ -375,6 +389,7 @@ main(int argc, char **argv)
         { "types",    ws_no_argument,   0, 2000 },
         { "refs",     ws_no_argument,   0, 3000 },
         { "file",     ws_required_argument, 0, 4000 },
+        { "insn-count", ws_no_argument, 0, 5000 },
         { NULL,       0,                0,  0   }
     };
     int opt;
@@ -444,6 +459,9 @@ main(int argc, char **argv)
             case 4000:
                 path = ws_optarg;
                 break;
+            case 5000:
+                opt_insn_count = 1;
+                break;
             case 'v':
                 show_version();
                 exit(EXIT_SUCCESS);
@@ -290,6 +290,9 @@ typedef struct _capture_src {
     uint32_t                     received;
     uint32_t                     dropped;
     uint32_t                     flushed;
+    uint32_t                     batches;                /**< pcap_dispatch() calls that processed packets */
+    uint32_t                     max_batch;              /**< most packets processed by one of them */
+    uint64_t                     batched;                /**< packets processed by all of them */
     pcap_t                      *pcap_h;
 #ifdef MUST_DO_SELECT
     int                          pcap_fd;                /**< pcap file descriptor */
@@ -437,6 +440,21 @@ static bool really_quiet;
 static bool use_threads;
 static uint64_t start_time;
 
+/*
+ * Maximum number of packets to process in one pcap_dispatch() call, or -1
+ * to process everything libpcap has buffered (on Linux, a whole TPACKET_V3
+ * block).  A signal stops the capture with pcap_breakloop(), which takes
+ * effect in the middle of a batch, so batching doesn't delay stopping.
+ * On Windows, we check the signal pipe only between pcap_dispatch() calls,
+ * so we process one packet at a time unless told otherwise.
+ */
+#ifdef _WIN32
+#define DEFAULT_DISPATCH_BATCH  1
+#else
+#define DEFAULT_DISPATCH_BATCH  -1
+#endif
+static int dispatch_batch = DEFAULT_DISPATCH_BATCH;
+
 static void capture_loop_write_packet_cb(uint8_t *pcap_src_p, const struct pcap_pkthdr *phdr,
                                          const uint8_t *pd);
 static void capture_loop_queue_packet_cb(uint8_t *pcap_src_p, const struct pcap_pkthdr *phdr,
@@ -454,6 +472,7 @@ WS_NORETURN static void exit_main(int err);
 static void report_new_capture_file(const char *filename);
 static void report_packet_count(unsigned int packet_count);
 static void report_packet_drops(uint32_t received, uint32_t pcap_drops, uint32_t drops, uint32_t flushed, uint32_t ps_ifdrop, char *name);
+static void report_dispatch_batches(uint32_t batches, uint64_t batched, uint32_t max_batch, char *name);
 static void report_capture_error(const char *error_msg, const char *secondary_error_msg);
 static void report_cfilter_error(capture_options *capture_opts, unsigned i, const char *errmsg);
 
@@ -552,6 +571,9 @@ print_usage(FILE *output)
     fprintf(output, "  -C <byte_limit>          maximum number of bytes used for buffering packets\n");
     fprintf(output, "                           within dumpcap\n");
     fprintf(output, "  -t                       use a separate thread per interface\n");
+    fprintf(output, "  --dispatch-batch <count> maximum number of packets to process per read from\n");
+    fprintf(output, "                           an interface; 0 for all that are buffered\n");
+    fprintf(output, "                           (default: %d)\n", DEFAULT_DISPATCH_BATCH < 0 ? 0 : DEFAULT_DISPATCH_BATCH);
     fprintf(output, "  -q                       don't report packet capture counts\n");
     fprintf(output, "  -Q                       suppress all non-error status messages to stderr\n");
     fprintf(output, "  --application-flavor <flavor>\n");
@@ -3535,6 +3557,19 @@ capture_loop_init_pcapng_output(capture_options *capture_opts, loop_data *ld,
     return successful;
 }
 
+/*
+ * Write the capture file from a separate thread, so that capturing doesn't
+ * wait for the file system.  Whatever reads from a pipe is expected to keep
+ * up, and wants each packet as soon as it's captured, so we don't do this
+ * for pipes.
+ */
+static void
+capture_loop_start_writer(capture_options *capture_opts, loop_data *ld)
+{
+    if (!capture_opts->output_to_pipe && writecap_start_writer_thread(ld->pdh))
+        ws_debug("Writing the capture file from a separate thread");
+}
+
 /* set up to write to the already-opened capture output file/files */
 static bool
 capture_loop_init_output(capture_options *capture_opts, loop_data *ld, char *errmsg, int errmsg_len)
@@ -3558,6 +3593,8 @@ capture_loop_init_output(capture_options *capture_opts, loop_data *ld, char *err
     }
     if (ld->pdh) {
         bool successful;
+
+        capture_loop_start_writer(capture_opts, ld);
         if (capture_opts->use_pcapng) {
             successful = capture_loop_init_pcapng_output(capture_opts, ld, &err);
         } else {
@@ -3727,15 +3764,14 @@ capture_loop_dispatch(loop_data *ld,
                  * "select()" says we can read from it without blocking; go for
                  * it.
                  *
-                 * We don't have pcap_breakloop(), so we only process one packet
-                 * per pcap_dispatch() call, to allow a signal to stop the
-                 * processing immediately, rather than processing all packets
-                 * in a batch before quitting.
+                 * Process up to dispatch_batch packets; a signal stops the
+                 * processing with pcap_breakloop() (see capture_loop_stop()),
+                 * so we don't have to process one packet per call for that.
                  */
                 if (use_threads) {
-                    inpkts = pcap_dispatch(pcap_src->pcap_h, 1, capture_loop_queue_packet_cb, (uint8_t *)pcap_src);
+                    inpkts = pcap_dispatch(pcap_src->pcap_h, dispatch_batch, capture_loop_queue_packet_cb, (uint8_t *)pcap_src);
                 } else {
-                    inpkts = pcap_dispatch(pcap_src->pcap_h, 1, capture_loop_write_packet_cb, (uint8_t *)pcap_src);
+                    inpkts = pcap_dispatch(pcap_src->pcap_h, dispatch_batch, capture_loop_write_packet_cb, (uint8_t *)pcap_src);
                 }
                 if (inpkts < 0) {
                     if (inpkts == -1) {
@@ -3761,25 +3797,18 @@ capture_loop_dispatch(loop_data *ld,
 #ifdef LOG_CAPTURE_VERBOSE
             ws_debug("capture_loop_dispatch: from pcap_dispatch");
 #endif
-#ifdef _WIN32
             /*
              * On Windows, we don't support asynchronously telling a process to
              * stop capturing; instead, we check for an indication on a pipe
              * after processing packets.  We therefore process only one packet
-             * at a time, so that we can check the pipe after every packet.
+             * at a time by default, so that we can check the pipe after every
+             * packet; see DEFAULT_DISPATCH_BATCH.
              */
             if (use_threads) {
-                inpkts = pcap_dispatch(pcap_src->pcap_h, 1, capture_loop_queue_packet_cb, (uint8_t *)pcap_src);
+                inpkts = pcap_dispatch(pcap_src->pcap_h, dispatch_batch, capture_loop_queue_packet_cb, (uint8_t *)pcap_src);
             } else {
-                inpkts = pcap_dispatch(pcap_src->pcap_h, 1, capture_loop_write_packet_cb, (uint8_t *)pcap_src);
+                inpkts = pcap_dispatch(pcap_src->pcap_h, dispatch_batch, capture_loop_write_packet_cb, (uint8_t *)pcap_src);
             }
-#else
-            if (use_threads) {
-                inpkts = pcap_dispatch(pcap_src->pcap_h, -1, capture_loop_queue_packet_cb, (uint8_t *)pcap_src);
-            } else {
-                inpkts = pcap_dispatch(pcap_src->pcap_h, -1, capture_loop_write_packet_cb, (uint8_t *)pcap_src);
-            }
-#endif
             if (inpkts < 0) {
                 if (inpkts == -1) {
                     /* Error, rather than pcap_breakloop(). */
@@ -3825,6 +3854,13 @@ capture_loop_dispatch(loop_data *ld,
             }
 #endif /* pcap_next_ex */
         }
+
+        if (inpkts > 0) {
+            pcap_src->batches++;
+            pcap_src->batched += inpkts;
+            if ((uint32_t)inpkts > pcap_src->max_batch)
+                pcap_src->max_batch = inpkts;
+        }
     }
 
 #ifdef LOG_CAPTURE_VERBOSE
@@ -4082,6 +4118,7 @@ do_file_switch_or_stop(capture_options *capture_opts)
             /* File switch succeeded: reset the conditions */
             global_ld.bytes_written = 0;
             global_ld.packets_written = 0;
+            capture_loop_start_writer(capture_opts, &global_ld);
             if (capture_opts->use_pcapng) {
                 successful = capture_loop_init_pcapng_output(capture_opts, &global_ld, &global_ld.err);
             } else {
@@ -4103,7 +4140,7 @@ do_file_switch_or_stop(capture_options *capture_opts)
             if (global_ld.next_interval_time) {
                 global_ld.next_interval_time = get_next_time_interval(global_ld.interval_s);
             }
-            writecap_flush(global_ld.pdh, NULL);
+            writecap_sync(global_ld.pdh, NULL);
             if (global_ld.inpkts_to_sync_pipe) {
                 if (!quiet)
                     report_packet_count(global_ld.inpkts_to_sync_pipe);
@@ -4321,7 +4358,7 @@ capture_loop_start(capture_options *capture_opts, bool *stats_known, struct pcap
            message to our parent so that they'll open the capture file and
            update its windows to indicate that we have a live capture in
            progress. */
-        writecap_flush(global_ld.pdh, NULL);
+        writecap_sync(global_ld.pdh, NULL);
         report_new_capture_file(capture_opts->save_file);
     }
 
@@ -4443,8 +4480,9 @@ capture_loop_start(capture_options *capture_opts, bool *stats_known, struct pcap
 #endif
             /* Let the parent process know. */
             if (global_ld.inpkts_to_sync_pipe) {
-                /* do sync here */
-                writecap_flush(global_ld.pdh, NULL);
+                /* do sync here; the packets must be in the file before
+                   we tell our parent about them */
+                writecap_sync(global_ld.pdh, NULL);
 
                 /* Send our parent a message saying we've written out
                    "global_ld.inpkts_to_sync_pipe" packets to the capture file. */
@@ -4689,6 +4727,8 @@ capture_loop_start(capture_options *capture_opts, bool *stats_known, struct pcap
             }
         }
         report_packet_drops(received, pcap_dropped, pcap_src->dropped, pcap_src->flushed, stats->ps_ifdrop, interface_opts->display_name);
+        if (!pcap_src->from_cap_pipe)
+            report_dispatch_batches(pcap_src->batches, pcap_src->batched, pcap_src->max_batch, interface_opts->display_name);
     }
 
     /* close the input file (pcap or capture pipe) */
@@ -4812,16 +4852,16 @@ capture_loop_wrote_one_packet(capture_src *pcap_src) {
         pcap_src->received++;
     }
 
-    /* check -c NUM */
+    /* check -c NUM; stop in the middle of the current batch, if any */
     if (global_capture_opts.has_autostop_packets && global_ld.packets_captured >= global_capture_opts.autostop_packets) {
         writecap_flush(global_ld.pdh, NULL);
-        global_ld.go = false;
+        capture_loop_stop();
         return;
     }
     /* check -a packets:NUM (treat like -c NUM) */
     if (global_capture_opts.has_autostop_written_packets && global_ld.packets_captured >= global_capture_opts.autostop_written_packets) {
         writecap_flush(global_ld.pdh, NULL);
-        global_ld.go = false;
+        capture_loop_stop();
         return;
     }
     /* check -b packets:NUM */
@@ -5152,6 +5192,7 @@ gather_dumpcap_runtime_info(feature_list l)
 #ifdef _WIN32
 #define LONGOPT_SIGNAL_PIPE         LONGOPT_BASE_APPLICATION+5
 #endif
+#define LONGOPT_DISPATCH_BATCH      LONGOPT_BASE_APPLICATION+6
 
 /* And now our feature presentation... [ fade to music ] */
 int
@@ -5167,6 +5208,7 @@ main(int argc, char *argv[])
         {"ifdescr", ws_required_argument, NULL, LONGOPT_IFDESCR},
         {"capture-comment", ws_required_argument, NULL, LONGOPT_CAPTURE_COMMENT},
         {"application-flavor", ws_required_argument, NULL, LONGOPT_APPLICATION_FLAVOR},
+        {"dispatch-batch", ws_required_argument, NULL, LONGOPT_DISPATCH_BATCH},
 #ifdef _WIN32
         {"signal-pipe", ws_required_argument, NULL, LONGOPT_SIGNAL_PIPE},
 #endif
@@ -5666,6 +5708,11 @@ main(int argc, char *argv[])
         case 'N':
             pcap_queue_packet_limit = get_positive_int(ws_optarg, "packet_limit");
             break;
+        case LONGOPT_DISPATCH_BATCH:
+            dispatch_batch = get_natural_int(ws_optarg, "dispatch batch");
+            if (dispatch_batch == 0)
+                dispatch_batch = -1;
+            break;
         default:
             cmdarg_err("Invalid Option: %s", argv[ws_optind-1]);
             /* FALLTHROUGH */
@@ -6262,6 +6309,29 @@ report_packet_drops(uint32_t received, uint32_t pcap_drops, uint32_t drops, uint
     }
 }
 
+static void
+report_dispatch_batches(uint32_t batches, uint64_t batched, uint32_t max_batch, char *name)
+{
+    double average = batches ? (double)batched / batches : 0.0;
+
+    /*
+     * This is for tuning --dispatch-batch, so the capture parent isn't
+     * told about it.
+     */
+    if (capture_child) {
+        ws_info("Batches read on interface '%s': %u (%.1f packets per batch, at most %u)",
+            name, batches, average, max_batch);
+    } else {
+        if (!really_quiet) {
+            fprintf(stderr,
+                "Batches read on interface '%s': %u (%.1f packets per batch, at most %u)\n",
+                name, batches, average, max_batch);
+            /* stderr could be line buffered */
+            fflush(stderr);
+        }
+    }
+}
+
 
 /************************************************************************************************/
 /* signal_pipe handling */
@@ -49,6 +49,7 @@
 
 #include <wsutil/clopts_common.h>
 #include <wsutil/cmdarg_err.h>
+#include <wsutil/crc32.h>
 #include <wsutil/filesystem.h>
 #include <wsutil/file_util.h>
 #include <wsutil/plugins.h>
@@ -85,11 +86,19 @@ struct select_item {
 
 /*
  * Duplicate frame detection
+ *
+ * The digests of the frames in the window are kept in fd_hash[], used
+ * as a ring buffer, and the entries in use are also chained into a hash
+ * table keyed on the digest and length, so that looking for a duplicate
+ * doesn't have to compare against every frame in the window.
  */
 typedef struct _fd_hash_t {
     uint8_t    digest[16];
     uint32_t   len;
     nstime_t   frame_time;
+    int        prev;    /* previous entry in the same bucket, or -1 */
+    int        next;    /* next entry in the same bucket, or -1 */
+    bool       in_use;
 } fd_hash_t;
 
 #define DEFAULT_DUP_DEPTH       5   /* Used with -d */
@@ -99,8 +108,40 @@ static fd_hash_t fd_hash[MAX_DUP_DEPTH];
 static int       dup_window    = DEFAULT_DUP_DEPTH;
 static int       cur_dup_entry;
 
+static int      *fd_hash_buckets;  /* first entry of each bucket, or -1 */
+static unsigned  fd_hash_mask;     /* number of buckets - 1 */
+
 static uint32_t  ignored_bytes;  /* Used with -I */
 
+/* Byte ranges of the frame to ignore in the digest (--dup-ignore) */
+typedef struct {
+    uint32_t offset;
+    uint32_t len;
+} dup_ignore_range_t;
+
+static GArray   *dup_ignore_ranges;
+static uint8_t  *dup_scratch;
+static size_t    dup_scratch_size;
+
+/* Digests that can be used for duplicate detection (--dup-digest) */
+typedef enum {
+    DUP_DIGEST_MD5,
+    DUP_DIGEST_CRC32C,
+    DUP_DIGEST_MURMUR64
+} dup_digest_e;
+
+static const struct {
+    const char *name;
+    const char *label;
+    unsigned    len;
+} dup_digests[] = {
+    [DUP_DIGEST_MD5]      = { "md5",      "MD5",      16 },
+    [DUP_DIGEST_CRC32C]   = { "crc32c",   "CRC32C",    4 },
+    [DUP_DIGEST_MURMUR64] = { "murmur64", "Murmur64",  8 },
+};
+
+static dup_digest_e dup_digest = DUP_DIGEST_MD5;
+
 #define ONE_BILLION 1000000000
 
 /* Weights of different errors we can introduce */
@@ -660,12 +701,127 @@ set_unused_info(wtap_rec *rec) {
     }
 }
 
+/*
+ * MurmurHash64A, by Austin Appleby, which is in the public domain.
+ * The data is read as little-endian words, so the digest doesn't depend
+ * on the host.
+ */
+static uint64_t
+murmur_hash64a(const uint8_t *data, size_t len, uint64_t seed)
+{
+    const uint64_t m = UINT64_C(0xc6a4a7935bd1e995);
+    const int r = 47;
+    uint64_t h = seed ^ (len * m);
+    size_t tail = len & 7;
+    const uint8_t *end = data + (len - tail);
+
+    for (; data != end; data += 8) {
+        uint64_t k = pletoh64(data);
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    if (tail != 0) {
+        for (size_t i = tail; i > 0; i--)
+            h ^= (uint64_t)data[i - 1] << (8 * (i - 1));
+        h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
 static bool
-is_duplicate(wtap_rec *rec) {
+parse_dup_ignore_range(const char *spec)
+{
+    const char *endp;
+    dup_ignore_range_t range;
+
+    if (!ws_strtou32(spec, &endp, &range.offset) || *endp != ':' ||
+        !ws_strtou32(endp + 1, NULL, &range.len) || range.len == 0) {
+        cmdarg_err("\"%s\" isn't a valid <offset>:<length>", spec);
+        return false;
+    }
+    if (dup_ignore_ranges == NULL)
+        dup_ignore_ranges = g_array_new(FALSE, FALSE, sizeof(dup_ignore_range_t));
+    g_array_append_val(dup_ignore_ranges, range);
+    return true;
+}
+
+static void
+dup_index_init(void)
+{
+    unsigned n_buckets = 1;
+
+    /* Keep the load factor at or below 1/2. */
+    while (n_buckets < 2 * (unsigned)dup_window)
+        n_buckets *= 2;
+    fd_hash_buckets = g_new(int, n_buckets);
+    for (unsigned b = 0; b < n_buckets; b++)
+        fd_hash_buckets[b] = -1;
+    fd_hash_mask = n_buckets - 1;
+
+    for (int i = 0; i < dup_window; i++) {
+        memset(&fd_hash[i].digest, 0, 16);
+        fd_hash[i].len = 0;
+        nstime_set_unset(&fd_hash[i].frame_time);
+        fd_hash[i].prev = fd_hash[i].next = -1;
+        fd_hash[i].in_use = false;
+    }
+}
+
+static unsigned
+dup_index_bucket(const fd_hash_t *entry)
+{
+    return (pntoh32(entry->digest) ^ (entry->len * 0x9e3779b1U)) & fd_hash_mask;
+}
+
+static void
+dup_index_remove(int i)
+{
+    fd_hash_t *entry = &fd_hash[i];
+
+    if (!entry->in_use)
+        return;
+    if (entry->prev != -1)
+        fd_hash[entry->prev].next = entry->next;
+    else
+        fd_hash_buckets[dup_index_bucket(entry)] = entry->next;
+    if (entry->next != -1)
+        fd_hash[entry->next].prev = entry->prev;
+    entry->in_use = false;
+}
+
+/* Newer entries go first, so each bucket is in reverse frame order. */
+static void
+dup_index_insert(int i)
+{
+    fd_hash_t *entry = &fd_hash[i];
+    int *head = &fd_hash_buckets[dup_index_bucket(entry)];
+
+    entry->prev = -1;
+    entry->next = *head;
+    if (*head != -1)
+        fd_hash[*head].prev = i;
+    *head = i;
+    entry->in_use = true;
+}
+
+/*
+ * Replace the oldest entry in the window with the digest of this frame,
+ * and return the index of the entry.
+ */
+static int
+dup_add_entry(wtap_rec *rec, bool skip_radiotap_hdr) {
     uint8_t* fd = ws_buffer_start_ptr(&rec->data);
     uint32_t len = rec->rec_header.packet_header.caplen;
-    int i;
     const struct ieee80211_radiotap_header* tap_header;
+    fd_hash_t *entry;
 
     /*Hint to ignore some bytes at the start of the frame for the digest calculation(-I option) */
     uint32_t offset = ignored_bytes;
@@ -677,7 +833,7 @@ is_duplicate(wtap_rec *rec) {
     }
 
     /* Get the size of radiotap header and use that as offset (-p option) */
-    if (skip_radiotap == true) {
+    if (skip_radiotap_hdr) {
         tap_header = (const struct ieee80211_radiotap_header*)fd;
         offset = pletoh16(&tap_header->it_len);
         if (offset >= len)
@@ -687,65 +843,90 @@ is_duplicate(wtap_rec *rec) {
     new_fd  = &fd[offset];
     new_len = len - (offset);
 
+    /* Zero the bytes to ignore (--dup-ignore) in a copy of the frame */
+    if (dup_ignore_ranges != NULL) {
+        if (dup_scratch_size < new_len) {
+            dup_scratch_size = new_len;
+            dup_scratch = g_realloc(dup_scratch, dup_scratch_size);
+        }
+        memcpy(dup_scratch, new_fd, new_len);
+        for (unsigned r = 0; r < dup_ignore_ranges->len; r++) {
+            const dup_ignore_range_t *range = &g_array_index(dup_ignore_ranges, dup_ignore_range_t, r);
+            uint64_t start = MAX(range->offset, offset);
+            uint64_t stop = MIN((uint64_t)range->offset + range->len, len);
+
+            if (start < stop)
+                memset(&dup_scratch[start - offset], 0, (size_t)(stop - start));
+        }
+        new_fd = dup_scratch;
+    }
+
     cur_dup_entry++;
     if (cur_dup_entry >= dup_window)
         cur_dup_entry = 0;
 
+    dup_index_remove(cur_dup_entry);
+    entry = &fd_hash[cur_dup_entry];
+
     /* Calculate our digest */
-    gcry_md_hash_buffer(GCRY_MD_MD5, fd_hash[cur_dup_entry].digest, new_fd, new_len);
+    memset(entry->digest, 0, sizeof entry->digest);
+    switch (dup_digest) {
 
-    fd_hash[cur_dup_entry].len = len;
+    case DUP_DIGEST_MD5:
+        gcry_md_hash_buffer(GCRY_MD_MD5, entry->digest, new_fd, new_len);
+        break;
 
-    /* Look for duplicates */
-    for (i = 0; i < dup_window; i++) {
-        if (i == cur_dup_entry)
-            continue;
+    case DUP_DIGEST_CRC32C:
+        phton32(entry->digest, crc32c_calculate(new_fd, new_len, CRC32C_PRELOAD));
+        break;
 
-        if (fd_hash[i].len == fd_hash[cur_dup_entry].len
-            && memcmp(fd_hash[i].digest, fd_hash[cur_dup_entry].digest, 16) == 0) {
-            return true;
-        }
+    case DUP_DIGEST_MURMUR64:
+        phton64(entry->digest, murmur_hash64a(new_fd, new_len, 0));
+        break;
     }
 
-    return false;
+    entry->len = len;
+
+    return cur_dup_entry;
 }
 
 static bool
-is_duplicate_rel_time(wtap_rec *rec, const nstime_t *current) {
-    uint8_t* fd = ws_buffer_start_ptr(&rec->data);
-    uint32_t len = rec->rec_header.packet_header.caplen;
-    int i;
+dup_entries_match(const fd_hash_t *a, const fd_hash_t *b)
+{
+    return a->len == b->len && memcmp(a->digest, b->digest, 16) == 0;
+}
 
-    /*Hint to ignore some bytes at the start of the frame for the digest calculation(-I option) */
-    uint32_t offset = ignored_bytes;
-    uint32_t new_len;
-    uint8_t *new_fd;
+static bool
+is_duplicate(wtap_rec *rec) {
+    int cur = dup_add_entry(rec, skip_radiotap);
+    bool found = false;
 
-    if (len <= ignored_bytes) {
-        offset = 0;
+    /* Look for duplicates */
+    for (int i = fd_hash_buckets[dup_index_bucket(&fd_hash[cur])]; i != -1; i = fd_hash[i].next) {
+        if (dup_entries_match(&fd_hash[i], &fd_hash[cur])) {
+            found = true;
+            break;
+        }
     }
 
-    new_fd  = &fd[offset];
-    new_len = len - (offset);
-
-    cur_dup_entry++;
-    if (cur_dup_entry >= dup_window)
-        cur_dup_entry = 0;
+    if (dup_window != 0)
+        dup_index_insert(cur);
+    return found;
+}
 
-    /* Calculate our digest */
-    gcry_md_hash_buffer(GCRY_MD_MD5, fd_hash[cur_dup_entry].digest, new_fd, new_len);
+static bool
+is_duplicate_rel_time(wtap_rec *rec, const nstime_t *current) {
+    int cur = dup_add_entry(rec, false);
+    bool found = false;
 
-    fd_hash[cur_dup_entry].len = len;
-    fd_hash[cur_dup_entry].frame_time.secs = current->secs;
-    fd_hash[cur_dup_entry].frame_time.nsecs = current->nsecs;
+    fd_hash[cur].frame_time.secs = current->secs;
+    fd_hash[cur].frame_time.nsecs = current->nsecs;
 
     /*
      * Look for relative time related duplicates.
-     * This is hopefully a reasonably efficient mechanism for
-     * finding duplicates by rel time in the fd_hash[] cache.
-     * We check starting from the most recently added hash
-     * entries and work backwards towards older packets.
-     * This approach allows the dup test to be terminated
+     * The entries with the same digest are checked starting from the
+     * most recently added one and working backwards towards older
+     * packets. This approach allows the dup test to be terminated
      * when the relative time of a cached entry is found to
      * be beyond the dup time window.
      *
@@ -753,35 +934,13 @@ is_duplicate_rel_time(wtap_rec *rec, const nstime_t *current) {
      * "well-formed" in the sense that the packet timestamps are
      * in strict chronologically increasing order (which is NOT
      * always the case!!).
-     *
-     * The fd_hash[] table was deliberately created large (1,000,000).
-     * Looking for time related duplicates in large trace files with
-     * non-fractional dup time window values can potentially take
-     * a long time to complete.
      */
 
-    for (i = cur_dup_entry - 1;; i--) {
+    for (int i = fd_hash_buckets[dup_index_bucket(&fd_hash[cur])]; i != -1; i = fd_hash[i].next) {
         nstime_t delta;
-        int cmp;
-
-        if (i < 0)
-            i = dup_window - 1;
 
-        if (i == cur_dup_entry) {
-            /*
-             * We've decremented back to where we started.
-             * Check no more!
-             */
-            break;
-        }
-
-        if (nstime_is_unset(&(fd_hash[i].frame_time))) {
-            /*
-             * We've decremented to an unused fd_hash[] entry.
-             * Check no more!
-             */
-            break;
-        }
+        if (!dup_entries_match(&fd_hash[i], &fd_hash[cur]))
+            continue;
 
         nstime_delta(&delta, current, &fd_hash[i].frame_time);
 
@@ -807,22 +966,32 @@ is_duplicate_rel_time(wtap_rec *rec, const nstime_t *current) {
             continue;
         }
 
-        cmp = nstime_cmp(&delta, &relative_time_window);
-
-        if (cmp > 0) {
+        if (nstime_cmp(&delta, &relative_time_window) > 0) {
             /*
              * The delta time indicates that we are now looking at
              * cached packets beyond the specified dup time window.
              * Check no more!
              */
             break;
-        } else if (fd_hash[i].len == fd_hash[cur_dup_entry].len
-                   && memcmp(fd_hash[i].digest, fd_hash[cur_dup_entry].digest, 16) == 0) {
-            return true;
         }
+
+        found = true;
+        break;
     }
 
-    return false;
+    dup_index_insert(cur);
+    return found;
+}
+
+static void
+print_dup_digest(const char *what, uint64_t count, const wtap_rec *rec)
+{
+    fprintf(stderr, "%s: %" PRIu64 ", Len: %u, %s Hash: ",
+            what, count, rec->rec_header.packet_header.caplen,
+            dup_digests[dup_digest].label);
+    for (unsigned i = 0; i < dup_digests[dup_digest].len; i++)
+        fprintf(stderr, "%02x", (unsigned char)fd_hash[cur_dup_entry].digest[i]);
+    fprintf(stderr, "\n");
 }
 
 static void
@@ -937,7 +1106,7 @@ print_usage(FILE *output)
     fprintf(output, "  -D <dup window>        remove packet if duplicate; configurable <dup window>.\n");
     fprintf(output, "                         Valid <dup window> values are 0 to %d.\n", MAX_DUP_DEPTH);
     fprintf(output, "                         NOTE: A <dup window> of 0 with -V (verbose option) is\n");
-    fprintf(output, "                         useful to print MD5 hashes.\n");
+    fprintf(output, "                         useful to print packet digests.\n");
     fprintf(output, "  -w <dup time window>   remove packet if duplicate packet is found EQUAL TO OR\n");
     fprintf(output, "                         LESS THAN <dup time window> prior to current packet.\n");
     fprintf(output, "                         A <dup time window> is specified in relative seconds\n");
@@ -950,6 +1119,12 @@ print_usage(FILE *output)
     fprintf(output, "                         Useful when processing packets captured by multiple radios\n");
     fprintf(output, "                         on the same channel in the vicinity of each other.\n");
     fprintf(output, "  --set-unused           set unused byts to zero in sll link addr.\n");
+    fprintf(output, "  --dup-digest <digest>  digest used to compare packets: md5 (default), or the\n");
+    fprintf(output, "                         faster but weaker crc32c or murmur64.\n");
+    fprintf(output, "  --dup-ignore <offset>:<length>\n");
+    fprintf(output, "                         ignore <length> bytes at <offset> from the beginning\n");
+    fprintf(output, "                         of the frame when checking for duplicates, e.g. the\n");
+    fprintf(output, "                         IPv4 TTL with --dup-ignore 22:1. Can be repeated.\n");
     fprintf(output, "\n");
     fprintf(output, "Packet manipulation:\n");
     fprintf(output, "  -s <snaplen>           truncate each packet to max. <snaplen> bytes of data.\n");
@@ -985,7 +1160,7 @@ print_usage(FILE *output)
     fprintf(output, "                         the pseudo-random number generator. This allows one to\n");
     fprintf(output, "                         repeat a particular sequence of errors.\n");
     fprintf(output, "  -I <bytes to ignore>   ignore the specified number of bytes at the beginning\n");
-    fprintf(output, "                         of the frame during MD5 hash calculation, unless the\n");
+    fprintf(output, "                         of the frame during digest calculation, unless the\n");
     fprintf(output, "                         frame is too short, then the full frame is used.\n");
     fprintf(output, "                         Useful to remove duplicated packets taken on\n");
     fprintf(output, "                         several routers (different mac addresses for\n");
@@ -1397,6 +1572,8 @@ main(int argc, char *argv[])
 #define LONGOPT_PRESERVE_PACKET_COMMENTS LONGOPT_BASE_APPLICATION+10
 #define LONGOPT_EXTRACT_SECRETS          LONGOPT_BASE_APPLICATION+11
 #define LONGOPT_COMPRESS                 LONGOPT_BASE_APPLICATION+12
+#define LONGOPT_DUP_DIGEST               LONGOPT_BASE_APPLICATION+13
+#define LONGOPT_DUP_IGNORE               LONGOPT_BASE_APPLICATION+14
 
     static const struct ws_option long_options[] = {
         {"novlan", ws_no_argument, NULL, LONGOPT_NO_VLAN},
@@ -1413,6 +1590,8 @@ main(int argc, char *argv[])
         {"preserve-packet-comments", ws_no_argument, NULL, LONGOPT_PRESERVE_PACKET_COMMENTS},
         {"extract-secrets", ws_no_argument, NULL, LONGOPT_EXTRACT_SECRETS},
         {"compress", ws_required_argument, NULL, LONGOPT_COMPRESS},
+        {"dup-digest", ws_required_argument, NULL, LONGOPT_DUP_DIGEST},
+        {"dup-ignore", ws_required_argument, NULL, LONGOPT_DUP_IGNORE},
         {0, 0, 0, 0 }
     };
 
@@ -1629,6 +1808,31 @@ main(int argc, char *argv[])
             break;
         }
 
+        case LONGOPT_DUP_DIGEST:
+        {
+            unsigned d;
+
+            for (d = 0; d < G_N_ELEMENTS(dup_digests); d++) {
+                if (g_ascii_strcasecmp(ws_optarg, dup_digests[d].name) == 0)
+                    break;
+            }
+            if (d == G_N_ELEMENTS(dup_digests)) {
+                cmdarg_err("\"%s\" isn't a valid duplicate detection digest; use md5, crc32c or murmur64",
+                           ws_optarg);
+                ret = WS_EXIT_INVALID_OPTION;
+                goto clean_exit;
+            }
+            dup_digest = (dup_digest_e)d;
+            break;
+        }
+
+        case LONGOPT_DUP_IGNORE:
+            if (!parse_dup_ignore_range(ws_optarg)) {
+                ret = WS_EXIT_INVALID_OPTION;
+                goto clean_exit;
+            }
+            break;
+
         case 'a':
         {
             uint64_t frame_number;
@@ -2161,11 +2365,7 @@ main(int argc, char *argv[])
         max_packet_number = UINT64_MAX;
 
     if (dup_detect || dup_detect_by_time) {
-        for (i = 0; i < dup_window; i++) {
-            memset(&fd_hash[i].digest, 0, 16);
-            fd_hash[i].len = 0;
-            nstime_set_unset(&fd_hash[i].frame_time);
-        }
+        dup_index_init();
     }
 
     /* Set up an array of all IDBs seen */
@@ -2462,28 +2662,14 @@ main(int argc, char *argv[])
                 /* suppress duplicates by packet window */
                 if (dup_detect) {
                     if (is_duplicate(&read_rec)) {
-                        if (verbose) {
-                            fprintf(stderr, "Skipped: %" PRIu64 ", Len: %u, MD5 Hash: ",
-                                    count,
-                                    read_rec.rec_header.packet_header.caplen);
-                            for (i = 0; i < 16; i++)
-                                fprintf(stderr, "%02x",
-                                        (unsigned char)fd_hash[cur_dup_entry].digest[i]);
-                            fprintf(stderr, "\n");
-                        }
+                        if (verbose)
+                            print_dup_digest("Skipped", count, &read_rec);
                         duplicate_count++;
                         count++;
                         continue;
                     } else {
-                        if (verbose) {
-                            fprintf(stderr, "Packet: %" PRIu64 ", Len: %u, MD5 Hash: ",
-                                    count,
-                                    read_rec.rec_header.packet_header.caplen);
-                            for (i = 0; i < 16; i++)
-                                fprintf(stderr, "%02x",
-                                        (unsigned char)fd_hash[cur_dup_entry].digest[i]);
-                            fprintf(stderr, "\n");
-                        }
+                        if (verbose)
+                            print_dup_digest("Packet", count, &read_rec);
                     }
                 } /* suppression of duplicates */
 
@@ -2496,28 +2682,14 @@ main(int argc, char *argv[])
                         current.nsecs = read_rec.ts.nsecs;
 
                         if (is_duplicate_rel_time(&read_rec, &current)) {
-                            if (verbose) {
-                                fprintf(stderr, "Skipped: %" PRIu64 ", Len: %u, MD5 Hash: ",
-                                        count,
-                                        read_rec.rec_header.packet_header.caplen);
-                                for (i = 0; i < 16; i++)
-                                    fprintf(stderr, "%02x",
-                                            (unsigned char)fd_hash[cur_dup_entry].digest[i]);
-                                fprintf(stderr, "\n");
-                            }
+                            if (verbose)
+                                print_dup_digest("Skipped", count, &read_rec);
                             duplicate_count++;
                             count++;
                             continue;
                         } else {
-                            if (verbose) {
-                                fprintf(stderr, "Packet: %" PRIu64 ", Len: %u, MD5 Hash: ",
-                                        count,
-                                        read_rec.rec_header.packet_header.caplen);
-                                for (i = 0; i < 16; i++)
-                                    fprintf(stderr, "%02x",
-                                            (unsigned char)fd_hash[cur_dup_entry].digest[i]);
-                                fprintf(stderr, "\n");
-                            }
+                            if (verbose)
+                                print_dup_digest("Packet", count, &read_rec);
                         }
                     }
                 } /* suppress duplicates by time window */
@@ -2706,6 +2878,10 @@ clean_exit:
         g_ptr_array_free(capture_comments, TRUE);
         capture_comments = NULL;
     }
+    if (dup_ignore_ranges != NULL)
+        g_array_free(dup_ignore_ranges, TRUE);
+    g_free(dup_scratch);
+    g_free(fd_hash_buckets);
     return ret;
 }
 
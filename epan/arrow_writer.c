@@ -0,0 +1,850 @@
+/* arrow_writer.c
+ * Writer for the Apache Arrow IPC streaming format
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LZ4FRAME_H
+#include <lz4frame.h>
+#endif
+
+#include <wsutil/array.h>
+#include <wsutil/pint.h>
+#include <wsutil/ws_assert.h>
+
+#include "arrow_writer.h"
+
+/*
+ * The format is described in
+ *
+ *    https://arrow.apache.org/docs/format/Columnar.html#serialization-and-interprocess-communication-ipc
+ *
+ * and the metadata of the messages are the flatbuffers defined in
+ * Schema.fbs and Message.fbs in the Arrow source tree. The few tables
+ * needed are written directly rather than with the flatbuffers library:
+ * objects are laid out from the start of the buffer, each table being
+ * preceded by its vtable, and the offsets to the objects a table refers
+ * to are filled in once those are written after it.
+ */
+
+/* Values from Schema.fbs and Message.fbs. */
+#define ARROW_METADATA_V5           4
+
+#define ARROW_HEADER_SCHEMA         1
+#define ARROW_HEADER_RECORD_BATCH   3
+
+#define ARROW_TYPE_ID_INT           2
+#define ARROW_TYPE_ID_FLOATING      3
+#define ARROW_TYPE_ID_BINARY        4
+#define ARROW_TYPE_ID_UTF8          5
+#define ARROW_TYPE_ID_BOOL          6
+#define ARROW_TYPE_ID_TIMESTAMP     10
+#define ARROW_TYPE_ID_LIST          12
+#define ARROW_TYPE_ID_DURATION      18
+
+#define ARROW_PRECISION_DOUBLE      2
+#define ARROW_TIME_UNIT_NANOSECOND  3
+
+#define ARROW_CODEC_LZ4_FRAME       0
+#define ARROW_CODEC_ZSTD            1
+
+#define ARROW_CONTINUATION          0xFFFFFFFF
+
+#define ARROW_ZSTD_LEVEL            1
+
+/* Variable length values are addressed with 32-bit offsets, so a batch is
+ * written early if a column holds more data than this. */
+#define ARROW_MAX_BATCH_DATA        (1U << 30)
+
+typedef struct {
+    GByteArray *validity;   /* Bitmap; NULL for the values of a list */
+    GByteArray *offsets;    /* int32, for variable length values and lists */
+    GByteArray *data;       /* Values, a bitmap for booleans; NULL for lists */
+    uint32_t    length;
+    uint32_t    null_count;
+} arrow_array_t;
+
+typedef struct {
+    char         *name;
+    arrow_type_e  type;
+    unsigned      width;        /* In bytes, for integers */
+    bool          list;
+    bool          has_value;    /* In the current row, for a scalar column */
+    arrow_array_t values;       /* The values of the column or of its lists */
+    arrow_array_t lists;        /* The lists, for a list column */
+} arrow_column_t;
+
+struct arrow_writer {
+    FILE                *fh;
+    unsigned             batch_rows;
+    arrow_compression_e  compression;
+    GArray              *columns;   /* arrow_column_t */
+    uint32_t             num_rows;
+    GByteArray          *meta;
+    GByteArray          *body;
+    GArray              *nodes;     /* uint64_t pairs: length, null count */
+    GArray              *buffers;   /* uint64_t pairs: offset, length */
+    GByteArray          *scratch;
+    bool                 write_failed;
+};
+
+/*
+ * Flatbuffer building.
+ */
+
+typedef struct {
+    uint8_t     size;       /* 0 if absent; else 1, 2, 4 or 8 bytes */
+    bool        offset;     /* An offset to an object written later */
+    uint64_t    value;
+} fb_field_t;
+
+#define FB_ABSENT           { 0, false, 0 }
+#define FB_SCALAR(sz, v)    { (sz), false, (uint64_t)(v) }
+#define FB_OFFSET           { 4, true, 0 }
+
+#define FB_MAX_FIELDS       8
+
+static void
+fb_put(GByteArray *b, uint64_t value, unsigned size)
+{
+    uint8_t le[8];
+
+    for (unsigned i = 0; i < size; i++) {
+        le[i] = (uint8_t)(value >> (8 * i));
+    }
+    g_byte_array_append(b, le, size);
+}
+
+static void
+fb_pad(GByteArray *b, unsigned align)
+{
+    static const uint8_t zeros[8];
+
+    if (b->len % align)
+        g_byte_array_append(b, zeros, align - b->len % align);
+}
+
+/* Fills in the offset at slot to an object at target. */
+static void
+fb_patch(GByteArray *b, uint32_t slot, uint32_t target)
+{
+    uint32_t off = target - slot;
+
+    ws_assert(target > slot);
+    for (unsigned i = 0; i < 4; i++) {
+        b->data[slot + i] = (uint8_t)(off >> (8 * i));
+    }
+}
+
+/*
+ * Writes a table and its vtable, and returns the position of the table.
+ * The position of the offset fields are returned in slots, to be patched
+ * with fb_patch().
+ */
+static uint32_t
+fb_table(GByteArray *b, const fb_field_t *fields, unsigned n, uint32_t *slots)
+{
+    uint16_t    field_pos[FB_MAX_FIELDS];
+    uint32_t    size = 4;   /* The offset to the vtable */
+    uint32_t    vt_pos, table_pos;
+
+    ws_assert(n <= FB_MAX_FIELDS);
+    for (unsigned i = 0; i < n; i++) {
+        field_pos[i] = 0;
+        if (fields[i].size) {
+            size = (size + fields[i].size - 1) & ~(uint32_t)(fields[i].size - 1);
+            field_pos[i] = size;
+            size += fields[i].size;
+        }
+    }
+
+    fb_pad(b, 2);
+    vt_pos = b->len;
+    fb_put(b, 4 + 2 * n, 2);
+    fb_put(b, size, 2);
+    for (unsigned i = 0; i < n; i++) {
+        fb_put(b, field_pos[i], 2);
+    }
+
+    /* The vtable precedes the table, so the offset to it is positive. */
+    fb_pad(b, 8);
+    table_pos = b->len;
+    fb_put(b, table_pos - vt_pos, 4);
+    for (unsigned i = 0; i < n; i++) {
+        if (!fields[i].size)
+            continue;
+        fb_pad(b, fields[i].size);
+        if (fields[i].offset)
+            slots[i] = b->len;
+        fb_put(b, fields[i].value, fields[i].size);
+    }
+    return table_pos;
+}
+
+static uint32_t
+fb_string(GByteArray *b, const char *s)
+{
+    uint32_t pos;
+    size_t   len = strlen(s);
+
+    fb_pad(b, 4);
+    pos = b->len;
+    fb_put(b, len, 4);
+    g_byte_array_append(b, (const uint8_t *)s, (unsigned)len + 1);
+    return pos;
+}
+
+/* Writes a vector of offsets to tables written later, the first one being
+ * at the returned position + 4. */
+static uint32_t
+fb_offset_vector(GByteArray *b, unsigned count)
+{
+    uint32_t pos;
+
+    fb_pad(b, 4);
+    pos = b->len;
+    fb_put(b, count, 4);
+    for (unsigned i = 0; i < count; i++) {
+        fb_put(b, 0, 4);
+    }
+    return pos;
+}
+
+/* Writes a vector of structs of two int64 fields. */
+static uint32_t
+fb_pair_vector(GByteArray *b, const GArray *pairs)
+{
+    uint32_t pos;
+
+    /* The elements are aligned on 8 bytes. */
+    fb_pad(b, 4);
+    if (b->len % 8 == 0)
+        fb_put(b, 0, 4);
+    pos = b->len;
+    fb_put(b, pairs->len / 2, 4);
+    for (unsigned i = 0; i < pairs->len; i++) {
+        fb_put(b, g_array_index(pairs, uint64_t, i), 8);
+    }
+    return pos;
+}
+
+static uint8_t
+type_id(arrow_type_e type)
+{
+    switch (type) {
+    case ARROW_TYPE_INT:
+    case ARROW_TYPE_UINT:
+        return ARROW_TYPE_ID_INT;
+    case ARROW_TYPE_DOUBLE:
+        return ARROW_TYPE_ID_FLOATING;
+    case ARROW_TYPE_BOOL:
+        return ARROW_TYPE_ID_BOOL;
+    case ARROW_TYPE_UTF8:
+        return ARROW_TYPE_ID_UTF8;
+    case ARROW_TYPE_BINARY:
+        return ARROW_TYPE_ID_BINARY;
+    case ARROW_TYPE_TIMESTAMP:
+        return ARROW_TYPE_ID_TIMESTAMP;
+    case ARROW_TYPE_DURATION:
+        return ARROW_TYPE_ID_DURATION;
+    }
+    ws_assert_not_reached();
+    return 0;
+}
+
+static uint32_t
+fb_type(GByteArray *b, arrow_type_e type, unsigned width)
+{
+    uint32_t slots[FB_MAX_FIELDS];
+    uint32_t pos;
+
+    switch (type) {
+    case ARROW_TYPE_INT:
+    case ARROW_TYPE_UINT:
+    {
+        const fb_field_t fields[] = {
+            FB_SCALAR(4, width * 8),
+            FB_SCALAR(1, type == ARROW_TYPE_INT),
+        };
+        return fb_table(b, fields, array_length(fields), slots);
+    }
+    case ARROW_TYPE_DOUBLE:
+    {
+        const fb_field_t fields[] = {
+            FB_SCALAR(2, ARROW_PRECISION_DOUBLE),
+        };
+        return fb_table(b, fields, array_length(fields), slots);
+    }
+    case ARROW_TYPE_TIMESTAMP:
+    {
+        const fb_field_t fields[] = {
+            FB_SCALAR(2, ARROW_TIME_UNIT_NANOSECOND),
+            FB_OFFSET,                                  /* timezone */
+        };
+        pos = fb_table(b, fields, array_length(fields), slots);
+        fb_patch(b, slots[1], fb_string(b, "UTC"));
+        return pos;
+    }
+    case ARROW_TYPE_DURATION:
+    {
+        const fb_field_t fields[] = {
+            FB_SCALAR(2, ARROW_TIME_UNIT_NANOSECOND),
+        };
+        return fb_table(b, fields, array_length(fields), slots);
+    }
+    case ARROW_TYPE_BOOL:
+    case ARROW_TYPE_UTF8:
+    case ARROW_TYPE_BINARY:
+        break;
+    }
+    return fb_table(b, NULL, 0, NULL);
+}
+
+static uint32_t
+fb_field(GByteArray *b, const char *name, arrow_type_e type, unsigned width,
+         bool list, bool nullable)
+{
+    const fb_field_t fields[] = {
+        FB_OFFSET,                      /* name */
+        FB_SCALAR(1, nullable),
+        FB_SCALAR(1, list ? ARROW_TYPE_ID_LIST : type_id(type)),
+        FB_OFFSET,                      /* type */
+        FB_ABSENT,                      /* dictionary */
+        FB_OFFSET,                      /* children */
+    };
+    uint32_t slots[FB_MAX_FIELDS];
+    uint32_t pos, children;
+
+    pos = fb_table(b, fields, array_length(fields), slots);
+    fb_patch(b, slots[0], fb_string(b, name));
+    if (list)
+        fb_patch(b, slots[3], fb_table(b, NULL, 0, NULL));
+    else
+        fb_patch(b, slots[3], fb_type(b, type, width));
+
+    children = fb_offset_vector(b, list ? 1 : 0);
+    fb_patch(b, slots[5], children);
+    if (list) {
+        fb_patch(b, children + 4, fb_field(b, "item", type, width, false, false));
+    }
+    return pos;
+}
+
+/* Starts the metadata of a message, and returns the slot of its header. */
+static uint32_t
+fb_message(GByteArray *b, uint8_t header_type, uint64_t body_length)
+{
+    const fb_field_t fields[] = {
+        FB_SCALAR(2, ARROW_METADATA_V5),
+        FB_SCALAR(1, header_type),
+        FB_OFFSET,                      /* header */
+        FB_SCALAR(8, body_length),
+    };
+    uint32_t slots[FB_MAX_FIELDS];
+
+    g_byte_array_set_size(b, 0);
+    fb_put(b, 0, 4);                    /* The offset to the root table */
+    fb_patch(b, 0, fb_table(b, fields, array_length(fields), slots));
+    return slots[2];
+}
+
+/*
+ * Arrays.
+ */
+
+static void
+bitmap_append(GByteArray *bitmap, uint32_t idx, bool set)
+{
+    uint8_t zero = 0;
+
+    if (idx % 8 == 0)
+        g_byte_array_append(bitmap, &zero, 1);
+    if (set)
+        bitmap->data[idx / 8] |= 1 << (idx % 8);
+}
+
+static void
+array_init(arrow_array_t *array, bool validity, bool offsets, bool data)
+{
+    array->validity = validity ? g_byte_array_new() : NULL;
+    array->offsets = offsets ? g_byte_array_new() : NULL;
+    array->data = data ? g_byte_array_new() : NULL;
+}
+
+static void
+array_reset(arrow_array_t *array)
+{
+    if (array->validity)
+        g_byte_array_set_size(array->validity, 0);
+    if (array->offsets) {
+        g_byte_array_set_size(array->offsets, 0);
+        fb_put(array->offsets, 0, 4);
+    }
+    if (array->data)
+        g_byte_array_set_size(array->data, 0);
+    array->length = 0;
+    array->null_count = 0;
+}
+
+static void
+array_free(arrow_array_t *array)
+{
+    if (array->validity)
+        g_byte_array_free(array->validity, true);
+    if (array->offsets)
+        g_byte_array_free(array->offsets, true);
+    if (array->data)
+        g_byte_array_free(array->data, true);
+}
+
+static bool
+type_is_variable(arrow_type_e type)
+{
+    return type == ARROW_TYPE_UTF8 || type == ARROW_TYPE_BINARY;
+}
+
+/* Appends an element, valid or not, whose value (if any) has been added to
+ * the data; end is the offset of its end, for an array with offsets. */
+static void
+array_append(arrow_array_t *array, bool valid, uint32_t end)
+{
+    if (array->validity)
+        bitmap_append(array->validity, array->length, valid);
+    if (!valid)
+        array->null_count++;
+    if (array->offsets)
+        fb_put(array->offsets, end, 4);
+    array->length++;
+}
+
+static arrow_array_t *
+column_values(arrow_writer_t *writer, unsigned column, arrow_type_e type)
+{
+    arrow_column_t *col;
+
+    ws_assert(column < writer->columns->len);
+    col = &g_array_index(writer->columns, arrow_column_t, column);
+    ws_assert(col->type == type ||
+              (col->type == ARROW_TYPE_TIMESTAMP && type == ARROW_TYPE_INT) ||
+              (col->type == ARROW_TYPE_DURATION && type == ARROW_TYPE_INT));
+    if (!col->list) {
+        ws_assert(!col->has_value);
+        col->has_value = true;
+    }
+    return &col->values;
+}
+
+/*
+ * Record batches.
+ */
+
+bool
+arrow_writer_compression_supported(arrow_compression_e compression)
+{
+    switch (compression) {
+    case ARROW_COMPRESSION_NONE:
+        return true;
+    case ARROW_COMPRESSION_LZ4:
+#ifdef HAVE_LZ4FRAME_H
+        return true;
+#else
+        return false;
+#endif
+    case ARROW_COMPRESSION_ZSTD:
+#ifdef HAVE_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+static bool
+compress_buffer(arrow_compression_e compression, const uint8_t *src, size_t length,
+                GByteArray *dst)
+{
+    switch (compression) {
+#ifdef HAVE_ZSTD
+    case ARROW_COMPRESSION_ZSTD:
+    {
+        size_t bound = ZSTD_compressBound(length);
+        size_t ret;
+
+        g_byte_array_set_size(dst, (unsigned)bound);
+        ret = ZSTD_compress(dst->data, bound, src, length, ARROW_ZSTD_LEVEL);
+        if (ZSTD_isError(ret))
+            return false;
+        g_byte_array_set_size(dst, (unsigned)ret);
+        return true;
+    }
+#endif
+#ifdef HAVE_LZ4FRAME_H
+    case ARROW_COMPRESSION_LZ4:
+    {
+        size_t bound = LZ4F_compressFrameBound(length, NULL);
+        size_t ret;
+
+        g_byte_array_set_size(dst, (unsigned)bound);
+        ret = LZ4F_compressFrame(dst->data, bound, src, length, NULL);
+        if (LZ4F_isError(ret))
+            return false;
+        g_byte_array_set_size(dst, (unsigned)ret);
+        return true;
+    }
+#endif
+    default:
+        break;
+    }
+    return false;
+}
+
+static void
+batch_add_buffer(arrow_writer_t *writer, const GByteArray *buffer)
+{
+    uint64_t offset, length;
+    size_t   len = buffer ? buffer->len : 0;
+
+    fb_pad(writer->body, 8);
+    offset = writer->body->len;
+    if (len > 0) {
+        if (writer->compression == ARROW_COMPRESSION_NONE) {
+            g_byte_array_append(writer->body, buffer->data, (unsigned)len);
+        } else if (compress_buffer(writer->compression, buffer->data, len, writer->scratch) &&
+                   writer->scratch->len < len) {
+            /* Compressed buffers are preceded by their uncompressed length. */
+            fb_put(writer->body, len, 8);
+            g_byte_array_append(writer->body, writer->scratch->data, writer->scratch->len);
+        } else {
+            /* Or by -1 if they are left uncompressed. */
+            fb_put(writer->body, UINT64_MAX, 8);
+            g_byte_array_append(writer->body, buffer->data, (unsigned)len);
+        }
+    }
+    length = writer->body->len - offset;
+    g_array_append_val(writer->buffers, offset);
+    g_array_append_val(writer->buffers, length);
+}
+
+static void
+batch_add_array(arrow_writer_t *writer, const arrow_array_t *array)
+{
+    uint64_t length = array->length;
+    uint64_t null_count = array->null_count;
+
+    g_array_append_val(writer->nodes, length);
+    g_array_append_val(writer->nodes, null_count);
+    /* The validity bitmap may be omitted if there are no nulls. */
+    batch_add_buffer(writer, null_count ? array->validity : NULL);
+    if (array->offsets)
+        batch_add_buffer(writer, array->offsets);
+    if (array->data)
+        batch_add_buffer(writer, array->data);
+}
+
+static void
+write_data(arrow_writer_t *writer, const void *data, size_t length)
+{
+    /* Once a write failed, the stream is truncated; don't write any more. */
+    if (writer->write_failed)
+        return;
+    if (fwrite(data, 1, length, writer->fh) != length)
+        writer->write_failed = true;
+}
+
+static void
+write_message(arrow_writer_t *writer, GByteArray *body)
+{
+    uint8_t prefix[8];
+
+    /* The body must start on a multiple of 8 bytes. */
+    fb_pad(writer->meta, 8);
+    phtole32(prefix, ARROW_CONTINUATION);
+    phtole32(prefix + 4, writer->meta->len);
+    write_data(writer, prefix, sizeof(prefix));
+    write_data(writer, writer->meta->data, writer->meta->len);
+    if (body)
+        write_data(writer, body->data, body->len);
+}
+
+static void
+write_batch(arrow_writer_t *writer)
+{
+    const fb_field_t fields[] = {
+        FB_SCALAR(8, writer->num_rows),
+        FB_OFFSET,                      /* nodes */
+        FB_OFFSET,                      /* buffers */
+        FB_OFFSET,                      /* compression */
+    };
+    const fb_field_t compression[] = {
+        FB_SCALAR(1, writer->compression == ARROW_COMPRESSION_ZSTD ?
+                  ARROW_CODEC_ZSTD : ARROW_CODEC_LZ4_FRAME),
+        FB_SCALAR(1, 0),                /* method: BUFFER */
+    };
+    GByteArray *b = writer->meta;
+    uint32_t    slots[FB_MAX_FIELDS], compression_slots[FB_MAX_FIELDS];
+    uint32_t    header, pos;
+
+    g_byte_array_set_size(writer->body, 0);
+    g_array_set_size(writer->nodes, 0);
+    g_array_set_size(writer->buffers, 0);
+    for (unsigned i = 0; i < writer->columns->len; i++) {
+        arrow_column_t *col = &g_array_index(writer->columns, arrow_column_t, i);
+
+        if (col->list)
+            batch_add_array(writer, &col->lists);
+        batch_add_array(writer, &col->values);
+    }
+    fb_pad(writer->body, 8);
+
+    header = fb_message(b, ARROW_HEADER_RECORD_BATCH, writer->body->len);
+    pos = fb_table(b, fields, writer->compression == ARROW_COMPRESSION_NONE ?
+                   array_length(fields) - 1 : array_length(fields), slots);
+    fb_patch(b, header, pos);
+    fb_patch(b, slots[1], fb_pair_vector(b, writer->nodes));
+    fb_patch(b, slots[2], fb_pair_vector(b, writer->buffers));
+    if (writer->compression != ARROW_COMPRESSION_NONE) {
+        fb_patch(b, slots[3], fb_table(b, compression, array_length(compression),
+                                       compression_slots));
+    }
+    write_message(writer, writer->body);
+
+    for (unsigned i = 0; i < writer->columns->len; i++) {
+        arrow_column_t *col = &g_array_index(writer->columns, arrow_column_t, i);
+
+        array_reset(&col->values);
+        if (col->list)
+            array_reset(&col->lists);
+    }
+    writer->num_rows = 0;
+}
+
+/*
+ * Public API.
+ */
+
+arrow_writer_t *
+arrow_writer_new(FILE *fh, unsigned batch_rows, arrow_compression_e compression)
+{
+    arrow_writer_t *writer = g_new0(arrow_writer_t, 1);
+
+    writer->fh = fh;
+    writer->batch_rows = batch_rows ? batch_rows : ARROW_WRITER_DEFAULT_BATCH_ROWS;
+    writer->compression = arrow_writer_compression_supported(compression) ?
+                          compression : ARROW_COMPRESSION_NONE;
+    writer->columns = g_array_new(false, true, sizeof(arrow_column_t));
+    writer->meta = g_byte_array_new();
+    writer->body = g_byte_array_new();
+    writer->nodes = g_array_new(false, false, sizeof(uint64_t));
+    writer->buffers = g_array_new(false, false, sizeof(uint64_t));
+    writer->scratch = g_byte_array_new();
+    return writer;
+}
+
+unsigned
+arrow_writer_add_column(arrow_writer_t *writer, const char *name,
+                        arrow_type_e type, unsigned bit_width, bool list)
+{
+    arrow_column_t col;
+
+    ws_assert(writer->num_rows == 0);
+    memset(&col, 0, sizeof(col));
+    col.name = g_strdup(name);
+    col.type = type;
+    col.list = list;
+    switch (type) {
+    case ARROW_TYPE_INT:
+    case ARROW_TYPE_UINT:
+        col.width = bit_width <= 8 ? 1 : bit_width <= 16 ? 2 : bit_width <= 32 ? 4 : 8;
+        break;
+    case ARROW_TYPE_DOUBLE:
+    case ARROW_TYPE_TIMESTAMP:
+    case ARROW_TYPE_DURATION:
+        col.width = 8;
+        break;
+    default:
+        break;
+    }
+    /* The values of a list can't be null, only the lists. */
+    array_init(&col.values, !list, type_is_variable(type), true);
+    array_reset(&col.values);
+    if (list) {
+        array_init(&col.lists, true, true, false);
+        array_reset(&col.lists);
+    }
+    g_array_append_val(writer->columns, col);
+    return writer->columns->len - 1;
+}
+
+void
+arrow_writer_begin(arrow_writer_t *writer)
+{
+    const fb_field_t fields[] = {
+        FB_ABSENT,                      /* endianness: little */
+        FB_OFFSET,                      /* fields */
+    };
+    GByteArray *b = writer->meta;
+    uint32_t    slots[FB_MAX_FIELDS];
+    uint32_t    header, vector;
+
+    header = fb_message(b, ARROW_HEADER_SCHEMA, 0);
+    fb_patch(b, header, fb_table(b, fields, array_length(fields), slots));
+    vector = fb_offset_vector(b, writer->columns->len);
+    fb_patch(b, slots[1], vector);
+    for (unsigned i = 0; i < writer->columns->len; i++) {
+        arrow_column_t *col = &g_array_index(writer->columns, arrow_column_t, i);
+
+        fb_patch(b, vector + 4 + 4 * i,
+                 fb_field(b, col->name, col->type, col->width, col->list, true));
+    }
+    write_message(writer, NULL);
+}
+
+void
+arrow_writer_append_int(arrow_writer_t *writer, unsigned column, int64_t value)
+{
+    arrow_column_t *col = &g_array_index(writer->columns, arrow_column_t, column);
+    arrow_array_t  *array = column_values(writer, column, ARROW_TYPE_INT);
+
+    fb_put(array->data, (uint64_t)value, col->width);
+    array_append(array, true, array->data->len);
+}
+
+void
+arrow_writer_append_uint(arrow_writer_t *writer, unsigned column, uint64_t value)
+{
+    arrow_column_t *col = &g_array_index(writer->columns, arrow_column_t, column);
+    arrow_array_t  *array = column_values(writer, column, ARROW_TYPE_UINT);
+
+    fb_put(array->data, value, col->width);
+    array_append(array, true, array->data->len);
+}
+
+void
+arrow_writer_append_double(arrow_writer_t *writer, unsigned column, double value)
+{
+    arrow_array_t *array = column_values(writer, column, ARROW_TYPE_DOUBLE);
+    uint64_t       bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    fb_put(array->data, bits, 8);
+    array_append(array, true, array->data->len);
+}
+
+void
+arrow_writer_append_bool(arrow_writer_t *writer, unsigned column, bool value)
+{
+    arrow_array_t *array = column_values(writer, column, ARROW_TYPE_BOOL);
+
+    bitmap_append(array->data, array->length, value);
+    array_append(array, true, array->data->len);
+}
+
+void
+arrow_writer_append_string(arrow_writer_t *writer, unsigned column, const char *value)
+{
+    arrow_array_t *array = column_values(writer, column, ARROW_TYPE_UTF8);
+
+    g_byte_array_append(array->data, (const uint8_t *)value, (unsigned)strlen(value));
+    array_append(array, true, array->data->len);
+}
+
+void
+arrow_writer_append_binary(arrow_writer_t *writer, unsigned column,
+                           const uint8_t *value, size_t length)
+{
+    arrow_array_t *array = column_values(writer, column, ARROW_TYPE_BINARY);
+
+    g_byte_array_append(array->data, value, (unsigned)length);
+    array_append(array, true, array->data->len);
+}
+
+void
+arrow_writer_end_row(arrow_writer_t *writer)
+{
+    bool full = false;
+
+    for (unsigned i = 0; i < writer->columns->len; i++) {
+        arrow_column_t *col = &g_array_index(writer->columns, arrow_column_t, i);
+        arrow_array_t  *values = &col->values;
+
+        if (col->list) {
+            /* A row without values is a null list. */
+            uint32_t start = pletoh32(col->lists.offsets->data + col->lists.offsets->len - 4);
+            array_append(&col->lists, values->length > start, values->length);
+        } else if (!col->has_value) {
+            if (col->type == ARROW_TYPE_BOOL)
+                bitmap_append(values->data, values->length, false);
+            else if (col->width)
+                fb_put(values->data, 0, col->width);
+            array_append(values, false, values->data->len);
+        }
+        col->has_value = false;
+        if (values->data->len >= ARROW_MAX_BATCH_DATA)
+            full = true;
+    }
+    writer->num_rows++;
+    if (full || writer->num_rows >= writer->batch_rows)
+        write_batch(writer);
+}
+
+bool
+arrow_writer_finish(arrow_writer_t *writer)
+{
+    uint8_t eos[8];
+
+    if (writer->num_rows > 0)
+        write_batch(writer);
+    phtole32(eos, ARROW_CONTINUATION);
+    phtole32(eos + 4, 0);
+    write_data(writer, eos, sizeof(eos));
+    if (!writer->write_failed && fflush(writer->fh) != 0)
+        writer->write_failed = true;
+    return !writer->write_failed;
+}
+
+void
+arrow_writer_free(arrow_writer_t *writer)
+{
+    if (writer == NULL)
+        return;
+    for (unsigned i = 0; i < writer->columns->len; i++) {
+        arrow_column_t *col = &g_array_index(writer->columns, arrow_column_t, i);
+
+        g_free(col->name);
+        array_free(&col->values);
+        if (col->list)
+            array_free(&col->lists);
+    }
+    g_array_free(writer->columns, true);
+    g_byte_array_free(writer->meta, true);
+    g_byte_array_free(writer->body, true);
+    g_array_free(writer->nodes, true);
+    g_array_free(writer->buffers, true);
+    g_byte_array_free(writer->scratch, true);
+    g_free(writer);
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 4
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=4 tabstop=8 expandtab:
+ * :indentSize=4:tabSize=8:noTabs=false:
+ */
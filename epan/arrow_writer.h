@@ -0,0 +1,141 @@
+/** @file
+ *
+ * Writer for the Apache Arrow IPC streaming format
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef __ARROW_WRITER_H__
+#define __ARROW_WRITER_H__
+
+#include <stdio.h>
+
+#include <wireshark.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Writes a table as an Arrow IPC stream: a schema message, followed by one
+ * record batch message for each batch of rows, followed by the end of
+ * stream marker. Any Arrow implementation can read it (for instance with
+ * pyarrow.ipc.open_stream()), and convert it to Parquet if needed.
+ *
+ * Columns are added before the first row. Each row is built by appending
+ * at most one value to each scalar column, and any number of values to each
+ * list column, and ended with arrow_writer_end_row(); a column that has no
+ * value in a row is null in that row.
+ */
+typedef struct arrow_writer arrow_writer_t;
+
+/** The logical type of the values of a column. */
+typedef enum {
+    ARROW_TYPE_INT,         /**< Signed integer of 8 to 64 bits */
+    ARROW_TYPE_UINT,        /**< Unsigned integer of 8 to 64 bits */
+    ARROW_TYPE_DOUBLE,      /**< 64-bit floating point */
+    ARROW_TYPE_BOOL,
+    ARROW_TYPE_UTF8,
+    ARROW_TYPE_BINARY,
+    ARROW_TYPE_TIMESTAMP,   /**< Nanoseconds since the epoch, in UTC */
+    ARROW_TYPE_DURATION     /**< Nanoseconds */
+} arrow_type_e;
+
+/** The compression of the buffers of the record batches. */
+typedef enum {
+    ARROW_COMPRESSION_NONE,
+    ARROW_COMPRESSION_LZ4,  /**< LZ4 frame format */
+    ARROW_COMPRESSION_ZSTD
+} arrow_compression_e;
+
+/** The default number of rows in a record batch. */
+#define ARROW_WRITER_DEFAULT_BATCH_ROWS 65536
+
+/**
+ * Whether this build supports a compression.
+ */
+WS_DLL_PUBLIC bool
+arrow_writer_compression_supported(arrow_compression_e compression);
+
+/**
+ * Create a writer.
+ *
+ * @param fh The stream to write to.
+ * @param batch_rows The number of rows after which a record batch is
+ * written.
+ * @param compression The compression of the record batches. If it isn't
+ * supported, they are written uncompressed.
+ */
+WS_DLL_PUBLIC arrow_writer_t *
+arrow_writer_new(FILE *fh, unsigned batch_rows, arrow_compression_e compression);
+
+/**
+ * Add a column. Must be called before arrow_writer_begin().
+ *
+ * @param name The name of the column.
+ * @param type The type of its values.
+ * @param bit_width The width of integers: 8, 16, 32 or 64. Ignored for the
+ * other types.
+ * @param list Whether a row holds a list of values rather than one value.
+ * @return The index of the column.
+ */
+WS_DLL_PUBLIC unsigned
+arrow_writer_add_column(arrow_writer_t *writer, const char *name,
+                        arrow_type_e type, unsigned bit_width, bool list);
+
+/**
+ * Write the schema.
+ */
+WS_DLL_PUBLIC void
+arrow_writer_begin(arrow_writer_t *writer);
+
+/*
+ * Append a value to a column. Integers are truncated to the width of the
+ * column; timestamps and durations are appended as integers.
+ */
+WS_DLL_PUBLIC void
+arrow_writer_append_int(arrow_writer_t *writer, unsigned column, int64_t value);
+
+WS_DLL_PUBLIC void
+arrow_writer_append_uint(arrow_writer_t *writer, unsigned column, uint64_t value);
+
+WS_DLL_PUBLIC void
+arrow_writer_append_double(arrow_writer_t *writer, unsigned column, double value);
+
+WS_DLL_PUBLIC void
+arrow_writer_append_bool(arrow_writer_t *writer, unsigned column, bool value);
+
+WS_DLL_PUBLIC void
+arrow_writer_append_string(arrow_writer_t *writer, unsigned column, const char *value);
+
+WS_DLL_PUBLIC void
+arrow_writer_append_binary(arrow_writer_t *writer, unsigned column,
+                           const uint8_t *value, size_t length);
+
+/**
+ * End the current row, and write a record batch if it is full.
+ */
+WS_DLL_PUBLIC void
+arrow_writer_end_row(arrow_writer_t *writer);
+
+/**
+ * Write the rows that are left and the end of stream marker, and flush
+ * the stream.
+ *
+ * @return false if writing any part of the stream failed.
+ */
+WS_DLL_PUBLIC bool
+arrow_writer_finish(arrow_writer_t *writer);
+
+WS_DLL_PUBLIC void
+arrow_writer_free(arrow_writer_t *writer);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __ARROW_WRITER_H__ */
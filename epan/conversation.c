@@ -21,18 +21,17 @@
 #include "to_str.h"
 #include "conversation.h"
 
-// The conversation database is a map of maps that contain conversation_t's.
-// Top-level map keys are strings that describe each conversation type.
-// Second-level map keys are conversation_element_t arrays.
+// The conversation database is a single index of conversation_key_t's, which
+// hold the elements of a key (see conversation_element_t) in a fixed-width,
+// canonical form with a precomputed hash:
 // {
-//   "uint,endpoint": {
-//     [ { type: CE_ADDR, addr_val: 10.20.30.40}, { type: CE_PORT, uint_val: 80 } ... ]: <conversation_t>
-//     [ { type: CE_ADDR, addr_val: 1.1.1.1}, { type: CE_PORT, uint_val: 53 } ... ]: <conversation_t>
-//   }
+//   { signature: "address,port,address,port,endpoint", addrs: [10.20.30.40, 1.1.1.1], vals: [80, 1234] ... }: <conversation_t>
+//   { signature: "uint,endpoint", vals: [42] ... }: <conversation_t>
 // }
-// Instead of using strings as keys we could bit-shift conversation endpoint types
-// into a uint64_t, e.g. 0x0000000102010200 for CE_ADDRESS,CE_PORT,CE_ADDRESS,CE_PORT,CE_CONVERSATION_TYPE.
-// We could also use this to prepend a type+length indicator for element arrays.
+// Keys that don't fit into a conversation_key_t (strings, blobs, 64-bit
+// integers, long addresses) are kept in a map of maps instead. Top-level
+// map keys are strings that describe each conversation type, second-level
+// map keys are conversation_element_t arrays.
 
 /* define DEBUG_CONVERSATION for pretty debug printing */
 /* #define DEBUG_CONVERSATION */
@@ -111,71 +110,178 @@ static const char *type_names[] = {
 };
 
 /*
- * Hash table of hash tables for conversations identified by element lists.
+ * Hash table of hash tables for conversations identified by element lists
+ * that don't fit into a conversation_key_t.
  */
 static wmem_map_t *conversation_hashtable_element_list;
 
 /*
- * Hash table for conversations based on addresses only
+ * The space a conversation_key_t has for the elements of a key. That's
+ * enough for all the keys of the conversation_new*() functions.
  */
-static wmem_map_t *conversation_hashtable_exact_addr;
+#define CONVERSATION_KEY_ADDRS 2
+#define CONVERSATION_KEY_ADDR_LEN 16
+#define CONVERSATION_KEY_VALS 4
 
-/*
- * Hash table for conversations with no wildcards.
- */
-static wmem_map_t *conversation_hashtable_exact_addr_port;
+/* An address, with its data; only short addresses fit. */
+typedef struct {
+    address addr;
+    uint8_t data[CONVERSATION_KEY_ADDR_LEN];
+} conversation_key_addr_t;
 
 /*
- * Hash table for conversations with one wildcard address.
+ * The key of a conversation in the conversation index: the addresses,
+ * and the ports and integers, of an element list, in order, with the
+ * types of the elements to tell the shapes of keys apart.
  */
-static wmem_map_t *conversation_hashtable_no_addr2;
+typedef struct {
+    unsigned hash;              /* of everything else, see conversation_key_init() */
+    unsigned signature;         /* see conversation_element_list_signature() */
+    conversation_type ctype;
+    uint32_t vals[CONVERSATION_KEY_VALS];
+    conversation_key_addr_t addrs[CONVERSATION_KEY_ADDRS];
+} conversation_key_t;
 
 /*
- * Hash table for conversations with one wildcard port.
+ * A conversation, and its key in the conversation index. The key isn't
+ * used for conversations whose key_ptr is set.
  */
-static wmem_map_t *conversation_hashtable_no_port2;
+typedef struct {
+    conversation_t conv;
+    conversation_key_t key;
+} conversation_entry_t;
 
 /*
- * Hash table for conversations with one wildcard address and port.
+ * The conversation index, of all the conversations whose key fits into
+ * a conversation_key_t.
  */
-static wmem_map_t *conversation_hashtable_no_addr2_or_port2;
+static wmem_map_t *conversation_index;
 
 /*
- * Hash table for conversations with a single unsigned ID number.
+ * The number of hash chains in the conversation index, by signature, so
+ * that looking up a kind of key nobody uses doesn't cost a probe.
  */
-static wmem_map_t *conversation_hashtable_id;
+static wmem_map_t *conversation_index_chains;
 
 /*
- * Hash table for conversations with no wildcards, and an anchor
+ * The number of hash chains of wildcarded conversations (see
+ * conversation_new()) in the conversation index, by their first address
+ * and port and conversation type. find_conversation() looks up each
+ * endpoint of a packet here once, rather than looking up each kind of
+ * wildcarded key.
  */
-static wmem_map_t *conversation_hashtable_exact_addr_port_anc = NULL;
+static wmem_map_t *conversation_wildcard_endpoints;
 
-/*
- * Hash table for conversations based on addresses only, and an anchor
- */
-static wmem_map_t *conversation_hashtable_exact_addr_anc = NULL;
+/* The signatures of the keys of wildcarded conversations. */
+static unsigned no_addr2_signature;
+static unsigned no_port2_signature;
+static unsigned no_addr2_or_port2_signature;
+
+static uint32_t new_index;
 
 /*
- * Hash table for conversations with one wildcard port, and an anchor
+ * Placeholder for address-less conversations.
  */
-static wmem_map_t *conversation_hashtable_no_port2_anc = NULL;
+static address null_address_ = ADDRESS_INIT_NONE;
 
 /*
- * Hash table for conversations with one wildcard address and port, and an anchor.
+ * The hash tables of conversation_hashtable_element_list, by the packed
+ * types of their elements (see conversation_element_list_signature()),
+ * so that finding one doesn't require building its name.
  */
-static wmem_map_t *conversation_hashtable_no_addr2_or_port2_anc;
+static wmem_map_t *conversation_hashtable_element_list_by_signature;
 
 /*
- * Hash table for deinterlacing conversations (typically L1 or L2)
+ * The results of the last few calls to find_conversation(). Several
+ * dissectors often look up the same conversation for a packet, and each
+ * lookup can probe the conversation index several times. Any change to
+ * the conversation index invalidates the cache.
  */
-static wmem_map_t *conversation_hashtable_deinterlacer = NULL;
+#define CONVERSATION_CACHE_SIZE 4
 
-static uint32_t new_index;
+typedef struct {
+    uint64_t generation;        /* 0 if unused */
+    uint32_t frame_num;
+    conversation_type ctype;
+    uint32_t port_a;
+    uint32_t port_b;
+    unsigned options;
+    conversation_key_addr_t addr_a;
+    conversation_key_addr_t addr_b;
+    conversation_t *conversation;
+} conversation_cache_entry_t;
+
+static conversation_cache_entry_t conversation_cache[CONVERSATION_CACHE_SIZE];
+static unsigned conversation_cache_next;
+static uint64_t conversation_generation = 1;
 
 /*
- * Placeholder for address-less conversations.
+ * The functions that free the data protocols associate with conversations,
+ * by protocol ID, for conversation_expire().
  */
-static address null_address_ = ADDRESS_INIT_NONE;
+static wmem_map_t *conversation_proto_data_release_funcs;
+
+static void
+conversation_cache_invalidate(void)
+{
+    conversation_generation++;
+}
+
+/* Copy an address with its data; only short addresses fit. */
+static bool
+conversation_key_set_address(conversation_key_addr_t *to, const address *from)
+{
+    if (from->len > CONVERSATION_KEY_ADDR_LEN) {
+        return false;
+    }
+    if (from->len > 0) {
+        memcpy(to->data, from->data, from->len);
+        set_address(&to->addr, from->type, from->len, to->data);
+    } else {
+        set_address(&to->addr, from->type, 0, NULL);
+    }
+    return true;
+}
+
+static conversation_cache_entry_t *
+conversation_cache_lookup(const uint32_t frame_num, const address *addr_a, const address *addr_b,
+        const conversation_type ctype, const uint32_t port_a, const uint32_t port_b, const unsigned options)
+{
+    for (unsigned i = 0; i < CONVERSATION_CACHE_SIZE; i++) {
+        conversation_cache_entry_t *entry = &conversation_cache[i];
+
+        if (entry->generation == conversation_generation && entry->frame_num == frame_num &&
+                entry->ctype == ctype && entry->port_a == port_a && entry->port_b == port_b &&
+                entry->options == options &&
+                addresses_equal(&entry->addr_a.addr, addr_a) &&
+                addresses_equal(&entry->addr_b.addr, addr_b)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void
+conversation_cache_store(const uint32_t frame_num, const address *addr_a, const address *addr_b,
+        const conversation_type ctype, const uint32_t port_a, const uint32_t port_b, const unsigned options,
+        conversation_t *conversation)
+{
+    conversation_cache_entry_t *entry = &conversation_cache[conversation_cache_next];
+
+    entry->generation = 0;
+    if (!conversation_key_set_address(&entry->addr_a, addr_a) ||
+            !conversation_key_set_address(&entry->addr_b, addr_b)) {
+        return;
+    }
+    entry->frame_num = frame_num;
+    entry->ctype = ctype;
+    entry->port_a = port_a;
+    entry->port_b = port_b;
+    entry->options = options;
+    entry->conversation = conversation;
+    entry->generation = conversation_generation;
+    conversation_cache_next = (conversation_cache_next + 1) % CONVERSATION_CACHE_SIZE;
+}
 
 
 /* Element count including the terminating CE_CONVERSATION_TYPE */
@@ -220,6 +326,176 @@ conversation_element_list_name(wmem_allocator_t *allocator, conversation_element
     return wmem_strbuf_finalize(conv_hash_group);
 }
 
+/*
+ * Pack the types of the elements into an integer, four bits each (plus
+ * one, so that leading types aren't lost); conversation_element_count()
+ * allows at most MAX_CONVERSATION_ELEMENTS of them.
+ */
+static unsigned
+conversation_element_list_signature(conversation_element_t *elements)
+{
+    unsigned signature = 0;
+    size_t element_count = conversation_element_count(elements);
+
+    for (size_t i = 0; i < element_count; i++) {
+        DISSECTOR_ASSERT(elements[i].type < array_length(type_names));
+        signature = (signature << 4) | (elements[i].type + 1);
+    }
+    return signature;
+}
+
+/*
+ * Fill in the conversation index key of an element list. Returns false if
+ * the elements don't fit into a conversation_key_t.
+ */
+static bool
+conversation_key_init(conversation_key_t *key, const conversation_element_t *elements)
+{
+    size_t addr_count = 0;
+    size_t val_count = 0;
+    unsigned hash_val = 0;
+    address tmp_addr;
+
+    // Clear the unused addresses and values, so that keys can be compared whole.
+    memset(key, 0, sizeof(*key));
+    for (const conversation_element_t *element = elements; ; element++) {
+        DISSECTOR_ASSERT(element->type < array_length(type_names));
+        key->signature = (key->signature << 4) | (element->type + 1);
+        switch (element->type) {
+        case CE_ADDRESS:
+            if (addr_count == CONVERSATION_KEY_ADDRS ||
+                    !conversation_key_set_address(&key->addrs[addr_count], &element->addr_val)) {
+                return false;
+            }
+            hash_val = add_address_to_hash(hash_val, &element->addr_val);
+            addr_count++;
+            break;
+        case CE_PORT:
+        case CE_UINT:
+        case CE_INT:
+            if (val_count == CONVERSATION_KEY_VALS) {
+                return false;
+            }
+            key->vals[val_count++] = element->uint_val;
+            break;
+        case CE_CONVERSATION_TYPE:
+            key->ctype = element->conversation_type_val;
+            goto done;
+        default:
+            return false;
+        }
+    }
+
+done:
+    // XXX We could use a hash_arbitrary_bytes routine. Abuse add_address_to_hash in the mean time.
+    tmp_addr.len = (int) (sizeof(key->vals[0]) * val_count);
+    tmp_addr.data = key->vals;
+    hash_val = add_address_to_hash(hash_val, &tmp_addr);
+    tmp_addr.len = (int) sizeof(key->signature);
+    tmp_addr.data = &key->signature;
+    hash_val = add_address_to_hash(hash_val, &tmp_addr);
+    tmp_addr.len = (int) sizeof(key->ctype);
+    tmp_addr.data = &key->ctype;
+    hash_val = add_address_to_hash(hash_val, &tmp_addr);
+
+    hash_val += ( hash_val << 3 );
+    hash_val ^= ( hash_val >> 11 );
+    hash_val += ( hash_val << 15 );
+    key->hash = hash_val;
+
+    return true;
+}
+
+static void
+conversation_key_copy(conversation_key_t *to, const conversation_key_t *from)
+{
+    *to = *from;
+    for (size_t i = 0; i < CONVERSATION_KEY_ADDRS; i++) {
+        if (to->addrs[i].addr.len > 0) {
+            to->addrs[i].addr.data = to->addrs[i].data;
+        }
+    }
+}
+
+static unsigned
+conversation_key_hash(const void *v)
+{
+    return ((const conversation_key_t *)v)->hash;
+}
+
+static gboolean
+conversation_key_equal(const void *v1, const void *v2)
+{
+    const conversation_key_t *key1 = (const conversation_key_t *)v1;
+    const conversation_key_t *key2 = (const conversation_key_t *)v2;
+
+    if (key1->hash != key2->hash || key1->signature != key2->signature || key1->ctype != key2->ctype ||
+            memcmp(key1->vals, key2->vals, sizeof(key1->vals)) != 0) {
+        return FALSE;
+    }
+    for (size_t i = 0; i < CONVERSATION_KEY_ADDRS; i++) {
+        if (!addresses_equal(&key1->addrs[i].addr, &key2->addrs[i].addr)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/*
+ * Get the element list of a conversation index key, which has at most
+ * MAX_CONVERSATION_ELEMENTS elements. The addresses point into the key.
+ */
+static void
+conversation_key_get_elements(const conversation_key_t *key, conversation_element_t *elements)
+{
+    size_t addr_count = 0;
+    size_t val_count = 0;
+    unsigned shift = 0;
+
+    // The type of the first element is in the highest nibble that is set.
+    while ((key->signature >> shift) > 0xf) {
+        shift += 4;
+    }
+    for (conversation_element_t *element = elements; ; element++, shift -= 4) {
+        element->type = (conversation_element_type) (((key->signature >> shift) & 0xf) - 1);
+        switch (element->type) {
+        case CE_ADDRESS:
+            element->addr_val = key->addrs[addr_count++].addr;
+            break;
+        case CE_PORT:
+        case CE_UINT:
+        case CE_INT:
+            element->uint_val = key->vals[val_count++];
+            break;
+        case CE_CONVERSATION_TYPE:
+            element->conversation_type_val = key->ctype;
+            return;
+        default:
+            DISSECTOR_ASSERT_NOT_REACHED();
+        }
+    }
+}
+
+static inline conversation_entry_t *
+conversation_entry(const conversation_t *conv)
+{
+    return (conversation_entry_t *)conv;
+}
+
+/*
+ * Get the key of a conversation as an element list, which has at most
+ * MAX_CONVERSATION_ELEMENTS elements.
+ */
+static void
+conversation_get_elements(const conversation_t *conv, conversation_element_t *elements)
+{
+    if (conv->key_ptr) {
+        memcpy(elements, conv->key_ptr, sizeof(conversation_element_t) * conversation_element_count(conv->key_ptr));
+    } else {
+        conversation_key_get_elements(&conversation_entry(conv)->key, elements);
+    }
+}
+
 #if 0 // debugging
 static char* conversation_element_list_values(conversation_element_t *elements) {
     char *sep = "";
@@ -319,7 +595,11 @@ is_no_addr2_port2_key(conversation_element_t *key)
 static conversation_t *
 conversation_create_from_template(conversation_t *conversation, const address *addr2, const uint32_t port2)
 {
-    conversation_type ctype = conversation_get_key_type(conversation->key_ptr);
+    conversation_element_t key[MAX_CONVERSATION_ELEMENTS];
+    conversation_type ctype;
+
+    conversation_get_elements(conversation, key);
+    ctype = conversation_get_key_type(key);
     /*
      * Add a new conversation and keep the conversation template only if the
      * CONVERSATION_TEMPLATE bit is set for a connection oriented protocol.
@@ -337,7 +617,7 @@ conversation_create_from_template(conversation_t *conversation, const address *a
          * Are both the NO_ADDR2 and NO_PORT2 wildcards set in the options mask?
          */
         if (conversation->options & NO_ADDR2 && conversation->options & NO_PORT2
-                && is_no_addr2_port2_key(conversation->key_ptr))
+                && is_no_addr2_port2_key(key))
         {
             /*
              * The conversation template was created without knowledge of both
@@ -346,11 +626,11 @@ conversation_create_from_template(conversation_t *conversation, const address *a
              */
             new_conversation_from_template =
                 conversation_new(conversation->setup_frame,
-                        &conversation->key_ptr[ADDR1_IDX].addr_val, addr2,
-                        ctype, conversation->key_ptr[PORT1_IDX].port_val,
+                        &key[ADDR1_IDX].addr_val, addr2,
+                        ctype, key[PORT1_IDX].port_val,
                         port2, options);
         }
-        else if (conversation->options & NO_PORT2 && is_no_port2_key(conversation->key_ptr))
+        else if (conversation->options & NO_PORT2 && is_no_port2_key(key))
         {
             /*
              * The conversation template was created without knowledge of port 2
@@ -358,11 +638,11 @@ conversation_create_from_template(conversation_t *conversation, const address *a
              */
             new_conversation_from_template =
                 conversation_new(conversation->setup_frame,
-                        &conversation->key_ptr[ADDR1_IDX].addr_val, &conversation->key_ptr[ADDR2_IDX].addr_val,
-                        ctype, conversation->key_ptr[PORT1_IDX].port_val,
+                        &key[ADDR1_IDX].addr_val, &key[ADDR2_IDX].addr_val,
+                        ctype, key[PORT1_IDX].port_val,
                         port2, options);
         }
-        else if (conversation->options & NO_ADDR2 && is_no_addr2_key(conversation->key_ptr))
+        else if (conversation->options & NO_ADDR2 && is_no_addr2_key(key))
         {
             /*
              * The conversation template was created without knowledge of address
@@ -370,9 +650,9 @@ conversation_create_from_template(conversation_t *conversation, const address *a
              */
             new_conversation_from_template =
                 conversation_new(conversation->setup_frame,
-                        &conversation->key_ptr[ADDR1_IDX].addr_val, addr2,
-                        ctype, conversation->key_ptr[PORT1_IDX].port_val,
-                        conversation->key_ptr[PORT2_NO_ADDR2_IDX].port_val, options);
+                        &key[ADDR1_IDX].addr_val, addr2,
+                        ctype, key[PORT1_IDX].port_val,
+                        key[PORT2_NO_ADDR2_IDX].port_val, options);
         }
         else
         {
@@ -544,6 +824,155 @@ conversation_match_element_list(const void *v1, const void *v2)
     return TRUE;
 }
 
+/*
+ * Get the hash table of conversations identified by element lists like
+ * this one, creating it if asked to.
+ */
+static wmem_map_t *
+conversation_element_list_map(conversation_element_t *elements, bool create)
+{
+    unsigned signature = conversation_element_list_signature(elements);
+    wmem_map_t *el_list_map = (wmem_map_t *) wmem_map_lookup(conversation_hashtable_element_list_by_signature,
+                                                             GUINT_TO_POINTER(signature));
+    if (el_list_map) {
+        return el_list_map;
+    }
+
+    char *el_list_map_key = conversation_element_list_name(NULL, elements);
+    el_list_map = (wmem_map_t *) wmem_map_lookup(conversation_hashtable_element_list, el_list_map_key);
+    if (!el_list_map) {
+        if (!create) {
+            g_free(el_list_map_key);
+            return NULL;
+        }
+        el_list_map = wmem_map_new_autoreset(wmem_epan_scope(), wmem_file_scope(), conversation_hash_element_list,
+                conversation_match_element_list);
+        wmem_map_insert(conversation_hashtable_element_list, wmem_strdup(wmem_epan_scope(), el_list_map_key), el_list_map);
+    }
+    g_free(el_list_map_key);
+    wmem_map_insert(conversation_hashtable_element_list_by_signature, GUINT_TO_POINTER(signature), el_list_map);
+    return el_list_map;
+}
+
+/* The hash table a conversation is in. */
+static wmem_map_t *
+conversation_hashtable(const conversation_t *conv)
+{
+    if (conv->key_ptr) {
+        return conversation_element_list_map(conv->key_ptr, true);
+    }
+    return conversation_index;
+}
+
+/* The key of a conversation in its hash table. */
+static void *
+conversation_hashtable_key(const conversation_t *conv)
+{
+    if (conv->key_ptr) {
+        return conv->key_ptr;
+    }
+    return &conversation_entry(conv)->key;
+}
+
+/*
+ * Fill in the key of the wildcarded conversations whose first address and
+ * port are these in conversation_wildcard_endpoints. Returns false if the
+ * address doesn't fit into a conversation_key_t.
+ */
+static bool
+conversation_wildcard_endpoint_init(conversation_key_t *key, const address *addr, const uint32_t port,
+        const conversation_type ctype)
+{
+    conversation_element_t elements[NO_ADDR2_PORT2_IDX_COUNT] = {
+        { CE_ADDRESS, .addr_val = *addr },
+        { CE_PORT, .port_val = port },
+        { CE_CONVERSATION_TYPE, .conversation_type_val = ctype },
+    };
+
+    return conversation_key_init(key, elements);
+}
+
+/*
+ * Count a hash chain of conversations in (delta 1) or out (delta -1) of
+ * conversation_index_chains and conversation_wildcard_endpoints.
+ */
+static void
+conversation_count_chain(const conversation_t *conv, const int delta)
+{
+    conversation_element_t elements[MAX_CONVERSATION_ELEMENTS];
+    conversation_key_t endpoint;
+    conversation_key_t *orig_key;
+    void *value;
+    unsigned signature;
+    unsigned count;
+
+    if (conv->key_ptr) {
+        signature = conversation_element_list_signature(conv->key_ptr);
+    } else {
+        signature = conversation_entry(conv)->key.signature;
+        count = GPOINTER_TO_UINT(wmem_map_lookup(conversation_index_chains, GUINT_TO_POINTER(signature))) + delta;
+        if (count) {
+            wmem_map_insert(conversation_index_chains, GUINT_TO_POINTER(signature), GUINT_TO_POINTER(count));
+        } else {
+            wmem_map_remove(conversation_index_chains, GUINT_TO_POINTER(signature));
+        }
+    }
+
+    if (signature != no_addr2_signature && signature != no_port2_signature &&
+            signature != no_addr2_or_port2_signature) {
+        return;
+    }
+    conversation_get_elements(conv, elements);
+    if (!conversation_wildcard_endpoint_init(&endpoint, &elements[ADDR1_IDX].addr_val,
+                elements[PORT1_IDX].port_val, conversation_get_key_type(elements))) {
+        return;
+    }
+    if (wmem_map_lookup_extended(conversation_wildcard_endpoints, &endpoint, (const void **)&orig_key, &value)) {
+        count = GPOINTER_TO_UINT(value) + delta;
+        if (count) {
+            wmem_map_insert(conversation_wildcard_endpoints, orig_key, GUINT_TO_POINTER(count));
+        } else {
+            wmem_map_remove(conversation_wildcard_endpoints, orig_key);
+            wmem_free(wmem_file_scope(), orig_key);
+        }
+    } else {
+        DISSECTOR_ASSERT(delta > 0);
+        orig_key = wmem_new(wmem_file_scope(), conversation_key_t);
+        conversation_key_copy(orig_key, &endpoint);
+        wmem_map_insert(conversation_wildcard_endpoints, orig_key, GUINT_TO_POINTER(1));
+    }
+}
+
+/*
+ * Can there be wildcarded conversations whose first address and port are
+ * these?
+ */
+static bool
+conversation_has_wildcards(const address *addr, const uint32_t port, const conversation_type ctype)
+{
+    conversation_key_t endpoint;
+
+    if (!conversation_wildcard_endpoint_init(&endpoint, addr, port, ctype)) {
+        return true;
+    }
+    return wmem_map_contains(conversation_wildcard_endpoints, &endpoint);
+}
+
+/*
+ * The signatures of the keys of the conversation_new*() functions, which
+ * get_conversation_hashtables() lists even if no conversation has them.
+ */
+static wmem_array_t *conversation_key_signatures;
+
+static unsigned
+conversation_add_key_signature(conversation_element_t *elements)
+{
+    unsigned signature = conversation_element_list_signature(elements);
+
+    wmem_array_append_one(conversation_key_signatures, signature);
+    return signature;
+}
+
 /**
  * Create a new hash tables for conversations.
  */
@@ -559,6 +988,16 @@ conversation_init(void)
      * above.
      */
     conversation_hashtable_element_list = wmem_map_new(wmem_epan_scope(), wmem_str_hash, g_str_equal);
+    conversation_hashtable_element_list_by_signature = wmem_map_new(wmem_epan_scope(), g_direct_hash, g_direct_equal);
+    conversation_proto_data_release_funcs = wmem_map_new(wmem_epan_scope(), g_direct_hash, g_direct_equal);
+    conversation_index = wmem_map_new_autoreset(wmem_epan_scope(), wmem_file_scope(),
+                                                conversation_key_hash, conversation_key_equal);
+    conversation_index_chains = wmem_map_new_autoreset(wmem_epan_scope(), wmem_file_scope(),
+                                                       g_direct_hash, g_direct_equal);
+    conversation_wildcard_endpoints = wmem_map_new_autoreset(wmem_epan_scope(), wmem_file_scope(),
+                                                             conversation_key_hash, conversation_key_equal);
+    conversation_key_signatures = wmem_array_new(wmem_epan_scope(), sizeof(unsigned));
+    conversation_cache_invalidate();
 
     conversation_element_t exact_elements[EXACT_IDX_COUNT] = {
         { CE_ADDRESS, .addr_val = ADDRESS_INIT_NONE },
@@ -567,24 +1006,14 @@ conversation_init(void)
         { CE_PORT, .port_val = 0 },
         { CE_CONVERSATION_TYPE, .conversation_type_val = CONVERSATION_NONE }
     };
-    char *exact_map_key = conversation_element_list_name(wmem_epan_scope(), exact_elements);
-    conversation_hashtable_exact_addr_port = wmem_map_new_autoreset(wmem_epan_scope(), wmem_file_scope(),
-                                                                    conversation_hash_element_list,
-                                                                    conversation_match_element_list);
-    wmem_map_insert(conversation_hashtable_element_list, wmem_strdup(wmem_epan_scope(), exact_map_key),
-                    conversation_hashtable_exact_addr_port);
+    conversation_add_key_signature(exact_elements);
 
     conversation_element_t addrs_elements[ADDRS_IDX_COUNT] = {
         { CE_ADDRESS, .addr_val = ADDRESS_INIT_NONE },
         { CE_ADDRESS, .addr_val = ADDRESS_INIT_NONE },
         { CE_CONVERSATION_TYPE, .conversation_type_val = CONVERSATION_NONE }
     };
-    char *addrs_map_key = conversation_element_list_name(wmem_epan_scope(), addrs_elements);
-    conversation_hashtable_exact_addr = wmem_map_new_autoreset(wmem_epan_scope(), wmem_file_scope(),
-                                                                    conversation_hash_element_list,
-                                                                    conversation_match_element_list);
-    wmem_map_insert(conversation_hashtable_element_list, wmem_strdup(wmem_epan_scope(), addrs_map_key),
-                    conversation_hashtable_exact_addr);
+    conversation_add_key_signature(addrs_elements);
 
     conversation_element_t no_addr2_elements[NO_ADDR2_IDX_COUNT] = {
         { CE_ADDRESS, .addr_val = ADDRESS_INIT_NONE },
@@ -592,12 +1021,7 @@ conversation_init(void)
         { CE_PORT, .port_val = 0 },
         { CE_CONVERSATION_TYPE, .conversation_type_val = CONVERSATION_NONE }
     };
-    char *no_addr2_map_key = conversation_element_list_name(wmem_epan_scope(), no_addr2_elements);
-    conversation_hashtable_no_addr2 = wmem_map_new_autoreset(wmem_epan_scope(), wmem_file_scope(),
-                                                       conversation_hash_element_list,
-                                                       conversation_match_element_list);
-    wmem_map_insert(conversation_hashtable_element_list, wmem_strdup(wmem_epan_scope(), no_addr2_map_key),
-                    conversation_hashtable_no_addr2);
+    no_addr2_signature = conversation_add_key_signature(no_addr2_elements);
 
     conversation_element_t no_port2_elements[NO_PORT2_IDX_COUNT] = {
         { CE_ADDRESS, .addr_val = ADDRESS_INIT_NONE },
@@ -605,39 +1029,24 @@ conversation_init(void)
         { CE_ADDRESS, .addr_val = ADDRESS_INIT_NONE },
         { CE_CONVERSATION_TYPE, .conversation_type_val = CONVERSATION_NONE }
     };
-    char *no_port2_map_key = conversation_element_list_name(wmem_epan_scope(), no_port2_elements);
-    conversation_hashtable_no_port2 = wmem_map_new_autoreset(wmem_epan_scope(), wmem_file_scope(),
-                                                       conversation_hash_element_list,
-                                                       conversation_match_element_list);
-    wmem_map_insert(conversation_hashtable_element_list, wmem_strdup(wmem_epan_scope(), no_port2_map_key),
-                    conversation_hashtable_no_port2);
+    no_port2_signature = conversation_add_key_signature(no_port2_elements);
 
     conversation_element_t no_addr2_or_port2_elements[NO_ADDR2_PORT2_IDX_COUNT] = {
         { CE_ADDRESS, .addr_val = ADDRESS_INIT_NONE },
         { CE_PORT, .port_val = 0 },
         { CE_CONVERSATION_TYPE, .conversation_type_val = CONVERSATION_NONE }
     };
-    char *no_addr2_or_port2_map_key = conversation_element_list_name(wmem_epan_scope(), no_addr2_or_port2_elements);
-    conversation_hashtable_no_addr2_or_port2 = wmem_map_new_autoreset(wmem_epan_scope(), wmem_file_scope(),
-                                                                    conversation_hash_element_list,
-                                                                    conversation_match_element_list);
-    wmem_map_insert(conversation_hashtable_element_list, wmem_strdup(wmem_epan_scope(), no_addr2_or_port2_map_key),
-                    conversation_hashtable_no_addr2_or_port2);
+    no_addr2_or_port2_signature = conversation_add_key_signature(no_addr2_or_port2_elements);
 
     conversation_element_t id_elements[2] = {
         { CE_UINT, .uint_val = 0 },
         { CE_CONVERSATION_TYPE, .conversation_type_val = CONVERSATION_NONE }
     };
-    char *id_map_key = conversation_element_list_name(wmem_epan_scope(), id_elements);
-    conversation_hashtable_id = wmem_map_new_autoreset(wmem_epan_scope(), wmem_file_scope(),
-                                                       conversation_hash_element_list,
-                                                       conversation_match_element_list);
-    wmem_map_insert(conversation_hashtable_element_list, wmem_strdup(wmem_epan_scope(), id_map_key),
-                    conversation_hashtable_id);
+    conversation_add_key_signature(id_elements);
 
     /*
-     * Initialize the "deinterlacer" table, which is used as the basis for the
-     * deinterlacing process, and in conjunction with the "anchor" tables
+     * The "deinterlacer" keys are used as the basis for the
+     * deinterlacing process, and in conjunction with the "anchor" keys.
      *
      * Typically the elements are:
      *   ETH address 1
@@ -646,7 +1055,7 @@ conversation_init(void)
      *   VLAN id
      *   not used yet
      *
-     * By the time of implementation, these table is invoked through the
+     * By the time of implementation, these keys are used through the
      * conversation_deinterlacing_key user preference.
      */
     conversation_element_t deinterlacer_elements[EXACT_IDX_COUNT+1] = {
@@ -657,20 +1066,15 @@ conversation_init(void)
         { CE_UINT, .uint_val = 0 },
         { CE_CONVERSATION_TYPE, .conversation_type_val = CONVERSATION_NONE }
     };
-    char *deinterlacer_map_key = conversation_element_list_name(wmem_epan_scope(), deinterlacer_elements);
-    conversation_hashtable_deinterlacer = wmem_map_new_autoreset(wmem_epan_scope(), wmem_file_scope(),
-                                                                    conversation_hash_element_list,
-                                                                    conversation_match_element_list);
-    wmem_map_insert(conversation_hashtable_element_list, wmem_strdup(wmem_epan_scope(), deinterlacer_map_key),
-                    conversation_hashtable_deinterlacer);
+    conversation_add_key_signature(deinterlacer_elements);
 
     /*
-     * Initialize the "_anc" tables, which are very similar to their standard counterparts
+     * The "_anc" keys are very similar to their standard counterparts
      * but contain an additional "anchor" materialized as an integer. This value is supposed
      * to indicate a stream ID of the underlying protocol, thus attaching two conversations
      * of two protocols together.
      *
-     * By the time of implementation, these table is invoked through the
+     * By the time of implementation, these keys are used through the
      * conversation_deinterlacing_key user preference.
      */
     conversation_element_t exact_elements_anc[EXACT_IDX_COUNT+1] = {
@@ -681,12 +1085,7 @@ conversation_init(void)
         { CE_UINT, .uint_val = 0 },
         { CE_CONVERSATION_TYPE, .conversation_type_val = CONVERSATION_NONE }
     };
-    char *exact_anc_map_key = conversation_element_list_name(wmem_epan_scope(), exact_elements_anc);
-    conversation_hashtable_exact_addr_port_anc = wmem_map_new_autoreset(wmem_epan_scope(), wmem_file_scope(),
-                                                                    conversation_hash_element_list,
-                                                                    conversation_match_element_list);
-    wmem_map_insert(conversation_hashtable_element_list, wmem_strdup(wmem_epan_scope(), exact_anc_map_key),
-                    conversation_hashtable_exact_addr_port_anc);
+    conversation_add_key_signature(exact_elements_anc);
 
     conversation_element_t addrs_elements_anc[ADDRS_IDX_COUNT+1] = {
         { CE_ADDRESS, .addr_val = ADDRESS_INIT_NONE },
@@ -694,12 +1093,7 @@ conversation_init(void)
         { CE_UINT, .uint_val = 0 },
         { CE_CONVERSATION_TYPE, .conversation_type_val = CONVERSATION_NONE }
     };
-    char *addrs_anc_map_key = conversation_element_list_name(wmem_epan_scope(), addrs_elements_anc);
-    conversation_hashtable_exact_addr_anc = wmem_map_new_autoreset(wmem_epan_scope(), wmem_file_scope(),
-                                                                    conversation_hash_element_list,
-                                                                    conversation_match_element_list);
-    wmem_map_insert(conversation_hashtable_element_list, wmem_strdup(wmem_epan_scope(), addrs_anc_map_key),
-                    conversation_hashtable_exact_addr_anc);
+    conversation_add_key_signature(addrs_elements_anc);
 
     conversation_element_t no_port2_elements_anc[DEINTD_NO_PORT2_IDX_COUNT] = {
         { CE_ADDRESS, .addr_val = ADDRESS_INIT_NONE },
@@ -708,12 +1102,7 @@ conversation_init(void)
         { CE_UINT, .uint_val = 0 },
         { CE_CONVERSATION_TYPE, .conversation_type_val = CONVERSATION_NONE }
     };
-    char *no_port2_anc_map_key = conversation_element_list_name(wmem_epan_scope(), no_port2_elements_anc);
-    conversation_hashtable_no_port2_anc = wmem_map_new_autoreset(wmem_epan_scope(), wmem_file_scope(),
-                                                                    conversation_hash_element_list,
-                                                                    conversation_match_element_list);
-    wmem_map_insert(conversation_hashtable_element_list, wmem_strdup(wmem_epan_scope(), no_port2_anc_map_key),
-                    conversation_hashtable_no_port2_anc);
+    conversation_add_key_signature(no_port2_elements_anc);
 
     conversation_element_t no_addr2_or_port2_elements_anc[DEINTD_NO_ADDR2_PORT2_IDX_COUNT] = {
         { CE_ADDRESS, .addr_val = ADDRESS_INIT_NONE },
@@ -721,13 +1110,7 @@ conversation_init(void)
         { CE_UINT, .uint_val = 0 },
         { CE_CONVERSATION_TYPE, .conversation_type_val = CONVERSATION_NONE }
     };
-    char *no_addr2_or_port2_anc_map_key = conversation_element_list_name(wmem_epan_scope(), no_addr2_or_port2_elements_anc);
-    conversation_hashtable_no_addr2_or_port2_anc = wmem_map_new_autoreset(wmem_epan_scope(), wmem_file_scope(),
-                                                                    conversation_hash_element_list,
-                                                                    conversation_match_element_list);
-    wmem_map_insert(conversation_hashtable_element_list, wmem_strdup(wmem_epan_scope(), no_addr2_or_port2_anc_map_key),
-                    conversation_hashtable_no_addr2_or_port2_anc);
-
+    conversation_add_key_signature(no_addr2_or_port2_elements_anc);
 }
 
 /**
@@ -740,6 +1123,11 @@ conversation_epan_reset(void)
      * Start the conversation indices over at 0.
      */
     new_index = 0;
+
+    /*
+     * The conversations the cache refers to are gone.
+     */
+    conversation_cache_invalidate();
 }
 
 /*
@@ -749,18 +1137,27 @@ conversation_epan_reset(void)
  * Mostly adapted from the old conversation_new().
  */
 static void
-conversation_insert_into_hashtable(wmem_map_t *hashtable, conversation_t *conv)
+conversation_insert_into_hashtable(conversation_t *conv)
 {
+    wmem_map_t *hashtable = conversation_hashtable(conv);
+    void *key = conversation_hashtable_key(conv);
     conversation_t *chain_head, *chain_tail, *cur, *prev;
 
-    chain_head = (conversation_t *)wmem_map_lookup(hashtable, conv->key_ptr);
+    conversation_cache_invalidate();
+
+    if (conv->setup_frame > conv->last_active_frame) {
+        conv->last_active_frame = conv->setup_frame;
+    }
+
+    chain_head = (conversation_t *)wmem_map_lookup(hashtable, key);
 
     if (NULL==chain_head) {
         /* New entry */
         conv->next = NULL;
         conv->last = conv;
 
-        wmem_map_insert(hashtable, conv->key_ptr, conv);
+        wmem_map_insert(hashtable, key, conv);
+        conversation_count_chain(conv, 1);
         DPRINT(("created a new conversation chain"));
     }
     else {
@@ -789,7 +1186,7 @@ conversation_insert_into_hashtable(wmem_map_t *hashtable, conversation_t *conv)
                 conv->next = chain_head;
                 conv->last = chain_tail;
                 chain_head->last = NULL;
-                wmem_map_insert(hashtable, conv->key_ptr, conv);
+                wmem_map_insert(hashtable, key, conv);
             }
             else {
                 /* Inserting into the middle of the chain */
@@ -806,11 +1203,19 @@ conversation_insert_into_hashtable(wmem_map_t *hashtable, conversation_t *conv)
  * taking into account ordering and hash chains and all that good stuff.
  */
 static void
-conversation_remove_from_hashtable(wmem_map_t *hashtable, conversation_t *conv)
+conversation_remove_from_hashtable(conversation_t *conv)
 {
+    wmem_map_t *hashtable = conversation_hashtable(conv);
+    void *key = conversation_hashtable_key(conv);
     conversation_t *chain_head, *cur, *prev;
 
-    chain_head = (conversation_t *)wmem_map_lookup(hashtable, conv->key_ptr);
+    conversation_cache_invalidate();
+
+    chain_head = (conversation_t *)wmem_map_lookup(hashtable, key);
+    if (chain_head == NULL) {
+        /* XXX: Conversation not found. Wrong hashtable? */
+        return;
+    }
 
     if (conv == chain_head) {
         /* We are currently the front of the chain */
@@ -819,20 +1224,19 @@ conversation_remove_from_hashtable(wmem_map_t *hashtable, conversation_t *conv)
              * update next pointer, but do not call
              * wmem_map_remove() either because the conv data
              * will be re-inserted. */
-            wmem_map_steal(hashtable, conv->key_ptr);
+            wmem_map_steal(hashtable, key);
+            conversation_count_chain(conv, -1);
+            return;
         }
-        else {
-            /* Update the head of the chain */
-            chain_head = conv->next;
-            chain_head->last = conv->last;
 
-            if (conv->latest_found == conv)
-                chain_head->latest_found = NULL;
-            else
-                chain_head->latest_found = conv->latest_found;
+        /* Update the head of the chain */
+        chain_head = conv->next;
+        chain_head->last = conv->last;
 
-            wmem_map_insert(hashtable, chain_head->key_ptr, chain_head);
-        }
+        if (conv->latest_found == conv)
+            chain_head->latest_found = NULL;
+        else
+            chain_head->latest_found = conv->latest_found;
     }
     else {
         /* We are not the front of the chain. Loop through to find us.
@@ -859,43 +1263,103 @@ conversation_remove_from_hashtable(wmem_map_t *hashtable, conversation_t *conv)
         if (chain_head->latest_found == conv)
             chain_head->latest_found = prev;
     }
+
+    /*
+     * The hash table keeps the key it was first given for a chain, which
+     * can be the key of this conversation even if it wasn't at the head
+     * of the chain any more; give it the key of the head.
+     */
+    wmem_map_steal(hashtable, key);
+    wmem_map_insert(hashtable, conversation_hashtable_key(chain_head), chain_head);
 }
 
-conversation_t *conversation_new_full(const uint32_t setup_frame, conversation_element_t *elements)
+/* Free a copy of an element list made by conversation_set_key(). */
+static void
+conversation_free_elements(conversation_element_t *elements)
 {
-    DISSECTOR_ASSERT(elements);
-
-    char *el_list_map_key = conversation_element_list_name(wmem_epan_scope(), elements);
-    wmem_map_t *el_list_map = (wmem_map_t *) wmem_map_lookup(conversation_hashtable_element_list, el_list_map_key);
-    if (!el_list_map) {
-        el_list_map = wmem_map_new_autoreset(wmem_epan_scope(), wmem_file_scope(), conversation_hash_element_list,
-                conversation_match_element_list);
-        wmem_map_insert(conversation_hashtable_element_list, wmem_strdup(wmem_epan_scope(), el_list_map_key), el_list_map);
+    for (conversation_element_t *element = elements; ; element++) {
+        switch (element->type) {
+        case CE_ADDRESS:
+            free_address_wmem(wmem_file_scope(), &element->addr_val);
+            break;
+        case CE_STRING:
+            wmem_free(wmem_file_scope(), (void *)element->str_val);
+            break;
+        case CE_BLOB:
+            wmem_free(wmem_file_scope(), (void *)element->blob.val);
+            break;
+        case CE_CONVERSATION_TYPE:
+            wmem_free(wmem_file_scope(), elements);
+            return;
+        default:
+            break;
+        }
     }
+}
 
-    size_t element_count = conversation_element_count(elements);
-    conversation_element_t *conv_key = wmem_memdup(wmem_file_scope(), elements, sizeof(conversation_element_t) * element_count);
-    for (size_t i = 0; i < element_count; i++) {
-        if (conv_key[i].type == CE_ADDRESS) {
-            copy_address_wmem(wmem_file_scope(), &conv_key[i].addr_val, &elements[i].addr_val);
-        } else if (conv_key[i].type == CE_STRING) {
-            conv_key[i].str_val = wmem_strdup(wmem_file_scope(), elements[i].str_val);
-        } else if (conv_key[i].type == CE_BLOB) {
-            conv_key[i].blob.val = wmem_memdup(wmem_file_scope(), elements[i].blob.val, elements[i].blob.len);
+/*
+ * Set the key of a conversation that isn't in a hash table. Keys that fit
+ * into the conversation index are kept in the conversation_entry_t, the
+ * others are copied into key_ptr.
+ */
+static void
+conversation_set_key(conversation_t *conv, conversation_element_t *elements)
+{
+    conversation_element_t *old_key = conv->key_ptr;
+    conversation_key_t key;
+
+    if (conversation_key_init(&key, elements)) {
+        conversation_key_copy(&conversation_entry(conv)->key, &key);
+        conv->key_ptr = NULL;
+    } else {
+        size_t element_count = conversation_element_count(elements);
+        conversation_element_t *conv_key = wmem_memdup(wmem_file_scope(), elements, sizeof(conversation_element_t) * element_count);
+        for (size_t i = 0; i < element_count; i++) {
+            if (conv_key[i].type == CE_ADDRESS) {
+                copy_address_wmem(wmem_file_scope(), &conv_key[i].addr_val, &elements[i].addr_val);
+            } else if (conv_key[i].type == CE_STRING) {
+                conv_key[i].str_val = wmem_strdup(wmem_file_scope(), elements[i].str_val);
+            } else if (conv_key[i].type == CE_BLOB) {
+                conv_key[i].blob.val = wmem_memdup(wmem_file_scope(), elements[i].blob.val, elements[i].blob.len);
+            }
         }
+        conv->key_ptr = conv_key;
+    }
+
+    /* The elements can point into the old key. */
+    if (old_key) {
+        conversation_free_elements(old_key);
     }
+}
+
+/* Create a conversation and add it to its hash table. */
+static conversation_t *
+conversation_create(const uint32_t setup_frame, conversation_element_t *elements, const unsigned options)
+{
+    conversation_entry_t *entry = wmem_new0(wmem_file_scope(), conversation_entry_t);
+    conversation_t *conversation = &entry->conv;
 
-    conversation_t *conversation = wmem_new0(wmem_file_scope(), conversation_t);
     conversation->conv_index = new_index;
     conversation->setup_frame = conversation->last_frame = setup_frame;
+    conversation->options = options;
 
     new_index++;
 
-    conversation->key_ptr = conv_key;
-    conversation_insert_into_hashtable(el_list_map, conversation);
+    conversation_set_key(conversation, elements);
+    conversation_insert_into_hashtable(conversation);
     return conversation;
 }
 
+conversation_t *conversation_new_full(const uint32_t setup_frame, conversation_element_t *elements)
+{
+    DISSECTOR_ASSERT(elements);
+
+    // Check the elements.
+    conversation_element_count(elements);
+
+    return conversation_create(setup_frame, elements, 0);
+}
+
 /*
  * Given two address/port pairs for a packet, create a new conversation
  * to contain packets between those address/port pairs.
@@ -912,7 +1376,6 @@ conversation_new(const uint32_t setup_frame, const address *addr1, const address
        DISSECTOR_ASSERT(!(options | CONVERSATION_TEMPLATE) || ((options | (NO_ADDR2 | NO_PORT2 | NO_PORT2_FORCE))) &&
        "A conversation template may not be constructed without wildcard options");
      */
-    wmem_map_t* hashtable;
     conversation_t *conversation = NULL;
     /*
      * Verify that the correct options are used, if any.
@@ -1014,16 +1477,14 @@ conversation_new(const uint32_t setup_frame, const address *addr1, const address
     }
 #endif
 
-    // Always allocate an "exact"-sized key in case we call conversation_set_port2
-    // or conversation_set_addr2 later.
-    conversation_element_t *new_key = wmem_alloc(wmem_file_scope(), sizeof(conversation_element_t) * EXACT_IDX_COUNT);
+    conversation_element_t new_key[EXACT_IDX_COUNT];
     size_t addr2_idx = 0;
     size_t port2_idx = 0;
     size_t endp_idx;
 
     new_key[ADDR1_IDX].type = CE_ADDRESS;
     if (addr1 != NULL) {
-        copy_address_wmem(wmem_file_scope(), &new_key[ADDR1_IDX].addr_val, addr1);
+        new_key[ADDR1_IDX].addr_val = *addr1;
     } else {
         clear_address(&new_key[ADDR1_IDX].addr_val);
     }
@@ -1035,24 +1496,19 @@ conversation_new(const uint32_t setup_frame, const address *addr1, const address
 
     if (options & NO_ADDR2) {
         if (options & (NO_PORT2|NO_PORT2_FORCE)) {
-            hashtable = conversation_hashtable_no_addr2_or_port2;
             endp_idx = ENDP_NO_ADDR2_PORT2_IDX;
         } else {
-            hashtable = conversation_hashtable_no_addr2;
             port2_idx = PORT2_NO_ADDR2_IDX;
             endp_idx = ENDP_NO_ADDR2_IDX;
         }
     } else {
         if (options & (NO_PORT2|NO_PORT2_FORCE)) {
-            hashtable = conversation_hashtable_no_port2;
             addr2_idx = ADDR2_IDX;
             endp_idx = ENDP_NO_PORT2_IDX;
         } else if (options & NO_PORTS) {
-            hashtable = conversation_hashtable_exact_addr;
             addr2_idx = PORT1_IDX;
             endp_idx = ENDP_NO_PORTS_IDX;
         } else {
-            hashtable = conversation_hashtable_exact_addr_port;
             addr2_idx = ADDR2_IDX;
             port2_idx = PORT2_IDX;
             endp_idx = ENDP_EXACT_IDX;
@@ -1062,7 +1518,7 @@ conversation_new(const uint32_t setup_frame, const address *addr1, const address
     if (addr2_idx) {
         new_key[addr2_idx].type = CE_ADDRESS;
         if (addr2 != NULL) {
-            copy_address_wmem(wmem_file_scope(), &new_key[addr2_idx].addr_val, addr2);
+            new_key[addr2_idx].addr_val = *addr2;
         } else {
             clear_address(&new_key[addr2_idx].addr_val);
         }
@@ -1076,19 +1532,8 @@ conversation_new(const uint32_t setup_frame, const address *addr1, const address
     new_key[endp_idx].type = CE_CONVERSATION_TYPE;
     new_key[endp_idx].conversation_type_val = ctype;
 
-    conversation = wmem_new0(wmem_file_scope(), conversation_t);
-
-    conversation->conv_index = new_index;
-    conversation->setup_frame = conversation->last_frame = setup_frame;
-
-    /* set the options and key pointer */
-    conversation->options = options;
-    conversation->key_ptr = new_key;
-
-    new_index++;
-
     DINDENT();
-    conversation_insert_into_hashtable(hashtable, conversation);
+    conversation = conversation_create(setup_frame, new_key, options);
     DENDENT();
 
     return conversation;
@@ -1122,134 +1567,60 @@ conversation_new_strat(packet_info *pinfo, const conversation_type ctype, const
 conversation_t *
 conversation_new_by_id(const uint32_t setup_frame, const conversation_type ctype, const uint32_t id)
 {
-    conversation_t *conversation = wmem_new0(wmem_file_scope(), conversation_t);
-    conversation->conv_index = new_index;
-    conversation->setup_frame = conversation->last_frame = setup_frame;
-
-    new_index++;
-
-    conversation_element_t *elements = wmem_alloc(wmem_file_scope(), sizeof(conversation_element_t) * 2);
-    elements[0].type = CE_UINT;
-    elements[0].uint_val = id;
-    elements[1].type = CE_CONVERSATION_TYPE;
-    elements[1].conversation_type_val = ctype;
-    conversation->key_ptr = elements;
-    conversation_insert_into_hashtable(conversation_hashtable_id, conversation);
+    conversation_element_t elements[2] = {
+        { CE_UINT, .uint_val = id },
+        { CE_CONVERSATION_TYPE, .conversation_type_val = ctype }
+    };
 
-    return conversation;
+    return conversation_create(setup_frame, elements, 0);
 }
 
 conversation_t *
 conversation_new_deinterlacer(const uint32_t setup_frame, const address *addr1, const address *addr2,
         const conversation_type ctype, const uint32_t key1, const uint32_t key2, const uint32_t key3)
 {
+    conversation_element_t new_key[DEINTR_ENDP_IDX+1] = {
+        { CE_ADDRESS, .addr_val = addr1 ? *addr1 : null_address_ },
+        { CE_ADDRESS, .addr_val = addr2 ? *addr2 : null_address_ },
+        { CE_UINT, .uint_val = key1 },
+        { CE_UINT, .uint_val = key2 },
+        { CE_UINT, .uint_val = key3 },
+        { CE_CONVERSATION_TYPE, .conversation_type_val = ctype },
+    };
 
-    conversation_t *conversation = wmem_new0(wmem_file_scope(), conversation_t);
-    conversation->conv_index = new_index;
-    conversation->setup_frame = conversation->last_frame = setup_frame;
+    return conversation_create(setup_frame, new_key, 0);
+}
 
-    conversation_element_t *new_key = wmem_alloc(wmem_file_scope(), sizeof(conversation_element_t) * (DEINTR_ENDP_IDX+1));
+conversation_t *
+conversation_new_deinterlaced(const uint32_t setup_frame, const address *addr1, const address *addr2,
+        const conversation_type ctype, const uint32_t port1, const uint32_t port2, const uint32_t anchor, const unsigned options)
+{
+    conversation_element_t new_key[DEINTD_EXACT_IDX_COUNT+1];
 
-    new_key[DEINTR_ADDR1_IDX].type = CE_ADDRESS;
+    new_key[DEINTD_ADDR1_IDX].type = CE_ADDRESS;
     if (addr1 != NULL) {
-        copy_address_wmem(wmem_file_scope(), &new_key[DEINTR_ADDR1_IDX].addr_val, addr1);
+        new_key[DEINTD_ADDR1_IDX].addr_val = *addr1;
     }
     else {
-        clear_address(&new_key[DEINTR_ADDR1_IDX].addr_val);
+        clear_address(&new_key[DEINTD_ADDR1_IDX].addr_val);
     }
 
-    new_key[DEINTR_ADDR2_IDX].type = CE_ADDRESS;
+    new_key[DEINTD_ADDR2_IDX].type = CE_ADDRESS;
     if (addr2 != NULL) {
-        copy_address_wmem(wmem_file_scope(), &new_key[DEINTR_ADDR2_IDX].addr_val, addr2);
+        new_key[DEINTD_ADDR2_IDX].addr_val = *addr2;
     }
     else {
-        clear_address(&new_key[DEINTR_ADDR2_IDX].addr_val);
+        clear_address(&new_key[DEINTD_ADDR2_IDX].addr_val);
     }
 
-    new_key[DEINTR_KEY1_IDX].type = CE_UINT;
-    new_key[DEINTR_KEY1_IDX].uint_val = key1;
-
-    new_key[DEINTR_KEY2_IDX].type = CE_UINT;
-    new_key[DEINTR_KEY2_IDX].uint_val = key2;
-
-    new_key[DEINTR_KEY3_IDX].type = CE_UINT;
-    new_key[DEINTR_KEY3_IDX].uint_val = key3;
-
-    new_key[DEINTR_ENDP_IDX].type = CE_CONVERSATION_TYPE;
-    new_key[DEINTR_ENDP_IDX].conversation_type_val = ctype;
-
-    conversation->key_ptr = new_key;
-
-    new_index++;
-
-    conversation_insert_into_hashtable(conversation_hashtable_deinterlacer, conversation);
-
-    return conversation;
-}
-
-conversation_t *
-conversation_new_deinterlaced(const uint32_t setup_frame, const address *addr1, const address *addr2,
-        const conversation_type ctype, const uint32_t port1, const uint32_t port2, const uint32_t anchor, const unsigned options)
-{
-
-    conversation_t *conversation = wmem_new0(wmem_file_scope(), conversation_t);
-    conversation->conv_index = new_index;
-    conversation->setup_frame = conversation->last_frame = setup_frame;
-
     if (options & NO_PORTS) {
-        conversation_element_t *new_key = wmem_alloc(wmem_file_scope(), sizeof(conversation_element_t) * (DEINTD_ENDP_NO_PORTS_IDX+2));
-
-        new_key[DEINTD_ADDR1_IDX].type = CE_ADDRESS;
-        if (addr1 != NULL) {
-            copy_address_wmem(wmem_file_scope(), &new_key[DEINTD_ADDR1_IDX].addr_val, addr1);
-        }
-        else {
-          clear_address(&new_key[DEINTD_ADDR1_IDX].addr_val);
-        }
-
-        new_key[DEINTD_ADDR2_IDX].type = CE_ADDRESS;
-        if (addr2 != NULL) {
-            copy_address_wmem(wmem_file_scope(), &new_key[DEINTD_ADDR2_IDX].addr_val, addr2);
-        }
-        else {
-          clear_address(&new_key[DEINTD_ADDR2_IDX].addr_val);
-        }
-
         new_key[DEINTD_ENDP_NO_PORTS_IDX].type = CE_UINT;
         new_key[DEINTD_ENDP_NO_PORTS_IDX].uint_val = anchor;
 
         new_key[DEINTD_ENDP_NO_PORTS_IDX+ 1].type = CE_CONVERSATION_TYPE;
         new_key[DEINTD_ENDP_NO_PORTS_IDX+ 1].conversation_type_val = ctype;
-
-        // set the options and key pointer
-        conversation->options = options;
-        conversation->key_ptr = new_key;
-
-        new_index++;
-
-        conversation_insert_into_hashtable(conversation_hashtable_exact_addr_anc, conversation);
-
-        return conversation;
     }
     else if (options & NO_PORT2) {
-        conversation_element_t *new_key = wmem_alloc(wmem_file_scope(), sizeof(conversation_element_t) * (DEINTD_EXACT_IDX_COUNT+1));
-
-        new_key[DEINTD_ADDR1_IDX].type = CE_ADDRESS;
-        if (addr1 != NULL) {
-            copy_address_wmem(wmem_file_scope(), &new_key[DEINTD_ADDR1_IDX].addr_val, addr1);
-        }
-        else {
-          clear_address(&new_key[DEINTD_ADDR1_IDX].addr_val);
-        }
-
-        new_key[DEINTD_ADDR2_IDX].type = CE_ADDRESS;
-        if (addr2 != NULL) {
-            copy_address_wmem(wmem_file_scope(), &new_key[DEINTD_ADDR2_IDX].addr_val, addr2);
-        }
-        else {
-          clear_address(&new_key[DEINTD_ADDR2_IDX].addr_val);
-        }
-
         new_key[DEINTD_PORT1_IDX].type = CE_PORT;
         new_key[DEINTD_PORT1_IDX].port_val = port1;
 
@@ -1258,36 +1629,8 @@ conversation_new_deinterlaced(const uint32_t setup_frame, const address *addr1,
 
         new_key[DEINTD_PORT1_IDX + 2].type = CE_CONVERSATION_TYPE;
         new_key[DEINTD_PORT1_IDX + 2].conversation_type_val = ctype;
-
-        // set the options and key pointer
-        conversation->options = options;
-        conversation->key_ptr = new_key;
-
-        new_index++;
-
-        conversation_insert_into_hashtable(conversation_hashtable_exact_addr_port_anc, conversation);
-
-        return conversation;
     }
     else {
-        conversation_element_t *new_key = wmem_alloc(wmem_file_scope(), sizeof(conversation_element_t) * (DEINTD_EXACT_IDX_COUNT+2));
-
-        new_key[DEINTD_ADDR1_IDX].type = CE_ADDRESS;
-        if (addr1 != NULL) {
-            copy_address_wmem(wmem_file_scope(), &new_key[DEINTD_ADDR1_IDX].addr_val, addr1);
-        }
-        else {
-          clear_address(&new_key[DEINTD_ADDR1_IDX].addr_val);
-        }
-
-        new_key[DEINTD_ADDR2_IDX].type = CE_ADDRESS;
-        if (addr2 != NULL) {
-            copy_address_wmem(wmem_file_scope(), &new_key[DEINTD_ADDR2_IDX].addr_val, addr2);
-        }
-        else {
-          clear_address(&new_key[DEINTD_ADDR2_IDX].addr_val);
-        }
-
         new_key[DEINTD_PORT1_IDX].type = CE_PORT;
         new_key[DEINTD_PORT1_IDX].port_val = port1;
 
@@ -1299,17 +1642,9 @@ conversation_new_deinterlaced(const uint32_t setup_frame, const address *addr1,
 
         new_key[DEINTD_ENDP_EXACT_IDX + 1].type = CE_CONVERSATION_TYPE;
         new_key[DEINTD_ENDP_EXACT_IDX + 1].conversation_type_val = ctype;
-
-        // set the options and key pointer
-        conversation->options = options;
-        conversation->key_ptr = new_key;
-
-        new_index++;
-
-        conversation_insert_into_hashtable(conversation_hashtable_exact_addr_port_anc, conversation);
-
-        return conversation;
     }
+
+    return conversation_create(setup_frame, new_key, options);
 }
 
 /*
@@ -1330,29 +1665,28 @@ conversation_set_port2(conversation_t *conv, const uint32_t port)
     if ((!(conv->options & NO_PORT2)) || (conv->options & NO_PORT2_FORCE))
         return;
 
+    conversation_element_t key[MAX_CONVERSATION_ELEMENTS];
+
     DINDENT();
-    if (conv->options & NO_ADDR2) {
-        conversation_remove_from_hashtable(conversation_hashtable_no_addr2_or_port2, conv);
-    } else {
-        conversation_remove_from_hashtable(conversation_hashtable_no_port2, conv);
-    }
+    conversation_remove_from_hashtable(conv);
+    conversation_get_elements(conv, key);
 
-    // Shift our endpoint element over and set our port. We assume that conv->key_ptr
-    // was created with conversation_new and that we have enough element slots.
+    // Shift our endpoint element over and set our port. We assume that conv
+    // was created with conversation_new.
     conv->options &= ~NO_PORT2;
     if (conv->options & NO_ADDR2) {
         // addr1,port1,endp -> addr1,port1,port2,endp
-        conv->key_ptr[ENDP_NO_ADDR2_IDX] = conv->key_ptr[ENDP_NO_ADDR2_PORT2_IDX];
-        conv->key_ptr[PORT2_NO_ADDR2_IDX].type = CE_PORT;
-        conv->key_ptr[PORT2_NO_ADDR2_IDX].port_val = port;
-        conversation_insert_into_hashtable(conversation_hashtable_no_addr2, conv);
+        key[ENDP_NO_ADDR2_IDX] = key[ENDP_NO_ADDR2_PORT2_IDX];
+        key[PORT2_NO_ADDR2_IDX].type = CE_PORT;
+        key[PORT2_NO_ADDR2_IDX].port_val = port;
     } else {
         // addr1,port1,addr2,endp -> addr1,port1,addr2,port2,endp
-        conv->key_ptr[ENDP_EXACT_IDX] = conv->key_ptr[ENDP_NO_PORT2_IDX];
-        conv->key_ptr[PORT2_IDX].type = CE_PORT;
-        conv->key_ptr[PORT2_IDX].port_val = port;
-        conversation_insert_into_hashtable(conversation_hashtable_exact_addr_port, conv);
+        key[ENDP_EXACT_IDX] = key[ENDP_NO_PORT2_IDX];
+        key[PORT2_IDX].type = CE_PORT;
+        key[PORT2_IDX].port_val = port;
     }
+    conversation_set_key(conv, key);
+    conversation_insert_into_hashtable(conv);
     DENDENT();
 }
 
@@ -1377,76 +1711,98 @@ conversation_set_addr2(conversation_t *conv, const address *addr)
     if (!(conv->options & NO_ADDR2))
         return;
 
+    conversation_element_t key[MAX_CONVERSATION_ELEMENTS];
+
     DINDENT();
-    if (conv->options & NO_PORT2) {
-        conversation_remove_from_hashtable(conversation_hashtable_no_addr2_or_port2, conv);
-    } else {
-        conversation_remove_from_hashtable(conversation_hashtable_no_addr2, conv);
-    }
+    conversation_remove_from_hashtable(conv);
+    conversation_get_elements(conv, key);
 
     // Shift our endpoint and, if needed, our port element over and set our address.
-    // We assume that conv->key_ptr was created with conversation_new and that we have
-    // enough element slots.
+    // We assume that conv was created with conversation_new.
     conv->options &= ~NO_ADDR2;
-    wmem_map_t *hashtable;
     if (conv->options & NO_PORT2) {
         // addr1,port1,endp -> addr1,port1,addr2,endp
-        conv->key_ptr[ENDP_NO_PORT2_IDX] = conv->key_ptr[ENDP_NO_ADDR2_PORT2_IDX];
-        hashtable = conversation_hashtable_no_port2;
+        key[ENDP_NO_PORT2_IDX] = key[ENDP_NO_ADDR2_PORT2_IDX];
     } else {
         // addr1,port1,port2,endp -> addr1,port1,addr2,port2,endp
-        conv->key_ptr[ENDP_EXACT_IDX] = conv->key_ptr[ENDP_NO_ADDR2_IDX];
-        conv->key_ptr[PORT2_IDX] = conv->key_ptr[PORT2_NO_ADDR2_IDX];
-        hashtable = conversation_hashtable_exact_addr_port;
+        key[ENDP_EXACT_IDX] = key[ENDP_NO_ADDR2_IDX];
+        key[PORT2_IDX] = key[PORT2_NO_ADDR2_IDX];
     }
-    conv->key_ptr[ADDR2_IDX].type = CE_ADDRESS;
-    copy_address_wmem(wmem_file_scope(), &conv->key_ptr[ADDR2_IDX].addr_val, addr);
-    conversation_insert_into_hashtable(hashtable, conv);
+    key[ADDR2_IDX].type = CE_ADDRESS;
+    key[ADDR2_IDX].addr_val = *addr;
+    conversation_set_key(conv, key);
+    conversation_insert_into_hashtable(conv);
     DENDENT();
 }
 
-static conversation_t *conversation_lookup_hashtable(wmem_map_t *conversation_hashtable, const uint32_t frame_num, conversation_element_t *conv_key)
+static conversation_t *conversation_lookup_hashtable(wmem_map_t *conversation_hashtable, const uint32_t frame_num, const void *conv_key)
 {
     conversation_t* convo = NULL;
     conversation_t* match = NULL;
     conversation_t* chain_head = NULL;
+
     chain_head = (conversation_t *)wmem_map_lookup(conversation_hashtable, conv_key);
 
     if (chain_head && (chain_head->setup_frame <= frame_num)) {
         match = chain_head;
 
-        if (chain_head->last && (chain_head->last->setup_frame <= frame_num))
-            return chain_head->last;
-
-        if (chain_head->latest_found && (chain_head->latest_found->setup_frame <= frame_num))
-            match = chain_head->latest_found;
+        if (chain_head->last && (chain_head->last->setup_frame <= frame_num)) {
+            match = chain_head->last;
+        } else {
+            if (chain_head->latest_found && (chain_head->latest_found->setup_frame <= frame_num))
+                match = chain_head->latest_found;
 
-        for (convo = match; convo && convo->setup_frame <= frame_num; convo = convo->next) {
-            if (convo->setup_frame > match->setup_frame) {
-                match = convo;
+            for (convo = match; convo && convo->setup_frame <= frame_num; convo = convo->next) {
+                if (convo->setup_frame > match->setup_frame) {
+                    match = convo;
+                }
             }
+
+            chain_head->latest_found = match;
         }
-    }
 
-    if (match) {
-        chain_head->latest_found = match;
+        if (frame_num > match->last_active_frame) {
+            match->last_active_frame = frame_num;
+        }
     }
 
     return match;
 }
 
-conversation_t *find_conversation_full(const uint32_t frame_num, conversation_element_t *elements)
+/*
+ * Search the conversation index, or the hash table of element lists like
+ * this one, for a conversation with the specified key and set up before
+ * frame_num.
+ */
+static conversation_t *
+conversation_lookup_elements(const uint32_t frame_num, conversation_element_t *elements)
 {
-    char *el_list_map_key = conversation_element_list_name(NULL, elements);
-    wmem_map_t *el_list_map = (wmem_map_t *) wmem_map_lookup(conversation_hashtable_element_list, el_list_map_key);
-    g_free(el_list_map_key);
+    conversation_key_t key;
+    wmem_map_t *el_list_map;
+
+    if (conversation_key_init(&key, elements)) {
+        /*
+         * Most kinds of keys, such as the wildcard ones, are usually
+         * unused; don't bother looking them up.
+         */
+        if (!wmem_map_contains(conversation_index_chains, GUINT_TO_POINTER(key.signature))) {
+            return NULL;
+        }
+        return conversation_lookup_hashtable(conversation_index, frame_num, &key);
+    }
+
+    el_list_map = conversation_element_list_map(elements, false);
     if (!el_list_map) {
         return NULL;
     }
-
     return conversation_lookup_hashtable(el_list_map, frame_num, elements);
 }
 
+conversation_t *find_conversation_full(const uint32_t frame_num, conversation_element_t *elements)
+{
+    return conversation_lookup_elements(frame_num, elements);
+}
+
 /*
  * Search a particular hash table for a conversation with the specified
  * {addr1, port1, addr2, port2} and set up before frame_num.
@@ -1462,7 +1818,7 @@ conversation_lookup_exact(const uint32_t frame_num, const address *addr1, const
         { CE_PORT, .port_val = port2 },
         { CE_CONVERSATION_TYPE, .conversation_type_val = ctype },
     };
-    return conversation_lookup_hashtable(conversation_hashtable_exact_addr_port, frame_num, key);
+    return conversation_lookup_elements(frame_num, key);
 }
 
 /*
@@ -1479,7 +1835,7 @@ conversation_lookup_no_addr2(const uint32_t frame_num, const address *addr1, con
         { CE_PORT, .port_val = port2 },
         { CE_CONVERSATION_TYPE, .conversation_type_val = ctype },
     };
-    return conversation_lookup_hashtable(conversation_hashtable_no_addr2, frame_num, key);
+    return conversation_lookup_elements(frame_num, key);
 }
 
 /*
@@ -1496,7 +1852,7 @@ conversation_lookup_no_port2(const uint32_t frame_num, const address *addr1, con
         { CE_ADDRESS, .addr_val = *addr2 },
         { CE_CONVERSATION_TYPE, .conversation_type_val = ctype },
     };
-    return conversation_lookup_hashtable(conversation_hashtable_no_port2, frame_num, key);
+    return conversation_lookup_elements(frame_num, key);
 }
 
 /*
@@ -1512,7 +1868,7 @@ conversation_lookup_no_addr2_or_port2(const uint32_t frame_num, const address *a
         { CE_PORT, .port_val = port1 },
         { CE_CONVERSATION_TYPE, .conversation_type_val = ctype },
     };
-    return conversation_lookup_hashtable(conversation_hashtable_no_addr2_or_port2, frame_num, key);
+    return conversation_lookup_elements(frame_num, key);
 }
 
 /*
@@ -1528,7 +1884,7 @@ conversation_lookup_no_ports(const uint32_t frame_num, const address *addr1,
         { CE_ADDRESS, .addr_val = *addr2 },
         { CE_CONVERSATION_TYPE, .conversation_type_val = ctype },
     };
-    return conversation_lookup_hashtable(conversation_hashtable_exact_addr, frame_num, key);
+    return conversation_lookup_elements(frame_num, key);
 }
 
 /*
@@ -1548,7 +1904,7 @@ conversation_lookup_exact_anc(const uint32_t frame_num, const address *addr1, co
         { CE_UINT, .uint_val = anchor },
         { CE_CONVERSATION_TYPE, .conversation_type_val = ctype },
     };
-    return conversation_lookup_hashtable(conversation_hashtable_exact_addr_port_anc, frame_num, key);
+    return conversation_lookup_elements(frame_num, key);
 }
 
 /*
@@ -1565,7 +1921,7 @@ conversation_lookup_no_ports_anc(const uint32_t frame_num, const address *addr1,
         { CE_UINT, .uint_val = anchor },
         { CE_CONVERSATION_TYPE, .conversation_type_val = ctype },
     };
-    return conversation_lookup_hashtable(conversation_hashtable_exact_addr_anc, frame_num, key);
+    return conversation_lookup_elements(frame_num, key);
 }
 
 static conversation_t *
@@ -1577,7 +1933,7 @@ conversation_lookup_no_anc_anc(const uint32_t frame_num, const address *addr1,
         { CE_ADDRESS, .addr_val = *addr2 },
         { CE_CONVERSATION_TYPE, .conversation_type_val = ctype },
     };
-    return conversation_lookup_hashtable(conversation_hashtable_exact_addr_anc, frame_num, key);
+    return conversation_lookup_elements(frame_num, key);
 }
 
 /*
@@ -1596,7 +1952,7 @@ conversation_lookup_no_port2_anc(const uint32_t frame_num, const address *addr1,
         { CE_UINT, .uint_val = anchor },
         { CE_CONVERSATION_TYPE, .conversation_type_val = ctype },
     };
-    return conversation_lookup_hashtable(conversation_hashtable_exact_addr_port_anc, frame_num, key);
+    return conversation_lookup_elements(frame_num, key);
 }
 
 /*
@@ -1617,7 +1973,7 @@ conversation_lookup_deinterlacer(const uint32_t frame_num, const address *addr1,
         { CE_UINT, .uint_val = key3 },
         { CE_CONVERSATION_TYPE, .conversation_type_val = ctype },
     };
-    return conversation_lookup_hashtable(conversation_hashtable_deinterlacer, frame_num, key);
+    return conversation_lookup_elements(frame_num, key);
 }
 
 /*
@@ -1661,6 +2017,9 @@ find_conversation(const uint32_t frame_num, const address *addr_a, const address
         const uint32_t port_a, const uint32_t port_b, const unsigned options)
 {
     conversation_t *conversation, *other_conv;
+    conversation_cache_entry_t *cache_entry;
+    uint64_t generation;
+    bool wildcards_a = false, wildcards_b = false;
 
     if (!addr_a) {
         addr_a = &null_address_;
@@ -1670,6 +2029,12 @@ find_conversation(const uint32_t frame_num, const address *addr_a, const address
         addr_b = &null_address_;
     }
 
+    cache_entry = conversation_cache_lookup(frame_num, addr_a, addr_b, ctype, port_a, port_b, options);
+    if (cache_entry != NULL) {
+        return cache_entry->conversation;
+    }
+    generation = conversation_generation;
+
     DINSTR(char *addr_a_str = address_to_str(NULL, addr_a));
     DINSTR(char *addr_b_str = address_to_str(NULL, addr_b));
     /*
@@ -1724,6 +2089,16 @@ find_conversation(const uint32_t frame_num, const address *addr_a, const address
             goto end;
     }
 
+    /*
+     * The wildcard lookups below all start from the first address and
+     * port of a wildcarded conversation; find out once whether each
+     * endpoint has any.
+     */
+    if (!(options & NO_PORT_X)) {
+        wildcards_a = conversation_has_wildcards(addr_a, port_a, ctype);
+        wildcards_b = conversation_has_wildcards(addr_b, port_b, ctype);
+    }
+
     /*
      * Well, that didn't find anything.  Try matches that wildcard
      * one of the addresses, if we have two ports.
@@ -1740,8 +2115,8 @@ find_conversation(const uint32_t frame_num, const address *addr_a, const address
          */
         DPRINT(("trying wildcarded match: %s:%d -> *:%d",
                     addr_a_str, port_a, port_b));
-        conversation = conversation_lookup_no_addr2(frame_num, addr_a, port_a, port_b, ctype);
-        if ((conversation == NULL) && (addr_a->type == AT_FC)) {
+        conversation = wildcards_a ? conversation_lookup_no_addr2(frame_num, addr_a, port_a, port_b, ctype) : NULL;
+        if ((conversation == NULL) && (addr_a->type == AT_FC) && conversation_has_wildcards(addr_b, port_a, ctype)) {
             /* In Fibre channel, OXID & RXID are never swapped as
              * TCP/UDP ports are in TCP/IP.
              */
@@ -1787,7 +2162,7 @@ find_conversation(const uint32_t frame_num, const address *addr_a, const address
          * first packet in the conversation).
          * ("addr_a" doesn't take part in this lookup.)
          */
-        if (!(options & NO_ADDR_B)) {
+        if (!(options & NO_ADDR_B) && wildcards_b) {
             DPRINT(("trying wildcarded match: %s:%d -> *:%d",
                         addr_b_str, port_b, port_a));
             conversation = conversation_lookup_no_addr2(frame_num, addr_b, port_b, port_a, ctype);
@@ -1833,8 +2208,8 @@ find_conversation(const uint32_t frame_num, const address *addr_a, const address
          */
         DPRINT(("trying wildcarded match: %s:%d -> %s:*",
                     addr_a_str, port_a, addr_b_str));
-        conversation = conversation_lookup_no_port2(frame_num, addr_a, port_a, addr_b, ctype);
-        if ((conversation == NULL) && (addr_a->type == AT_FC)) {
+        conversation = wildcards_a ? conversation_lookup_no_port2(frame_num, addr_a, port_a, addr_b, ctype) : NULL;
+        if ((conversation == NULL) && (addr_a->type == AT_FC) && conversation_has_wildcards(addr_b, port_a, ctype)) {
             /* In Fibre channel, OXID & RXID are never swapped as
              * TCP/UDP ports are in TCP/IP
              */
@@ -1879,7 +2254,7 @@ find_conversation(const uint32_t frame_num, const address *addr_a, const address
          * from the first packet in the conversation).
          * ("port_a" doesn't take part in this lookup.)
          */
-        if (!(options & NO_PORT_B)) {
+        if (!(options & NO_PORT_B) && wildcards_b) {
             DPRINT(("trying wildcarded match: %s:%d -> %s:*",
                         addr_b_str, port_b, addr_a_str));
             conversation = conversation_lookup_no_port2(frame_num, addr_b, port_b, addr_a, ctype);
@@ -1923,7 +2298,7 @@ find_conversation(const uint32_t frame_num, const address *addr_a, const address
      */
     if (!(options & NO_PORT_X)) {
         DPRINT(("trying wildcarded match: %s:%d -> *:*", addr_a_str, port_a));
-        conversation = conversation_lookup_no_addr2_or_port2(frame_num, addr_a, port_a, ctype);
+        conversation = wildcards_a ? conversation_lookup_no_addr2_or_port2(frame_num, addr_a, port_a, ctype) : NULL;
         if (conversation != NULL) {
             /*
              * If this is for a connection-oriented protocol:
@@ -1976,11 +2351,12 @@ find_conversation(const uint32_t frame_num, const address *addr_a, const address
             if (addr_a->type == AT_FC) {
                 DPRINT(("trying wildcarded match: %s:%d -> *:*",
                             addr_b_str, port_a));
-                conversation = conversation_lookup_no_addr2_or_port2(frame_num, addr_b, port_a, ctype);
+                conversation = conversation_has_wildcards(addr_b, port_a, ctype) ?
+                    conversation_lookup_no_addr2_or_port2(frame_num, addr_b, port_a, ctype) : NULL;
             } else {
                 DPRINT(("trying wildcarded match: %s:%d -> *:*",
                             addr_b_str, port_b));
-                conversation = conversation_lookup_no_addr2_or_port2(frame_num, addr_b, port_b, ctype);
+                conversation = wildcards_b ? conversation_lookup_no_addr2_or_port2(frame_num, addr_b, port_b, ctype) : NULL;
             }
             if (conversation != NULL) {
                 /*
@@ -2053,6 +2429,14 @@ find_conversation(const uint32_t frame_num, const address *addr_a, const address
     conversation = NULL;
 
 end:
+    /*
+     * Don't cache the result of a lookup that changed the hash tables
+     * (by filling in a wildcard, or creating a conversation from a
+     * template); the next one will take another path.
+     */
+    if (generation == conversation_generation) {
+        conversation_cache_store(frame_num, addr_a, addr_b, ctype, port_a, port_b, options, conversation);
+    }
     DINSTR(wmem_free(NULL, addr_a_str));
     DINSTR(wmem_free(NULL, addr_b_str));
     return conversation;
@@ -2201,7 +2585,7 @@ find_conversation_by_id(const uint32_t frame, const conversation_type ctype, con
         { CE_CONVERSATION_TYPE, .conversation_type_val = ctype }
     };
 
-    return conversation_lookup_hashtable(conversation_hashtable_id, frame, elements);
+    return conversation_lookup_elements(frame, elements);
 }
 
 void
@@ -2241,6 +2625,100 @@ conversation_delete_proto_data(conversation_t *conv, const int proto)
         wmem_tree_remove32(conv->data_list, proto);
 }
 
+void
+conversation_register_proto_data_release(const int proto, conversation_proto_data_release_func release_func)
+{
+    wmem_map_insert(conversation_proto_data_release_funcs, GINT_TO_POINTER(proto), (void *)release_func);
+}
+
+void
+conversation_set_closed(conversation_t *conv)
+{
+    conv->closed = true;
+}
+
+typedef struct {
+    uint32_t idle_frame;
+    uint32_t closed_frame;
+    GPtrArray *expired;
+} conversation_expire_t;
+
+static void
+conversation_collect_expired(void *key _U_, void *value, void *user_data)
+{
+    conversation_expire_t *ctx = (conversation_expire_t *)user_data;
+    conversation_t *conv;
+
+    for (conv = (conversation_t *)value; conv; conv = conv->next) {
+        if (conv->last_active_frame < ctx->idle_frame ||
+                (conv->closed && conv->last_active_frame < ctx->closed_frame)) {
+            g_ptr_array_add(ctx->expired, conv);
+        }
+    }
+}
+
+static void
+conversation_collect_expired_in_hashtable(void *key _U_, void *value, void *user_data)
+{
+    wmem_map_foreach((wmem_map_t *)value, conversation_collect_expired, user_data);
+}
+
+static bool
+conversation_release_proto_data(const void *key, void *value, void *user_data)
+{
+    conversation_proto_data_release_func release_func;
+
+    release_func = (conversation_proto_data_release_func)wmem_map_lookup(conversation_proto_data_release_funcs, key);
+    if (release_func) {
+        release_func((conversation_t *)user_data, value);
+    }
+    return false;
+}
+
+/*
+ * Free an expired conversation along with its key and the data protocols
+ * associated with it.
+ */
+static void
+conversation_free(conversation_t *conv)
+{
+    if (conv->data_list) {
+        wmem_tree_foreach(conv->data_list, conversation_release_proto_data, conv);
+        wmem_tree_destroy(conv->data_list, false, false);
+    }
+    if (conv->dissector_tree) {
+        wmem_tree_destroy(conv->dissector_tree, false, false);
+    }
+    if (conv->key_ptr) {
+        conversation_free_elements(conv->key_ptr);
+    }
+    wmem_free(wmem_file_scope(), conversation_entry(conv));
+}
+
+unsigned
+conversation_expire(const uint32_t idle_frame, const uint32_t closed_frame)
+{
+    conversation_expire_t ctx;
+    conversation_t *conv;
+    unsigned count;
+
+    ctx.idle_frame = idle_frame;
+    ctx.closed_frame = closed_frame;
+    ctx.expired = g_ptr_array_new();
+    wmem_map_foreach(conversation_index, conversation_collect_expired, &ctx);
+    wmem_map_foreach(conversation_hashtable_element_list, conversation_collect_expired_in_hashtable, &ctx);
+
+    for (unsigned i = 0; i < ctx.expired->len; i++) {
+        conv = (conversation_t *)g_ptr_array_index(ctx.expired, i);
+        conversation_remove_from_hashtable(conv);
+        conversation_free(conv);
+    }
+
+    count = ctx.expired->len;
+    g_ptr_array_free(ctx.expired, true);
+    return count;
+}
+
 void
 conversation_set_dissector_from_frame_number(conversation_t *conversation,
         const uint32_t starting_frame_num, const dissector_handle_t handle)
@@ -2657,26 +3135,115 @@ conversation_get_id_from_elements(struct _packet_info *pinfo, conversation_type
     return pinfo->conv_elements[0].uint_val;
 }
 
+/*
+ * The memory of the view of the conversations that
+ * get_conversation_hashtables() returns.
+ */
+static wmem_allocator_t *conversation_view_scope;
+
+/* The table of a view for element lists like this one. */
+static wmem_map_t *
+conversation_view_table(wmem_map_t *view, conversation_element_t *elements)
+{
+    char *name = conversation_element_list_name(conversation_view_scope, elements);
+    wmem_map_t *table = (wmem_map_t *) wmem_map_lookup(view, name);
+
+    if (!table) {
+        table = wmem_map_new(conversation_view_scope, conversation_hash_element_list, conversation_match_element_list);
+        wmem_map_insert(view, name, table);
+    }
+    return table;
+}
+
+static void
+conversation_view_add_index_entry(void *key, void *value, void *user_data)
+{
+    conversation_element_t *elements = wmem_alloc_array(conversation_view_scope, conversation_element_t,
+                                                        MAX_CONVERSATION_ELEMENTS);
+
+    conversation_key_get_elements((conversation_key_t *)key, elements);
+    wmem_map_insert(conversation_view_table((wmem_map_t *)user_data, elements), elements, value);
+}
+
+static void
+conversation_view_add_element_list_entry(void *key, void *value, void *user_data)
+{
+    wmem_map_insert(conversation_view_table((wmem_map_t *)user_data, (conversation_element_t *)key), key, value);
+}
+
+static void
+conversation_view_add_element_list(void *key _U_, void *value, void *user_data)
+{
+    wmem_map_foreach((wmem_map_t *)value, conversation_view_add_element_list_entry, user_data);
+}
+
 wmem_map_t *
 get_conversation_hashtables(void)
 {
-    return conversation_hashtable_element_list;
+    conversation_element_t elements[MAX_CONVERSATION_ELEMENTS];
+    conversation_key_t key;
+    wmem_map_t *view;
+
+    if (conversation_view_scope) {
+        wmem_free_all(conversation_view_scope);
+    } else {
+        conversation_view_scope = wmem_allocator_new(WMEM_ALLOCATOR_BLOCK);
+    }
+    view = wmem_map_new(conversation_view_scope, wmem_str_hash, g_str_equal);
+
+    /* List the keys of the conversation_new*() functions even if they are unused. */
+    memset(&key, 0, sizeof(key));
+    for (unsigned i = 0; i < wmem_array_get_count(conversation_key_signatures); i++) {
+        key.signature = *(unsigned *)wmem_array_index(conversation_key_signatures, i);
+        conversation_key_get_elements(&key, elements);
+        conversation_view_table(view, elements);
+    }
+
+    wmem_map_foreach(conversation_index, conversation_view_add_index_entry, view);
+    wmem_map_foreach(conversation_hashtable_element_list, conversation_view_add_element_list, view);
+    return view;
+}
+
+/*
+ * Get the address at an index of the key of a conversation; the elements
+ * of the key are those of conversation_get_elements().
+ */
+static const address *
+conversation_key_address(const conversation_t *conv, const conversation_element_t *elements, const size_t idx)
+{
+    size_t addr_count = 0;
+
+    if (conv->key_ptr) {
+        return &conv->key_ptr[idx].addr_val;
+    }
+    for (size_t i = 0; i < idx; i++) {
+        if (elements[i].type == CE_ADDRESS) {
+            addr_count++;
+        }
+    }
+    return &conversation_entry(conv)->key.addrs[addr_count].addr;
 }
 
 const address*
-conversation_key_addr1(const conversation_element_t *key)
+conversation_key_addr1(const conversation_t *conv)
 {
+    conversation_element_t key[MAX_CONVERSATION_ELEMENTS];
     const address *addr = &null_address_;
+
+    conversation_get_elements(conv, key);
     if (key[ADDR1_IDX].type == CE_ADDRESS) {
-        addr = &key[ADDR1_IDX].addr_val;
+        addr = conversation_key_address(conv, key, ADDR1_IDX);
     }
     return addr;
 }
 
 uint32_t
-conversation_key_port1(const conversation_element_t * key)
+conversation_key_port1(const conversation_t *conv)
 {
+    conversation_element_t key[MAX_CONVERSATION_ELEMENTS];
     uint32_t port = 0;
+
+    conversation_get_elements(conv, key);
     if (key[ADDR1_IDX].type == CE_ADDRESS && key[PORT1_IDX].type == CE_PORT) {
         port = key[PORT1_IDX].port_val;
     }
@@ -2684,19 +3251,25 @@ conversation_key_port1(const conversation_element_t * key)
 }
 
 const address*
-conversation_key_addr2(const conversation_element_t * key)
+conversation_key_addr2(const conversation_t *conv)
 {
+    conversation_element_t key[MAX_CONVERSATION_ELEMENTS];
     const address *addr = &null_address_;
+
+    conversation_get_elements(conv, key);
     if (key[ADDR1_IDX].type == CE_ADDRESS && key[PORT1_IDX].type == CE_PORT && key[ADDR2_IDX].type == CE_ADDRESS) {
-        addr = &key[ADDR2_IDX].addr_val;
+        addr = conversation_key_address(conv, key, ADDR2_IDX);
     }
     return addr;
 }
 
 uint32_t
-conversation_key_port2(const conversation_element_t * key)
+conversation_key_port2(const conversation_t *conv)
 {
+    conversation_element_t key[MAX_CONVERSATION_ELEMENTS];
     uint32_t port = 0;
+
+    conversation_get_elements(conv, key);
     if (key[ADDR1_IDX].type == CE_ADDRESS && key[PORT1_IDX].type == CE_PORT) {
         if (key[ADDR2_IDX].type == CE_ADDRESS && key[PORT2_IDX].type == CE_PORT) {
             // Exact
@@ -236,7 +236,9 @@ typedef struct conversation {
     wmem_tree_t *data_list;		/** list of data associated with conversation */
     wmem_tree_t *dissector_tree;	/** tree containing protocol dissector client associated with conversation */
     unsigned	options;		/** wildcard flags */
-    conversation_element_t *key_ptr;	/** Keys are conversation element arrays terminated with a CE_CONVERSATION_TYPE */
+    conversation_element_t *key_ptr;	/** Keys that don't fit into the conversation index, as conversation element arrays terminated with a CE_CONVERSATION_TYPE; NULL for the others. Use conversation_key_addr1() and friends to get at the key */
+    uint32_t last_active_frame;		/** highest frame number in which this conversation was created or looked up */
+    bool	closed;			/** the endpoints closed this conversation (see conversation_set_closed()) */
 } conversation_t;
 
 /*
@@ -276,10 +278,15 @@ typedef struct conversation {
 struct conversation_addr_port_endpoints;
 typedef struct conversation_addr_port_endpoints* conversation_addr_port_endpoints_t;
 
-WS_DLL_PUBLIC const address* conversation_key_addr1(const conversation_element_t *key);
-WS_DLL_PUBLIC uint32_t conversation_key_port1(const conversation_element_t *key);
-WS_DLL_PUBLIC const address* conversation_key_addr2(const conversation_element_t *key);
-WS_DLL_PUBLIC uint32_t conversation_key_port2(const conversation_element_t *key);
+/**
+ * Get the addresses and ports of the key of a conversation created with
+ * conversation_new(); empty addresses and zero ports if it has none.
+ * The addresses belong to the conversation.
+ */
+WS_DLL_PUBLIC const address* conversation_key_addr1(const conversation_t *conv);
+WS_DLL_PUBLIC uint32_t conversation_key_port1(const conversation_t *conv);
+WS_DLL_PUBLIC const address* conversation_key_addr2(const conversation_t *conv);
+WS_DLL_PUBLIC uint32_t conversation_key_port2(const conversation_t *conv);
 
 /**
  * Create a new hash tables for conversations.
@@ -487,6 +494,50 @@ WS_DLL_PUBLIC void *conversation_get_proto_data(const conversation_t *conv, cons
  */
 WS_DLL_PUBLIC void conversation_delete_proto_data(conversation_t *conv, const int proto);
 
+/** A function that frees the data a protocol associated with a conversation
+ * when the conversation is expired by conversation_expire().
+ * @param conv The conversation being expired.
+ * @param proto_data The data set with conversation_add_proto_data.
+ */
+typedef void (*conversation_proto_data_release_func)(conversation_t *conv, void *proto_data);
+
+/** Register a function that frees the data a protocol associates with
+ * conversations, when they are expired. The data of protocols that don't
+ * register one is left in file scope until the capture file is closed.
+ * The function should also remove the entries that the protocol keyed by
+ * the conversation in its own tables.
+ * @param proto Protocol ID.
+ * @param release_func The function.
+ */
+WS_DLL_PUBLIC void conversation_register_proto_data_release(const int proto,
+    conversation_proto_data_release_func release_func);
+
+/** Mark a conversation as closed by its endpoints, e.g. after a TCP FIN or
+ * RST, so that it can be expired sooner than idle ones.
+ * @param conv Conversation. Must not be NULL.
+ */
+WS_DLL_PUBLIC void conversation_set_closed(conversation_t *conv);
+
+/** Expire the conversations that no packet has used recently: remove them
+ * from the conversation tables, call the release functions of the protocols
+ * that associated data with them, and free them.
+ *
+ * A later conversation can be allocated at the address of an expired one,
+ * so a table keyed by conversation pointer must either have its entries
+ * removed by a release function or also compare conv_index, which is never
+ * reused within a capture file.
+ *
+ * This is meant for single-pass dissection of unbounded captures, where
+ * earlier frames are never dissected again; a conversation that is expired
+ * is created anew if a later packet belongs to it.
+ *
+ * @param idle_frame Expire the conversations last used before this frame.
+ * @param closed_frame Expire the closed conversations last used before
+ * this frame.
+ * @return The number of conversations expired.
+ */
+WS_DLL_PUBLIC unsigned conversation_expire(const uint32_t idle_frame, const uint32_t closed_frame);
+
 WS_DLL_PUBLIC void conversation_set_dissector(conversation_t *conversation, const dissector_handle_t handle);
 
 WS_DLL_PUBLIC void conversation_set_dissector_from_frame_number(conversation_t *conversation,
@@ -567,10 +618,15 @@ WS_DLL_PUBLIC void conversation_set_port2(conversation_t *conv, const uint32_t p
 WS_DLL_PUBLIC void conversation_set_addr2(conversation_t *conv, const address *addr);
 
 /**
- * @brief Get a hash table of conversation hash table.
+ * @brief Get a read-only view of the conversations, by the types of the
+ * elements of their keys.
+ *
+ * The conversations are kept in a single index; the view is built for
+ * each call and is valid until the next one, or until conversations are
+ * added, changed or removed.
  *
  * @return A wmem_map_t * of (const char *: wmem_map_t *).
- * Each value is a wmem_map_t * of (const conversation_element_t *: void *).
+ * Each value is a wmem_map_t * of (const conversation_element_t *: conversation_t *).
  */
 WS_DLL_PUBLIC wmem_map_t *get_conversation_hashtables(void);
 
@@ -0,0 +1,246 @@
+/* conversation_test.c
+ * Standalone program to test the lookups of conversation.h
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include <epan/epan.h>
+#include <epan/conversation.h>
+#include <wiretap/wtap.h>
+
+static const uint8_t addr_bytes[3][4] = {
+    { 10, 0, 0, 1 },
+    { 10, 0, 0, 2 },
+    { 10, 0, 0, 3 },
+};
+
+static const char long_addr_str[] = "an address too long for the conversation index";
+
+static address addr_a, addr_b, addr_c, addr_long;
+
+static const nstime_t *
+test_get_frame_ts(struct packet_provider_data *prov _U_, uint32_t frame_num _U_)
+{
+    static const nstime_t empty;
+
+    return &empty;
+}
+
+/* Each test gets its own set of conversations. */
+static epan_t *
+test_epan_new(void)
+{
+    static const struct packet_provider_funcs funcs = {
+        test_get_frame_ts,
+        NULL,
+        NULL,
+        NULL
+    };
+
+    return epan_new(NULL, &funcs);
+}
+
+/* A lookup that found nothing doesn't hide a conversation created later
+ * in the same frame. */
+static void
+conversation_test_new_after_miss(void)
+{
+    epan_t *session = test_epan_new();
+    conversation_t *conv;
+
+    g_assert_null(find_conversation(1, &addr_a, &addr_b, CONVERSATION_UDP, 1000, 2000, 0));
+    conv = conversation_new(1, &addr_a, &addr_b, CONVERSATION_UDP, 1000, 2000, 0);
+    g_assert_nonnull(conv);
+    g_assert_true(find_conversation(1, &addr_a, &addr_b, CONVERSATION_UDP, 1000, 2000, 0) == conv);
+    g_assert_true(find_conversation(1, &addr_b, &addr_a, CONVERSATION_UDP, 2000, 1000, 0) == conv);
+
+    /* A later conversation with the same key replaces it from its
+     * setup frame on, even in the frame that was just looked up. */
+    g_assert_true(find_conversation(2, &addr_a, &addr_b, CONVERSATION_UDP, 1000, 2000, 0) == conv);
+    conv = conversation_new(2, &addr_a, &addr_b, CONVERSATION_UDP, 1000, 2000, 0);
+    g_assert_true(find_conversation(2, &addr_a, &addr_b, CONVERSATION_UDP, 1000, 2000, 0) == conv);
+
+    epan_free(session);
+}
+
+/* Filling in the wildcard of a conversation changes the result of the
+ * lookups that matched the wildcard in the same frame. */
+static void
+conversation_test_set_port2(void)
+{
+    epan_t *session = test_epan_new();
+    conversation_t *conv;
+
+    conv = conversation_new(1, &addr_a, &addr_c, CONVERSATION_UDP, 1000, 0, NO_PORT2);
+    g_assert_true(find_conversation(1, &addr_a, &addr_c, CONVERSATION_UDP, 1000, 3000, 0) == conv);
+    g_assert_true(find_conversation(1, &addr_a, &addr_c, CONVERSATION_UDP, 1000, 4000, 0) == conv);
+
+    conversation_set_port2(conv, 3000);
+    g_assert_true(find_conversation(1, &addr_a, &addr_c, CONVERSATION_UDP, 1000, 3000, 0) == conv);
+    g_assert_null(find_conversation(1, &addr_a, &addr_c, CONVERSATION_UDP, 1000, 4000, 0));
+
+    epan_free(session);
+}
+
+/* The same for the address. */
+static void
+conversation_test_set_addr2(void)
+{
+    epan_t *session = test_epan_new();
+    conversation_t *conv;
+
+    conv = conversation_new(1, &addr_a, NULL, CONVERSATION_UDP, 1000, 2000, NO_ADDR2);
+    g_assert_true(find_conversation(1, &addr_a, &addr_b, CONVERSATION_UDP, 1000, 2000, 0) == conv);
+    g_assert_true(find_conversation(1, &addr_a, &addr_c, CONVERSATION_UDP, 1000, 2000, 0) == conv);
+
+    conversation_set_addr2(conv, &addr_b);
+    g_assert_true(find_conversation(1, &addr_a, &addr_b, CONVERSATION_UDP, 1000, 2000, 0) == conv);
+    g_assert_null(find_conversation(1, &addr_a, &addr_c, CONVERSATION_UDP, 1000, 2000, 0));
+
+    epan_free(session);
+}
+
+/* Conversations whose keys don't fit into the conversation index are
+ * found as well, including when filling in a wildcard moves them there. */
+static void
+conversation_test_long_address(void)
+{
+    epan_t *session = test_epan_new();
+    conversation_t *conv;
+
+    conv = conversation_new(1, &addr_long, &addr_b, CONVERSATION_TCP, 1000, 2000, 0);
+    g_assert_true(find_conversation(1, &addr_b, &addr_long, CONVERSATION_TCP, 2000, 1000, 0) == conv);
+    g_assert_true(addresses_equal(conversation_key_addr1(conv), &addr_long));
+    g_assert_cmpuint(conversation_key_port2(conv), ==, 2000);
+
+    conv = conversation_new(1, &addr_a, NULL, CONVERSATION_TCP, 21, 0, NO_ADDR2|NO_PORT2);
+    g_assert_true(find_conversation(1, &addr_long, &addr_a, CONVERSATION_TCP, 4000, 21, 0) == conv);
+    g_assert_true(addresses_equal(conversation_key_addr2(conv), &addr_long));
+    g_assert_cmpuint(conversation_key_port2(conv), ==, 4000);
+    g_assert_true(find_conversation(2, &addr_a, &addr_long, CONVERSATION_TCP, 21, 4000, 0) == conv);
+    g_assert_null(find_conversation(2, &addr_a, &addr_long, CONVERSATION_TCP, 21, 4001, 0));
+
+    epan_free(session);
+}
+
+/* The view of the conversations has a table for each kind of key. */
+static void
+conversation_test_hashtables(void)
+{
+    epan_t *session = test_epan_new();
+    wmem_map_t *tables;
+    wmem_map_t *table;
+
+    conversation_new(1, &addr_a, &addr_b, CONVERSATION_UDP, 1000, 2000, 0);
+    conversation_new(1, &addr_a, &addr_c, CONVERSATION_UDP, 1000, 2000, 0);
+    conversation_new_by_id(1, CONVERSATION_LOG, 42);
+
+    tables = get_conversation_hashtables();
+    table = (wmem_map_t *)wmem_map_lookup(tables, "address,port,address,port,endpoint");
+    g_assert_nonnull(table);
+    g_assert_cmpuint(wmem_map_size(table), ==, 2);
+    table = (wmem_map_t *)wmem_map_lookup(tables, "uint,endpoint");
+    g_assert_nonnull(table);
+    g_assert_cmpuint(wmem_map_size(table), ==, 1);
+    table = (wmem_map_t *)wmem_map_lookup(tables, "address,port,endpoint");
+    g_assert_nonnull(table);
+    g_assert_cmpuint(wmem_map_size(table), ==, 0);
+
+    epan_free(session);
+}
+
+/* Not a registered protocol; used to attach data to conversations. */
+#define TEST_PROTO 0x7fff0000
+
+static unsigned released;
+
+static void
+test_release(conversation_t *conv _U_, void *proto_data)
+{
+    g_assert_true(proto_data == &released);
+    released++;
+}
+
+/* Expiring conversations removes and frees them along with their data,
+ * including ones whose keys don't fit into the conversation index. */
+static void
+conversation_test_expire(void)
+{
+    epan_t *session = test_epan_new();
+    conversation_t *conv;
+
+    released = 0;
+    conversation_register_proto_data_release(TEST_PROTO, test_release);
+    conv = conversation_new(1, &addr_a, &addr_b, CONVERSATION_UDP, 1000, 2000, 0);
+    conversation_add_proto_data(conv, TEST_PROTO, &released);
+    conv = conversation_new(1, &addr_a, &addr_long, CONVERSATION_UDP, 1000, 2000, 0);
+    conversation_add_proto_data(conv, TEST_PROTO, &released);
+    conv = conversation_new(5, &addr_a, &addr_b, CONVERSATION_UDP, 1000, 2000, 0);
+    conversation_new(5, &addr_a, &addr_c, CONVERSATION_UDP, 1000, 2000, 0);
+    g_assert_null(find_conversation(4, &addr_a, &addr_c, CONVERSATION_UDP, 1000, 2000, 0));
+    g_assert_true(find_conversation(6, &addr_a, &addr_c, CONVERSATION_UDP, 1000, 2000, 0) != NULL);
+
+    g_assert_cmpuint(conversation_expire(3, 0), ==, 2);
+    g_assert_cmpuint(released, ==, 2);
+    g_assert_true(find_conversation(6, &addr_a, &addr_b, CONVERSATION_UDP, 1000, 2000, 0) == conv);
+    g_assert_null(find_conversation(6, &addr_a, &addr_long, CONVERSATION_UDP, 1000, 2000, 0));
+
+    /* Closed conversations go sooner. */
+    conversation_set_closed(conv);
+    g_assert_cmpuint(conversation_expire(3, 7), ==, 1);
+    g_assert_null(find_conversation(6, &addr_a, &addr_b, CONVERSATION_UDP, 1000, 2000, 0));
+    g_assert_true(find_conversation(6, &addr_a, &addr_c, CONVERSATION_UDP, 1000, 2000, 0) != NULL);
+    g_assert_cmpuint(released, ==, 2);
+
+    epan_free(session);
+}
+
+int
+main(int argc, char **argv)
+{
+    int result;
+
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/conversation/find/new_after_miss", conversation_test_new_after_miss);
+    g_test_add_func("/conversation/find/set_port2", conversation_test_set_port2);
+    g_test_add_func("/conversation/find/set_addr2", conversation_test_set_addr2);
+    g_test_add_func("/conversation/find/long_address", conversation_test_long_address);
+    g_test_add_func("/conversation/hashtables", conversation_test_hashtables);
+    g_test_add_func("/conversation/expire", conversation_test_expire);
+
+    set_address(&addr_a, AT_IPv4, 4, addr_bytes[0]);
+    set_address(&addr_b, AT_IPv4, 4, addr_bytes[1]);
+    set_address(&addr_c, AT_IPv4, 4, addr_bytes[2]);
+    set_address(&addr_long, AT_STRINGZ, (int) sizeof(long_addr_str), long_addr_str);
+
+    wtap_init(false);
+    if (!epan_init(NULL, NULL, false))
+        return 1;
+    result = g_test_run();
+    epan_cleanup();
+    wtap_cleanup();
+
+    return result;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 4
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=4 tabstop=8 expandtab:
+ * :indentSize=4:tabSize=8:noTabs=true:
+ */
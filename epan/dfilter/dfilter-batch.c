@@ -0,0 +1,859 @@
+/*
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 2001 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+#define WS_LOG_DOMAIN LOG_DOMAIN_DFILTER
+
+#include "dfilter-batch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dfilter-int.h"
+#include "dfvm.h"
+#include <ftypes/ftypes.h>
+#include <wsutil/ws_assert.h>
+
+/*
+ * The bytecode of the filter is translated instruction by instruction,
+ * so jump targets don't change. It is then run over a chunk of packets at
+ * a time, with one bit per packet: each instruction has a mask of the
+ * packets whose evaluation reaches it (all jumps go forward, so the mask
+ * is complete when the instruction is reached) and the accumulator has a
+ * bit per packet.
+ */
+
+/* Packets evaluated at a time, so that the masks stay in the cache. */
+#define BATCH_CHUNK		4096
+#define BATCH_CHUNK_WORDS	(BATCH_CHUNK / 64)
+
+/* Maps signed values to unsigned ones that sort in the same order. */
+#define SIGN_BIT		(UINT64_C(1) << 63)
+
+/* A test matches the values in a sorted list of disjoint intervals or,
+ * if the test is complemented, the values outside of them. */
+typedef struct {
+	uint64_t	lo;
+	uint64_t	hi;
+} batch_interval_t;
+
+typedef enum {
+	BATCH_NO_OP,
+	BATCH_PRESENT,		/* Is the field present? */
+	BATCH_TEST,		/* Do any (or all) of its values match? */
+	BATCH_NOT,
+	BATCH_IF_TRUE_GOTO,
+	BATCH_IF_FALSE_GOTO,
+	BATCH_RETURN,
+} batch_opcode_t;
+
+typedef struct {
+	batch_opcode_t	op;
+	unsigned	column;
+	unsigned	target;
+	bool		all;		/* All the values must match, not any. */
+	bool		complement;	/* Match the values outside the intervals. */
+	bool		invert;		/* Negate the result. */
+	batch_interval_t *intervals;
+	unsigned	num_intervals;
+} batch_insn_t;
+
+typedef struct {
+	int			field;
+	dfilter_batch_kind_t	kind;
+	bool			boolean;
+} batch_column_info_t;
+
+struct dfilter_batch {
+	batch_insn_t	*insns;
+	unsigned	num_insns;
+	GArray		*columns;	/* batch_column_info_t */
+};
+
+/* The comparisons of the VM, with the field on the left. */
+typedef enum {
+	REL_EQ,
+	REL_NE,
+	REL_GT,
+	REL_GE,
+	REL_LT,
+	REL_LE,
+} batch_relation_t;
+
+static bool
+field_kind(header_field_info *hfinfo, dfilter_batch_kind_t *kind, bool *boolean)
+{
+	dfilter_batch_kind_t	k;
+	bool			first = true;
+
+	for (; hfinfo != NULL; hfinfo = hfinfo->same_name_next) {
+		if (FT_IS_UINT(hfinfo->type) || hfinfo->type == FT_BOOLEAN)
+			k = DF_BATCH_COLUMN_UNSIGNED;
+		else if (FT_IS_INT(hfinfo->type))
+			k = DF_BATCH_COLUMN_SIGNED;
+		else if (hfinfo->type == FT_IPv4)
+			k = DF_BATCH_COLUMN_IPV4;
+		else
+			return false;
+
+		/* Booleans compare their truth values, so they can't share
+		 * a column with integers. */
+		if (!first && (k != *kind || (hfinfo->type == FT_BOOLEAN) != *boolean))
+			return false;
+		*kind = k;
+		*boolean = hfinfo->type == FT_BOOLEAN;
+		first = false;
+	}
+	return true;
+}
+
+/* Returns the column of a field, or -1 if its values can't be stored in
+ * one. */
+static int
+get_column(dfilter_batch_t *batch, header_field_info *hfinfo, bool need_values)
+{
+	batch_column_info_t	info, *col;
+
+	info.field = hfinfo->id;
+	info.kind = DF_BATCH_COLUMN_PRESENCE;
+	info.boolean = false;
+	if (need_values && !field_kind(hfinfo, &info.kind, &info.boolean))
+		return -1;
+
+	for (unsigned i = 0; i < batch->columns->len; i++) {
+		col = &g_array_index(batch->columns, batch_column_info_t, i);
+		if (col->field != info.field)
+			continue;
+		if (need_values)
+			*col = info;
+		return i;
+	}
+	g_array_append_val(batch->columns, info);
+	return batch->columns->len - 1;
+}
+
+/* Gets the interval of the values equal to a constant. */
+static bool
+constant_interval(const batch_column_info_t *col, fvalue_t *fv,
+				batch_interval_t *iv)
+{
+	uint64_t		u;
+	int64_t			s;
+	const ipv4_addr_and_mask *ipv4;
+
+	switch (col->kind) {
+		case DF_BATCH_COLUMN_UNSIGNED:
+			if (fvalue_to_uinteger64(fv, &u) != FT_OK)
+				return false;
+			if (col->boolean)
+				u = (u != 0);
+			iv->lo = iv->hi = u;
+			return true;
+
+		case DF_BATCH_COLUMN_SIGNED:
+			if (fvalue_to_sinteger64(fv, &s) != FT_OK)
+				return false;
+			iv->lo = iv->hi = (uint64_t)s ^ SIGN_BIT;
+			return true;
+
+		case DF_BATCH_COLUMN_IPV4:
+			if (fvalue_type_ftenum(fv) != FT_IPv4)
+				return false;
+			/* A subnet is equal to all of its addresses. */
+			ipv4 = fvalue_get_ipv4(fv);
+			iv->lo = ipv4->addr & ipv4->nmask;
+			iv->hi = iv->lo | (~ipv4->nmask & UINT32_MAX);
+			return true;
+
+		case DF_BATCH_COLUMN_PRESENCE:
+			break;
+	}
+	return false;
+}
+
+static uint64_t
+kind_max(dfilter_batch_kind_t kind)
+{
+	return kind == DF_BATCH_COLUMN_IPV4 ? UINT32_MAX : UINT64_MAX;
+}
+
+static int
+compare_intervals(const void *_a, const void *_b)
+{
+	const batch_interval_t *a = _a;
+	const batch_interval_t *b = _b;
+
+	if (a->lo != b->lo)
+		return a->lo < b->lo ? -1 : 1;
+	return 0;
+}
+
+/* Sorts the intervals and merges those that overlap or touch. */
+static void
+normalize_intervals(GArray *intervals)
+{
+	batch_interval_t	*iv;
+	unsigned		i, n = 0;
+
+	if (intervals->len == 0)
+		return;
+	g_array_sort(intervals, compare_intervals);
+	iv = (batch_interval_t *)(void *)intervals->data;
+	for (i = 1; i < intervals->len; i++) {
+		if (iv[n].hi == UINT64_MAX || iv[i].lo <= iv[n].hi + 1) {
+			if (iv[i].hi > iv[n].hi)
+				iv[n].hi = iv[i].hi;
+		}
+		else {
+			iv[++n] = iv[i];
+		}
+	}
+	g_array_set_size(intervals, n + 1);
+}
+
+static void
+set_intervals(batch_insn_t *insn, GArray *intervals)
+{
+	normalize_intervals(intervals);
+	insn->num_intervals = intervals->len;
+	insn->intervals = g_memdup2(intervals->data,
+				intervals->len * sizeof(batch_interval_t));
+}
+
+static bool
+translate_relation(dfilter_batch_t *batch, batch_insn_t *insn,
+			dfvm_insn_t *vm_insn, const int *reg_column,
+			batch_relation_t rel, bool all)
+{
+	dfvm_value_t		*reg, *constant;
+	batch_column_info_t	*col;
+	batch_interval_t	eq, iv;
+	uint64_t		max;
+	GArray			*intervals;
+
+	if (vm_insn->arg1->type == REGISTER && vm_insn->arg2->type == FVALUE) {
+		reg = vm_insn->arg1;
+		constant = vm_insn->arg2;
+	}
+	else if (vm_insn->arg1->type == FVALUE && vm_insn->arg2->type == REGISTER) {
+		/* Put the field on the left. */
+		reg = vm_insn->arg2;
+		constant = vm_insn->arg1;
+		switch (rel) {
+			case REL_GT:	rel = REL_LT; break;
+			case REL_GE:	rel = REL_LE; break;
+			case REL_LT:	rel = REL_GT; break;
+			case REL_LE:	rel = REL_GE; break;
+			case REL_EQ:
+			case REL_NE:
+				break;
+		}
+	}
+	else {
+		return false;
+	}
+
+	if (reg_column[reg->value.numeric] < 0)
+		return false;
+	insn->column = reg_column[reg->value.numeric];
+	col = &g_array_index(batch->columns, batch_column_info_t, insn->column);
+	if (!constant_interval(col, dfvm_value_get_fvalue(constant), &eq))
+		return false;
+	max = kind_max(col->kind);
+
+	insn->op = BATCH_TEST;
+	insn->all = all;
+	intervals = g_array_new(false, false, sizeof(batch_interval_t));
+	switch (rel) {
+		case REL_EQ:
+			g_array_append_val(intervals, eq);
+			break;
+		case REL_NE:
+			g_array_append_val(intervals, eq);
+			insn->complement = true;
+			break;
+		case REL_GT:
+			if (eq.hi < max) {
+				iv.lo = eq.hi + 1;
+				iv.hi = max;
+				g_array_append_val(intervals, iv);
+			}
+			break;
+		case REL_GE:
+			iv.lo = eq.lo;
+			iv.hi = max;
+			g_array_append_val(intervals, iv);
+			break;
+		case REL_LT:
+			if (eq.lo > 0) {
+				iv.lo = 0;
+				iv.hi = eq.lo - 1;
+				g_array_append_val(intervals, iv);
+			}
+			break;
+		case REL_LE:
+			iv.lo = 0;
+			iv.hi = eq.hi;
+			g_array_append_val(intervals, iv);
+			break;
+	}
+	set_intervals(insn, intervals);
+	g_array_free(intervals, true);
+	return true;
+}
+
+/* Adds the interval of an element of a set, or of a range if high isn't
+ * NULL. */
+static bool
+add_set_interval(const batch_column_info_t *col, fvalue_t *low, fvalue_t *high,
+			GArray *intervals)
+{
+	batch_interval_t	lo, hi, iv;
+
+	if (high == NULL) {
+		if (!constant_interval(col, low, &iv))
+			return false;
+		g_array_append_val(intervals, iv);
+		return true;
+	}
+	if (!constant_interval(col, low, &lo) || !constant_interval(col, high, &hi))
+		return false;
+	/* An empty range matches nothing. */
+	if (lo.lo <= hi.hi) {
+		iv.lo = lo.lo;
+		iv.hi = hi.hi;
+		g_array_append_val(intervals, iv);
+	}
+	return true;
+}
+
+/* Translates a membership test, given the elements pushed on the set
+ * stack (pairs of values, the second one NULL unless it's a range) and
+ * the indexed set of constants, if any. */
+static bool
+translate_membership(dfilter_batch_t *batch, batch_insn_t *insn,
+			dfvm_insn_t *vm_insn, const int *reg_column,
+			GPtrArray *elements, bool all, bool invert)
+{
+	batch_column_info_t	*col;
+	GArray			*intervals;
+	fvalue_t		*low, *high;
+	bool			ok = true;
+
+	if (vm_insn->arg1->type != REGISTER || reg_column[vm_insn->arg1->value.numeric] < 0)
+		return false;
+	insn->column = reg_column[vm_insn->arg1->value.numeric];
+	col = &g_array_index(batch->columns, batch_column_info_t, insn->column);
+
+	intervals = g_array_new(false, false, sizeof(batch_interval_t));
+	for (unsigned i = 0; ok && i < elements->len; i += 2) {
+		dfvm_value_t *low_val = g_ptr_array_index(elements, i);
+		dfvm_value_t *high_val = g_ptr_array_index(elements, i + 1);
+
+		if (low_val->type != FVALUE || (high_val && high_val->type != FVALUE))
+			ok = false;
+		else
+			ok = add_set_interval(col, dfvm_value_get_fvalue(low_val),
+					high_val ? dfvm_value_get_fvalue(high_val) : NULL,
+					intervals);
+	}
+	if (vm_insn->arg2 && vm_insn->arg2->type == FVALUE_SET) {
+		df_set_t *set = vm_insn->arg2->value.set;
+
+		for (unsigned i = 0; ok && i < df_set_size(set); i++) {
+			df_set_get(set, i, &low, &high);
+			ok = add_set_interval(col, low, high, intervals);
+		}
+	}
+
+	if (ok) {
+		insn->op = BATCH_TEST;
+		insn->all = all;
+		insn->invert = invert;
+		set_intervals(insn, intervals);
+	}
+	g_array_free(intervals, true);
+	return ok;
+}
+
+static bool
+translate(dfilter_batch_t *batch, const dfilter_t *df)
+{
+	dfvm_insn_t	*vm_insn;
+	batch_insn_t	*insn;
+	int		*reg_column;
+	GPtrArray	*elements;
+	int		col;
+	bool		ok = true;
+
+	reg_column = g_new(int, df->num_registers + 1);
+	for (unsigned i = 0; i <= df->num_registers; i++)
+		reg_column[i] = -1;
+	elements = g_ptr_array_new();
+
+	for (unsigned id = 0; ok && id < batch->num_insns; id++) {
+		vm_insn = g_ptr_array_index(df->insns, id);
+		insn = &batch->insns[id];
+
+		switch (vm_insn->op) {
+			case DFVM_NO_OP:
+				insn->op = BATCH_NO_OP;
+				break;
+
+			case DFVM_NOT:
+				insn->op = BATCH_NOT;
+				break;
+
+			case DFVM_RETURN:
+				insn->op = BATCH_RETURN;
+				break;
+
+			case DFVM_IF_TRUE_GOTO:
+			case DFVM_IF_FALSE_GOTO:
+				insn->op = (vm_insn->op == DFVM_IF_TRUE_GOTO) ?
+					BATCH_IF_TRUE_GOTO : BATCH_IF_FALSE_GOTO;
+				insn->target = vm_insn->arg1->value.numeric;
+				ok = insn->target > id && insn->target < batch->num_insns;
+				break;
+
+			case DFVM_CHECK_EXISTS:
+				col = get_column(batch, vm_insn->arg1->value.hfinfo, false);
+				insn->op = BATCH_PRESENT;
+				insn->column = col;
+				break;
+
+			case DFVM_READ_TREE:
+				/* The register is loaded on demand by the test; here
+				 * the field only needs to be present. */
+				if (vm_insn->arg1->type != HFINFO) {
+					ok = false;
+					break;
+				}
+				col = get_column(batch, vm_insn->arg1->value.hfinfo, true);
+				if (col < 0) {
+					ok = false;
+					break;
+				}
+				reg_column[vm_insn->arg2->value.numeric] = col;
+				insn->op = BATCH_PRESENT;
+				insn->column = col;
+				break;
+
+			case DFVM_ALL_EQ:
+			case DFVM_ANY_EQ:
+				ok = translate_relation(batch, insn, vm_insn, reg_column,
+						REL_EQ, vm_insn->op == DFVM_ALL_EQ);
+				break;
+
+			case DFVM_ALL_NE:
+			case DFVM_ANY_NE:
+				ok = translate_relation(batch, insn, vm_insn, reg_column,
+						REL_NE, vm_insn->op == DFVM_ALL_NE);
+				break;
+
+			case DFVM_ALL_GT:
+			case DFVM_ANY_GT:
+				ok = translate_relation(batch, insn, vm_insn, reg_column,
+						REL_GT, vm_insn->op == DFVM_ALL_GT);
+				break;
+
+			case DFVM_ALL_GE:
+			case DFVM_ANY_GE:
+				ok = translate_relation(batch, insn, vm_insn, reg_column,
+						REL_GE, vm_insn->op == DFVM_ALL_GE);
+				break;
+
+			case DFVM_ALL_LT:
+			case DFVM_ANY_LT:
+				ok = translate_relation(batch, insn, vm_insn, reg_column,
+						REL_LT, vm_insn->op == DFVM_ALL_LT);
+				break;
+
+			case DFVM_ALL_LE:
+			case DFVM_ANY_LE:
+				ok = translate_relation(batch, insn, vm_insn, reg_column,
+						REL_LE, vm_insn->op == DFVM_ALL_LE);
+				break;
+
+			case DFVM_SET_ADD:
+				g_ptr_array_add(elements, vm_insn->arg1);
+				g_ptr_array_add(elements, NULL);
+				insn->op = BATCH_NO_OP;
+				break;
+
+			case DFVM_SET_ADD_RANGE:
+				g_ptr_array_add(elements, vm_insn->arg1);
+				g_ptr_array_add(elements, vm_insn->arg2);
+				insn->op = BATCH_NO_OP;
+				break;
+
+			case DFVM_SET_ALL_IN:
+			case DFVM_SET_ANY_IN:
+			case DFVM_SET_ALL_NOT_IN:
+			case DFVM_SET_ANY_NOT_IN:
+				ok = translate_membership(batch, insn, vm_insn, reg_column, elements,
+						vm_insn->op == DFVM_SET_ALL_IN || vm_insn->op == DFVM_SET_ALL_NOT_IN,
+						vm_insn->op == DFVM_SET_ALL_NOT_IN || vm_insn->op == DFVM_SET_ANY_NOT_IN);
+				break;
+
+			case DFVM_SET_CLEAR:
+				g_ptr_array_set_size(elements, 0);
+				insn->op = BATCH_NO_OP;
+				break;
+
+			case DFVM_CHECK_EXISTS_R:
+			case DFVM_READ_TREE_R:
+			case DFVM_READ_REFERENCE:
+			case DFVM_READ_REFERENCE_R:
+			case DFVM_PUT_FVALUE:
+			case DFVM_ALL_CONTAINS:
+			case DFVM_ANY_CONTAINS:
+			case DFVM_ALL_MATCHES:
+			case DFVM_ANY_MATCHES:
+			case DFVM_SLICE:
+			case DFVM_LENGTH:
+			case DFVM_BITWISE_AND:
+			case DFVM_UNARY_MINUS:
+			case DFVM_ADD:
+			case DFVM_SUBTRACT:
+			case DFVM_MULTIPLY:
+			case DFVM_DIVIDE:
+			case DFVM_MODULO:
+			case DFVM_CALL_FUNCTION:
+			case DFVM_STACK_PUSH:
+			case DFVM_STACK_POP:
+			case DFVM_NOT_ALL_ZERO:
+			case DFVM_NULL:
+				ok = false;
+				break;
+		}
+	}
+
+	g_ptr_array_free(elements, true);
+	g_free(reg_column);
+	return ok;
+}
+
+dfilter_batch_t *
+dfilter_batch_new(const dfilter_t *df)
+{
+	dfilter_batch_t	*batch;
+
+	if (df == NULL || df->insns->len == 0)
+		return NULL;
+
+	batch = g_new0(dfilter_batch_t, 1);
+	batch->num_insns = df->insns->len;
+	batch->insns = g_new0(batch_insn_t, batch->num_insns);
+	batch->columns = g_array_new(false, false, sizeof(batch_column_info_t));
+
+	if (!translate(batch, df)) {
+		ws_noisy("Filter \"%s\" can't be evaluated in batches", df->expanded_text);
+		dfilter_batch_free(batch);
+		return NULL;
+	}
+	return batch;
+}
+
+void
+dfilter_batch_free(dfilter_batch_t *batch)
+{
+	if (batch == NULL)
+		return;
+	for (unsigned id = 0; id < batch->num_insns; id++)
+		g_free(batch->insns[id].intervals);
+	g_free(batch->insns);
+	g_array_free(batch->columns, true);
+	g_free(batch);
+}
+
+unsigned
+dfilter_batch_num_columns(const dfilter_batch_t *batch)
+{
+	return batch->columns->len;
+}
+
+int
+dfilter_batch_column_field(const dfilter_batch_t *batch, unsigned column,
+				dfilter_batch_kind_t *kind)
+{
+	const batch_column_info_t *col;
+
+	ws_assert(column < batch->columns->len);
+	col = &g_array_index(batch->columns, batch_column_info_t, column);
+	if (kind)
+		*kind = col->kind;
+	return col->field;
+}
+
+void
+dfilter_batch_extract(proto_tree *tree, int field, dfilter_batch_kind_t kind,
+				GArray *offsets, GArray *values)
+{
+	header_field_info	*hfinfo;
+	GPtrArray		*finfos;
+	field_info		*finfo;
+	uint32_t		total;
+	uint64_t		u;
+	int64_t			s;
+	uint32_t		addr;
+
+	ws_assert(offsets->len > 0);
+	total = g_array_index(offsets, uint32_t, offsets->len - 1);
+
+	for (hfinfo = proto_registrar_get_nth(field); hfinfo != NULL; hfinfo = hfinfo->same_name_next) {
+		finfos = proto_get_finfo_ptr_array(tree, hfinfo->id);
+		if (finfos == NULL)
+			continue;
+		for (unsigned i = 0; i < finfos->len; i++) {
+			finfo = g_ptr_array_index(finfos, i);
+			total++;
+			switch (kind) {
+				case DF_BATCH_COLUMN_PRESENCE:
+					break;
+				case DF_BATCH_COLUMN_UNSIGNED:
+					u = 0;
+					fvalue_to_uinteger64(finfo->value, &u);
+					if (hfinfo->type == FT_BOOLEAN)
+						u = (u != 0);
+					g_array_append_val(values, u);
+					break;
+				case DF_BATCH_COLUMN_SIGNED:
+					s = 0;
+					fvalue_to_sinteger64(finfo->value, &s);
+					g_array_append_val(values, s);
+					break;
+				case DF_BATCH_COLUMN_IPV4:
+					addr = fvalue_get_ipv4(finfo->value)->addr;
+					g_array_append_val(values, addr);
+					break;
+			}
+		}
+	}
+	g_array_append_val(offsets, total);
+}
+
+static inline bool
+in_intervals(const batch_interval_t *iv, unsigned count, uint64_t key)
+{
+	unsigned lo = 0, hi = count, mid;
+
+	/* Find the first interval that starts after the key. */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (iv[mid].lo <= key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo > 0 && key <= iv[lo - 1].hi;
+}
+
+static inline uint64_t
+value_key(dfilter_batch_kind_t kind, const void *values, uint32_t idx)
+{
+	switch (kind) {
+		case DF_BATCH_COLUMN_UNSIGNED:
+			return ((const uint64_t *)values)[idx];
+		case DF_BATCH_COLUMN_SIGNED:
+			return (uint64_t)((const int64_t *)values)[idx] ^ SIGN_BIT;
+		case DF_BATCH_COLUMN_IPV4:
+			return ((const uint32_t *)values)[idx];
+		case DF_BATCH_COLUMN_PRESENCE:
+			break;
+	}
+	ws_assert_not_reached();
+}
+
+/* Sets flags[i] to whether value first + i matches the test. */
+static void
+match_values(const batch_insn_t *insn, dfilter_batch_kind_t kind,
+		const void *values, uint32_t first, uint32_t count, uint8_t *flags)
+{
+	uint8_t		complement = insn->complement;
+	uint64_t	lo, span;
+
+	if (insn->num_intervals == 0) {
+		memset(flags, complement, count);
+		return;
+	}
+
+	if (insn->num_intervals > 1) {
+		for (uint32_t i = 0; i < count; i++)
+			flags[i] = in_intervals(insn->intervals, insn->num_intervals,
+					value_key(kind, values, first + i)) ^ complement;
+		return;
+	}
+
+	/* A single interval, which is the common case: one unsigned
+	 * comparison per value, without branches, so that the compiler
+	 * can vectorize the loops. */
+	lo = insn->intervals[0].lo;
+	span = insn->intervals[0].hi - lo;
+	switch (kind) {
+		case DF_BATCH_COLUMN_UNSIGNED: {
+			const uint64_t *v = (const uint64_t *)values + first;
+			for (uint32_t i = 0; i < count; i++)
+				flags[i] = (uint8_t)(v[i] - lo <= span) ^ complement;
+			break;
+		}
+		case DF_BATCH_COLUMN_SIGNED: {
+			const int64_t *v = (const int64_t *)values + first;
+			for (uint32_t i = 0; i < count; i++)
+				flags[i] = (uint8_t)(((uint64_t)v[i] ^ SIGN_BIT) - lo <= span) ^ complement;
+			break;
+		}
+		case DF_BATCH_COLUMN_IPV4: {
+			const uint32_t *v = (const uint32_t *)values + first;
+			for (uint32_t i = 0; i < count; i++)
+				flags[i] = (uint8_t)((uint64_t)v[i] - lo <= span) ^ complement;
+			break;
+		}
+		case DF_BATCH_COLUMN_PRESENCE:
+			ws_assert_not_reached();
+	}
+}
+
+static void
+present_bits(const dfilter_batch_column_t *column, unsigned first,
+		unsigned count, uint64_t *bits)
+{
+	const uint32_t *offsets = column->offsets + first;
+
+	memset(bits, 0, BATCH_CHUNK_WORDS * sizeof(uint64_t));
+	for (unsigned i = 0; i < count; i++)
+		bits[i / 64] |= (uint64_t)(offsets[i + 1] > offsets[i]) << (i % 64);
+}
+
+static void
+test_bits(const dfilter_batch_t *batch, const batch_insn_t *insn,
+		const dfilter_batch_column_t *column, unsigned first,
+		unsigned count, uint64_t *bits, GByteArray *flags)
+{
+	const uint32_t	*offsets = column->offsets + first;
+	uint32_t	base = offsets[0];
+	uint32_t	num_values = offsets[count] - base;
+	dfilter_batch_kind_t kind;
+	uint8_t		r;
+
+	kind = g_array_index(batch->columns, batch_column_info_t, insn->column).kind;
+	g_byte_array_set_size(flags, num_values);
+	match_values(insn, kind, column->values, base, num_values, flags->data);
+
+	memset(bits, 0, BATCH_CHUNK_WORDS * sizeof(uint64_t));
+	for (unsigned i = 0; i < count; i++) {
+		const uint8_t *f = flags->data + (offsets[i] - base);
+		uint32_t n = offsets[i + 1] - offsets[i];
+
+		if (insn->all) {
+			r = 1;
+			for (uint32_t j = 0; j < n; j++)
+				r &= f[j];
+		}
+		else {
+			r = 0;
+			for (uint32_t j = 0; j < n; j++)
+				r |= f[j];
+		}
+		r ^= insn->invert;
+		bits[i / 64] |= (uint64_t)r << (i % 64);
+	}
+}
+
+void
+dfilter_batch_apply(const dfilter_batch_t *batch,
+			const dfilter_batch_column_t *columns,
+			unsigned num_packets, uint64_t *selected)
+{
+	uint64_t	*active, *mask, *next, *target;
+	uint64_t	accum[BATCH_CHUNK_WORDS], result[BATCH_CHUNK_WORDS];
+	GByteArray	*flags;
+	unsigned	first, count, num_words, w;
+	const batch_insn_t *insn;
+	bool		reached;
+
+	memset(selected, 0, ((num_packets + 63) / 64) * sizeof(uint64_t));
+	active = g_new(uint64_t, (size_t)batch->num_insns * BATCH_CHUNK_WORDS);
+	flags = g_byte_array_new();
+
+	for (first = 0; first < num_packets; first += BATCH_CHUNK) {
+		count = MIN(BATCH_CHUNK, num_packets - first);
+		num_words = (count + 63) / 64;
+
+		memset(active, 0, (size_t)batch->num_insns * BATCH_CHUNK_WORDS * sizeof(uint64_t));
+		/* All the packets start at the first instruction, with the
+		 * accumulator set, as in the VM. */
+		for (w = 0; w < num_words; w++)
+			active[w] = UINT64_MAX;
+		if (count % 64)
+			active[num_words - 1] = (UINT64_C(1) << (count % 64)) - 1;
+		memcpy(accum, active, sizeof(accum));
+
+		for (unsigned id = 0; id < batch->num_insns; id++) {
+			insn = &batch->insns[id];
+			mask = &active[id * BATCH_CHUNK_WORDS];
+			next = (id + 1 < batch->num_insns) ? mask + BATCH_CHUNK_WORDS : NULL;
+
+			reached = false;
+			for (w = 0; w < num_words && !reached; w++)
+				reached = mask[w] != 0;
+			if (!reached)
+				continue;
+
+			switch (insn->op) {
+				case BATCH_PRESENT:
+				case BATCH_TEST:
+					if (insn->op == BATCH_PRESENT)
+						present_bits(&columns[insn->column], first, count, result);
+					else
+						test_bits(batch, insn, &columns[insn->column], first, count, result, flags);
+					for (w = 0; w < num_words; w++) {
+						accum[w] = (accum[w] & ~mask[w]) | (result[w] & mask[w]);
+						next[w] |= mask[w];
+					}
+					break;
+
+				case BATCH_NOT:
+					for (w = 0; w < num_words; w++) {
+						accum[w] ^= mask[w];
+						next[w] |= mask[w];
+					}
+					break;
+
+				case BATCH_IF_TRUE_GOTO:
+					target = &active[insn->target * BATCH_CHUNK_WORDS];
+					for (w = 0; w < num_words; w++) {
+						target[w] |= mask[w] & accum[w];
+						next[w] |= mask[w] & ~accum[w];
+					}
+					break;
+
+				case BATCH_IF_FALSE_GOTO:
+					target = &active[insn->target * BATCH_CHUNK_WORDS];
+					for (w = 0; w < num_words; w++) {
+						target[w] |= mask[w] & ~accum[w];
+						next[w] |= mask[w] & accum[w];
+					}
+					break;
+
+				case BATCH_RETURN:
+					for (w = 0; w < num_words; w++)
+						selected[first / 64 + w] |= mask[w] & accum[w];
+					break;
+
+				case BATCH_NO_OP:
+					for (w = 0; w < num_words; w++)
+						next[w] |= mask[w];
+					break;
+			}
+		}
+	}
+
+	g_byte_array_free(flags, true);
+	g_free(active);
+}
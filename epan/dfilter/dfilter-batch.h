@@ -0,0 +1,121 @@
+/** @file
+ *
+ * Evaluate a display filter over a batch of packets, using the values of
+ * the fields it tests extracted into columns
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 2001 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef DFILTER_BATCH_H
+#define DFILTER_BATCH_H
+
+#include <wireshark.h>
+
+#include <epan/proto.h>
+#include "dfilter.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * A filter that only tests whether fields exist and compares integer,
+ * boolean and IPv4 fields with constants (including set membership and
+ * ranges), combined with "and", "or" and "not", can be evaluated over many
+ * packets at once: each test runs over the values of a field for the whole
+ * batch, without dissecting the packets again or going through the VM
+ * packet by packet.
+ */
+typedef struct dfilter_batch dfilter_batch_t;
+
+/** How the values of a field are stored in its column. */
+typedef enum {
+	DF_BATCH_COLUMN_PRESENCE,	/**< No values; only the number of occurrences */
+	DF_BATCH_COLUMN_UNSIGNED,	/**< uint64_t; booleans are 0 or 1 */
+	DF_BATCH_COLUMN_SIGNED,		/**< int64_t */
+	DF_BATCH_COLUMN_IPV4,		/**< uint32_t, in host byte order */
+} dfilter_batch_kind_t;
+
+/** The values of a field in a batch of packets. */
+typedef struct {
+	/** num_packets + 1 entries; packet i has offsets[i + 1] - offsets[i]
+	 *  occurrences of the field, whose values (unless the column is a
+	 *  presence column) are values[offsets[i]] to values[offsets[i + 1] - 1]. */
+	const uint32_t	*offsets;
+	/** uint64_t, int64_t or uint32_t array, according to the kind of
+	 *  the column; NULL for a presence column. */
+	const void	*values;
+} dfilter_batch_column_t;
+
+/**
+ * Prepare a compiled filter for batch evaluation.
+ *
+ * @param df The filter. It isn't referenced by the result.
+ * @return NULL if the filter can't be evaluated in batches.
+ */
+WS_DLL_PUBLIC
+dfilter_batch_t *
+dfilter_batch_new(const dfilter_t *df);
+
+WS_DLL_PUBLIC
+void
+dfilter_batch_free(dfilter_batch_t *batch);
+
+/** Number of columns the filter needs. */
+WS_DLL_PUBLIC
+unsigned
+dfilter_batch_num_columns(const dfilter_batch_t *batch);
+
+/**
+ * Get the field of a column, and how its values must be stored.
+ *
+ * The column holds the values of every field with the same name as the
+ * one returned.
+ */
+WS_DLL_PUBLIC
+int
+dfilter_batch_column_field(const dfilter_batch_t *batch, unsigned column,
+				dfilter_batch_kind_t *kind);
+
+/**
+ * Append the values of a field in a tree to a column being built.
+ *
+ * The tree must have been primed with a filter interested in the field.
+ *
+ * @param tree The tree of a packet.
+ * @param field The field, as returned by dfilter_batch_column_field().
+ * @param kind The kind of the column.
+ * @param offsets Array of uint32_t, initially holding a single 0.
+ * @param values Array of the element type of the kind, unused for
+ * a presence column.
+ */
+WS_DLL_PUBLIC
+void
+dfilter_batch_extract(proto_tree *tree, int field, dfilter_batch_kind_t kind,
+				GArray *offsets, GArray *values);
+
+/**
+ * Evaluate the filter over a batch of packets.
+ *
+ * @param batch The prepared filter.
+ * @param columns One column per dfilter_batch_num_columns().
+ * @param num_packets The number of packets in the batch.
+ * @param selected Set to a bitmap of the packets that match the filter,
+ * packet i being bit (i % 64) of selected[i / 64]. Must have room for
+ * (num_packets + 63) / 64 words.
+ */
+WS_DLL_PUBLIC
+void
+dfilter_batch_apply(const dfilter_batch_t *batch,
+			const dfilter_batch_column_t *columns,
+			unsigned num_packets, uint64_t *selected);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* DFILTER_BATCH_H */
@@ -34,6 +34,7 @@ typedef struct {
 /* Passed back to user */
 struct epan_dfilter {
 	GPtrArray	*insns;
+	unsigned	num_insns_unoptimized;
 	unsigned	num_registers;
 	df_cell_t	*registers;
 	int		*interesting_fields;
@@ -47,6 +48,8 @@ struct epan_dfilter {
 	/* Used to pass arguments to functions. List of Lists (list of registers). */
 	GSList		*function_stack;
 	GSList		*set_stack;
+	/* Field reads shared with the other filters of a group, if any. */
+	GHashTable	*shared_reads;
 	ftenum_t	 ret_type;
 };
 
@@ -79,6 +82,7 @@ typedef struct {
 	stnode_t	*st_root;
 	unsigned	field_count;
 	GPtrArray	*insns;
+	unsigned	num_insns_unoptimized; /* Not counting no-ops. */
 	GHashTable	*loaded_fields;
 	GHashTable	*loaded_raw_fields;
 	GHashTable	*loaded_vs_fields;
@@ -14,6 +14,7 @@
 
 #include "dfilter-int.h"
 #include "syntax-tree.h"
+#include "sttype-op.h"
 #include "gencode.h"
 #include "semcheck.h"
 #include "dfvm.h"
@@ -495,6 +496,7 @@ dfwork_build(dfwork_t *dfw)
 	dfilter = dfilter_new(dfw->deprecated);
 	dfilter->insns = dfw->insns;
 	dfw->insns = NULL;
+	dfilter->num_insns_unoptimized = dfw->num_insns_unoptimized;
 	dfilter->interesting_fields = dfw_interesting_fields(dfw,
 		&dfilter->num_interesting_fields);
 	dfilter->expanded_text = dfw->expanded_text;
@@ -689,6 +691,53 @@ struct stnode *dfilter_get_syntax_tree(const char *text)
 	return st_root;
 }
 
+static void
+add_and_subexpressions(stnode_t *node, const char *text, GPtrArray *subexprs)
+{
+	stnode_op_t op;
+	stnode_t *operands[2];
+	df_loc_t loc;
+
+	if (stnode_type_id(node) != STTYPE_TEST)
+		return;
+	sttype_oper_get(node, &op, &operands[0], &operands[1]);
+	if (op != STNODE_OP_AND)
+		return;
+
+	for (int i = 0; i < 2; i++) {
+		loc = stnode_location(operands[i]);
+		if (loc.col_start >= 0) {
+			g_ptr_array_add(subexprs, g_strndup(text + loc.col_start, loc.col_len));
+		}
+		add_and_subexpressions(operands[i], text, subexprs);
+	}
+}
+
+GPtrArray *
+dfilter_and_subexpressions(const char *text)
+{
+	char *expanded_text;
+	stnode_t *st_root;
+	GPtrArray *subexprs;
+
+	expanded_text = dfilter_macro_apply(text, NULL);
+	if (!expanded_text)
+		return NULL;
+
+	st_root = dfilter_get_syntax_tree(expanded_text);
+	if (!st_root) {
+		g_free(expanded_text);
+		return NULL;
+	}
+
+	subexprs = g_ptr_array_new_with_free_func(g_free);
+	add_and_subexpressions(st_root, expanded_text, subexprs);
+
+	stnode_free(st_root);
+	g_free(expanded_text);
+	return subexprs;
+}
+
 bool
 dfilter_apply(dfilter_t *df, proto_tree *tree)
 {
@@ -717,6 +766,118 @@ dfilter_prime_proto_tree(const dfilter_t *df, proto_tree *tree)
 	}
 }
 
+/* Results of the filters of a group on the current packet. */
+enum {
+	GROUP_UNKNOWN,
+	GROUP_FALSE,
+	GROUP_TRUE,
+};
+
+struct dfilter_group {
+	GPtrArray	*filters;	/* Distinct dfilter_t *, NULL included */
+	GArray		*slots;		/* unsigned: index in filters, per filter added */
+	uint8_t		*results;	/* Per distinct filter */
+	GHashTable	*shared_reads;	/* header_field_info * -> GPtrArray * */
+};
+
+dfilter_group_t *
+dfilter_group_new(void)
+{
+	dfilter_group_t *group = g_new0(dfilter_group_t, 1);
+
+	group->filters = g_ptr_array_new();
+	group->slots = g_array_new(false, false, sizeof(unsigned));
+	group->shared_reads = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+					NULL, (GDestroyNotify)g_ptr_array_unref);
+	return group;
+}
+
+void
+dfilter_group_free(dfilter_group_t *group)
+{
+	if (group == NULL)
+		return;
+	g_ptr_array_free(group->filters, true);
+	g_array_free(group->slots, true);
+	g_free(group->results);
+	g_hash_table_destroy(group->shared_reads);
+	g_free(group);
+}
+
+unsigned
+dfilter_group_add(dfilter_group_t *group, dfilter_t *df)
+{
+	unsigned	slot;
+	dfilter_t	*other;
+
+	/* Evaluate identical filters only once. Filters with references
+	 * to fields of another packet may have loaded different values. */
+	for (slot = 0; slot < group->filters->len; slot++) {
+		other = g_ptr_array_index(group->filters, slot);
+		if (other == df)
+			break;
+		if (other && df && g_strcmp0(other->expanded_text, df->expanded_text) == 0 &&
+				g_hash_table_size(other->references) == 0 &&
+				g_hash_table_size(other->raw_references) == 0)
+			break;
+	}
+	if (slot == group->filters->len) {
+		g_ptr_array_add(group->filters, df);
+		group->results = g_realloc(group->results, group->filters->len);
+		group->results[slot] = GROUP_UNKNOWN;
+	}
+	g_array_append_val(group->slots, slot);
+	return group->slots->len - 1;
+}
+
+bool
+dfilter_group_test_edt(dfilter_group_t *group, unsigned idx, epan_dissect_t *edt)
+{
+	unsigned	slot;
+	dfilter_t	*df;
+	bool		passed;
+
+	ws_assert(idx < group->slots->len);
+	slot = g_array_index(group->slots, unsigned, idx);
+	if (group->results[slot] != GROUP_UNKNOWN)
+		return group->results[slot] == GROUP_TRUE;
+
+	df = g_ptr_array_index(group->filters, slot);
+	if (df == NULL) {
+		passed = true;
+	}
+	else {
+		df->shared_reads = group->shared_reads;
+		passed = dfvm_apply(df, edt->tree);
+		df->shared_reads = NULL;
+	}
+	group->results[slot] = passed ? GROUP_TRUE : GROUP_FALSE;
+	return passed;
+}
+
+void
+dfilter_group_reset(dfilter_group_t *group)
+{
+	g_hash_table_remove_all(group->shared_reads);
+	if (group->filters->len > 0)
+		memset(group->results, GROUP_UNKNOWN, group->filters->len);
+}
+
+int
+dfilter_group_apply_first_edt(dfilter_group_t *group, epan_dissect_t *edt)
+{
+	int first = -1;
+
+	for (unsigned idx = 0; idx < group->slots->len; idx++) {
+		if (dfilter_group_test_edt(group, idx, edt)) {
+			first = idx;
+			break;
+		}
+	}
+	dfilter_group_reset(group);
+	return first;
+}
+
 void
 dfilter_prime_proto_tree_print(const dfilter_t *df, proto_tree *tree)
 {
@@ -823,6 +984,22 @@ dfilter_get_return_type(dfilter_t *df)
 	return df->ret_type;
 }
 
+unsigned
+dfilter_get_insn_count(dfilter_t *df, unsigned *unoptimized)
+{
+	unsigned	count = 0;
+	dfvm_insn_t	*insn;
+
+	for (unsigned id = 0; id < df->insns->len; id++) {
+		insn = g_ptr_array_index(df->insns, id);
+		if (insn->op != DFVM_NO_OP)
+			count++;
+	}
+	if (unoptimized)
+		*unoptimized = df->num_insns_unoptimized;
+	return count;
+}
+
 void
 dfilter_log_full(const char *domain, enum ws_log_level level,
 			const char *file, long line, const char *func,
@@ -76,6 +76,9 @@ dfilter_expand(const char *expr, df_error_t **err_ret);
 /* If the root of the syntax tree is a field, load and return the field values.
  * By default the field is only checked for existence. */
 #define DF_RETURN_VALUES        (1U << 5)
+/* Allow the values of a set to be read from a file with @"path". Only
+ * set it for filters typed by the user running the program. */
+#define DF_SET_FILES		(1U << 6)
 
 /* Compiles a string to a dfilter_t.
  * On success, sets the dfilter* pointed to by dfp
@@ -111,6 +114,20 @@ struct stnode;
 WS_DLL_PUBLIC
 struct stnode *dfilter_get_syntax_tree(const char *text);
 
+/** Get the sub-expressions joined by the "and" operators at the top of a
+ * filter's syntax tree.
+ *
+ * For "a && (b && c)" these are "a", "(b && c)", "b" and "c". A packet
+ * that matches the filter matches each of them, so the packets matching
+ * any one of them are a superset of the packets matching the filter.
+ *
+ * @param text A display filter.
+ * @return An array of strings, which must be freed with g_ptr_array_unref(),
+ *         or NULL if the filter is invalid.
+ */
+WS_DLL_PUBLIC
+GPtrArray *dfilter_and_subexpressions(const char *text);
+
 /* Frees all memory used by dfilter, and frees
  * the dfilter itself. */
 WS_DLL_PUBLIC
@@ -135,6 +152,46 @@ dfilter_apply_full(dfilter_t *df, proto_tree *tree, GPtrArray **fvals);
 void
 dfilter_prime_proto_tree(const dfilter_t *df, proto_tree *tree);
 
+/*
+ * A group of filters evaluated on the same packets, such as the coloring
+ * rules or the tap filters. The filters of a group share the fields they
+ * read from the tree, and identical filters are evaluated once. The
+ * group doesn't own the filters, which must outlive it.
+ */
+typedef struct dfilter_group dfilter_group_t;
+
+WS_DLL_PUBLIC
+dfilter_group_t *
+dfilter_group_new(void);
+
+WS_DLL_PUBLIC
+void
+dfilter_group_free(dfilter_group_t *group);
+
+/* Add a filter to a group and return its index. A NULL filter matches
+ * every packet. */
+WS_DLL_PUBLIC
+unsigned
+dfilter_group_add(dfilter_group_t *group, dfilter_t *df);
+
+/* Evaluate the filters of the group in order on a packet, up to the first
+ * one that matches, and return its index, or -1 if none does. */
+WS_DLL_PUBLIC
+int
+dfilter_group_apply_first_edt(dfilter_group_t *group, struct epan_dissect *edt);
+
+/* Evaluate one filter of the group on a packet, remembering the fields
+ * read and the result until dfilter_group_reset() is called, which must
+ * be done before the tree is freed. */
+WS_DLL_PUBLIC
+bool
+dfilter_group_test_edt(dfilter_group_t *group, unsigned idx,
+				struct epan_dissect *edt);
+
+WS_DLL_PUBLIC
+void
+dfilter_group_reset(dfilter_group_t *group);
+
 /* Prime a proto_tree using the fields/protocols used in a dfilter, marked for print. */
 void
 dfilter_prime_proto_tree_print(const dfilter_t *df, proto_tree *tree);
@@ -206,6 +263,12 @@ WS_DLL_PUBLIC
 ftenum_t
 dfilter_get_return_type(dfilter_t *df);
 
+/* Number of bytecode instructions, not counting no-ops. If unoptimized
+ * is not NULL it is set to the number before optimization. */
+WS_DLL_PUBLIC
+unsigned
+dfilter_get_insn_count(dfilter_t *df, unsigned *unoptimized);
+
 /* Print bytecode of dfilter to log */
 WS_DLL_PUBLIC
 void
@@ -0,0 +1,389 @@
+/*
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 2001 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+#define WS_LOG_DOMAIN LOG_DOMAIN_DFILTER
+
+#include "dfset.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <wsutil/pint.h>
+#include <wsutil/ws_assert.h>
+
+/*
+ * The elements of a set that have the same kind of value as the first one
+ * are indexed: integers, booleans and addresses as a sorted array of
+ * disjoint intervals (an IPv4 or IPv6 subnet being the interval of its
+ * addresses), searched in O(log n); strings and byte strings in a hash
+ * table. The other elements, and any value of a different kind than the
+ * indexed ones, are compared one by one, as the VM does without an index.
+ */
+
+typedef enum {
+	KEY_NONE,
+	KEY_UNSIGNED,
+	KEY_SIGNED,
+	KEY_BOOLEAN,
+	KEY_IPV4,
+	KEY_IPV6,
+	KEY_HASH,
+} set_key_t;
+
+/* A 128-bit key, so that all the ordered kinds share the same intervals. */
+typedef struct {
+	uint64_t	hi;
+	uint64_t	lo;
+} set_key128_t;
+
+typedef struct {
+	set_key128_t	lo;
+	set_key128_t	hi;
+} set_interval_t;
+
+struct df_set {
+	GPtrArray	*elements;	/* Pairs of low and high (or NULL) values */
+	set_key_t	key;
+	ftenum_t	ftype;		/* Of the indexed elements */
+	set_interval_t	*intervals;
+	unsigned	num_intervals;
+	GHashTable	*table;		/* fvalue_t * for KEY_HASH */
+	GPtrArray	*rest;		/* Pairs that aren't indexed */
+};
+
+static set_key_t
+key_kind(ftenum_t ftype)
+{
+	if (FT_IS_UINT(ftype))
+		return KEY_UNSIGNED;
+	if (FT_IS_INT(ftype))
+		return KEY_SIGNED;
+	if (ftype == FT_BOOLEAN)
+		return KEY_BOOLEAN;
+	if (ftype == FT_IPv4)
+		return KEY_IPV4;
+	if (ftype == FT_IPv6)
+		return KEY_IPV6;
+	if (FT_IS_STRING(ftype) || ftype == FT_BYTES || ftype == FT_UINT_BYTES || ftype == FT_ETHER)
+		return KEY_HASH;
+	return KEY_NONE;
+}
+
+static int
+key_cmp(const set_key128_t *a, const set_key128_t *b)
+{
+	if (a->hi != b->hi)
+		return a->hi < b->hi ? -1 : 1;
+	if (a->lo != b->lo)
+		return a->lo < b->lo ? -1 : 1;
+	return 0;
+}
+
+/* Gets the interval of the values that compare equal to a value.
+ * Returns false if it can't be represented. */
+static bool
+key_interval(set_key_t key, fvalue_t *fv, set_interval_t *iv)
+{
+	uint64_t	u;
+	int64_t		s;
+	const ipv4_addr_and_mask *ipv4;
+	const ipv6_addr_and_prefix *ipv6;
+	uint64_t	net[2], host[2];
+
+	memset(iv, 0, sizeof(*iv));
+	switch (key) {
+		case KEY_UNSIGNED:
+			if (fvalue_to_uinteger64(fv, &u) != FT_OK)
+				return false;
+			iv->lo.lo = iv->hi.lo = u;
+			return true;
+
+		case KEY_BOOLEAN:
+			if (fvalue_to_uinteger64(fv, &u) != FT_OK)
+				return false;
+			iv->lo.lo = iv->hi.lo = (u != 0);
+			return true;
+
+		case KEY_SIGNED:
+			if (fvalue_to_sinteger64(fv, &s) != FT_OK)
+				return false;
+			/* Flip the sign bit so that they sort as unsigned. */
+			iv->lo.lo = iv->hi.lo = (uint64_t)s ^ (UINT64_C(1) << 63);
+			return true;
+
+		case KEY_IPV4:
+			ipv4 = fvalue_get_ipv4(fv);
+			iv->lo.lo = ipv4->addr & ipv4->nmask;
+			iv->hi.lo = iv->lo.lo | (~ipv4->nmask & UINT32_MAX);
+			return true;
+
+		case KEY_IPV6:
+			ipv6 = fvalue_get_ipv6(fv);
+			net[0] = pntoh64(&ipv6->addr.bytes[0]);
+			net[1] = pntoh64(&ipv6->addr.bytes[8]);
+			if (ipv6->prefix >= 128) {
+				host[0] = host[1] = 0;
+			}
+			else if (ipv6->prefix >= 64) {
+				host[0] = 0;
+				host[1] = UINT64_MAX >> (ipv6->prefix - 64);
+			}
+			else {
+				host[0] = ipv6->prefix == 0 ? UINT64_MAX : UINT64_MAX >> ipv6->prefix;
+				host[1] = UINT64_MAX;
+			}
+			iv->lo.hi = net[0] & ~host[0];
+			iv->lo.lo = net[1] & ~host[1];
+			iv->hi.hi = net[0] | host[0];
+			iv->hi.lo = net[1] | host[1];
+			return true;
+
+		case KEY_HASH:
+		case KEY_NONE:
+			break;
+	}
+	return false;
+}
+
+/* Whether a value compares equal to a single key, so that it can be
+ * looked up. */
+static bool
+is_single_value(set_key_t key, fvalue_t *fv)
+{
+	switch (key) {
+		case KEY_IPV4:
+			return fvalue_get_ipv4(fv)->nmask == UINT32_MAX;
+		case KEY_IPV6:
+			return fvalue_get_ipv6(fv)->prefix >= 128;
+		case KEY_UNSIGNED:
+		case KEY_SIGNED:
+		case KEY_BOOLEAN:
+		case KEY_HASH:
+			return true;
+		case KEY_NONE:
+			break;
+	}
+	return false;
+}
+
+static int
+compare_intervals(const void *_a, const void *_b)
+{
+	const set_interval_t *a = _a;
+	const set_interval_t *b = _b;
+
+	return key_cmp(&a->lo, &b->lo);
+}
+
+static unsigned
+set_hash(const void *v)
+{
+	return fvalue_hash(v);
+}
+
+static gboolean
+set_equal(const void *a, const void *b)
+{
+	return fvalue_equal(a, b);
+}
+
+static bool
+key_adjacent(const set_key128_t *a, const set_key128_t *b)
+{
+	/* Is b the successor of a? */
+	if (a->lo == UINT64_MAX)
+		return b->lo == 0 && b->hi == a->hi + 1;
+	return b->hi == a->hi && b->lo == a->lo + 1;
+}
+
+df_set_t *
+df_set_new(void)
+{
+	df_set_t *set = g_new0(df_set_t, 1);
+
+	set->elements = g_ptr_array_new();
+	set->rest = g_ptr_array_new();
+	return set;
+}
+
+void
+df_set_free(df_set_t *set)
+{
+	if (set == NULL)
+		return;
+	if (set->table)
+		g_hash_table_destroy(set->table);
+	g_free(set->intervals);
+	g_ptr_array_free(set->rest, true);
+	for (unsigned i = 0; i < set->elements->len; i++) {
+		if (set->elements->pdata[i])
+			fvalue_free(set->elements->pdata[i]);
+	}
+	g_ptr_array_free(set->elements, true);
+	g_free(set);
+}
+
+void
+df_set_add(df_set_t *set, fvalue_t *low, fvalue_t *high)
+{
+	g_ptr_array_add(set->elements, low);
+	g_ptr_array_add(set->elements, high);
+}
+
+void
+df_set_build(df_set_t *set)
+{
+	GArray		*intervals;
+	set_interval_t	iv, hiv, *ivs;
+	fvalue_t	*low, *high;
+	unsigned	n;
+
+	ws_assert(set->intervals == NULL && set->table == NULL);
+	if (set->elements->len == 0)
+		return;
+
+	set->ftype = fvalue_type_ftenum(g_ptr_array_index(set->elements, 0));
+	set->key = key_kind(set->ftype);
+	if (set->key == KEY_HASH)
+		set->table = g_hash_table_new(set_hash, set_equal);
+	intervals = g_array_new(false, false, sizeof(set_interval_t));
+
+	for (unsigned i = 0; i < set->elements->len; i += 2) {
+		low = g_ptr_array_index(set->elements, i);
+		high = g_ptr_array_index(set->elements, i + 1);
+
+		if (set->key == KEY_HASH && high == NULL && fvalue_type_ftenum(low) == set->ftype) {
+			g_hash_table_add(set->table, low);
+			continue;
+		}
+		if (set->key != KEY_HASH && set->key != KEY_NONE &&
+				key_kind(fvalue_type_ftenum(low)) == set->key &&
+				key_interval(set->key, low, &iv)) {
+			if (high == NULL) {
+				g_array_append_val(intervals, iv);
+				continue;
+			}
+			if (key_kind(fvalue_type_ftenum(high)) == set->key &&
+					key_interval(set->key, high, &hiv)) {
+				/* An empty range matches nothing. */
+				if (key_cmp(&iv.lo, &hiv.hi) <= 0) {
+					iv.hi = hiv.hi;
+					g_array_append_val(intervals, iv);
+				}
+				continue;
+			}
+		}
+		g_ptr_array_add(set->rest, low);
+		g_ptr_array_add(set->rest, high);
+	}
+
+	/* Sort the intervals and merge those that overlap or touch. */
+	if (intervals->len > 0) {
+		g_array_sort(intervals, compare_intervals);
+		ivs = (set_interval_t *)(void *)intervals->data;
+		n = 0;
+		for (unsigned i = 1; i < intervals->len; i++) {
+			if (key_cmp(&ivs[i].lo, &ivs[n].hi) <= 0 ||
+					key_adjacent(&ivs[n].hi, &ivs[i].lo)) {
+				if (key_cmp(&ivs[i].hi, &ivs[n].hi) > 0)
+					ivs[n].hi = ivs[i].hi;
+			}
+			else {
+				ivs[++n] = ivs[i];
+			}
+		}
+		set->num_intervals = n + 1;
+		set->intervals = g_memdup2(ivs, set->num_intervals * sizeof(set_interval_t));
+	}
+	g_array_free(intervals, true);
+}
+
+static bool
+test_pair(fvalue_t *fv, fvalue_t *low, fvalue_t *high)
+{
+	if (high == NULL)
+		return fvalue_eq(fv, low) == FT_TRUE;
+	return fvalue_ge(fv, low) == FT_TRUE && fvalue_le(fv, high) == FT_TRUE;
+}
+
+static bool
+test_pairs(fvalue_t *fv, GPtrArray *pairs)
+{
+	for (unsigned i = 0; i < pairs->len; i += 2) {
+		if (test_pair(fv, g_ptr_array_index(pairs, i), g_ptr_array_index(pairs, i + 1)))
+			return true;
+	}
+	return false;
+}
+
+static bool
+lookup_intervals(const df_set_t *set, const set_key128_t *key)
+{
+	unsigned lo = 0, hi = set->num_intervals, mid;
+
+	/* Find the first interval that starts after the key. */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (key_cmp(&set->intervals[mid].lo, key) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo > 0 && key_cmp(key, &set->intervals[lo - 1].hi) <= 0;
+}
+
+bool
+df_set_contains(const df_set_t *set, fvalue_t *fv)
+{
+	ftenum_t	ftype = fvalue_type_ftenum(fv);
+	set_interval_t	iv;
+
+	if (set->key == KEY_HASH && ftype == set->ftype) {
+		if (g_hash_table_contains(set->table, fv))
+			return true;
+	}
+	else if (set->key != KEY_HASH && set->key != KEY_NONE &&
+			key_kind(ftype) == set->key && is_single_value(set->key, fv) &&
+			key_interval(set->key, fv, &iv)) {
+		if (lookup_intervals(set, &iv.lo))
+			return true;
+	}
+	else {
+		/* Not comparable with the index. */
+		return test_pairs(fv, set->elements);
+	}
+	return test_pairs(fv, set->rest);
+}
+
+unsigned
+df_set_size(const df_set_t *set)
+{
+	return set->elements->len / 2;
+}
+
+void
+df_set_get(const df_set_t *set, unsigned idx, fvalue_t **low, fvalue_t **high)
+{
+	ws_assert(idx < df_set_size(set));
+	*low = g_ptr_array_index(set->elements, idx * 2);
+	*high = g_ptr_array_index(set->elements, idx * 2 + 1);
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: t
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 noexpandtab:
+ * :indentSize=8:tabSize=8:noTabs=false:
+ */
@@ -0,0 +1,51 @@
+/** @file
+ *
+ * Constant sets of values for the "in" operator, indexed at compile time
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 2001 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef DFSET_H
+#define DFSET_H
+
+#include <wireshark.h>
+#include <epan/ftypes/ftypes.h>
+
+/* Sets with fewer elements than this are tested element by element. */
+#define DF_SET_INDEX_MIN	16
+
+typedef struct df_set df_set_t;
+
+df_set_t *
+df_set_new(void);
+
+void
+df_set_free(df_set_t *set);
+
+/* Adds an element, or a range of elements if high isn't NULL. The set
+ * takes ownership of the values. */
+void
+df_set_add(df_set_t *set, fvalue_t *low, fvalue_t *high);
+
+/* Builds the index. Call it once all the elements have been added. */
+void
+df_set_build(df_set_t *set);
+
+/* Tests whether a value is equal to an element of the set or within one
+ * of its ranges, like fvalue_eq(), fvalue_ge() and fvalue_le() would. */
+bool
+df_set_contains(const df_set_t *set, fvalue_t *fv);
+
+/* Number of elements and ranges. */
+unsigned
+df_set_size(const df_set_t *set);
+
+/* Gets an element; *high is NULL unless it is a range. */
+void
+df_set_get(const df_set_t *set, unsigned idx, fvalue_t **low, fvalue_t **high);
+
+#endif /* DFSET_H */
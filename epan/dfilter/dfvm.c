@@ -89,6 +89,9 @@ dfvm_value_free(dfvm_value_t *v)
 		case PCRE:
 			ws_regex_free(v->value.pcre);
 			break;
+		case FVALUE_SET:
+			df_set_free(v->value.set);
+			break;
 		case EMPTY:
 		case HFINFO:
 		case RAW_HFINFO:
@@ -235,6 +238,14 @@ dfvm_value_new_pcre(ws_regex_t *re)
 	return v;
 }
 
+dfvm_value_t*
+dfvm_value_new_set(df_set_t *set)
+{
+	dfvm_value_t *v = dfvm_value_new(FVALUE_SET);
+	v->value.set = set;
+	return v;
+}
+
 dfvm_value_t*
 dfvm_value_new_uint(unsigned num)
 {
@@ -270,6 +281,9 @@ dfvm_value_tostr(dfvm_value_t *v)
 		case PCRE:
 			s = ws_strdup(ws_regex_pattern(v->value.pcre));
 			break;
+		case FVALUE_SET:
+			s = ws_strdup_printf("{%u values}", df_set_size(v->value.set));
+			break;
 		case REGISTER:
 			s = ws_strdup_printf("R%"PRIu32, v->value.numeric);
 			break;
@@ -554,6 +568,9 @@ append_op_args(wmem_strbuf_t *buf, dfvm_insn_t *insn, GSList **stack_print,
 		case DFVM_SET_ANY_NOT_IN:
 			wmem_strbuf_append_printf(buf, "%s%s",
 						arg1_str, arg1_str_type);
+			if (arg2_str) {
+				wmem_strbuf_append_printf(buf, " in %s", arg2_str);
+			}
 			break;
 
 		case DFVM_SET_ADD:
@@ -945,6 +962,15 @@ read_tree(dfilter_t *df, proto_tree *tree,
 		return !df_cell_is_empty(rp);
 	}
 
+	/* Already loaded by another filter of the group? */
+	if (df->shared_reads && !raw && !val_str && !range) {
+		GPtrArray *shared = g_hash_table_lookup(df->shared_reads, hfinfo);
+		if (shared) {
+			rp->array = g_ptr_array_ref(shared);
+			return !df_cell_is_empty(rp);
+		}
+	}
+
 	if (raw || val_str) {
 		df_cell_init(rp, true);
 	}
@@ -958,6 +984,10 @@ read_tree(dfilter_t *df, proto_tree *tree,
 		hfinfo = hfinfo->same_name_next;
 	}
 
+	if (df->shared_reads && !raw && !val_str && !range) {
+		g_hash_table_insert(df->shared_reads, arg1->value.hfinfo, df_cell_ref(rp));
+	}
+
 	return !df_cell_is_empty(rp);
 }
 
@@ -1215,29 +1245,36 @@ test_in_internal(fvalue_t *fv, GPtrArray *range[2])
 	return low_ok;
 }
 
+/* Tests a value against the constant set in arg2, if any, and the
+ * elements pushed on the set stack. */
 static bool
-any_in(dfilter_t *df, dfvm_value_t *arg1)
+test_in(dfilter_t *df, fvalue_t *fv, dfvm_value_t *arg2)
+{
+	GSList *stack;
+
+	if (arg2 && df_set_contains(arg2->value.set, fv)) {
+		return true;
+	}
+	for (stack = df->set_stack; stack; stack = stack->next) {
+		if (test_in_internal(fv, stack->data)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool
+any_in(dfilter_t *df, dfvm_value_t *arg1, dfvm_value_t *arg2)
 {
 	df_cell_t *rp = &df->registers[arg1->value.numeric];
 	GPtrArray *value;
-	GSList *stack;
-	bool ok;
 
 	/* If the read failed we jump over the membership test. */
 	ws_assert(!df_cell_is_empty(rp));
 	value = df_cell_ptr(rp);
 
 	for (size_t i = 0; i < value->len; i++) {
-		stack = df->set_stack;
-		ok = false;
-		while (stack) {
-			if (test_in_internal(value->pdata[i], stack->data)) {
-				ok = true;
-				break;
-			}
-			stack = stack->next;
-		}
-		if (ok) {
+		if (test_in(df, value->pdata[i], arg2)) {
 			return true;
 		}
 	}
@@ -1245,28 +1282,17 @@ any_in(dfilter_t *df, dfvm_value_t *arg1)
 }
 
 static bool
-all_in(dfilter_t *df, dfvm_value_t *arg1)
+all_in(dfilter_t *df, dfvm_value_t *arg1, dfvm_value_t *arg2)
 {
 	df_cell_t *rp = &df->registers[arg1->value.numeric];
 	GPtrArray *value;
-	GSList *stack;
-	bool ok;
 
 	/* If the read failed we jump over the membership test. */
 	ws_assert(!df_cell_is_empty(rp));
 	value = df_cell_ptr(rp);
 
 	for (size_t i = 0; i < value->len; i++) {
-		stack = df->set_stack;
-		ok = false;
-		while (stack) {
-			if (test_in_internal(value->pdata[i], stack->data)) {
-				ok = true;
-				break;
-			}
-			stack = stack->next;
-		}
-		if (!ok) {
+		if (!test_in(df, value->pdata[i], arg2)) {
 			return false;
 		}
 	}
@@ -1775,19 +1801,19 @@ dfvm_apply_full(dfilter_t *df, proto_tree *tree, GPtrArray **fvals)
 				break;
 
 			case DFVM_SET_ALL_IN:
-				accum = all_in(df, arg1);
+				accum = all_in(df, arg1, arg2);
 				break;
 
 			case DFVM_SET_ANY_IN:
-				accum = any_in(df, arg1);
+				accum = any_in(df, arg1, arg2);
 				break;
 
 			case DFVM_SET_ALL_NOT_IN:
-				accum = !all_in(df, arg1);
+				accum = !all_in(df, arg1, arg2);
 				break;
 
 			case DFVM_SET_ANY_NOT_IN:
-				accum = !any_in(df, arg1);
+				accum = !any_in(df, arg1, arg2);
 				break;
 
 			case DFVM_SET_CLEAR:
@@ -19,6 +19,8 @@
 #include "ftypes/ftypes.h"
 #include <wsutil/ws_assert.h>
 
+#include <string.h>
+
 static void
 fixup_jumps(void *data, void *user_data);
 
@@ -444,8 +446,39 @@ fixup_jumps(void *data, void *user_data)
 	}
 }
 
+/* Builds an index of a large set of constants. Returns NULL if the set
+ * is small or has elements that must be evaluated. */
+static df_set_t *
+gen_constant_set(GSList *nodelist)
+{
+	df_set_t	*set;
+	stnode_t	*node1, *node2;
+	unsigned	count = 0;
+
+	for (GSList *l = nodelist; l; l = g_slist_next(l)) {
+		if (l->data && stnode_type_id(l->data) != STTYPE_FVALUE)
+			return NULL;
+		count++;
+	}
+	if (count / 2 < DF_SET_INDEX_MIN)
+		return NULL;
+
+	set = df_set_new();
+	while (nodelist) {
+		node1 = nodelist->data;
+		nodelist = g_slist_next(nodelist);
+		node2 = nodelist->data;
+		nodelist = g_slist_next(nodelist);
+		df_set_add(set, stnode_steal_data(node1), node2 ? stnode_steal_data(node2) : NULL);
+	}
+	df_set_build(set);
+	return set;
+}
+
 /* Generate the code for the in operator. Pushes set values into a stack
- * and then evaluates membership in a single instruction. */
+ * and then evaluates membership in a single instruction. Large sets of
+ * constants are indexed at compile time instead and passed to the
+ * instruction directly. */
 static void
 gen_relation_in(dfwork_t *dfw, dfvm_opcode_t op, stmatch_t how,
 				stnode_t *st_arg1, stnode_t *st_arg2)
@@ -456,12 +489,27 @@ gen_relation_in(dfwork_t *dfw, dfvm_opcode_t op, stmatch_t how,
 	dfvm_value_t	*val1, *val2, *val3;
 	stnode_t	*node1, *node2;
 	GSList		*nodelist_head, *nodelist;
+	df_set_t	*set;
 
 	/* Create code for the LHS of the relation */
 	val1 = gen_entity(dfw, st_arg1, &jumps);
 
+	nodelist_head = stnode_steal_data(st_arg2);
+	set = gen_constant_set(nodelist_head);
+	if (set) {
+		insn = dfvm_insn_new(select_opcode(op, how));
+		insn->arg1 = dfvm_value_ref(val1);
+		insn->arg2 = dfvm_value_ref(dfvm_value_new_set(set));
+		dfw_append_insn(dfw, insn);
+		set_nodelist_free(nodelist_head);
+
+		g_slist_foreach(jumps, fixup_jumps, dfw);
+		g_slist_free(jumps);
+		return;
+	}
+
 	/* Create code to populate the set stack */
-	nodelist_head = nodelist = stnode_steal_data(st_arg2);
+	nodelist = nodelist_head;
 	while (nodelist) {
 		node1 = nodelist->data;
 		nodelist = g_slist_next(nodelist);
@@ -844,8 +892,463 @@ gencode(dfwork_t *dfw, stnode_t *st_node)
 }
 
 
+/*
+ * Cost-based ordering of chains of "and" or "or".
+ *
+ * Tests have no side effects, so the operands of a chain of "and" (or of
+ * "or") may be evaluated in any order. The expected cost of the chain is
+ * lowest if the operands that are cheap and likely to decide the result
+ * (false for "and", true for "or") are evaluated first, that is if they
+ * are sorted by their cost divided by the probability that they end the
+ * evaluation. Costs and probabilities are rough static estimates.
+ */
+typedef struct {
+	stnode_t	*node;
+	double		cost;
+	double		prob;	/* Probability that the test is true. */
+	double		rank;
+	unsigned	pos;
+} chain_operand_t;
+
+static double
+order_tests(stnode_t *st_node, double *prob);
+
+static double
+entity_cost(stnode_t *st_node)
+{
+	stnode_op_t	st_op;
+	stnode_t	*left, *right;
+	GSList		*params;
+	double		cost;
+
+	switch (stnode_type_id(st_node)) {
+		case STTYPE_FIELD:
+			/* Layer ranges must be filtered. */
+			return sttype_field_drange(st_node) ? 3 : 2;
+		case STTYPE_REFERENCE:
+			return 2;
+		case STTYPE_SLICE:
+			return entity_cost(sttype_slice_entity(st_node)) + 1;
+		case STTYPE_FUNCTION:
+			cost = 4;
+			for (params = sttype_function_params(st_node); params != NULL; params = params->next)
+				cost += entity_cost(params->data);
+			return cost;
+		case STTYPE_ARITHMETIC:
+			sttype_oper_get(st_node, &st_op, &left, &right);
+			cost = 1 + entity_cost(left);
+			if (right)
+				cost += entity_cost(right);
+			return cost;
+		default:
+			/* Constants */
+			return 0;
+	}
+}
+
+static double
+set_cost(stnode_t *st_node)
+{
+	GSList		*nodelist;
+	double		cost = 0;
+
+	/* The list holds pairs of nodes, the second one NULL unless the
+	 * element is a range. */
+	for (nodelist = stnode_data(st_node); nodelist != NULL; nodelist = nodelist->next->next) {
+		cost += 0.5 + entity_cost(nodelist->data);
+		if (nodelist->next->data)
+			cost += 0.5 + entity_cost(nodelist->next->data);
+	}
+	return cost;
+}
+
 static void
-optimize(dfwork_t *dfw)
+collect_chain(stnode_t *st_node, stnode_op_t chain_op, GPtrArray *links, GArray *operands)
+{
+	stnode_op_t	st_op;
+	stnode_t	*args[2];
+	chain_operand_t	operand;
+
+	sttype_oper_get(st_node, &st_op, &args[0], &args[1]);
+	g_ptr_array_add(links, st_node);
+
+	for (unsigned i = 0; i < 2; i++) {
+		if (stnode_type_id(args[i]) == STTYPE_TEST &&
+				sttype_oper_get_op(args[i]) == chain_op) {
+			collect_chain(args[i], chain_op, links, operands);
+		}
+		else {
+			memset(&operand, 0, sizeof(operand));
+			operand.node = args[i];
+			g_array_append_val(operands, operand);
+		}
+	}
+}
+
+static int
+compare_chain_operands(const void *_a, const void *_b)
+{
+	const chain_operand_t *a = _a;
+	const chain_operand_t *b = _b;
+
+	if (a->rank != b->rank)
+		return a->rank < b->rank ? -1 : 1;
+	/* Keep the order of the filter text if in doubt. */
+	return a->pos < b->pos ? -1 : 1;
+}
+
+static double
+order_chain(stnode_t *st_node, stnode_op_t chain_op, double *prob)
+{
+	GPtrArray	*links;
+	GArray		*operands;
+	chain_operand_t	*operand;
+	stnode_t	*next;
+	double		cost = 0, reach = 1;
+	unsigned	i, count;
+
+	links = g_ptr_array_new();
+	operands = g_array_new(false, false, sizeof(chain_operand_t));
+	collect_chain(st_node, chain_op, links, operands);
+	count = operands->len;
+	ws_assert(links->len == count - 1);
+
+	for (i = 0; i < count; i++) {
+		operand = &g_array_index(operands, chain_operand_t, i);
+		operand->cost = order_tests(operand->node, &operand->prob);
+		operand->pos = i;
+		if (chain_op == STNODE_OP_AND)
+			operand->rank = operand->cost / MAX(1 - operand->prob, 0.01);
+		else
+			operand->rank = operand->cost / MAX(operand->prob, 0.01);
+	}
+	g_array_sort(operands, compare_chain_operands);
+
+	/* Relink the chain, reusing its nodes, so that the operands are
+	 * evaluated in order. The first node stays at the top, since our
+	 * parent points to it. */
+	for (i = 0; i < count - 1; i++) {
+		if (i + 2 < count)
+			next = g_ptr_array_index(links, i + 1);
+		else
+			next = g_array_index(operands, chain_operand_t, count - 1).node;
+		sttype_oper_set2_args(g_ptr_array_index(links, i),
+				g_array_index(operands, chain_operand_t, i).node, next);
+	}
+
+	/* Expected cost of the chain, and probability that it is true. */
+	for (i = 0; i < count; i++) {
+		operand = &g_array_index(operands, chain_operand_t, i);
+		cost += reach * operand->cost;
+		reach *= (chain_op == STNODE_OP_AND) ? operand->prob : 1 - operand->prob;
+	}
+	*prob = (chain_op == STNODE_OP_AND) ? reach : 1 - reach;
+
+	g_ptr_array_free(links, true);
+	g_array_free(operands, true);
+	return cost;
+}
+
+/* Reorders the chains of "and" and "or" below st_node. Returns the
+ * estimated cost of the test and sets prob to the estimated probability
+ * that it is true. */
+static double
+order_tests(stnode_t *st_node, double *prob)
+{
+	stnode_op_t	st_op;
+	stnode_t	*st_arg1, *st_arg2;
+	double		cost, p;
+
+	switch (stnode_type_id(st_node)) {
+		case STTYPE_TEST:
+			break;
+		case STTYPE_FIELD:
+			/* Existence test. */
+			*prob = 0.5;
+			return sttype_field_drange(st_node) ? 2 : 1;
+		default:
+			/* Test that the value is not zero. */
+			*prob = 0.5;
+			return entity_cost(st_node) + 1;
+	}
+
+	sttype_oper_get(st_node, &st_op, &st_arg1, &st_arg2);
+
+	switch (st_op) {
+		case STNODE_OP_NOT:
+			cost = order_tests(st_arg1, &p);
+			*prob = 1 - p;
+			return cost;
+
+		case STNODE_OP_AND:
+		case STNODE_OP_OR:
+			return order_chain(st_node, st_op, prob);
+
+		case STNODE_OP_ALL_EQ:
+		case STNODE_OP_ANY_EQ:
+			*prob = 0.1;
+			cost = 1;
+			break;
+
+		case STNODE_OP_ALL_NE:
+		case STNODE_OP_ANY_NE:
+			*prob = 0.9;
+			cost = 1;
+			break;
+
+		case STNODE_OP_GT:
+		case STNODE_OP_GE:
+		case STNODE_OP_LT:
+		case STNODE_OP_LE:
+			*prob = 0.5;
+			cost = 1;
+			break;
+
+		case STNODE_OP_CONTAINS:
+			*prob = 0.2;
+			cost = 4;
+			break;
+
+		case STNODE_OP_MATCHES:
+			*prob = 0.2;
+			cost = 16;
+			break;
+
+		case STNODE_OP_IN:
+			*prob = 0.2;
+			return entity_cost(st_arg1) + 1 + set_cost(st_arg2);
+
+		case STNODE_OP_NOT_IN:
+			*prob = 0.8;
+			return entity_cost(st_arg1) + 1 + set_cost(st_arg2);
+
+		case STNODE_OP_UNINITIALIZED:
+		case STNODE_OP_BITWISE_AND:
+		case STNODE_OP_UNARY_MINUS:
+		case STNODE_OP_ADD:
+		case STNODE_OP_SUBTRACT:
+		case STNODE_OP_MULTIPLY:
+		case STNODE_OP_DIVIDE:
+		case STNODE_OP_MODULO:
+			ASSERT_STNODE_OP_NOT_REACHED(st_op);
+	}
+
+	return cost + entity_cost(st_arg1) + entity_cost(st_arg2);
+}
+
+/* How an instruction uses the accumulator. */
+typedef enum {
+	ACCUM_KEEP,	/* Neither reads nor sets it. */
+	ACCUM_SET,	/* Sets it without reading it. */
+	ACCUM_READ,	/* Reads it. */
+} accum_use_t;
+
+static accum_use_t
+insn_accum_use(dfvm_opcode_t op)
+{
+	switch (op) {
+		case DFVM_PUT_FVALUE:
+		case DFVM_SET_ADD:
+		case DFVM_SET_ADD_RANGE:
+		case DFVM_SET_CLEAR:
+		case DFVM_SLICE:
+		case DFVM_LENGTH:
+		case DFVM_BITWISE_AND:
+		case DFVM_UNARY_MINUS:
+		case DFVM_ADD:
+		case DFVM_SUBTRACT:
+		case DFVM_MULTIPLY:
+		case DFVM_DIVIDE:
+		case DFVM_MODULO:
+		case DFVM_STACK_PUSH:
+		case DFVM_STACK_POP:
+		case DFVM_NO_OP:
+			return ACCUM_KEEP;
+
+		case DFVM_CHECK_EXISTS:
+		case DFVM_CHECK_EXISTS_R:
+		case DFVM_READ_TREE:
+		case DFVM_READ_TREE_R:
+		case DFVM_READ_REFERENCE:
+		case DFVM_READ_REFERENCE_R:
+		case DFVM_ALL_EQ:
+		case DFVM_ANY_EQ:
+		case DFVM_ALL_NE:
+		case DFVM_ANY_NE:
+		case DFVM_ALL_GT:
+		case DFVM_ANY_GT:
+		case DFVM_ALL_GE:
+		case DFVM_ANY_GE:
+		case DFVM_ALL_LT:
+		case DFVM_ANY_LT:
+		case DFVM_ALL_LE:
+		case DFVM_ANY_LE:
+		case DFVM_ALL_CONTAINS:
+		case DFVM_ANY_CONTAINS:
+		case DFVM_ALL_MATCHES:
+		case DFVM_ANY_MATCHES:
+		case DFVM_SET_ALL_IN:
+		case DFVM_SET_ANY_IN:
+		case DFVM_SET_ALL_NOT_IN:
+		case DFVM_SET_ANY_NOT_IN:
+		case DFVM_CALL_FUNCTION:
+		case DFVM_NOT_ALL_ZERO:
+			return ACCUM_SET;
+
+		case DFVM_IF_TRUE_GOTO:
+		case DFVM_IF_FALSE_GOTO:
+		case DFVM_NOT:
+		case DFVM_RETURN:
+		case DFVM_NULL:
+			break;
+	}
+	return ACCUM_READ;
+}
+
+/* Is the accumulator overwritten, starting at instruction id, before
+ * it is read? */
+static bool
+accum_is_dead(dfwork_t *dfw, unsigned id)
+{
+	dfvm_insn_t	*insn;
+
+	for (; id < dfw->insns->len; id++) {
+		insn = g_ptr_array_index(dfw->insns, id);
+		switch (insn_accum_use(insn->op)) {
+			case ACCUM_KEEP:
+				continue;
+			case ACCUM_SET:
+				return true;
+			case ACCUM_READ:
+				return false;
+		}
+	}
+	return false;
+}
+
+static bool
+is_plain_read_tree(dfvm_insn_t *insn)
+{
+	/* Raw and value string reads can leave an empty register after
+	 * succeeding, so a second read of those might fail. */
+	return insn->op == DFVM_READ_TREE && insn->arg1->type == HFINFO;
+}
+
+static void
+merge_loaded(uint8_t **loaded, unsigned id, unsigned length,
+				const uint8_t *state, unsigned num_registers)
+{
+	if (id >= length)
+		return;
+	if (loaded[id] == NULL) {
+		loaded[id] = g_malloc(num_registers);
+		memcpy(loaded[id], state, num_registers);
+		return;
+	}
+	for (unsigned reg = 0; reg < num_registers; reg++)
+		loaded[id][reg] &= state[reg];
+}
+
+/*
+ * Every read of a field (without a layer range) uses the same register,
+ * see dfw_append_read_tree(), and the VM doesn't read a register again
+ * once it is loaded, but the READ_TREE and the IF_FALSE_GOTO after it
+ * still run each time the field appears in the filter. Find, in a single
+ * forward pass (all jumps go forward), the registers that hold a non-empty
+ * value on every path to each instruction. A read of such a register
+ * always succeeds, so it and its jump can be removed, unless something
+ * reads the accumulator it would have set.
+ */
+static void
+remove_redundant_reads(dfwork_t *dfw)
+{
+	unsigned	id, length, num_registers, target, reg;
+	dfvm_insn_t	*insn, *next;
+	uint8_t		**loaded, *state;
+	bool		*is_target;
+
+	length = dfw->insns->len;
+	num_registers = dfw->next_register;
+	if (num_registers == 0)
+		return;
+	/* Don't spend too much memory on huge filters. */
+	if ((uint64_t)length * num_registers > (1U << 24))
+		return;
+
+	is_target = g_new0(bool, length);
+	for (id = 0; id < length; id++) {
+		insn = g_ptr_array_index(dfw->insns, id);
+		if (insn->op == DFVM_IF_TRUE_GOTO || insn->op == DFVM_IF_FALSE_GOTO) {
+			target = insn->arg1->value.numeric;
+			if (target <= id || target >= length) {
+				/* Not a forward jump; give up. */
+				g_free(is_target);
+				return;
+			}
+			is_target[target] = true;
+		}
+	}
+
+	/* loaded[id] is NULL until a path to id has been seen. */
+	loaded = g_new0(uint8_t *, length);
+	loaded[0] = g_malloc0(num_registers);
+
+	for (id = 0; id < length; id++) {
+		state = loaded[id];
+		if (state == NULL)
+			continue;
+		insn = g_ptr_array_index(dfw->insns, id);
+		next = (id + 1 < length) ? g_ptr_array_index(dfw->insns, id + 1) : NULL;
+
+		if (is_plain_read_tree(insn) && state[insn->arg2->value.numeric] &&
+				next && next->op == DFVM_IF_FALSE_GOTO && !is_target[id + 1] &&
+				accum_is_dead(dfw, id + 2)) {
+			dfvm_insn_replace_no_op(insn);
+			dfvm_insn_replace_no_op(next);
+		}
+
+		switch (insn->op) {
+			case DFVM_RETURN:
+				break;
+			case DFVM_IF_TRUE_GOTO:
+			case DFVM_IF_FALSE_GOTO:
+				merge_loaded(loaded, insn->arg1->value.numeric, length, state, num_registers);
+				if (insn->op == DFVM_IF_FALSE_GOTO && id > 0 && !is_target[id]) {
+					/* Not taken after a successful read. */
+					next = g_ptr_array_index(dfw->insns, id - 1);
+					if (is_plain_read_tree(next)) {
+						reg = next->arg2->value.numeric;
+						state[reg] = 1;
+					}
+				}
+				merge_loaded(loaded, id + 1, length, state, num_registers);
+				break;
+			default:
+				merge_loaded(loaded, id + 1, length, state, num_registers);
+				break;
+		}
+		g_free(state);
+		loaded[id] = NULL;
+	}
+
+	g_free(loaded);
+	g_free(is_target);
+}
+
+static unsigned
+count_insns(GPtrArray *insns)
+{
+	unsigned	count = 0;
+
+	for (unsigned id = 0; id < insns->len; id++) {
+		if (((dfvm_insn_t *)g_ptr_array_index(insns, id))->op != DFVM_NO_OP)
+			count++;
+	}
+	return count;
+}
+
+static void
+thread_jumps(dfwork_t *dfw)
 {
 	int		id, id1, length;
 	dfvm_insn_t	*insn, *insn1, *prev;
@@ -869,6 +1372,10 @@ optimize(dfwork_t *dfw)
 			dfvm_opcode_t revert = (insn->op == DFVM_IF_FALSE_GOTO) ? DFVM_IF_TRUE_GOTO : DFVM_IF_FALSE_GOTO;
 			for (;;) {
 				insn1 = (dfvm_insn_t*)g_ptr_array_index(dfw->insns, id1);
+				if (insn1->op == DFVM_NO_OP) {
+					id1 = id1 +1;
+					continue;
+				}
 				if (insn1->op == revert) {
 					/* Skip this one; it is always false and the branch is not taken */
 					id1 = id1 +1;
@@ -897,6 +1404,17 @@ optimize(dfwork_t *dfw)
 	}
 }
 
+static void
+optimize(dfwork_t *dfw)
+{
+	thread_jumps(dfw);
+	/* Needs the jumps threaded to see that a field was read on every
+	 * path, then leaves no-ops for the jumps to skip. */
+	remove_redundant_reads(dfw);
+	thread_jumps(dfw);
+}
+
+
 void
 dfw_gencode(dfwork_t *dfw)
 {
@@ -905,9 +1423,14 @@ dfw_gencode(dfwork_t *dfw)
 	dfw->loaded_raw_fields = g_hash_table_new(g_direct_hash, g_direct_equal);
 	dfw->loaded_vs_fields = g_hash_table_new(g_direct_hash, g_direct_equal);
 	dfw->interesting_fields = g_hash_table_new(g_int_hash, g_int_equal);
+	if (dfw->flags & DF_OPTIMIZE) {
+		double prob;
+		order_tests(dfw->st_root, &prob);
+	}
 	dfvm_insn_t *insn = dfvm_insn_new(DFVM_RETURN);
 	insn->arg1 = dfvm_value_ref(gencode(dfw, dfw->st_root));
 	dfw_append_insn(dfw, insn);
+	dfw->num_insns_unoptimized = count_insns(dfw->insns);
 	if (dfw->flags & DF_OPTIMIZE) {
 		optimize(dfw);
 	}
@@ -1709,6 +1709,30 @@ check_relation_matches(dfwork_t *dfw, stnode_t *st_node,
 	}
 }
 
+/* The error for an invalid value read from a set file gives its file and
+ * line instead of echoing the contents of the file. */
+static void
+check_set_file_element(dfwork_t *dfw, stnode_t *st_node,
+		stnode_t *st_arg1, stnode_t *st_element)
+{
+	volatile bool ok = true;
+
+	TRY {
+		check_relation_LHS_FIELD(dfw, STNODE_OP_ANY_EQ, ftype_can_eq,
+				false, st_node, st_arg1, st_element);
+	}
+	CATCH(TypeError) {
+		ok = false;
+	}
+	ENDTRY;
+
+	if (!ok) {
+		df_error_free(&dfw->error);
+		FAIL(dfw, st_element, "Invalid value for %s at %s.",
+				stnode_todisplay(st_arg1), stnode_token(st_element));
+	}
+}
+
 static void
 check_relation_in(dfwork_t *dfw, stnode_t *st_node _U_,
 		stnode_t *st_arg1, stnode_t *st_arg2)
@@ -1751,6 +1775,8 @@ check_relation_in(dfwork_t *dfw, stnode_t *st_node _U_,
 					false, st_node, st_arg1, node_left);
 			check_relation_LHS_FIELD(dfw, STNODE_OP_LE, ftype_can_cmp,
 					false, st_node, st_arg1, node_right);
+		} else if (stnode_get_flags(node_left, STFLAG_SET_FILE)) {
+			check_set_file_element(dfw, st_node, st_arg1, node_left);
 		} else {
 			check_relation_LHS_FIELD(dfw, STNODE_OP_ANY_EQ, ftype_can_eq,
 					false, st_node, st_arg1, node_left);
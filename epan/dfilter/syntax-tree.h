@@ -73,6 +73,8 @@ typedef enum {
 
 /* Lexical value is ambiguous (can be a protocol field or a literal). */
 #define STFLAG_UNPARSED		(1 << 0)
+/* Value read from a set file; the token is the file name and line. */
+#define STFLAG_SET_FILE		(1 << 1)
 
 /** Node (type instance) information */
 typedef struct stnode {
@@ -73,6 +73,7 @@ typedef struct _h225ras_call_t {
 typedef struct _h225ras_call_info_key {
   unsigned reqSeqNum;
   conversation_t *conversation;
+  uint32_t conv_index;
 } h225ras_call_info_key;
 
 /* Global Memory Chunks for lists and Global hash tables*/
@@ -270,7 +271,8 @@ static int h225ras_call_equal(const void *k1, const void *k2)
   const h225ras_call_info_key* key2 = (const h225ras_call_info_key*) k2;
 
   return (key1->reqSeqNum == key2->reqSeqNum &&
-          key1->conversation == key2->conversation);
+          key1->conversation == key2->conversation &&
+          key1->conv_index == key2->conv_index);
 }
 
 /* calculate a hash key */
@@ -1020,6 +1022,7 @@ static void ras_call_matching(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tre
       /* prepare the key data */
       h225ras_call_key.reqSeqNum = pi->requestSeqNum;
       h225ras_call_key.conversation = conversation;
+      h225ras_call_key.conv_index = conversation->conv_index;
 
       /* look up the request */
       h225ras_call = find_h225ras_call(&h225ras_call_key ,msg_category);
@@ -1085,6 +1088,7 @@ static void ras_call_matching(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tre
            matching conversation is available. */
         h225ras_call_key.reqSeqNum = pi->requestSeqNum;
         h225ras_call_key.conversation = conversation;
+        h225ras_call_key.conv_index = conversation->conv_index;
         h225ras_call = find_h225ras_call(&h225ras_call_key ,msg_category);
         if(h225ras_call) {
           /* find matching ras_call in list of ras calls with identical keys */
@@ -677,6 +677,7 @@ netlogon_auth_hash (const void *k)
 
 typedef struct _dcerpc_auth_schannel_key {
     conversation_t *conv;
+    uint32_t        conv_index;
     uint64_t        transport_salt;
     uint32_t        auth_context_id;
 } dcerpc_auth_schannel_key;
@@ -703,6 +704,7 @@ dcerpc_auth_schannel_key_equal(const void *k1, const void *k2)
     const dcerpc_auth_schannel_key *key2 = (const dcerpc_auth_schannel_key *)k2;
 
     return ((key1->conv == key2->conv)
+            && (key1->conv_index == key2->conv_index)
             && (key1->transport_salt == key2->transport_salt)
             && (key1->auth_context_id == key2->auth_context_id));
 }
@@ -3841,8 +3843,10 @@ static netlogon_auth_vars *find_or_create_schannel_netlogon_auth_vars(packet_inf
                                                                       dcerpc_auth_info *auth_info,
                                                                       unsigned char is_server)
 {
+    conversation_t *conv = find_or_create_conversation(pinfo);
     dcerpc_auth_schannel_key skey = {
-        .conv = find_or_create_conversation(pinfo),
+        .conv = conv,
+        .conv_index = conv->conv_index,
         .transport_salt = dcerpc_get_transport_salt(pinfo),
         .auth_context_id = auth_info->auth_context_id,
     };
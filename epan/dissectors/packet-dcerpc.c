@@ -695,6 +695,7 @@ static wmem_map_t *dcerpc_connections;
 
 typedef struct _dcerpc_connection {
     conversation_t *conv;
+    uint32_t        conv_index;
     uint64_t        transport_salt;
     uint32_t        first_frame;
     bool            hdr_signing_negotiated;
@@ -711,6 +712,7 @@ static wmem_map_t *dcerpc_binds;
 
 typedef struct _dcerpc_bind_key {
     conversation_t *conv;
+    uint32_t        conv_index;
     uint16_t        ctx_id;
     uint64_t        transport_salt;
 } dcerpc_bind_key;
@@ -725,6 +727,7 @@ static wmem_map_t *dcerpc_auths;
 
 typedef struct _dcerpc_auth_context {
     conversation_t *conv;
+    uint32_t        conv_index;
     uint64_t        transport_salt;
     uint8_t         auth_type;
     uint8_t         auth_level;
@@ -733,6 +736,52 @@ typedef struct _dcerpc_auth_context {
     bool            hdr_signing;
 } dcerpc_auth_context;
 
+/*
+ * The entries a conversation has in the tables keyed by conversation, kept
+ * as the DCE/RPC data of the conversation so that they can be removed when
+ * it's expired. The keys also hold the conv_index of the conversation, as a
+ * later one can be allocated at the same address.
+ */
+typedef struct _dcerpc_conv_entry {
+    wmem_map_t *table;
+    void       *key;
+    bool        free_value;     /* false if the value is the key, or shared */
+} dcerpc_conv_entry;
+
+static void
+dcerpc_conv_add_entry(conversation_t *conv, wmem_map_t *table, void *key, bool free_value)
+{
+    wmem_array_t *entries;
+    dcerpc_conv_entry entry = { table, key, free_value };
+
+    entries = (wmem_array_t *)conversation_get_proto_data(conv, proto_dcerpc);
+    if (!entries) {
+        entries = wmem_array_new(wmem_file_scope(), sizeof(dcerpc_conv_entry));
+        conversation_add_proto_data(conv, proto_dcerpc, entries);
+    }
+    wmem_array_append_one(entries, entry);
+}
+
+/* Remove the entries of an expired conversation (see conversation_expire()). */
+static void
+dcerpc_release_conversation_data(conversation_t *conv _U_, void *proto_data)
+{
+    wmem_array_t *entries = (wmem_array_t *)proto_data;
+    dcerpc_conv_entry *entry;
+    void *value;
+
+    for (unsigned i = 0; i < wmem_array_get_count(entries); i++) {
+        entry = (dcerpc_conv_entry *)wmem_array_index(entries, i);
+        /* Of equal keys only the first is in the table; the others find nothing. */
+        value = wmem_map_remove(entry->table, entry->key);
+        if (value && entry->free_value) {
+            wmem_free(wmem_file_scope(), value);
+        }
+        wmem_free(wmem_file_scope(), entry->key);
+    }
+    wmem_destroy_array(entries);
+}
+
 /* Extra data for DCERPC handling and tracking of context ids */
 typedef struct _dcerpc_decode_as_data {
     uint16_t dcectxid;             /**< Context ID (DCERPC-specific) */
@@ -803,11 +852,13 @@ dcerpc_add_conv_to_bind_table(decode_dcerpc_bind_values_t *binding)
 
     key = wmem_new(wmem_file_scope(), dcerpc_bind_key);
     key->conv = conv;
+    key->conv_index = conv->conv_index;
     key->ctx_id = binding->ctx_id;
     key->transport_salt = binding->transport_salt;
 
     /* add this entry to the bind table */
     wmem_map_insert(dcerpc_binds, key, bind_value);
+    dcerpc_conv_add_entry(conv, dcerpc_binds, key, true);
 
     return bind_value;
 
@@ -1837,6 +1888,7 @@ dcerpc_connection_equal(const void *k1, const void *k2)
     const dcerpc_connection *key1 = (const dcerpc_connection *)k1;
     const dcerpc_connection *key2 = (const dcerpc_connection *)k2;
     return ((key1->conv == key2->conv)
+            && (key1->conv_index == key2->conv_index)
             && (key1->transport_salt == key2->transport_salt));
 }
 
@@ -1859,6 +1911,7 @@ dcerpc_bind_equal(const void *k1, const void *k2)
     const dcerpc_bind_key *key1 = (const dcerpc_bind_key *)k1;
     const dcerpc_bind_key *key2 = (const dcerpc_bind_key *)k2;
     return ((key1->conv == key2->conv)
+            && (key1->conv_index == key2->conv_index)
             && (key1->ctx_id == key2->ctx_id)
             && (key1->transport_salt == key2->transport_salt));
 }
@@ -1884,6 +1937,7 @@ dcerpc_auth_context_equal(const void *k1, const void *k2)
     const dcerpc_auth_context *key1 = (const dcerpc_auth_context *)k1;
     const dcerpc_auth_context *key2 = (const dcerpc_auth_context *)k2;
     return ((key1->conv == key2->conv)
+            && (key1->conv_index == key2->conv_index)
             && (key1->auth_context_id == key2->auth_context_id)
             && (key1->transport_salt == key2->transport_salt));
 }
@@ -1912,12 +1966,14 @@ static wmem_map_t *dcerpc_dg_calls;
 
 typedef struct _dcerpc_cn_call_key {
     conversation_t *conv;
+    uint32_t conv_index;
     uint32_t call_id;
     uint64_t transport_salt;
 } dcerpc_cn_call_key;
 
 typedef struct _dcerpc_dg_call_key {
     conversation_t *conv;
+    uint32_t        conv_index;
     uint32_t        seqnum;
     e_guid_t        act_id ;
 } dcerpc_dg_call_key;
@@ -1929,6 +1985,7 @@ dcerpc_cn_call_equal(const void *k1, const void *k2)
     const dcerpc_cn_call_key *key1 = (const dcerpc_cn_call_key *)k1;
     const dcerpc_cn_call_key *key2 = (const dcerpc_cn_call_key *)k2;
     return ((key1->conv == key2->conv)
+            && (key1->conv_index == key2->conv_index)
             && (key1->call_id == key2->call_id)
             && (key1->transport_salt == key2->transport_salt));
 }
@@ -1939,6 +1996,7 @@ dcerpc_dg_call_equal(const void *k1, const void *k2)
     const dcerpc_dg_call_key *key1 = (const dcerpc_dg_call_key *)k1;
     const dcerpc_dg_call_key *key2 = (const dcerpc_dg_call_key *)k2;
     return ((key1->conv == key2->conv)
+            && (key1->conv_index == key2->conv_index)
             && (key1->seqnum == key2->seqnum)
             && ((memcmp(&key1->act_id, &key2->act_id, sizeof (e_guid_t)) == 0)));
 }
@@ -3838,8 +3896,10 @@ dissect_dcerpc_cn_auth_move(dcerpc_auth_info *auth_info, proto_tree *dcerpc_tree
 
 static dcerpc_connection *find_or_create_dcerpc_connection(packet_info *pinfo)
 {
+    conversation_t *conv = find_or_create_conversation(pinfo);
     dcerpc_connection connection_key = {
-        .conv = find_or_create_conversation(pinfo),
+        .conv = conv,
+        .conv_index = conv->conv_index,
         .transport_salt = dcerpc_get_transport_salt(pinfo),
         .first_frame = UINT32_MAX,
     };
@@ -3857,6 +3917,7 @@ static dcerpc_connection *find_or_create_dcerpc_connection(packet_info *pinfo)
 
     *connection = connection_key;
     wmem_map_insert(dcerpc_connections, connection, connection);
+    dcerpc_conv_add_entry(conv, dcerpc_connections, connection, false);
 
 return_value:
     if (pinfo->fd->num < connection->first_frame) {
@@ -3868,8 +3929,10 @@ return_value:
 static dcerpc_auth_context *find_or_create_dcerpc_auth_context(packet_info *pinfo,
                                                                dcerpc_auth_info *auth_info)
 {
+    conversation_t *conv = find_or_create_conversation(pinfo);
     dcerpc_auth_context auth_key = {
-        .conv = find_or_create_conversation(pinfo),
+        .conv = conv,
+        .conv_index = conv->conv_index,
         .transport_salt = dcerpc_get_transport_salt(pinfo),
         .auth_type = auth_info->auth_type,
         .auth_level = auth_info->auth_level,
@@ -3890,6 +3953,7 @@ static dcerpc_auth_context *find_or_create_dcerpc_auth_context(packet_info *pinf
 
     *auth_value = auth_key;
     wmem_map_insert(dcerpc_auths, auth_value, auth_value);
+    dcerpc_conv_add_entry(conv, dcerpc_auths, auth_value, false);
 
 return_value:
     if (pinfo->fd->num < auth_value->first_frame) {
@@ -4246,6 +4310,7 @@ dissect_dcerpc_cn_bind(tvbuff_t *tvb, int offset, packet_info *pinfo,
 
             key = wmem_new(wmem_file_scope(), dcerpc_bind_key);
             key->conv = conv;
+            key->conv_index = conv->conv_index;
             key->ctx_id = ctx_id;
             key->transport_salt = dcerpc_get_transport_salt(pinfo);
 
@@ -4256,6 +4321,7 @@ dissect_dcerpc_cn_bind(tvbuff_t *tvb, int offset, packet_info *pinfo,
 
             /* add this entry to the bind table */
             wmem_map_insert(dcerpc_binds, key, value);
+            dcerpc_conv_add_entry(conv, dcerpc_binds, key, true);
         }
 
         if (i > 0) {
@@ -4715,6 +4781,8 @@ dissect_dcerpc_cn_rqst(tvbuff_t *tvb, int offset, packet_info *pinfo,
             dcerpc_bind_value *bind_value;
 
             bind_key.conv = conv;
+
+            bind_key.conv_index = conv->conv_index;
             bind_key.ctx_id = ctx_id;
             bind_key.transport_salt = dcerpc_get_transport_salt(pinfo);
 
@@ -4724,12 +4792,15 @@ dissect_dcerpc_cn_rqst(tvbuff_t *tvb, int offset, packet_info *pinfo,
                     dcerpc_call_value *call_value;
 
                     call_key.conv = conv;
+
+                    call_key.conv_index = conv->conv_index;
                     call_key.call_id = hdr->call_id;
                     call_key.transport_salt = dcerpc_get_transport_salt(pinfo);
                     if ((call_value = (dcerpc_call_value *)wmem_map_lookup(dcerpc_cn_calls, &call_key))) {
                         new_matched_key = wmem_new(wmem_file_scope(), dcerpc_matched_key);
                         *new_matched_key = matched_key;
                         wmem_map_insert(dcerpc_matched, new_matched_key, call_value);
+                        dcerpc_conv_add_entry(conv, dcerpc_matched, new_matched_key, false);
                         value = call_value;
                     }
                 } else {
@@ -4743,6 +4814,7 @@ dissect_dcerpc_cn_rqst(tvbuff_t *tvb, int offset, packet_info *pinfo,
                     */
                     call_key = wmem_new(wmem_file_scope(), dcerpc_cn_call_key);
                     call_key->conv = conv;
+                    call_key->conv_index = conv->conv_index;
                     call_key->call_id = hdr->call_id;
                     call_key->transport_salt = dcerpc_get_transport_salt(pinfo);
 
@@ -4770,10 +4842,12 @@ dissect_dcerpc_cn_rqst(tvbuff_t *tvb, int offset, packet_info *pinfo,
                     }
 
                     wmem_map_insert(dcerpc_cn_calls, call_key, call_value);
+                    dcerpc_conv_add_entry(conv, dcerpc_cn_calls, call_key, true);
 
                     new_matched_key = wmem_new(wmem_file_scope(), dcerpc_matched_key);
                     *new_matched_key = matched_key;
                     wmem_map_insert(dcerpc_matched, new_matched_key, call_value);
+                    dcerpc_conv_add_entry(conv, dcerpc_matched, new_matched_key, false);
                     value = call_value;
                 }
             }
@@ -4880,6 +4954,8 @@ dissect_dcerpc_cn_resp(tvbuff_t *tvb, int offset, packet_info *pinfo,
             dcerpc_call_value *call_value;
 
             call_key.conv = conv;
+
+            call_key.conv_index = conv->conv_index;
             call_key.call_id = hdr->call_id;
             call_key.transport_salt = dcerpc_get_transport_salt(pinfo);
 
@@ -4890,6 +4966,7 @@ dissect_dcerpc_cn_resp(tvbuff_t *tvb, int offset, packet_info *pinfo,
                     new_matched_key = wmem_new(wmem_file_scope(), dcerpc_matched_key);
                     *new_matched_key = matched_key;
                     wmem_map_insert(dcerpc_matched, new_matched_key, call_value);
+                    dcerpc_conv_add_entry(conv, dcerpc_matched, new_matched_key, false);
                     value = call_value;
                     if (call_value->rep_frame == 0) {
                         call_value->rep_frame = pinfo->num;
@@ -5047,6 +5124,8 @@ dissect_dcerpc_cn_fault(tvbuff_t *tvb, int offset, packet_info *pinfo,
             dcerpc_call_value *call_value;
 
             call_key.conv = conv;
+
+            call_key.conv_index = conv->conv_index;
             call_key.call_id = hdr->call_id;
             call_key.transport_salt = dcerpc_get_transport_salt(pinfo);
 
@@ -5054,6 +5133,7 @@ dissect_dcerpc_cn_fault(tvbuff_t *tvb, int offset, packet_info *pinfo,
                 new_matched_key = wmem_new(wmem_file_scope(), dcerpc_matched_key);
                 *new_matched_key = matched_key;
                 wmem_map_insert(dcerpc_matched, new_matched_key, call_value);
+                dcerpc_conv_add_entry(conv, dcerpc_matched, new_matched_key, false);
 
                 value = call_value;
                 if (call_value->rep_frame == 0) {
@@ -6308,6 +6388,7 @@ dissect_dcerpc_dg_rqst(tvbuff_t *tvb, int offset, packet_info *pinfo,
 
         call_key = wmem_new(wmem_file_scope(), dcerpc_dg_call_key);
         call_key->conv = conv;
+        call_key->conv_index = conv->conv_index;
         call_key->seqnum = hdr->seqnum;
         call_key->act_id = hdr->act_id;
 
@@ -6327,11 +6408,13 @@ dissect_dcerpc_dg_rqst(tvbuff_t *tvb, int offset, packet_info *pinfo,
         call_value->flags = 0;
 
         wmem_map_insert(dcerpc_dg_calls, call_key, call_value);
+        dcerpc_conv_add_entry(conv, dcerpc_dg_calls, call_key, true);
 
         new_matched_key = wmem_new(wmem_file_scope(), dcerpc_matched_key);
         new_matched_key->frame = pinfo->num;
         new_matched_key->call_id = hdr->seqnum;
         wmem_map_insert(dcerpc_matched, new_matched_key, call_value);
+        dcerpc_conv_add_entry(conv, dcerpc_matched, new_matched_key, false);
     }
 
     matched_key.frame = pinfo->num;
@@ -6386,6 +6469,8 @@ dissect_dcerpc_dg_resp(tvbuff_t *tvb, int offset, packet_info *pinfo,
         dcerpc_dg_call_key call_key;
 
         call_key.conv = conv;
+
+        call_key.conv_index = conv->conv_index;
         call_key.seqnum = hdr->seqnum;
         call_key.act_id = hdr->act_id;
 
@@ -6394,6 +6479,7 @@ dissect_dcerpc_dg_resp(tvbuff_t *tvb, int offset, packet_info *pinfo,
             new_matched_key->frame = pinfo->num;
             new_matched_key->call_id = hdr->seqnum;
             wmem_map_insert(dcerpc_matched, new_matched_key, call_value);
+            dcerpc_conv_add_entry(conv, dcerpc_matched, new_matched_key, false);
             if (call_value->rep_frame == 0) {
                 call_value->rep_frame = pinfo->num;
             }
@@ -6448,6 +6534,8 @@ dissect_dcerpc_dg_ping_ack(tvbuff_t *tvb, int offset, packet_info *pinfo,
     dcerpc_dg_call_key  call_key;
 
     call_key.conv = conv;
+
+    call_key.conv_index = conv->conv_index;
     call_key.seqnum = hdr->seqnum;
     call_key.act_id = hdr->act_id;
 
@@ -7292,6 +7380,7 @@ proto_register_dcerpc(void)
     dcerpc_matched = wmem_map_new_autoreset(wmem_epan_scope(), wmem_file_scope(), dcerpc_matched_hash, dcerpc_matched_equal);
 
     register_init_routine(decode_dcerpc_inject_bindings);
+    conversation_register_proto_data_release(proto_dcerpc, dcerpc_release_conversation_data);
 
     dcerpc_module = prefs_register_protocol(proto_dcerpc, NULL);
     prefs_register_bool_preference(dcerpc_module,
@@ -987,6 +987,7 @@ static const value_string gse_proto_next_header_str[] = {
 
 typedef struct {
     const conversation_t* conv;
+    uint32_t conv_index;
     uint32_t isi;
 } virtual_stream_key;
 
@@ -1000,7 +1001,7 @@ virtual_stream_equal(const void *v, const void *w)
     const virtual_stream_key *v1 = (const virtual_stream_key *)v;
     const virtual_stream_key *v2 = (const virtual_stream_key *)w;
     int result;
-    result = (v1->conv == v2->conv && v1->isi == v2->isi);
+    result = (v1->conv == v2->conv && v1->conv_index == v2->conv_index && v1->isi == v2->isi);
     return result;
 }
 
@@ -1018,6 +1019,7 @@ virtual_stream_lookup(const conversation_t* conv, uint32_t isi)
     virtual_stream_key key, *new_key;
     uint32_t virtual_isi;
     key.conv = conv;
+    key.conv_index = conv->conv_index;
     key.isi = isi;
     virtual_isi = GPOINTER_TO_UINT(wmem_map_lookup(virtual_stream_hashtable, &key));
     if (virtual_isi == 0) {
@@ -1631,7 +1633,7 @@ static int dissect_dvb_s2_bb(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree
          * for the unlikely case of two streams between the same endpointss in
          * the opposite direction.
          */
-        if (addresses_equal(&pinfo->src, conversation_key_addr1(conv->key_ptr))) {
+        if (addresses_equal(&pinfo->src, conversation_key_addr1(conv))) {
             pinfo->p2p_dir = P2P_DIR_SENT;
         } else {
             pinfo->p2p_dir = P2P_DIR_RECV;
@@ -1106,6 +1106,40 @@ get_http_conversation_data(packet_info *pinfo, conversation_t **conversation)
 	return conv_data;
 }
 
+static void
+free_match_trans(void *key, void *value, void *user_data _U_)
+{
+	match_trans_t *match_trans = (match_trans_t *)value;
+
+	/* Each match is in the table under its request and response frames. */
+	if (GPOINTER_TO_UINT(key) == match_trans->resp_frame) {
+		wmem_free(wmem_file_scope(), match_trans);
+	}
+}
+
+/* Free the data of an expired conversation (see conversation_expire()).
+ * The request/response records are left alone, the frames point to them.
+ */
+static void
+http_release_conversation_data(conversation_t *conv _U_, void *proto_data)
+{
+	http_conv_t *conv_data = (http_conv_t *)proto_data;
+	GSList *iter;
+
+	wmem_map_destroy(conv_data->chunk_offsets_fwd, false, false);
+	wmem_map_destroy(conv_data->chunk_offsets_rev, false, false);
+	wmem_map_foreach(conv_data->matches_table, free_match_trans, NULL);
+	wmem_map_destroy(conv_data->matches_table, false, false);
+	for (iter = conv_data->req_list; iter; iter = iter->next) {
+		wmem_free(wmem_file_scope(), iter->data);
+	}
+	g_slist_free(conv_data->req_list);
+	wmem_free(wmem_file_scope(), conv_data->websocket_protocol);
+	wmem_free(wmem_file_scope(), conv_data->websocket_extensions);
+	free_address_wmem(wmem_file_scope(), &conv_data->server_addr);
+	wmem_free(wmem_file_scope(), conv_data);
+}
+
 /**
  * create a new http_req_res_t and add it to the conversation.
  * @return the new allocated object which is already added to the linked list
@@ -4922,6 +4956,7 @@ proto_register_http(void)
 	http_sctp_handle = register_dissector("http-over-sctp", dissect_http_sctp, proto_http);
 
 	reassembly_table_register(&http_streaming_reassembly_table, &addresses_ports_reassembly_table_functions);
+	conversation_register_proto_data_release(proto_http, http_release_conversation_data);
 
 	http_module = prefs_register_protocol(proto_http, reinit_http);
 	prefs_register_bool_preference(http_module, "desegment_headers",
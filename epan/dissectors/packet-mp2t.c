@@ -298,6 +298,7 @@ static uint32_t mp2t_stream_count;
 
 typedef struct {
     const conversation_t* conv;
+    uint32_t conv_index;
     int dir;
 } mp2t_stream_key;
 
@@ -308,7 +309,7 @@ mp2t_stream_equal(const void *v, const void *w)
     const mp2t_stream_key *v1 = (const mp2t_stream_key *)v;
     const mp2t_stream_key *v2 = (const mp2t_stream_key *)w;
     int result;
-    result = (v1->conv == v2->conv && v1->dir == v2->dir);
+    result = (v1->conv == v2->conv && v1->conv_index == v2->conv_index && v1->dir == v2->dir);
     return result;
 }
 
@@ -1583,14 +1584,15 @@ dissect_mp2t( tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, void* data _U
     conv = find_or_create_conversation(pinfo);
     stream = wmem_new(pinfo->pool, mp2t_stream_key);
     stream->conv = conv;
+    stream->conv_index = conv->conv_index;
     /* Conversations on UDP, etc. are bidirectional, but in the odd case
      * that we have two MP2T streams in the opposite directions, we have to
      * separately track their Continuity Counters, manage their fragmentation
      * status information, etc.
      */
-    if (addresses_equal(&pinfo->src, conversation_key_addr1(conv->key_ptr))) {
+    if (addresses_equal(&pinfo->src, conversation_key_addr1(conv))) {
         stream->dir = P2P_DIR_SENT;
-    } else if (addresses_equal(&pinfo->dst, conversation_key_addr1(conv->key_ptr))) {
+    } else if (addresses_equal(&pinfo->dst, conversation_key_addr1(conv))) {
         stream->dir = P2P_DIR_RECV;
     } else {
         /* DVB Base Band Frames, or some other endpoint that doesn't set the
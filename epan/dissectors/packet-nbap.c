@@ -12609,8 +12609,8 @@ nbap_private_data->binding_id_port = 0;
 
   delete_setup_conv(request_conv);
   ws_debug("    Frame %u conversation setup frame: %u %s:%u -> %s:%u", actx->pinfo->num, conv->setup_frame,
-            address_to_str(actx->pinfo->pool, conversation_key_addr1(conv->key_ptr)), conversation_key_port1(conv->key_ptr),
-            address_to_str(actx->pinfo->pool, conversation_key_addr2(conv->key_ptr)), conversation_key_port2(conv->key_ptr));
+            address_to_str(actx->pinfo->pool, conversation_key_addr1(conv)), conversation_key_port1(conv),
+            address_to_str(actx->pinfo->pool, conversation_key_addr2(conv)), conversation_key_port2(conv));
 
   ws_debug("Frame %u CommonTransportChannel-InformationResponse End", actx->pinfo->num);
 
@@ -195,8 +195,8 @@ dissect_proxy_proxied(tvbuff_t* tvb, packet_info* pinfo, proto_tree* tree,
          * currently that doesn't work well with Follow Stream (whether we
          * change them back before returning to the TCP dissector or not.)
          */
-        if (addresses_equal(&pinfo->src, conversation_key_addr1(conv->key_ptr)) &&
-            (pinfo->srcport == conversation_key_port1(conv->key_ptr))) {
+        if (addresses_equal(&pinfo->src, conversation_key_addr1(conv)) &&
+            (pinfo->srcport == conversation_key_port1(conv))) {
             conversation_set_conv_addr_port_endpoints(pinfo, &proxy_info->src, &proxy_info->dst,
                 CONVERSATION_PROXY, proxy_info->srcport,
                 proxy_info->dstport);
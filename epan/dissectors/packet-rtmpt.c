@@ -2622,10 +2622,10 @@ dissect_rtmpt_tcp(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, void* dat
                 rconv = rtmpt_init_rconv(conv);
         }
 
-        cdir = (addresses_equal(conversation_key_addr1(conv->key_ptr), &pinfo->src) &&
-                addresses_equal(conversation_key_addr2(conv->key_ptr), &pinfo->dst) &&
-                conversation_key_port1(conv->key_ptr) == pinfo->srcport &&
-                conversation_key_port2(conv->key_ptr) == pinfo->destport) ? 0 : 1;
+        cdir = (addresses_equal(conversation_key_addr1(conv), &pinfo->src) &&
+                addresses_equal(conversation_key_addr2(conv), &pinfo->dst) &&
+                conversation_key_port1(conv) == pinfo->srcport &&
+                conversation_key_port2(conv) == pinfo->destport) ? 0 : 1;
 
         dissect_rtmpt_common(tvb, pinfo, tree, rconv, cdir, tcpinfo->seq, tcpinfo->lastackseq);
         return tvb_reported_length(tvb);
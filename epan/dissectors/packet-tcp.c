@@ -511,6 +511,10 @@ static bool tcp_no_subdissector_on_error = true;
  * subdissector (depends on "tcp_desegment"). */
 static bool tcp_reassemble_out_of_order;
 
+/* Reassemble PDUs as views of the segments' data rather than copies of
+ * it (depends on "tcp_desegment"). */
+static bool tcp_reassemble_zero_copy;
+
 /*
  * FF: https://www.rfc-editor.org/rfc/rfc6994.html
  * With this flag set we assume the option structure for experimental
@@ -2166,9 +2170,9 @@ add_tcp_process_info(uint32_t frame_num, address *local_addr, address *remote_ad
         return;
     }
 
-    if (cmp_address(local_addr, conversation_key_addr1(conv->key_ptr)) == 0 && local_port == conversation_key_port1(conv->key_ptr)) {
+    if (cmp_address(local_addr, conversation_key_addr1(conv)) == 0 && local_port == conversation_key_port1(conv)) {
         flow = &tcpd->flow1;
-    } else if (cmp_address(remote_addr, conversation_key_addr1(conv->key_ptr)) == 0 && remote_port == conversation_key_port1(conv->key_ptr)) {
+    } else if (cmp_address(remote_addr, conversation_key_addr1(conv)) == 0 && remote_port == conversation_key_port1(conv)) {
         flow = &tcpd->flow2;
     }
     if (!flow || (flow->process_info && flow->process_info->command)) {
@@ -4343,6 +4347,56 @@ compare_ooo_segment_item(const void *a, const void *b)
     return 0;
 }
 
+static void
+tcp_release_flow(tcp_flow_t *flow)
+{
+    wmem_list_frame_t *frame;
+    ooo_segment_item *fd;
+    tcp_unacked_t *ual, *next_ual;
+
+    wmem_tree_destroy(flow->multisegment_pdus, false, true);
+    if (flow->ooo_segments) {
+        for (frame = wmem_list_head(flow->ooo_segments); frame; frame = wmem_list_frame_next(frame)) {
+            fd = (ooo_segment_item *)wmem_list_frame_data(frame);
+            wmem_free(wmem_file_scope(), fd->data);
+            wmem_free(wmem_file_scope(), fd);
+        }
+        wmem_destroy_list(flow->ooo_segments);
+    }
+    if (flow->tcp_analyze_seq_info) {
+        for (ual = flow->tcp_analyze_seq_info->segments; ual; ual = next_ual) {
+            next_ual = ual->next;
+            wmem_free(wmem_file_scope(), ual);
+        }
+        wmem_free(wmem_file_scope(), flow->tcp_analyze_seq_info);
+    }
+    if (flow->process_info) {
+        wmem_free(wmem_file_scope(), flow->process_info->username);
+        wmem_free(wmem_file_scope(), flow->process_info->command);
+        wmem_free(wmem_file_scope(), flow->process_info);
+    }
+}
+
+/* Free the analysis data of an expired conversation (see conversation_expire()).
+ * The data of MPTCP subflows is shared with the other subflows, so it's left
+ * alone.
+ */
+static void
+tcp_release_conversation_data(conversation_t *conv _U_, void *proto_data)
+{
+    struct tcp_analysis *tcpd = (struct tcp_analysis *)proto_data;
+
+    if (tcpd->mptcp_analysis || tcpd->flow1.mptcp_subflow || tcpd->flow2.mptcp_subflow) {
+        return;
+    }
+
+    tcp_release_flow(&tcpd->flow1);
+    tcp_release_flow(&tcpd->flow2);
+    wmem_tree_destroy(tcpd->acked_table, false, true);
+    wmem_free(wmem_file_scope(), tcpd->conversation_completeness_str);
+    wmem_free(wmem_file_scope(), tcpd);
+}
+
 /* Search through our list of out of order segments and add the ones that are
  * now contiguous onto a MSP until we use them all or reach another gap.
  *
@@ -8731,6 +8785,14 @@ dissect_tcp(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, void* data _U_)
           tcpd->conversation_completeness = conversation_completeness;
           tcpd->conversation_completeness_str = completeness_flags_to_str_first_letter(wmem_file_scope(), tcpd->conversation_completeness) ;
       }
+
+      /* Once either side has closed it, the conversation can be expired
+       * sooner than idle ones.
+       */
+      if (!(pinfo->fd->visited) &&
+          (conversation_completeness & (TCP_COMPLETENESS_FIN|TCP_COMPLETENESS_RST))) {
+          conversation_set_closed(conv);
+      }
     }
 
     if (tcp_summary_in_tree) {
@@ -9422,6 +9484,8 @@ tcp_init(void)
 {
     tcp_stream_count = 0;
 
+    reassembly_table_set_zero_copy(&tcp_reassembly_table, tcp_reassemble_zero_copy);
+
     /* MPTCP init */
     mptcp_stream_count = 0;
     mptcp_tokens = wmem_tree_new(wmem_file_scope());
@@ -10521,6 +10585,8 @@ proto_register_tcp(void)
     expert_module_t* expert_mptcp;
 
     proto_tcp = proto_register_protocol("Transmission Control Protocol", "TCP", "tcp");
+    /* Carries protocols, such as DNS, that keep state for others. */
+    proto_set_state_bearing(proto_tcp);
     tcp_handle = register_dissector("tcp", dissect_tcp, proto_tcp);
     tcp_cap_handle = register_capture_dissector("tcp", capture_tcp, proto_tcp);
     proto_register_field_array(proto_tcp, hf, array_length(hf));
@@ -10585,6 +10651,12 @@ proto_register_tcp(void)
         "Whether out-of-order segments should be buffered and reordered before passing it to a subdissector. "
         "To use this option you must also enable \"Allow subdissector to reassemble TCP streams\".",
         &tcp_reassemble_out_of_order);
+    prefs_register_bool_preference(tcp_module, "reassemble_zero_copy",
+        "Reassemble without copying segments",
+        "Whether reassembled PDUs should refer to the data of their segments instead of copying it into a new buffer. "
+        "This uses less memory for large PDUs; the data is only copied when a subdissector needs it contiguous. "
+        "To use this option you must also enable \"Allow subdissector to reassemble TCP streams\".",
+        &tcp_reassemble_zero_copy);
     prefs_register_bool_preference(tcp_module, "analyze_sequence_numbers",
         "Analyze TCP sequence numbers",
         "Make the TCP dissector analyze TCP sequence numbers to find and flag segment retransmissions, missing segments and RTT",
@@ -10660,6 +10732,7 @@ proto_register_tcp(void)
     register_init_routine(tcp_init);
     reassembly_table_register(&tcp_reassembly_table,
                           &tcp_reassembly_table_functions);
+    conversation_register_proto_data_release(proto_tcp, tcp_release_conversation_data);
 
     register_decode_as(&tcp_da);
 
@@ -940,7 +940,7 @@ dissect_tftp(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, void* data _U_
        * and with both ports, and take the latest of those.
        */
       /* Set other side of conversation (server port) */
-      if (pinfo->destport == conversation_key_port1(conversation->key_ptr))
+      if (pinfo->destport == conversation_key_port1(conversation))
         conversation_set_port2(conversation, pinfo->srcport);
 #endif
     } else if ((conversation = find_conversation_strat(pinfo, CONVERSATION_UDP,
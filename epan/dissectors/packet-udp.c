@@ -189,6 +189,19 @@ init_udp_conversation_data(packet_info *pinfo)
     return udpd;
 }
 
+/* Free the data of an expired conversation (see conversation_expire()). */
+static void
+udp_release_conversation_data(conversation_t *conv _U_, void *proto_data)
+{
+    struct udp_analysis *udpd = (struct udp_analysis *)proto_data;
+
+    wmem_free(wmem_file_scope(), udpd->flow1.username);
+    wmem_free(wmem_file_scope(), udpd->flow1.command);
+    wmem_free(wmem_file_scope(), udpd->flow2.username);
+    wmem_free(wmem_file_scope(), udpd->flow2.command);
+    wmem_free(wmem_file_scope(), udpd);
+}
+
 struct udp_analysis *
 get_udp_conversation_data(conversation_t *conv, packet_info *pinfo)
 {
@@ -444,10 +457,10 @@ add_udp_process_info(uint32_t frame_num, address *local_addr, address *remote_ad
         return;
     }
 
-    if ((cmp_address(local_addr, conversation_key_addr1(conv->key_ptr)) == 0) && (local_port == conversation_key_port1(conv->key_ptr))) {
+    if ((cmp_address(local_addr, conversation_key_addr1(conv)) == 0) && (local_port == conversation_key_port1(conv))) {
         flow = &udpd->flow1;
     }
-    else if ((cmp_address(remote_addr, conversation_key_addr1(conv->key_ptr)) == 0) && (remote_port == conversation_key_port1(conv->key_ptr))) {
+    else if ((cmp_address(remote_addr, conversation_key_addr1(conv)) == 0) && (remote_port == conversation_key_port1(conv))) {
         flow = &udpd->flow2;
     }
     if (!flow || flow->command) {
@@ -1480,6 +1493,8 @@ proto_register_udp(void)
     expert_module_t* expert_udp;
 
     proto_udp = proto_register_protocol("User Datagram Protocol", "UDP", "udp");
+    /* Carries protocols, such as DNS, that keep state for others. */
+    proto_set_state_bearing(proto_udp);
     proto_register_field_array(proto_udp, hf_udp, array_length(hf_udp));
     udp_handle = register_dissector("udp", dissect_udp, proto_udp);
     udp_cap_handle = register_capture_dissector("udp", capture_udp, proto_udp);
@@ -1548,6 +1563,7 @@ proto_register_udp(void)
                         udp_port_to_display, follow_tvb_tap_listener, get_udp_stream_count, NULL);
 
     register_init_routine(udp_init);
+    conversation_register_proto_data_release(proto_udp, udp_release_conversation_data);
 
     udp_tap = register_tap("udp");
     udp_follow_tap = register_tap("udp_follow");
@@ -29,7 +29,15 @@ bytes_fvalue_new(fvalue_t *fv)
 static void
 bytes_fvalue_copy(fvalue_t *dst, const fvalue_t *src)
 {
-	dst->value.bytes = g_bytes_ref(src->value.bytes);
+	if (src->scope != NULL && src->value.bytes != NULL) {
+		/* The data may be borrowed; the copy must own it. */
+		size_t size;
+		const void *data = g_bytes_get_data(src->value.bytes, &size);
+		dst->value.bytes = g_bytes_new(data, size);
+	}
+	else {
+		dst->value.bytes = g_bytes_ref(src->value.bytes);
+	}
 }
 
 static void
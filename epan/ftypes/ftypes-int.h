@@ -16,6 +16,10 @@
 
 struct _fvalue_t {
 	const ftype_t	*ftype;
+	/* Scope the fvalue and its string payload were allocated in, or NULL
+	 * for the global allocator. Bytes payloads of a scoped fvalue may be
+	 * borrowed from packet data. */
+	wmem_allocator_t	*scope;
 	union {
 		/* Put a few basic types in here */
 		uint64_t		uinteger64;
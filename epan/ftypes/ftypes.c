@@ -493,6 +493,29 @@ fvalue_new(ftenum_t ftype)
 
 	FTYPE_LOOKUP(ftype, ft);
 	fv->ftype = ft;
+	fv->scope = NULL;
+
+	new_value = ft->new_value;
+	if (new_value) {
+		new_value(fv);
+	}
+
+	return fv;
+}
+
+/* Allocate and initialize an fvalue_t in a wmem scope, given an ftype */
+fvalue_t*
+fvalue_new_scoped(wmem_allocator_t *scope, ftenum_t ftype)
+{
+	fvalue_t		*fv;
+	const ftype_t		*ft;
+	FvalueNewFunc		new_value;
+
+	fv = wmem_new(scope, fvalue_t);
+
+	FTYPE_LOOKUP(ftype, ft);
+	fv->ftype = ft;
+	fv->scope = scope;
 
 	new_value = ft->new_value;
 	if (new_value) {
@@ -510,6 +533,7 @@ fvalue_dup(const fvalue_t *fv_orig)
 
 	fv_new = g_slice_new(fvalue_t);
 	fv_new->ftype = fv_orig->ftype;
+	fv_new->scope = NULL;
 	copy_value = fv_new->ftype->copy_value;
 	if (copy_value != NULL) {
 		/* deep copy */
@@ -531,6 +555,7 @@ fvalue_init(fvalue_t *fv, ftenum_t ftype)
 
 	FTYPE_LOOKUP(ftype, ft);
 	fv->ftype = ft;
+	fv->scope = NULL;
 
 	new_value = ft->new_value;
 	if (new_value) {
@@ -550,7 +575,10 @@ void
 fvalue_free(fvalue_t *fv)
 {
 	fvalue_cleanup(fv);
-	g_slice_free(fvalue_t, fv);
+	if (fv->scope != NULL)
+		wmem_free(fv->scope, fv);
+	else
+		g_slice_free(fvalue_t, fv);
 }
 
 fvalue_t*
@@ -959,6 +987,15 @@ fvalue_set_bytes_data(fvalue_t *fv, const void *data, size_t size)
 	g_bytes_unref(bytes);
 }
 
+void
+fvalue_set_bytes_borrowed(fvalue_t *fv, const void *data, size_t size)
+{
+	ws_assert(fv->scope != NULL);
+	GBytes *bytes = g_bytes_new_static(data, size);
+	fvalue_set_bytes(fv, bytes);
+	g_bytes_unref(bytes);
+}
+
 void
 fvalue_set_fcwwn(fvalue_t *fv, const uint8_t *value)
 {
@@ -970,7 +1007,7 @@ fvalue_set_fcwwn(fvalue_t *fv, const uint8_t *value)
 void
 fvalue_set_ax25(fvalue_t *fv, const uint8_t *value)
 {
-	wmem_strbuf_t *buf = wmem_strbuf_new(NULL, NULL);
+	wmem_strbuf_t *buf = wmem_strbuf_new(fv->scope, NULL);
 	for (size_t i = 0; i < FT_AX25_ADDR_LEN - 1; i++) {
 		if (value[i] != 0x40) {
 			/* ignore space-padding */
@@ -1020,16 +1057,15 @@ fvalue_set_time(fvalue_t *fv, const nstime_t *value)
 void
 fvalue_set_string(fvalue_t *fv, const char *value)
 {
-	wmem_strbuf_t *buf = wmem_strbuf_new(NULL, value);
+	wmem_strbuf_t *buf = wmem_strbuf_new(fv->scope, value);
 	fvalue_set_strbuf(fv, buf);
 }
 
 void
 fvalue_set_strbuf(fvalue_t *fv, wmem_strbuf_t *value)
 {
-	if (value->allocator != NULL) {
-		/* XXX Can this condition be relaxed? */
-		ws_critical("Fvalue strbuf allocator must be NULL");
+	if (value->allocator != NULL && value->allocator != fv->scope) {
+		ws_critical("Fvalue strbuf allocator must be NULL or the fvalue's scope");
 	}
 	ws_assert(FT_IS_STRING(fv->ftype->ftype));
 	ws_assert(fv->ftype->set_value.set_value_strbuf);
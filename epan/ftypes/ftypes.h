@@ -314,6 +314,15 @@ WS_DLL_PUBLIC
 fvalue_t*
 fvalue_new(ftenum_t ftype);
 
+/* Allocate an fvalue_t, and its string payload if it has one, in a wmem
+ * scope instead of with the global allocator. fvalue_free() must still be
+ * called before the scope is freed, to release any GBytes payload. */
+WS_DLL_PUBLIC
+fvalue_t*
+fvalue_new_scoped(wmem_allocator_t *scope, ftenum_t ftype);
+
+/* The copy is always allocated with the global allocator, and owns
+ * its payload. */
 WS_DLL_PUBLIC
 fvalue_t*
 fvalue_dup(const fvalue_t *fv);
@@ -399,6 +408,12 @@ WS_DLL_PUBLIC
 void
 fvalue_set_bytes_data(fvalue_t *fv, const void *data, size_t size);
 
+/* Set a bytes value that points to the data instead of copying it. The
+ * fvalue must be scoped, and the data must outlive it. */
+WS_DLL_PUBLIC
+void
+fvalue_set_bytes_borrowed(fvalue_t *fv, const void *data, size_t size);
+
 WS_DLL_PUBLIC
 void
 fvalue_set_fcwwn(fvalue_t *fv, const uint8_t *value);
@@ -28,6 +28,7 @@
 
 #include "addr_resolv.h"
 #include "tvbuff.h"
+#include "tvbuff-int.h"
 #include "epan_dissect.h"
 
 #include <epan/wmem_scopes.h>
@@ -121,6 +122,15 @@ struct depend_dissector_list {
 /* Maps char *dissector_name to depend_dissector_list_t */
 static GHashTable *depend_dissector_lists;
 
+/*
+ * Whether a protocol can lead to another one through the protocols it
+ * depends on (see register_depend_dissector()), that is the dissectors it
+ * calls directly or through its dissector tables. Maps the two protocol
+ * ids to GINT_TO_POINTER(1) if it can, GINT_TO_POINTER(2) if it can't;
+ * cleared when a dependency changes.
+ */
+static GHashTable *prune_carries;
+
 /* Allow protocols to register a "cleanup" routine to be
  * run after the initial sequential run through the packets.
  * Note that the file can still be open after this; this is not
@@ -288,6 +298,10 @@ packet_cleanup(void)
 	g_hash_table_destroy(dissector_table_aliases);
 	g_hash_table_destroy(registered_dissectors);
 	g_hash_table_destroy(depend_dissector_lists);
+	if (prune_carries) {
+		g_hash_table_destroy(prune_carries);
+		prune_carries = NULL;
+	}
 	g_hash_table_destroy(heur_dissector_lists);
 	g_hash_table_destroy(heuristic_short_names);
 	g_slist_foreach(shutdown_routines, &call_routine, NULL);
@@ -417,6 +431,7 @@ struct data_source *add_new_data_source(packet_info *pinfo, tvbuff_t *tvb, const
 	/* This could end up slow, but we should never have that many data
 	 * sources so it probably doesn't matter */
 	pinfo->data_src = g_slist_append(pinfo->data_src, src);
+	tvb_set_data_source(tvb, true);
 	return src;
 }
 
@@ -431,9 +446,19 @@ void
 remove_last_data_source(packet_info *pinfo)
 {
 	GSList *last;
+	tvbuff_t *tvb;
 
 	last = g_slist_last(pinfo->data_src);
+	if (last == NULL)
+		return;
+	tvb = ((struct data_source *)last->data)->tvb;
 	pinfo->data_src = g_slist_delete_link(pinfo->data_src, last);
+	/* The same tvbuff could have been added more than once. */
+	for (GSList *src = pinfo->data_src; src != NULL; src = src->next) {
+		if (((struct data_source *)src->data)->tvb == tvb)
+			return;
+	}
+	tvb_set_data_source(tvb, false);
 }
 
 char*
@@ -489,6 +514,8 @@ void
 free_data_sources(packet_info *pinfo)
 {
 	if (pinfo->data_src) {
+		for (GSList *src = pinfo->data_src; src != NULL; src = src->next)
+			tvb_set_data_source(((struct data_source *)src->data)->tvb, false);
 		g_slist_free(pinfo->data_src);
 		pinfo->data_src = NULL;
 	}
@@ -918,6 +945,131 @@ call_dissector_through_handle(dissector_handle_t handle, tvbuff_t *tvb,
 	return len;
 }
 
+/*
+ * Skip the dissectors of protocols that nothing references?
+ */
+static bool prune_unreferenced_protocols;
+
+void
+set_prune_unreferenced_protocols(const bool prune)
+{
+	prune_unreferenced_protocols = prune;
+}
+
+static bool
+depend_dissector_reaches(const char *name, const char *target, GHashTable *visited)
+{
+	depend_dissector_list_t  sub_dissectors;
+	GSList                  *entry;
+
+	if (strcmp(name, target) == 0)
+		return true;
+	if (!g_hash_table_add(visited, (void *)name))
+		return false;
+
+	sub_dissectors = find_depend_dissector_list(name);
+	if (sub_dissectors == NULL)
+		return false;
+	for (entry = sub_dissectors->dissectors; entry != NULL; entry = g_slist_next(entry)) {
+		// NOLINTNEXTLINE(misc-no-recursion)
+		if (depend_dissector_reaches((const char *)entry->data, target, visited))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Can a protocol carry another one, for instance IP in a tunnel?
+ */
+static bool
+protocol_can_carry(int proto_id, int carried_id)
+{
+	int64_t     key = ((int64_t)proto_id << 32) | (uint32_t)carried_id;
+	void       *cached;
+	GHashTable *visited;
+	bool        carries;
+
+	if (prune_carries == NULL)
+		prune_carries = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+
+	cached = g_hash_table_lookup(prune_carries, &key);
+	if (cached != NULL)
+		return GPOINTER_TO_INT(cached) == 1;
+
+	visited = g_hash_table_new(g_str_hash, g_str_equal);
+	carries = depend_dissector_reaches(proto_get_protocol_short_name(find_protocol_by_id(proto_id)),
+	    proto_get_protocol_short_name(find_protocol_by_id(carried_id)), visited);
+	g_hash_table_destroy(visited);
+
+	g_hash_table_insert(prune_carries, g_memdup2(&key, sizeof key), GINT_TO_POINTER(carries ? 1 : 2));
+	return carries;
+}
+
+/*
+ * Can the dissector of a protocol be skipped, along with everything it
+ * would dissect? Only if the tree isn't visible and no column is filled
+ * in, nothing references the protocol, it doesn't keep state that other
+ * protocols depend on, all the referenced protocols have already been
+ * dissected, and it can't carry any of them again, as a tunnel would.
+ */
+static bool
+can_prune_dissector(dissector_handle_t handle, packet_info *pinfo, proto_tree *tree)
+{
+	const int *protos;
+	unsigned   count;
+	int        proto_id;
+	int       *layer_num;
+
+	if (tree == NULL || PTREE_DATA(tree)->visible || pinfo->cinfo != NULL)
+		return false;
+
+	if (proto_is_pino(handle->protocol) || proto_is_state_bearing(handle->protocol))
+		return false;
+
+	proto_id = proto_get_id(handle->protocol);
+	if (proto_field_is_referenced(tree, proto_id))
+		return false;
+
+	protos = proto_referenced_protocols(&count);
+	for (unsigned i = 0; i < count; i++) {
+		layer_num = pinfo->proto_layers ?
+		    (int *)wmem_map_lookup(pinfo->proto_layers, GINT_TO_POINTER(protos[i])) : NULL;
+		if (layer_num == NULL || *layer_num == 0)
+			return false;
+		if (protocol_can_carry(proto_id, protos[i]))
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Call the dissector found in a dissector table.
+ * If dissection of unreferenced protocols is pruned and the protocol can
+ * be skipped, return the length of the tvbuff without calling it. Only
+ * dissector table lookups are pruned, as their callers mostly use the
+ * result to know whether the data was handled; the callers of a handle
+ * often step over the number of bytes it returns.
+ */
+static int
+call_dissector_work(dissector_handle_t handle, tvbuff_t *tvb, packet_info *pinfo,
+		    proto_tree *tree, bool add_proto_name, void *data);
+
+static int
+call_table_dissector_work(dissector_handle_t handle, tvbuff_t *tvb, packet_info *pinfo,
+		    proto_tree *tree, bool add_proto_name, void *data)
+{
+	if (prune_unreferenced_protocols && handle->protocol != NULL &&
+	    proto_is_protocol_enabled(handle->protocol) &&
+	    can_prune_dissector(handle, pinfo, tree)) {
+		/*
+		 * Nothing needs what it would dissect; claim the data.
+		 */
+		return tvb_captured_length(tvb);
+	}
+
+	return call_dissector_work(handle, tvb, pinfo, tree, add_proto_name, data);
+}
+
 /*
  * Call a dissector through a handle.
  * If the protocol for that handle isn't enabled, return 0 without
@@ -1673,7 +1825,7 @@ dissector_try_uint_with_data(dissector_table_t sub_dissectors, const uint32_t ui
 	 */
 	saved_match_uint  = pinfo->match_uint;
 	pinfo->match_uint = uint_val;
-	len = call_dissector_work(handle, tvb, pinfo, tree, add_proto_name, data);
+	len = call_table_dissector_work(handle, tvb, pinfo, tree, add_proto_name, data);
 	pinfo->match_uint = saved_match_uint;
 
 	/*
@@ -1982,7 +2134,7 @@ dissector_try_string_with_data(dissector_table_t sub_dissectors, const char *str
 		 */
 		saved_match_string = pinfo->match_string;
 		pinfo->match_string = string;
-		len = call_dissector_work(handle, tvb, pinfo, tree, add_proto_name, data);
+		len = call_table_dissector_work(handle, tvb, pinfo, tree, add_proto_name, data);
 		pinfo->match_string = saved_match_string;
 
 		/*
@@ -2133,7 +2285,7 @@ int dissector_try_guid_with_data(dissector_table_t sub_dissectors,
 		 * set it to the uint_val that matched, call the
 		 * dissector, and restore "pinfo->match_uint".
 		 */
-		len = call_dissector_work(handle, tvb, pinfo, tree, add_proto_name, data);
+		len = call_table_dissector_work(handle, tvb, pinfo, tree, add_proto_name, data);
 
 		/*
 		 * If a new-style dissector returned 0, it means that
@@ -3791,6 +3943,8 @@ bool register_depend_dissector(const char* parent, const char* dependent)
 		return true; /* Dependency already exists */
 
 	sub_dissectors->dissectors = g_slist_prepend(sub_dissectors->dissectors, (void *)g_strdup(dependent));
+	if (prune_carries)
+		g_hash_table_remove_all(prune_carries);
 	return true;
 }
 
@@ -3801,6 +3955,8 @@ bool deregister_depend_dissector(const char* parent, const char* dependent)
 	/* sanity check */
 	ws_assert(sub_dissectors != NULL);
 
+	if (prune_carries)
+		g_hash_table_remove_all(prune_carries);
 	return remove_depend_dissector_from_list(sub_dissectors, dependent);
 }
 
@@ -775,6 +775,22 @@ WS_DLL_PUBLIC depend_dissector_list_t find_depend_dissector_list(const char* nam
  */
 WS_DLL_PUBLIC void set_actual_length(tvbuff_t *tvb, const unsigned specified_len);
 
+/**
+ * Skip the dissectors of protocols that can't add anything referenced by
+ * the filters and fields the tree was primed with, or fill in a column,
+ * and that aren't marked with proto_set_state_bearing(); see
+ * proto_referenced_protocols_seen(). Off by default.
+ *
+ * Only the dissectors found in dissector tables are skipped, and not
+ * those of protocols that can lead to a referenced protocol through their
+ * dependencies (see register_depend_dissector()), such as tunnels.
+ *
+ * Fields that describe the layers below a protocol, such as
+ * frame.protocols, only reflect what was dissected. Taps see only the
+ * protocols that were dissected.
+ */
+WS_DLL_PUBLIC void set_prune_unreferenced_protocols(const bool prune);
+
 /**
  * Allow protocols to register "init" routines, which are called before
  * we make a pass through a capture file and dissect all its packets
@@ -159,6 +159,7 @@ typedef struct _packet_info {
   int dissection_depth;         /**< The current "depth" or layer number in the current frame */
 
   uint32_t stream_id;            /**< Conversation Stream ID of the highest protocol */
+  struct tap_packet_queue *tap_queue; /**< Packets queued for the tap listeners; NULL when not tapping */
 } packet_info;
 
 /** @} */
@@ -25,11 +25,13 @@
 #include <epan/dfilter/dfilter.h>
 #include <epan/prefs.h>
 #include <epan/print.h>
+#include <epan/arrow_writer.h>
 #include <wsutil/array.h>
 #include <wsutil/json_dumper.h>
 #include <wsutil/filesystem.h>
 #include <wsutil/utf8_entities.h>
 #include <wsutil/str_util.h>
+#include <wsutil/strtoi.h>
 #include <wsutil/ws_assert.h>
 #include <epan/strutil.h>
 #include <ftypes/ftypes.h>
@@ -78,11 +80,19 @@ struct _output_fields {
     GPtrArray    *fields;
     GPtrArray    *field_dfilters;
     GHashTable   *field_indicies;
+    GPtrArray    *field_hfinfos;
     GPtrArray   **field_values;
     wmem_map_t   *protocolfilter;
     char          quote;
     bool          escape;
     bool          includes_col_fields;
+    /* Arrow output */
+    unsigned             arrow_batch_rows;
+    arrow_compression_e  arrow_compression;
+    GHashTable          *arrow_text_fields;
+    arrow_writer_t      *arrow;
+    arrow_type_e        *arrow_types;
+    GPtrArray          **field_finfos;
 };
 
 static char *get_field_hex_value(GSList *src_list, field_info *fi);
@@ -2011,10 +2021,24 @@ void output_fields_free(output_fields_t* fields)
             g_ptr_array_unref(fields->field_dfilters);
         }
 
+        if (NULL != fields->field_hfinfos) {
+            g_ptr_array_free(fields->field_hfinfos, true);
+        }
+
         if (NULL != fields->field_values) {
             g_free(fields->field_values);
         }
 
+        if (NULL != fields->field_finfos) {
+            for (i = 0; i < fields->fields->len; ++i) {
+                g_ptr_array_free(fields->field_finfos[i], true);
+            }
+            g_free(fields->field_finfos);
+        }
+
+        arrow_writer_free(fields->arrow);
+        g_free(fields->arrow_types);
+
         for (i = 0; i < fields->fields->len; ++i) {
             char* field = (char *)g_ptr_array_index(fields->fields,i);
             g_free(field);
@@ -2022,6 +2046,10 @@ void output_fields_free(output_fields_t* fields)
         g_ptr_array_free(fields->fields, true);
     }
 
+    if (NULL != fields->arrow_text_fields) {
+        g_hash_table_destroy(fields->arrow_text_fields);
+    }
+
     g_free(fields);
 }
 
@@ -2235,6 +2263,40 @@ bool output_fields_set_option(output_fields_t *info, char *option)
         }
         return true;
     }
+    else if (0 == strcmp(option_name, "batch")) {
+        uint32_t rows;
+
+        if (!ws_strtou32(option_value, NULL, &rows) || rows == 0) {
+            return false;
+        }
+        info->arrow_batch_rows = rows;
+        return true;
+    }
+    else if (0 == strcmp(option_name, "compression")) {
+        arrow_compression_e compression;
+
+        if (0 == strcmp(option_value, "none")) {
+            compression = ARROW_COMPRESSION_NONE;
+        } else if (0 == strcmp(option_value, "lz4")) {
+            compression = ARROW_COMPRESSION_LZ4;
+        } else if (0 == strcmp(option_value, "zstd")) {
+            compression = ARROW_COMPRESSION_ZSTD;
+        } else {
+            return false;
+        }
+        if (!arrow_writer_compression_supported(compression)) {
+            return false;
+        }
+        info->arrow_compression = compression;
+        return true;
+    }
+    else if (0 == strcmp(option_name, "text")) {
+        if (NULL == info->arrow_text_fields) {
+            info->arrow_text_fields = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        }
+        g_hash_table_add(info->arrow_text_fields, g_strdup(option_value));
+        return true;
+    }
 
     return false;
 }
@@ -2248,6 +2310,9 @@ void output_fields_list_options(FILE *fh)
     fputs("occurrence=f|l|a  Select the occurrence of a field to use;\n     \"f\" = first, \"l\" = last, \"a\" = all (def: a: all)\n", fh);
     fputs("aggregator=,|/s|<character>   Set the aggregator to use;\n     \",\" = comma, \"/s\" = space (def: ,: comma)\n", fh);
     fputs("quote=d|s|n   Print either d: double-quotes, s: single quotes or \n     n: no quotes around field values (def: n: none)\n", fh);
+    fputs("batch=<rows>   With -T arrow, the number of rows of a record batch (def: 65536)\n", fh);
+    fputs("compression=none|lz4|zstd   With -T arrow, the compression of the\n     record batches (def: none)\n", fh);
+    fputs("text=<field>   With -T arrow, write the values of the field as text rather\n     than with the type of the field; can be given more than once\n", fh);
 }
 
 bool output_fields_has_cols(output_fields_t* fields)
@@ -2434,50 +2499,107 @@ static void proto_tree_get_node_field_values(proto_node *node, void *data)
     }
 }
 
-static void write_specified_fields(fields_format format, output_fields_t *fields, epan_dissect_t *edt, column_info *cinfo _U_, FILE *fh, json_dumper *dumper)
+/*
+ * Look up the occurrence of a field, by name, in the arrays of the
+ * interesting fields found in the packet. Returns false if they can't
+ * be used in place of walking the tree: if the field wasn't primed, so
+ * that it isn't in the arrays, or if it occurs more than once, as the
+ * arrays are in the order the items were added, which isn't always the
+ * order of the tree.
+ */
+static bool
+get_single_finfo(epan_dissect_t *edt, header_field_info *hfinfo, field_info **found)
 {
-    unsigned    i;
+    GPtrArray *finfos;
 
-    write_field_data_t data;
+    *found = NULL;
+    for (; hfinfo != NULL; hfinfo = hfinfo->same_name_next) {
+        if (hfinfo->ref_type != HF_REF_TYPE_DIRECT && hfinfo->ref_type != HF_REF_TYPE_PRINT)
+            return false;
+        finfos = proto_get_finfo_ptr_array(edt->tree, hfinfo->id);
+        if (finfos == NULL)
+            continue;
+        if (finfos->len > 1 || *found != NULL)
+            return false;
+        *found = (field_info *)g_ptr_array_index(finfos, 0);
+    }
+    return true;
+}
 
-    ws_assert(fields);
-    ws_assert(fields->fields);
-    ws_assert(edt);
-    /* JSON formats must go through json_dumper */
-    if (format == FORMAT_JSON || format == FORMAT_EK) {
-        ws_assert(!fh && dumper);
-    } else {
-        ws_assert(fh && !dumper);
+/*
+ * Get the values of the fields given by name without walking the tree,
+ * when each of them occurs at most once, which is the usual case.
+ */
+static bool
+get_field_values_fast(output_fields_t *fields, epan_dissect_t *edt)
+{
+    header_field_info *hfinfo;
+    field_info        *fi;
+    unsigned           i;
+
+    for (i = 0; i < fields->field_hfinfos->len; i++) {
+        hfinfo = (header_field_info *)g_ptr_array_index(fields->field_hfinfos, i);
+        if (hfinfo != NULL && !get_single_finfo(edt, hfinfo, &fi))
+            return false;
     }
 
-    data.fields = fields;
-    data.edt = edt;
+    for (i = 0; i < fields->field_hfinfos->len; i++) {
+        hfinfo = (header_field_info *)g_ptr_array_index(fields->field_hfinfos, i);
+        if (hfinfo != NULL && get_single_finfo(edt, hfinfo, &fi) && fi != NULL) {
+            format_field_values(fields, GUINT_TO_POINTER(i + 1),
+                                get_node_field_value(fi, edt) /* g_ alloc'd string */
+                );
+        }
+    }
+    return true;
+}
 
-    if (NULL == fields->field_indicies) {
-        /* Prepare a lookup table from string abbreviation for field to its index. */
-        fields->field_indicies = g_hash_table_new(g_str_hash, g_str_equal);
+static void
+output_fields_init_indicies(output_fields_t *fields)
+{
+    unsigned i;
 
-        i = 0;
-        while (i < fields->fields->len) {
-            char *field = (char *)g_ptr_array_index(fields->fields, i);
-            /* Store field indicies +1 so that zero is not a valid value,
-             * and can be distinguished from NULL as a pointer.
-             */
-            ++i;
-            if (proto_registrar_get_byname(field)) {
-                g_hash_table_insert(fields->field_indicies, field, GUINT_TO_POINTER(i));
+    if (NULL != fields->field_indicies)
+        return;
+
+    /* Prepare a lookup table from string abbreviation for field to its index. */
+    fields->field_indicies = g_hash_table_new(g_str_hash, g_str_equal);
+
+    i = 0;
+    while (i < fields->fields->len) {
+        char *field = (char *)g_ptr_array_index(fields->fields, i);
+        /* Store field indicies +1 so that zero is not a valid value,
+         * and can be distinguished from NULL as a pointer.
+         */
+        ++i;
+        if (proto_registrar_get_byname(field)) {
+            g_hash_table_insert(fields->field_indicies, field, GUINT_TO_POINTER(i));
+        }
+    }
+
+    /* And the first hf of each name, for the fields that the lookup
+     * table maps to their index (the last one, if a field is given
+     * more than once). */
+    fields->field_hfinfos = g_ptr_array_sized_new(fields->fields->len);
+    for (i = 0; i < fields->fields->len; i++) {
+        char *field = (char *)g_ptr_array_index(fields->fields, i);
+        header_field_info *hfinfo = NULL;
+
+        if (GPOINTER_TO_UINT(g_hash_table_lookup(fields->field_indicies, field)) == i + 1) {
+            hfinfo = proto_registrar_get_byname(field);
+            while (hfinfo->same_name_prev_id != -1) {
+                hfinfo = proto_registrar_get_nth(hfinfo->same_name_prev_id);
             }
         }
+        g_ptr_array_add(fields->field_hfinfos, hfinfo);
     }
+}
 
-    /* Array buffer to store values for this packet              */
-    /*  Allocate an array for the 'GPtrarray *' the first time   */
-    /*   ths function is invoked for a file;                     */
-    /*  Any and all 'GPtrArray *' are freed (after use) each     */
-    /*   time (each packet) this function is invoked for a flle. */
-    /* XXX: ToDo: use packet-scope'd memory & (if/when implemented) wmem ptr_array */
-    if (NULL == fields->field_values)
-        fields->field_values = g_new0(GPtrArray*, fields->fields->len);  /* free'd in output_fields_free() */
+/* Get the values of the fields given as display filter expressions. */
+static void
+get_dfilter_field_values(output_fields_t *fields, epan_dissect_t *edt)
+{
+    unsigned i;
 
     i = 0;
     while(i < fields->fields->len) {
@@ -2506,9 +2628,44 @@ static void write_specified_fields(fields_format format, output_fields_t *fields
             }
         }
     }
+}
+
+static void write_specified_fields(fields_format format, output_fields_t *fields, epan_dissect_t *edt, column_info *cinfo _U_, FILE *fh, json_dumper *dumper)
+{
+    unsigned    i;
+
+    write_field_data_t data;
+
+    ws_assert(fields);
+    ws_assert(fields->fields);
+    ws_assert(edt);
+    /* JSON formats must go through json_dumper */
+    if (format == FORMAT_JSON || format == FORMAT_EK) {
+        ws_assert(!fh && dumper);
+    } else {
+        ws_assert(fh && !dumper);
+    }
+
+    data.fields = fields;
+    data.edt = edt;
 
-    proto_tree_children_foreach(edt->tree, proto_tree_get_node_field_values,
-                                &data);
+    output_fields_init_indicies(fields);
+
+    /* Array buffer to store values for this packet              */
+    /*  Allocate an array for the 'GPtrarray *' the first time   */
+    /*   ths function is invoked for a file;                     */
+    /*  Any and all 'GPtrArray *' are freed (after use) each     */
+    /*   time (each packet) this function is invoked for a flle. */
+    /* XXX: ToDo: use packet-scope'd memory & (if/when implemented) wmem ptr_array */
+    if (NULL == fields->field_values)
+        fields->field_values = g_new0(GPtrArray*, fields->fields->len);  /* free'd in output_fields_free() */
+
+    get_dfilter_field_values(fields, edt);
+
+    if (!get_field_values_fast(fields, edt)) {
+        proto_tree_children_foreach(edt->tree, proto_tree_get_node_field_values,
+                                    &data);
+    }
 
     switch (format) {
     case FORMAT_CSV:
@@ -2627,6 +2784,261 @@ void write_fields_finale(output_fields_t* fields _U_ , FILE *fh _U_)
     /* Nothing to do */
 }
 
+/*
+ * Arrow output: the values of the fields given by name are written with
+ * the type of the field, unless they were asked to be written as text;
+ * the values of expressions are written as text, as with -T fields.
+ */
+static unsigned
+arrow_int_width(ftenum_t ftype)
+{
+    switch (ftype) {
+    case FT_CHAR:
+    case FT_UINT8:
+    case FT_INT8:
+        return 8;
+    case FT_UINT16:
+    case FT_INT16:
+        return 16;
+    default:
+        return FT_IS_UINT32(ftype) || FT_IS_INT32(ftype) ? 32 : 64;
+    }
+}
+
+static arrow_type_e
+arrow_ftype(ftenum_t ftype)
+{
+    if (FT_IS_UINT(ftype))
+        return ARROW_TYPE_UINT;
+    if (FT_IS_INT(ftype))
+        return ARROW_TYPE_INT;
+    if (FT_IS_FLOATING(ftype))
+        return ARROW_TYPE_DOUBLE;
+    switch (ftype) {
+    case FT_BOOLEAN:
+        return ARROW_TYPE_BOOL;
+    case FT_ABSOLUTE_TIME:
+        return ARROW_TYPE_TIMESTAMP;
+    case FT_RELATIVE_TIME:
+        return ARROW_TYPE_DURATION;
+    case FT_BYTES:
+    case FT_UINT_BYTES:
+        return ARROW_TYPE_BINARY;
+    default:
+        return ARROW_TYPE_UTF8;
+    }
+}
+
+/* The type of the values of a field, or text if the fields with its name
+ * don't all have the same kind of type. */
+static arrow_type_e
+arrow_field_type(output_fields_t *fields, const char *field, unsigned *bit_width)
+{
+    header_field_info *hfinfo = proto_registrar_get_byname(field);
+    arrow_type_e type = ARROW_TYPE_UTF8;
+
+    *bit_width = 0;
+    if (hfinfo == NULL ||
+        (fields->arrow_text_fields && g_hash_table_contains(fields->arrow_text_fields, field)))
+        return ARROW_TYPE_UTF8;
+
+    while (hfinfo->same_name_prev_id != -1) {
+        hfinfo = proto_registrar_get_nth(hfinfo->same_name_prev_id);
+    }
+    type = arrow_ftype(hfinfo->type);
+    for (; hfinfo != NULL; hfinfo = hfinfo->same_name_next) {
+        if (arrow_ftype(hfinfo->type) != type)
+            return ARROW_TYPE_UTF8;
+        if (FT_IS_INTEGER(hfinfo->type))
+            *bit_width = MAX(*bit_width, arrow_int_width(hfinfo->type));
+    }
+    return type;
+}
+
+static void
+proto_tree_get_node_field_finfos(proto_node *node, void *data)
+{
+    output_fields_t *fields = (output_fields_t *)data;
+    field_info *fi = PNODE_FINFO(node);
+    void *field_index;
+
+    /* check for a faked item with an invisible tree */
+    if (fi) {
+        field_index = g_hash_table_lookup(fields->field_indicies, fi->hfinfo->abbrev);
+        if (NULL != field_index) {
+            g_ptr_array_add(fields->field_finfos[GPOINTER_TO_UINT(field_index) - 1], fi);
+        }
+    }
+
+    /* Recurse here. */
+    if (node->first_child != NULL) {
+        proto_tree_children_foreach(node, proto_tree_get_node_field_finfos, fields);
+    }
+}
+
+/* Get the occurrences of the fields given by name, in the order of the
+ * tree. */
+static void
+get_field_finfos(output_fields_t *fields, epan_dissect_t *edt)
+{
+    header_field_info *hfinfo;
+    field_info        *fi;
+    unsigned           i;
+
+    for (i = 0; i < fields->fields->len; i++) {
+        g_ptr_array_set_size(fields->field_finfos[i], 0);
+    }
+
+    for (i = 0; i < fields->field_hfinfos->len; i++) {
+        hfinfo = (header_field_info *)g_ptr_array_index(fields->field_hfinfos, i);
+        if (hfinfo != NULL && !get_single_finfo(edt, hfinfo, &fi)) {
+            proto_tree_children_foreach(edt->tree, proto_tree_get_node_field_finfos, fields);
+            return;
+        }
+    }
+
+    for (i = 0; i < fields->field_hfinfos->len; i++) {
+        hfinfo = (header_field_info *)g_ptr_array_index(fields->field_hfinfos, i);
+        if (hfinfo != NULL && get_single_finfo(edt, hfinfo, &fi) && fi != NULL) {
+            g_ptr_array_add(fields->field_finfos[i], fi);
+        }
+    }
+}
+
+static void
+write_arrow_value(output_fields_t *fields, unsigned column, field_info *fi, epan_dissect_t *edt)
+{
+    const nstime_t *ts;
+    uint64_t        uvalue;
+    int64_t         svalue;
+    double          dvalue;
+    const uint8_t  *bytes;
+    char           *str;
+
+    switch (fields->arrow_types[column]) {
+    case ARROW_TYPE_UINT:
+        if (fvalue_to_uinteger64(fi->value, &uvalue) == FT_OK)
+            arrow_writer_append_uint(fields->arrow, column, uvalue);
+        break;
+    case ARROW_TYPE_INT:
+        if (fvalue_to_sinteger64(fi->value, &svalue) == FT_OK)
+            arrow_writer_append_int(fields->arrow, column, svalue);
+        break;
+    case ARROW_TYPE_BOOL:
+        if (fvalue_to_uinteger64(fi->value, &uvalue) == FT_OK)
+            arrow_writer_append_bool(fields->arrow, column, uvalue != 0);
+        break;
+    case ARROW_TYPE_DOUBLE:
+        if (fvalue_to_double(fi->value, &dvalue) == FT_OK)
+            arrow_writer_append_double(fields->arrow, column, dvalue);
+        break;
+    case ARROW_TYPE_TIMESTAMP:
+    case ARROW_TYPE_DURATION:
+        ts = fvalue_get_time(fi->value);
+        arrow_writer_append_int(fields->arrow, column,
+                                (int64_t)ts->secs * INT64_C(1000000000) + ts->nsecs);
+        break;
+    case ARROW_TYPE_BINARY:
+        bytes = (const uint8_t *)fvalue_get_bytes_data(fi->value);
+        if (bytes)
+            arrow_writer_append_binary(fields->arrow, column, bytes,
+                                       fvalue_get_bytes_size(fi->value));
+        break;
+    case ARROW_TYPE_UTF8:
+        str = get_node_field_value(fi, edt);
+        if (str)
+            arrow_writer_append_string(fields->arrow, column, str);
+        g_free(str);
+        break;
+    }
+}
+
+void write_arrow_preamble(output_fields_t* fields, FILE *fh)
+{
+    arrow_type_e type;
+    unsigned     bit_width;
+
+    ws_assert(fields);
+    ws_assert(fh);
+    ws_assert(fields->fields);
+
+    fields->arrow = arrow_writer_new(fh, fields->arrow_batch_rows, fields->arrow_compression);
+    fields->arrow_types = g_new(arrow_type_e, fields->fields->len);
+    for (unsigned i = 0; i < fields->fields->len; ++i) {
+        const char* field = (const char *)g_ptr_array_index(fields->fields, i);
+
+        type = arrow_field_type(fields, field, &bit_width);
+        fields->arrow_types[i] = type;
+        /* With occurrence=a, each row holds the list of the values. */
+        arrow_writer_add_column(fields->arrow, field, type, bit_width, fields->occurrence == 'a');
+    }
+    arrow_writer_begin(fields->arrow);
+}
+
+void write_arrow_proto_tree(output_fields_t* fields, epan_dissect_t *edt, column_info *cinfo _U_)
+{
+    GPtrArray *values;
+    unsigned   i, j, first, last;
+
+    ws_assert(fields);
+    ws_assert(fields->arrow);
+    ws_assert(edt);
+
+    output_fields_init_indicies(fields);
+    if (NULL == fields->field_values)
+        fields->field_values = g_new0(GPtrArray*, fields->fields->len);  /* free'd in output_fields_free() */
+    if (NULL == fields->field_finfos) {
+        fields->field_finfos = g_new(GPtrArray*, fields->fields->len);  /* free'd in output_fields_free() */
+        for (i = 0; i < fields->fields->len; i++) {
+            fields->field_finfos[i] = g_ptr_array_new();
+        }
+    }
+
+    get_dfilter_field_values(fields, edt);
+    get_field_finfos(fields, edt);
+
+    for (i = 0; i < fields->fields->len; i++) {
+        if (NULL != fields->field_values[i]) {
+            /* The text of an expression, already only the occurrences
+             * asked for. */
+            values = fields->field_values[i];
+            for (j = 0; j < g_ptr_array_len(values); j++) {
+                arrow_writer_append_string(fields->arrow, i, (char *)g_ptr_array_index(values, j));
+            }
+            g_ptr_array_free(values, true);  /* get ready for the next packet */
+            fields->field_values[i] = NULL;
+            continue;
+        }
+
+        values = fields->field_finfos[i];
+        if (g_ptr_array_len(values) == 0)
+            continue;
+        first = 0;
+        last = g_ptr_array_len(values) - 1;
+        if (fields->occurrence == 'f')
+            last = first;
+        else if (fields->occurrence == 'l')
+            first = last;
+        for (j = first; j <= last; j++) {
+            write_arrow_value(fields, i, (field_info *)g_ptr_array_index(values, j), edt);
+        }
+    }
+    arrow_writer_end_row(fields->arrow);
+}
+
+bool write_arrow_finale(output_fields_t* fields)
+{
+    bool ok;
+
+    ws_assert(fields);
+    ws_assert(fields->arrow);
+
+    ok = arrow_writer_finish(fields->arrow);
+    arrow_writer_free(fields->arrow);
+    fields->arrow = NULL;
+    return ok;
+}
+
 /* Returns an g_malloced string */
 char* get_node_field_value(field_info* fi, epan_dissect_t* edt)
 {
@@ -2762,11 +3174,18 @@ output_fields_t* output_fields_new(void)
     fields->fields              = NULL; /*Do lazy initialisation */
     fields->field_dfilters      = NULL;
     fields->field_indicies      = NULL;
+    fields->field_hfinfos       = NULL;
     fields->field_values        = NULL;
     fields->protocolfilter      = NULL;
     fields->quote               ='\0';
     fields->escape              = true;
     fields->includes_col_fields = false;
+    fields->arrow_batch_rows    = ARROW_WRITER_DEFAULT_BATCH_ROWS;
+    fields->arrow_compression   = ARROW_COMPRESSION_NONE;
+    fields->arrow_text_fields   = NULL;
+    fields->arrow               = NULL;
+    fields->arrow_types         = NULL;
+    fields->field_finfos        = NULL;
     return fields;
 }
 
@@ -41,6 +41,7 @@
 #include "epan_dissect.h"
 #include "dfilter/dfilter.h"
 #include "tvbuff.h"
+#include "tvbuff-int.h"
 #include "charsets.h"
 #include "column-info.h"
 #include "to_str.h"
@@ -301,6 +302,10 @@ static void
 proto_tree_set_bytes(field_info *fi, const uint8_t* start_ptr, int length);
 static void
 proto_tree_set_bytes_tvb(field_info *fi, tvbuff_t *tvb, int offset, int length);
+static bool
+tvb_data_outlives_tree(tvbuff_t *tvb);
+static void
+proto_tree_set_bytes_tvb_borrowed(field_info *fi, tvbuff_t *tvb, int offset, int length);
 static void
 proto_tree_set_bytes_gbytearray(field_info *fi, const GByteArray *value);
 static void
@@ -398,6 +403,7 @@ struct _protocol {
 	bool        is_enabled;         /* true if protocol is enabled */
 	bool        enabled_by_default; /* true if protocol is enabled by default */
 	bool        can_toggle;         /* true if is_enabled can be changed */
+	bool        is_state_bearing;   /* true if other protocols depend on its state */
 	int         parent_proto_id;    /* Used to identify "pino"s (Protocol In Name Only).
 	                                   For dissectors that need a protocol name so they
 	                                   can be added to a dissector table, but use the
@@ -474,6 +480,20 @@ static GHashTable *gpa_protocol_aliases;
 static char *last_field_name;
 static header_field_info *last_hfinfo;
 
+/* Dense slots of the fields that have been primed as interesting, so
+ * that a tree keeps the field_info pointers it found in a flat array.
+ * interesting_slots[hfid] is the slot of a field plus one, or 0. */
+static uint32_t *interesting_slots;
+static uint32_t interesting_slots_len;
+static GArray *interesting_slot_hfids;	/* int, per slot */
+
+/* The protocols of the referenced fields, see proto_referenced_protocols(),
+ * rebuilt when the generation changes, which it does whenever the
+ * reference type of a field does. */
+static unsigned referenced_generation;
+static unsigned referenced_protos_generation = UINT_MAX;
+static GArray *referenced_protos;	/* int */
+
 static void save_same_name_hfinfo(void *data)
 {
 	same_name_hfinfo = (header_field_info*)data;
@@ -745,6 +765,19 @@ proto_cleanup_base(void)
 	g_free(tree_is_expanded);
 	tree_is_expanded = NULL;
 
+	g_free(interesting_slots);
+	interesting_slots = NULL;
+	interesting_slots_len = 0;
+	if (interesting_slot_hfids) {
+		g_array_free(interesting_slot_hfids, true);
+		interesting_slot_hfids = NULL;
+	}
+	if (referenced_protos) {
+		g_array_free(referenced_protos, true);
+		referenced_protos = NULL;
+	}
+	referenced_protos_generation = UINT_MAX;
+
 	if (prefixes)
 		g_hash_table_destroy(prefixes);
 }
@@ -806,28 +839,37 @@ proto_tree_children_foreach(proto_tree *tree, proto_tree_foreach_func func,
 	}
 }
 
+/* Empty the field_info arrays of the interesting fields found in the
+ * packet, keeping them for the next one. */
 static void
-free_GPtrArray_value(void *key, void *value, void *user_data _U_)
+tree_data_reset_interesting_fields(tree_data_t *tree_data)
 {
-	GPtrArray         *ptrs = (GPtrArray *)value;
-	int                hfid = GPOINTER_TO_UINT(key);
+	unsigned           slot;
+	int                hfid;
 	header_field_info *hfinfo;
 
-	PROTO_REGISTRAR_GET_NTH(hfid, hfinfo);
-	if (hfinfo->ref_type != HF_REF_TYPE_NONE) {
-		/* when a field is referenced by a filter this also
-		   affects the refcount for the parent protocol so we need
-		   to adjust the refcount for the parent as well
-		*/
-		if (hfinfo->parent != -1) {
-			header_field_info *parent_hfinfo;
-			PROTO_REGISTRAR_GET_NTH(hfinfo->parent, parent_hfinfo);
-			parent_hfinfo->ref_type = HF_REF_TYPE_NONE;
+	for (unsigned i = 0; i < tree_data->num_found_slots; i++) {
+		slot = tree_data->found_slots[i];
+		hfid = g_array_index(interesting_slot_hfids, int, slot);
+
+		PROTO_REGISTRAR_GET_NTH(hfid, hfinfo);
+		if (hfinfo->ref_type != HF_REF_TYPE_NONE) {
+			/* when a field is referenced by a filter this also
+			   affects the refcount for the parent protocol so we need
+			   to adjust the refcount for the parent as well
+			*/
+			if (hfinfo->parent != -1) {
+				header_field_info *parent_hfinfo;
+				PROTO_REGISTRAR_GET_NTH(hfinfo->parent, parent_hfinfo);
+				parent_hfinfo->ref_type = HF_REF_TYPE_NONE;
+			}
+			hfinfo->ref_type = HF_REF_TYPE_NONE;
+			referenced_generation++;
 		}
-		hfinfo->ref_type = HF_REF_TYPE_NONE;
-	}
 
-	g_ptr_array_free(ptrs, true);
+		g_ptr_array_set_size(tree_data->interesting_finfos[slot], 0);
+	}
+	tree_data->num_found_slots = 0;
 }
 
 static void
@@ -851,14 +893,7 @@ proto_tree_reset(proto_tree *tree)
 	proto_tree_children_foreach(tree, proto_tree_free_node, NULL);
 
 	/* free tree data */
-	if (tree_data->interesting_hfids) {
-		/* Free all the GPtrArray's in the interesting_hfids hash. */
-		g_hash_table_foreach(tree_data->interesting_hfids,
-			free_GPtrArray_value, NULL);
-
-		/* And then remove all values. */
-		g_hash_table_remove_all(tree_data->interesting_hfids);
-	}
+	tree_data_reset_interesting_fields(tree_data);
 
 	/* Reset track of the number of children */
 	tree_data->count = 0;
@@ -879,14 +914,13 @@ proto_tree_free(proto_tree *tree)
 	proto_tree_children_foreach(tree, proto_tree_free_node, NULL);
 
 	/* free tree data */
-	if (tree_data->interesting_hfids) {
-		/* Free all the GPtrArray's in the interesting_hfids hash. */
-		g_hash_table_foreach(tree_data->interesting_hfids,
-			free_GPtrArray_value, NULL);
-
-		/* And then destroy the hash. */
-		g_hash_table_destroy(tree_data->interesting_hfids);
+	tree_data_reset_interesting_fields(tree_data);
+	for (unsigned slot = 0; slot < tree_data->num_interesting_slots; slot++) {
+		if (tree_data->interesting_finfos[slot])
+			g_ptr_array_free(tree_data->interesting_finfos[slot], true);
 	}
+	g_free(tree_data->interesting_finfos);
+	g_free(tree_data->found_slots);
 
 	g_slice_free(tree_data_t, tree_data);
 
@@ -943,6 +977,40 @@ proto_field_is_referenced(proto_tree *tree, int proto_id)
 	return false;
 }
 
+const int *
+proto_referenced_protocols(unsigned *count)
+{
+	header_field_info *hfinfo;
+	int                proto_id;
+	unsigned           i;
+
+	if (referenced_protos == NULL)
+		referenced_protos = g_array_new(false, false, sizeof(int));
+
+	if (referenced_protos_generation != referenced_generation) {
+		g_array_set_size(referenced_protos, 0);
+		/* Every field that is referenced has been given a slot. */
+		for (unsigned slot = 0; interesting_slot_hfids && slot < interesting_slot_hfids->len; slot++) {
+			hfinfo = gpa_hfinfo.hfi[g_array_index(interesting_slot_hfids, int, slot)];
+			if (hfinfo == NULL ||
+			    (hfinfo->ref_type != HF_REF_TYPE_DIRECT && hfinfo->ref_type != HF_REF_TYPE_PRINT))
+				continue;
+
+			proto_id = hfinfo->parent == -1 ? hfinfo->id : hfinfo->parent;
+			for (i = 0; i < referenced_protos->len; i++) {
+				if (g_array_index(referenced_protos, int, i) == proto_id)
+					break;
+			}
+			if (i == referenced_protos->len)
+				g_array_append_val(referenced_protos, proto_id);
+		}
+		referenced_protos_generation = referenced_generation;
+	}
+
+	*count = referenced_protos->len;
+	return (const int *)(void *)referenced_protos->data;
+}
+
 
 /* Finds a record in the hfinfo array by id. */
 header_field_info *
@@ -2641,32 +2709,61 @@ get_time_value(proto_tree *tree, tvbuff_t *tvb, const int start,
 	}
 }
 
+static void
+interesting_slot_assign(const int hfid)
+{
+	uint32_t new_len;
+
+	if ((uint32_t)hfid >= interesting_slots_len) {
+		new_len = MAX(gpa_hfinfo.len, (uint32_t)hfid + 1);
+		interesting_slots = g_renew(uint32_t, interesting_slots, new_len);
+		memset(interesting_slots + interesting_slots_len, 0,
+		    (new_len - interesting_slots_len) * sizeof(uint32_t));
+		interesting_slots_len = new_len;
+	}
+	if (interesting_slots[hfid] == 0) {
+		if (interesting_slot_hfids == NULL)
+			interesting_slot_hfids = g_array_new(false, false, sizeof(int));
+		g_array_append_val(interesting_slot_hfids, hfid);
+		interesting_slots[hfid] = interesting_slot_hfids->len;
+	}
+}
+
 static void
 tree_data_add_maybe_interesting_field(tree_data_t *tree_data, field_info *fi)
 {
 	const header_field_info *hfinfo = fi->hfinfo;
+	GPtrArray *ptrs;
+	unsigned slot, num_slots;
 
-	if (hfinfo->ref_type == HF_REF_TYPE_DIRECT || hfinfo->ref_type == HF_REF_TYPE_PRINT) {
-		GPtrArray *ptrs = NULL;
+	if (hfinfo->ref_type != HF_REF_TYPE_DIRECT && hfinfo->ref_type != HF_REF_TYPE_PRINT)
+		return;
 
-		if (tree_data->interesting_hfids == NULL) {
-			/* Initialize the hash because we now know that it is needed */
-			tree_data->interesting_hfids =
-				g_hash_table_new(g_direct_hash, NULL /* g_direct_equal */);
-		} else if (g_hash_table_size(tree_data->interesting_hfids)) {
-			ptrs = (GPtrArray *)g_hash_table_lookup(tree_data->interesting_hfids,
-					   GINT_TO_POINTER(hfinfo->id));
-		}
+	/* Fields are given a slot when they are primed. */
+	if ((uint32_t)hfinfo->id >= interesting_slots_len || interesting_slots[hfinfo->id] == 0)
+		interesting_slot_assign(hfinfo->id);
+	slot = interesting_slots[hfinfo->id] - 1;
 
-		if (!ptrs) {
-			/* First element triggers the creation of pointer array */
-			ptrs = g_ptr_array_new();
-			g_hash_table_insert(tree_data->interesting_hfids,
-					    GINT_TO_POINTER(hfinfo->id), ptrs);
-		}
+	if (slot >= tree_data->num_interesting_slots) {
+		num_slots = interesting_slot_hfids->len;
+		tree_data->interesting_finfos = g_renew(GPtrArray *,
+		    tree_data->interesting_finfos, num_slots);
+		memset(tree_data->interesting_finfos + tree_data->num_interesting_slots, 0,
+		    (num_slots - tree_data->num_interesting_slots) * sizeof(GPtrArray *));
+		tree_data->found_slots = g_renew(unsigned, tree_data->found_slots, num_slots);
+		tree_data->num_interesting_slots = num_slots;
+	}
 
-		g_ptr_array_add(ptrs, fi);
+	ptrs = tree_data->interesting_finfos[slot];
+	if (ptrs == NULL) {
+		/* The array is kept for the next packets */
+		ptrs = g_ptr_array_new();
+		tree_data->interesting_finfos[slot] = ptrs;
 	}
+	if (ptrs->len == 0)
+		tree_data->found_slots[tree_data->num_found_slots++] = slot;
+
+	g_ptr_array_add(ptrs, fi);
 }
 
 
@@ -2765,12 +2862,12 @@ proto_tree_new_item(field_info *new_fi, proto_tree *tree,
 			break;
 
 		case FT_BYTES:
-			proto_tree_set_bytes_tvb(new_fi, tvb, start, length);
+			proto_tree_set_bytes_tvb_borrowed(new_fi, tvb, start, length);
 			break;
 
 		case FT_UINT_BYTES:
 			n = get_uint_value(tree, tvb, start, length, encoding);
-			proto_tree_set_bytes_tvb(new_fi, tvb, start + length, n);
+			proto_tree_set_bytes_tvb_borrowed(new_fi, tvb, start + length, n);
 
 			/* Instead of calling proto_item_set_len(), since we don't yet
 			 * have a proto_item, we set the field_info's length ourselves. */
@@ -2935,7 +3032,10 @@ proto_tree_new_item(field_info *new_fi, proto_tree *tree,
 				length_error = length < FT_ETHER_LEN ? true : false;
 				report_type_length_mismatch(tree, "a MAC address", length, length_error);
 			}
-			proto_tree_set_ether_tvb(new_fi, tvb, start);
+			if (tvb_data_outlives_tree(tvb))
+				fvalue_set_bytes_borrowed(new_fi->value, tvb_get_ptr(tvb, start, FT_ETHER_LEN), FT_ETHER_LEN);
+			else
+				proto_tree_set_ether_tvb(new_fi, tvb, start);
 			break;
 
 		case FT_EUI64:
@@ -4854,6 +4954,33 @@ proto_tree_set_bytes_tvb(field_info *fi, tvbuff_t *tvb, int offset, int length)
 	proto_tree_set_bytes(fi, tvb_get_ptr(tvb, offset, length), length);
 }
 
+/*
+ * Whether the data of a tvbuff lives as long as the protocol tree, so that
+ * field values can point to it instead of copying it. That's the case for
+ * the data sources of the packet and the tvbuffs backed by them, which are
+ * freed only when the packet is; other tvbuffs may be freed by the
+ * dissector that created them. add_new_data_source() flags the data source
+ * tvbuff, so this doesn't search the packet's list of data sources.
+ */
+static bool
+tvb_data_outlives_tree(tvbuff_t *tvb)
+{
+	return tvb_backed_by_data_source(tvb);
+}
+
+/* Set the FT_BYTES value without copying the data, if possible. */
+static void
+proto_tree_set_bytes_tvb_borrowed(field_info *fi, tvbuff_t *tvb, int offset, int length)
+{
+	if (length > 0 && tvb_data_outlives_tree(tvb)) {
+		tvb_ensure_bytes_exist(tvb, offset, length);
+		fvalue_set_bytes_borrowed(fi->value, tvb_get_ptr(tvb, offset, length), length);
+	}
+	else {
+		proto_tree_set_bytes_tvb(fi, tvb, offset, length);
+	}
+}
+
 static void
 proto_tree_set_bytes_gbytearray(field_info *fi, const GByteArray *value)
 {
@@ -6855,7 +6982,7 @@ new_field_info(proto_tree *tree, header_field_info *hfinfo, tvbuff_t *tvb,
 			FI_SET_FLAG(fi, FI_HIDDEN);
 		}
 	}
-	fi->value = fvalue_new(fi->hfinfo->type);
+	fi->value = fvalue_new_scoped(PNODE_POOL(tree), fi->hfinfo->type);
 	fi->rep        = NULL;
 
 	/* add the data source tvbuff */
@@ -7955,8 +8082,11 @@ proto_tree_create_root(packet_info *pinfo)
 	/* Make sure we can access pinfo everywhere */
 	pnode->tree_data->pinfo = pinfo;
 
-	/* Don't initialize the tree_data_t. Wait until we know we need it */
-	pnode->tree_data->interesting_hfids = NULL;
+	/* Don't allocate the interesting fields arrays. Wait until we know we need them */
+	pnode->tree_data->interesting_finfos = NULL;
+	pnode->tree_data->num_interesting_slots = 0;
+	pnode->tree_data->found_slots = NULL;
+	pnode->tree_data->num_found_slots = 0;
 
 	/* Set the default to false so it's easier to
 	 * find errors; if we expect to see the protocol tree
@@ -7992,8 +8122,11 @@ proto_tree_prime_with_hfid(proto_tree *tree _U_, const int hfid)
 	   type, as that is a superset of direct reference.
 	*/
 	if (hfinfo->ref_type != HF_REF_TYPE_PRINT) {
+		if (hfinfo->ref_type != HF_REF_TYPE_DIRECT)
+			referenced_generation++;
 		hfinfo->ref_type = HF_REF_TYPE_DIRECT;
 	}
+	interesting_slot_assign(hfid);
 	/* only increase the refcount if there is a parent.
 	   if this is a protocol and not a field then parent will be -1
 	   and there is no parent to add any refcounting for.
@@ -8021,7 +8154,10 @@ proto_tree_prime_with_hfid_print(proto_tree *tree _U_, const int hfid)
 	/* this field is referenced by an (output) filter so increase the refcount.
 	   also increase the refcount for the parent, i.e the protocol.
 	*/
+	if (hfinfo->ref_type != HF_REF_TYPE_PRINT)
+		referenced_generation++;
 	hfinfo->ref_type = HF_REF_TYPE_PRINT;
+	interesting_slot_assign(hfid);
 	/* only increase the refcount if there is a parent.
 	   if this is a protocol and not a field then parent will be -1
 	   and there is no parent to add any refcounting for.
@@ -8275,6 +8411,7 @@ proto_register_protocol(const char *name, const char *short_name,
 	protocol->is_enabled = true; /* protocol is enabled by default */
 	protocol->enabled_by_default = true; /* see previous comment */
 	protocol->can_toggle = true;
+	protocol->is_state_bearing = false;
 	protocol->parent_proto_id = -1;
 	protocol->heur_list = NULL;
 
@@ -8333,6 +8470,7 @@ proto_register_protocol_in_name_only(const char *name, const char *short_name, c
 	protocol->is_enabled = true;
 	protocol->enabled_by_default = true;
 	protocol->can_toggle = true;
+	protocol->is_state_bearing = false;
 
 	protocol->parent_proto_id = parent_proto;
 	protocol->heur_list = NULL;
@@ -8827,6 +8965,29 @@ proto_set_cant_toggle(const int proto_id)
 	protocol->can_toggle = false;
 }
 
+void
+proto_set_state_bearing(const int proto_id)
+{
+	protocol_t *protocol;
+
+	protocol = find_protocol_by_id(proto_id);
+	protocol->is_state_bearing = true;
+}
+
+bool
+// NOLINTNEXTLINE(misc-no-recursion)
+proto_is_state_bearing(const protocol_t *protocol)
+{
+	if (protocol == NULL)
+		return false;
+
+	//parent protocol determines it for helper dissectors
+	if (proto_is_pino(protocol))
+		return proto_is_state_bearing(find_protocol_by_id(protocol->parent_proto_id));
+
+	return protocol->is_state_bearing;
+}
+
 static int
 proto_register_field_common(protocol_t *proto, header_field_info *hfi, const int parent)
 {
@@ -11367,27 +11528,35 @@ proto_check_for_protocol_or_field(const proto_tree* tree, const int id)
 GPtrArray *
 proto_get_finfo_ptr_array(const proto_tree *tree, const int id)
 {
+	tree_data_t *tree_data;
+	GPtrArray   *ptrs;
+	unsigned     slot;
+
 	if (!tree)
 		return NULL;
 
-	if (PTREE_DATA(tree)->interesting_hfids != NULL)
-		return (GPtrArray *)g_hash_table_lookup(PTREE_DATA(tree)->interesting_hfids,
-					   GINT_TO_POINTER(id));
-	else
+	if (id < 0 || (uint32_t)id >= interesting_slots_len || interesting_slots[id] == 0)
+		return NULL;
+	slot = interesting_slots[id] - 1;
+
+	tree_data = PTREE_DATA(tree);
+	if (slot >= tree_data->num_interesting_slots)
 		return NULL;
+
+	/* Arrays are kept empty for the fields not found in this packet. */
+	ptrs = tree_data->interesting_finfos[slot];
+	if (ptrs == NULL || ptrs->len == 0)
+		return NULL;
+	return ptrs;
 }
 
 bool
 proto_tracking_interesting_fields(const proto_tree *tree)
 {
-	GHashTable *interesting_hfids;
-
 	if (!tree)
 		return false;
 
-	interesting_hfids = PTREE_DATA(tree)->interesting_hfids;
-
-	return (interesting_hfids != NULL) && g_hash_table_size(interesting_hfids);
+	return PTREE_DATA(tree)->num_found_slots > 0;
 }
 
 /* Helper struct for proto_find_info() and	proto_all_finfos() */
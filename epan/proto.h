@@ -890,7 +890,14 @@ typedef struct
 /** One of these exists for the entire protocol tree. Each proto_node
  * in the protocol tree points to the same copy. */
 typedef struct {
-    GHashTable          *interesting_hfids;
+    /** Per interesting field slot (see proto_tree_prime_with_hfid()),
+     *  the field_info pointers found in the packet, or NULL. */
+    GPtrArray          **interesting_finfos;
+    unsigned             num_interesting_slots;
+    /** Slots with at least one field_info, so that resetting only
+     *  visits those. */
+    unsigned            *found_slots;
+    unsigned             num_found_slots;
     bool                 visible;
     bool                 fake_protocols;
     unsigned             count;
@@ -1119,6 +1126,12 @@ extern void proto_cleanup(void);
 */
 WS_DLL_PUBLIC bool proto_field_is_referenced(proto_tree *tree, int proto_id);
 
+/** Get the protocols that have a field referenced by a filter, or that
+    are referenced themselves.
+ @param[out] count the number of protocols
+ @return their ids, valid until the referenced fields change */
+extern const int *proto_referenced_protocols(unsigned *count);
+
 /** Create a subtree under an existing item.
  @param pi the parent item of the new subtree
  @param idx one of the ett_ array elements registered with proto_register_subtree_array()
@@ -2887,6 +2900,18 @@ WS_DLL_PUBLIC void proto_reenable_all(void);
  @param proto_id protocol id (0-indexed) */
 WS_DLL_PUBLIC void proto_set_cant_toggle(const int proto_id);
 
+/** Mark a protocol as keeping state that the dissection of other
+ * protocols or of later packets depends on, for instance a signalling
+ * protocol that sets up the conversations of a media protocol, so that
+ * it is dissected even when nothing references it.
+ @param proto_id protocol id (0-indexed) */
+WS_DLL_PUBLIC void proto_set_state_bearing(const int proto_id);
+
+/** Is the protocol marked as keeping state for other protocols?
+ @param protocol the protocol
+ @return true if it is */
+WS_DLL_PUBLIC bool proto_is_state_bearing(const protocol_t *protocol);
+
 /** Checks for existence any protocol or field within a tree.
  @param tree "Protocols" are assumed to be a child of the [empty] root node.
  @param id hfindex of protocol or field
@@ -13,6 +13,7 @@
 #include <string.h>
 
 #include <epan/packet.h>
+#include <epan/app_mem_usage.h>
 #include <epan/exceptions.h>
 #include <epan/reassemble.h>
 #include <epan/tvbuff-int.h>
@@ -20,6 +21,12 @@
 #include <wsutil/str_util.h>
 #include <wsutil/ws_assert.h>
 
+/*
+ * The built-in keys hold addresses of up to this many bytes (which covers
+ * IPv4, IPv6 and MAC addresses) inline, rather than a copy of them.
+ */
+#define FRAGMENT_KEY_ADDRESS_LEN	16
+
 /*
  * Functions for reassembly tables where the endpoint addresses, and a
  * fragment ID, are used as the key.
@@ -28,32 +35,44 @@ typedef struct _fragment_addresses_key {
 	address src;
 	address dst;
 	uint32_t id;
+	uint8_t src_data[FRAGMENT_KEY_ADDRESS_LEN];
+	uint8_t dst_data[FRAGMENT_KEY_ADDRESS_LEN];
 } fragment_addresses_key;
 
 GList* reassembly_table_list;
 
+/*
+ * Copy an address into a persistent key, inline if it fits in the key's
+ * buffer. free_address() frees it in either case.
+ */
+static void
+copy_key_address(address *to, uint8_t *to_data, const address *from)
+{
+	if (from->len > FRAGMENT_KEY_ADDRESS_LEN) {
+		copy_address(to, from);
+	} else if (from->len > 0) {
+		memcpy(to_data, from->data, from->len);
+		set_address(to, from->type, from->len, to_data);
+	} else {
+		set_address(to, from->type, 0, NULL);
+	}
+}
+
 static unsigned
 fragment_addresses_hash(const void *k)
 {
 	const fragment_addresses_key* key = (const fragment_addresses_key*) k;
 	unsigned hash_val;
-/*
-	int i;
-*/
-
-	hash_val = 0;
-
-/*	More than likely: in most captures src and dst addresses are the
-	same, and would hash the same.
-	We only use id as the hash as an optimization.
-
-	for (i = 0; i < key->src.len; i++)
-		hash_val += key->src.data[i];
-	for (i = 0; i < key->dst.len; i++)
-		hash_val += key->dst.data[i];
-*/
 
-	hash_val += key->id;
+	/*
+	 * The IDs of different flows are often the same (e.g., IP IDs
+	 * that start at 0, or are incremented by all the flows from a
+	 * host), so mix in the addresses to keep them in different
+	 * buckets.
+	 */
+	hash_val = key->id;
+	hash_val = add_address_to_hash(hash_val, &key->src);
+	hash_val = add_address_to_hash(hash_val, &key->dst);
 
 	return hash_val;
 }
@@ -75,22 +94,33 @@ fragment_addresses_equal(const void *k1, const void *k2)
 }
 
 /*
- * Create a fragment key for temporary use; it can point to non-
- * persistent data, and so must only be used to look up and
- * delete entries, not to add them.
+ * Fill in a key for temporary use; it points to non-persistent data,
+ * and so must only be used to look up and delete entries, not to add
+ * them.
  */
-static void *
-fragment_addresses_temporary_key(const packet_info *pinfo, const uint32_t id,
-				 const void *data _U_)
+static void
+fragment_addresses_init_temporary_key(fragment_addresses_key *key,
+				      const packet_info *pinfo, const uint32_t id)
 {
-	fragment_addresses_key *key = g_slice_new(fragment_addresses_key);
-
 	/*
 	 * Do a shallow copy of the addresses.
 	 */
 	copy_address_shallow(&key->src, &pinfo->src);
 	copy_address_shallow(&key->dst, &pinfo->dst);
 	key->id = id;
+}
+
+/*
+ * Create a fragment key for temporary use. (lookup_fd_head() doesn't
+ * call this, it fills in a key on the stack.)
+ */
+static void *
+fragment_addresses_temporary_key(const packet_info *pinfo, const uint32_t id,
+				 const void *data _U_)
+{
+	fragment_addresses_key *key = g_slice_new(fragment_addresses_key);
+
+	fragment_addresses_init_temporary_key(key, pinfo, id);
 
 	return (void *)key;
 }
@@ -108,8 +138,8 @@ fragment_addresses_persistent_key(const packet_info *pinfo, const uint32_t id,
 	/*
 	 * Do a deep copy of the addresses.
 	 */
-	copy_address(&key->src, &pinfo->src);
-	copy_address(&key->dst, &pinfo->dst);
+	copy_key_address(&key->src, key->src_data, &pinfo->src);
+	copy_key_address(&key->dst, key->dst_data, &pinfo->dst);
 	key->id = id;
 
 	return (void *)key;
@@ -158,6 +188,8 @@ typedef struct _fragment_addresses_ports_key {
 	uint32_t src_port;
 	uint32_t dst_port;
 	uint32_t id;
+	uint8_t src_data[FRAGMENT_KEY_ADDRESS_LEN];
+	uint8_t dst_data[FRAGMENT_KEY_ADDRESS_LEN];
 } fragment_addresses_ports_key;
 
 static unsigned
@@ -165,25 +197,12 @@ fragment_addresses_ports_hash(const void *k)
 {
 	const fragment_addresses_ports_key* key = (const fragment_addresses_ports_key*) k;
 	unsigned hash_val;
-/*
-	int i;
-*/
-
-	hash_val = 0;
-
-/*	More than likely: in most captures src and dst addresses and ports
-	are the same, and would hash the same.
-	We only use id as the hash as an optimization.
-
-	for (i = 0; i < key->src.len; i++)
-		hash_val += key->src_addr.data[i];
-	for (i = 0; i < key->dst.len; i++)
-		hash_val += key->dst_addr.data[i];
-	hash_val += key->src_port;
-	hash_val += key->dst_port;
-*/
 
-	hash_val += key->id;
+	/* See fragment_addresses_hash(). */
+	hash_val = key->id;
+	hash_val = add_address_to_hash(hash_val, &key->src_addr);
+	hash_val = add_address_to_hash(hash_val, &key->dst_addr);
+	hash_val ^= (key->src_port << 16) | key->dst_port;
 
 	return hash_val;
 }
@@ -207,16 +226,14 @@ fragment_addresses_ports_equal(const void *k1, const void *k2)
 }
 
 /*
- * Create a fragment key for temporary use; it can point to non-
- * persistent data, and so must only be used to look up and
- * delete entries, not to add them.
+ * Fill in a key for temporary use; it points to non-persistent data,
+ * and so must only be used to look up and delete entries, not to add
+ * them.
  */
-static void *
-fragment_addresses_ports_temporary_key(const packet_info *pinfo, const uint32_t id,
-				       const void *data _U_)
+static void
+fragment_addresses_ports_init_temporary_key(fragment_addresses_ports_key *key,
+					    const packet_info *pinfo, const uint32_t id)
 {
-	fragment_addresses_ports_key *key = g_slice_new(fragment_addresses_ports_key);
-
 	/*
 	 * Do a shallow copy of the addresses.
 	 */
@@ -225,6 +242,19 @@ fragment_addresses_ports_temporary_key(const packet_info *pinfo, const uint32_t
 	key->src_port = pinfo->srcport;
 	key->dst_port = pinfo->destport;
 	key->id = id;
+}
+
+/*
+ * Create a fragment key for temporary use. (lookup_fd_head() doesn't
+ * call this, it fills in a key on the stack.)
+ */
+static void *
+fragment_addresses_ports_temporary_key(const packet_info *pinfo, const uint32_t id,
+				       const void *data _U_)
+{
+	fragment_addresses_ports_key *key = g_slice_new(fragment_addresses_ports_key);
+
+	fragment_addresses_ports_init_temporary_key(key, pinfo, id);
 
 	return (void *)key;
 }
@@ -242,8 +272,8 @@ fragment_addresses_ports_persistent_key(const packet_info *pinfo,
 	/*
 	 * Do a deep copy of the addresses.
 	 */
-	copy_address(&key->src_addr, &pinfo->src);
-	copy_address(&key->dst_addr, &pinfo->dst);
+	copy_key_address(&key->src_addr, key->src_data, &pinfo->src);
+	copy_key_address(&key->dst_addr, key->dst_data, &pinfo->dst);
 	key->src_port = pinfo->srcport;
 	key->dst_port = pinfo->destport;
 	key->id = id;
@@ -351,7 +381,7 @@ free_all_fragments(void *key_arg _U_, void *value, void *user_data _U_)
 }
 
 /* ------------------------- */
-static fragment_head *new_head(const uint32_t flags)
+static fragment_head *new_head(const reassembly_table *table, const uint32_t flags)
 {
 	fragment_head *fd_head;
 	/* If head/first structure in list only holds no other data than
@@ -361,6 +391,8 @@ static fragment_head *new_head(const uint32_t flags)
 	fd_head=g_slice_new0(fragment_head);
 
 	fd_head->flags=flags;
+	if (table->zero_copy)
+		fd_head->flags |= FD_ZERO_COPY;
 	return fd_head;
 }
 
@@ -413,8 +445,9 @@ reassembled_table_insert(GHashTable *reassembled_table, reassembled_key *key, fr
 			 * address via set_address_tvb(). (See #19094.)
 			 */
 			if (old_fd_head->tvb_data && fd_head->tvb_data) {
-				/* Free it when the new tvb is freed */
-				tvb_set_child_real_data_tvbuff(fd_head->tvb_data, old_fd_head->tvb_data);
+				/* Free it when the new tvb is freed. (Either
+				 * can be a composite tvb, with FD_ZERO_COPY.) */
+				tvb_add_to_chain(fd_head->tvb_data, old_fd_head->tvb_data);
 			}
 			/* XXX: Set the old data to NULL regardless. If we
 			 * have old data but not new data, that is odd (we're
@@ -552,6 +585,113 @@ reassembly_table_destroy(reassembly_table *table)
 	}
 }
 
+void
+reassembly_table_set_zero_copy(reassembly_table *table, bool zero_copy)
+{
+	table->zero_copy = zero_copy;
+}
+
+static void
+memory_usage_add_head(const fragment_head *fd_head, reassembly_table_memory_t *usage)
+{
+	const fragment_item *fd_i;
+
+	if (fd_head->flags & FD_DEFRAGMENTED)
+		usage->reassembled++;
+	else
+		usage->in_progress++;
+
+	for (fd_i = fd_head->next; fd_i; fd_i = fd_i->next) {
+		if (fd_i->tvb_data && !(fd_i->flags & FD_SUBSET_TVB))
+			usage->fragment_bytes += tvb_captured_length(fd_i->tvb_data);
+	}
+	if (fd_head->tvb_data) {
+		if (fd_head->flags & FD_ZERO_COPY) {
+			/* It holds the data of its fragments. */
+			usage->fragment_bytes += tvb_captured_length(fd_head->tvb_data);
+			usage->reassembled_bytes += tvb_composite_copied_bytes(fd_head->tvb_data);
+		} else {
+			usage->reassembled_bytes += tvb_captured_length(fd_head->tvb_data);
+		}
+	}
+}
+
+/*
+ * Get the memory used by the data of a reassembly table. A reassembly
+ * can be in both hash tables, and in the reassembled table under the
+ * number of each of its frames, so each one is counted once.
+ */
+void
+reassembly_table_get_memory_usage(const reassembly_table *table,
+				  reassembly_table_memory_t *usage)
+{
+	GHashTable *seen;
+	GHashTableIter iter;
+	void *value;
+
+	memset(usage, 0, sizeof(*usage));
+	seen = g_hash_table_new(g_direct_hash, g_direct_equal);
+	if (table->fragment_table != NULL) {
+		g_hash_table_iter_init(&iter, table->fragment_table);
+		while (g_hash_table_iter_next(&iter, NULL, &value)) {
+			if (g_hash_table_add(seen, value))
+				memory_usage_add_head((const fragment_head *)value, usage);
+		}
+	}
+	if (table->reassembled_table != NULL) {
+		g_hash_table_iter_init(&iter, table->reassembled_table);
+		while (g_hash_table_iter_next(&iter, NULL, &value)) {
+			if (g_hash_table_add(seen, value))
+				memory_usage_add_head((const fragment_head *)value, usage);
+		}
+	}
+	g_hash_table_destroy(seen);
+}
+
+static gboolean
+fragment_head_expired(void *key _U_, void *value, void *user_data)
+{
+	const fragment_head *fd_head = (const fragment_head *)value;
+	const fragment_item *fd_i;
+	uint32_t before_frame = GPOINTER_TO_UINT(user_data);
+	uint32_t frame = fd_head->frame;
+
+	/* It is also in the reassembled table. */
+	if (fd_head->ref_count != 0)
+		return FALSE;
+
+	for (fd_i = fd_head->next; fd_i; fd_i = fd_i->next) {
+		if (fd_i->frame > frame)
+			frame = fd_i->frame;
+	}
+	/* A reassembly that was started without any fragment is kept. */
+	if (frame == 0 || frame >= before_frame)
+		return FALSE;
+
+	return free_all_fragments(key, value, NULL);
+}
+
+static gboolean
+reassembled_expired(void *key, void *value _U_, void *user_data)
+{
+	return ((const reassembled_key *)key)->frame < GPOINTER_TO_UINT(user_data);
+}
+
+/*
+ * Free the reassemblies that no fragment was added to since before a frame,
+ * and the reassembled data of frames before it.
+ */
+void
+reassembly_table_expire(reassembly_table *table, const uint32_t before_frame)
+{
+	if (table->fragment_table != NULL)
+		g_hash_table_foreach_remove(table->fragment_table,
+					    fragment_head_expired, GUINT_TO_POINTER(before_frame));
+	if (table->reassembled_table != NULL)
+		g_hash_table_foreach_remove(table->reassembled_table,
+					    reassembled_expired, GUINT_TO_POINTER(before_frame));
+}
+
 /*
  * Look up an fd_head in the fragment table, optionally returning the key
  * for it.
@@ -560,11 +700,26 @@ static fragment_head *
 lookup_fd_head(reassembly_table *table, const packet_info *pinfo,
 	       const uint32_t id, const void *data, void * *orig_keyp)
 {
+	union {
+		fragment_addresses_key addresses;
+		fragment_addresses_ports_key addresses_ports;
+	} stack_key;
 	void *key;
 	void *value;
 
-	/* Create key to search hash with */
-	key = table->temporary_key_func(pinfo, id, data);
+	/*
+	 * Create key to search hash with; the built-in keys don't need
+	 * to be allocated.
+	 */
+	if (table->temporary_key_func == fragment_addresses_temporary_key) {
+		fragment_addresses_init_temporary_key(&stack_key.addresses, pinfo, id);
+		key = &stack_key;
+	} else if (table->temporary_key_func == fragment_addresses_ports_temporary_key) {
+		fragment_addresses_ports_init_temporary_key(&stack_key.addresses_ports, pinfo, id);
+		key = &stack_key;
+	} else {
+		key = table->temporary_key_func(pinfo, id, data);
+	}
 
 	/*
 	 * Look up the reassembly in the fragment table.
@@ -573,7 +728,8 @@ lookup_fd_head(reassembly_table *table, const packet_info *pinfo,
 					  &value))
 		value = NULL;
 	/* Free the key */
-	table->free_temporary_key_func(key);
+	if (key != &stack_key)
+		table->free_temporary_key_func(key);
 
 	return (fragment_head *)value;
 }
@@ -898,8 +1054,15 @@ fragment_truncate(reassembly_table *table, const packet_info *pinfo,
 	DISSECTOR_ASSERT(fd_head->datalen > tot_len);
 
 	old_tvb_data=fd_head->tvb_data;
-	fd_head->tvb_data = tvb_clone_offset_len(old_tvb_data, 0, tot_len);
-	tvb_set_free_cb(fd_head->tvb_data, g_free);
+	if ((fd_head->flags & FD_ZERO_COPY) && old_tvb_data && tot_len) {
+		/* Refer to the beginning of the old data. */
+		fd_head->tvb_data = tvb_new_composite_detached();
+		tvb_composite_append_range(fd_head->tvb_data, old_tvb_data, 0, tot_len);
+		tvb_composite_finalize(fd_head->tvb_data);
+	} else {
+		fd_head->tvb_data = tvb_clone_offset_len(old_tvb_data, 0, tot_len);
+		tvb_set_free_cb(fd_head->tvb_data, g_free);
+	}
 
 	if (old_tvb_data)
 		tvb_add_to_chain(fd_head->tvb_data, old_tvb_data);
@@ -1173,6 +1336,106 @@ MERGE_FRAG(fragment_head *fd_head, fragment_item *fd)
 	update_first_gap(fd_head, inserted, multi_insert);
 }
 
+/*
+ * Zero-copy reassembly (FD_ZERO_COPY): rather than copying the fragments
+ * into a new buffer, the reassembled data is a composite tvbuff of the
+ * pieces of the fragments' data that make it up. It owns that data (the
+ * fragments' tvbuffs are added to its chain), and the previous reassembled
+ * data, if any, which the fragments of an extended reassembly refer to.
+ * The pieces that are in the previous reassembled data are resolved to
+ * the fragments' data it is made of, so that the composites don't nest,
+ * and the reassembled data before the previous one, which nothing refers
+ * to anymore, is freed.
+ */
+typedef struct {
+	tvbuff_t *tvb;		/* data of the fragment */
+	uint32_t tvb_offset;	/* offset of the piece in it */
+	uint32_t offset;	/* offset of the piece in the reassembled data */
+	uint32_t len;
+} reassembly_piece;
+
+static void
+pieces_add(GArray *pieces, tvbuff_t *tvb, const uint32_t tvb_offset,
+	   const uint32_t offset, const uint32_t len)
+{
+	reassembly_piece piece = { tvb, tvb_offset, offset, len };
+
+	g_array_append_val(pieces, piece);
+}
+
+/* Are the len bytes of the reassembled data at offset equal to data? */
+static bool
+pieces_memeql(GArray *pieces, const uint32_t offset, const uint8_t *data,
+	      const uint32_t len)
+{
+	reassembly_piece *piece;
+	uint32_t start, end;
+
+	/* The pieces are in order and don't overlap, and overlapping
+	 * fragments usually overlap the last ones. */
+	for (unsigned i = pieces->len; i > 0; i--) {
+		piece = &g_array_index(pieces, reassembly_piece, i - 1);
+		if (piece->offset + piece->len <= offset)
+			break;
+		if (piece->offset >= offset + len)
+			continue;
+		start = MAX(piece->offset, offset);
+		end = MIN(piece->offset + piece->len, offset + len);
+		if (tvb_memeql(piece->tvb, piece->tvb_offset + (start - piece->offset),
+				data + (start - offset), end - start) != 0)
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Build the reassembled data of the given size from the pieces. The
+ * tvbuffs in owned, and old_tvb_data, are freed along with it.
+ */
+static tvbuff_t *
+pieces_to_tvb(GArray *pieces, const uint32_t size, GSList *owned,
+	      tvbuff_t *old_tvb_data)
+{
+	tvbuff_t *tvb, *member;
+	reassembly_piece *piece;
+	uint32_t dfpos = 0;
+	uint8_t *zeroes;
+
+	if (size == 0) {
+		tvb = tvb_new_real_data(NULL, 0, 0);
+	} else {
+		tvb = tvb_new_composite_detached();
+		for (unsigned i = 0; i < pieces->len; i++) {
+			piece = &g_array_index(pieces, reassembly_piece, i);
+			tvb_composite_append_range(tvb, piece->tvb,
+			    piece->tvb_offset, piece->len);
+			dfpos += piece->len;
+		}
+		/* If a fragment had no data (which is an error), a copy
+		 * would have left a hole; fill it. */
+		if (dfpos < size) {
+			zeroes = (uint8_t *)g_malloc0(size - dfpos);
+			member = tvb_new_real_data(zeroes, size - dfpos, size - dfpos);
+			tvb_set_free_cb(member, g_free);
+			tvb_composite_append(tvb, member);
+			owned = g_slist_prepend(owned, member);
+		}
+		tvb_composite_finalize(tvb);
+	}
+
+	for (GSList *l = owned; l; l = l->next)
+		tvb_add_to_chain(tvb, (tvbuff_t *)l->data);
+	g_slist_free(owned);
+	if (old_tvb_data) {
+		tvb_add_to_chain(tvb, old_tvb_data);
+		/* The previous reassembled data might still be in use in
+		 * this frame, the ones before it aren't. */
+		tvb_composite_free_detached(tvb, old_tvb_data);
+	}
+
+	return tvb;
+}
+
 /*
  * This function adds a new fragment to the fragment hash table.
  * If this is the first fragment seen for this datagram, a new entry
@@ -1204,7 +1467,10 @@ fragment_add_work(fragment_head *fd_head, tvbuff_t *tvb, const int offset,
 	fragment_item *fd_i;
 	uint32_t dfpos, fraglen, overlap;
 	tvbuff_t *old_tvb_data;
-	uint8_t *data;
+	uint8_t *data = NULL;
+	GArray *pieces = NULL;
+	GSList *owned = NULL;
+	bool used;
 
 	/* create new fd describing this fragment */
 	fd = g_slice_new(fragment_item);
@@ -1377,12 +1643,17 @@ fragment_add_work(fragment_head *fd_head, tvbuff_t *tvb, const int offset,
 	 */
 	/* store old data just in case */
 	old_tvb_data=fd_head->tvb_data;
-	data = (uint8_t *) g_malloc(fd_head->datalen);
-	fd_head->tvb_data = tvb_new_real_data(data, fd_head->datalen, fd_head->datalen);
-	tvb_set_free_cb(fd_head->tvb_data, g_free);
+	if (fd_head->flags & FD_ZERO_COPY) {
+		pieces = g_array_new(false, false, sizeof(reassembly_piece));
+	} else {
+		data = (uint8_t *) g_malloc(fd_head->datalen);
+		fd_head->tvb_data = tvb_new_real_data(data, fd_head->datalen, fd_head->datalen);
+		tvb_set_free_cb(fd_head->tvb_data, g_free);
+	}
 
 	/* add all data fragments */
 	for (dfpos=0,fd_i=fd_head->next;fd_i;fd_i=fd_i->next) {
+		used = false;
 		if (fd_i->len) {
 			/*
 			 * The contiguous length check above also
@@ -1459,7 +1730,11 @@ fragment_add_work(fragment_head *fd_head, tvbuff_t *tvb, const int offset,
 
 					fd_i->flags    |= FD_OVERLAP;
 					fd_head->flags |= FD_OVERLAP;
-					if ( memcmp(data + fd_i->offset,
+					if (pieces ?
+					    !pieces_memeql(pieces, fd_i->offset,
+							tvb_get_ptr(fd_i->tvb_data, 0, cmp_len),
+							cmp_len) :
+					    memcmp(data + fd_i->offset,
 							tvb_get_ptr(fd_i->tvb_data, 0, cmp_len),
 							cmp_len)
 							 ) {
@@ -1487,15 +1762,23 @@ fragment_add_work(fragment_head *fd_head, tvbuff_t *tvb, const int offset,
 				 * out rather than mixed with the new ones?
 				 */
 				if (fd_i->offset + fraglen > dfpos) {
-					memcpy(data+dfpos,
-						tvb_get_ptr(fd_i->tvb_data, overlap, fraglen-overlap),
-						fraglen-overlap);
+					if (pieces) {
+						pieces_add(pieces, fd_i->tvb_data, overlap,
+							dfpos, fraglen-overlap);
+						used = true;
+					} else {
+						memcpy(data+dfpos,
+							tvb_get_ptr(fd_i->tvb_data, overlap, fraglen-overlap),
+							fraglen-overlap);
+					}
 					dfpos = fd_i->offset + fraglen;
 				}
 			}
 
 			if (fd_i->flags & FD_SUBSET_TVB)
 				fd_i->flags &= ~FD_SUBSET_TVB;
+			else if (used)
+				owned = g_slist_prepend(owned, fd_i->tvb_data);
 			else if (fd_i->tvb_data)
 				tvb_free(fd_i->tvb_data);
 
@@ -1503,8 +1786,12 @@ fragment_add_work(fragment_head *fd_head, tvbuff_t *tvb, const int offset,
 		}
 	}
 
-	if (old_tvb_data)
+	if (pieces) {
+		fd_head->tvb_data = pieces_to_tvb(pieces, fd_head->datalen, owned, old_tvb_data);
+		g_array_free(pieces, true);
+	} else if (old_tvb_data) {
 		tvb_add_to_chain(tvb, old_tvb_data);
+	}
 	/* mark this packet as defragmented.
 	   allows us to skip any trailing fragments */
 	fd_head->flags |= FD_DEFRAGMENTED;
@@ -1688,7 +1975,7 @@ fragment_add_common(reassembly_table *table, tvbuff_t *tvb, const int offset,
 		/* not found, this must be the first snooped fragment for this
 		 * packet. Create list-head.
 		 */
-		fd_head = new_head(0);
+		fd_head = new_head(table, 0);
 
 		/*
 		 * Insert it into the hash table.
@@ -1802,7 +2089,7 @@ fragment_add_check_with_fallback(reassembly_table *table, tvbuff_t *tvb, const i
 		/* not found, this must be the first snooped fragment for this
 		 * packet. Create list-head.
 		 */
-		fd_head = new_head(0);
+		fd_head = new_head(table, 0);
 
 		/*
 		 * Save the key, for unhashing it later.
@@ -1867,7 +2154,9 @@ fragment_defragment_and_free (fragment_head *fd_head, const packet_info *pinfo)
 	fragment_item *last_fd = NULL;
 	uint32_t dfpos = 0, size = 0;
 	tvbuff_t *old_tvb_data = NULL;
-	uint8_t *data;
+	uint8_t *data = NULL;
+	GArray *pieces = NULL;
+	GSList *owned = NULL;
 
 	for(fd_i=fd_head->next;fd_i;fd_i=fd_i->next) {
 		if(!last_fd || last_fd->offset!=fd_i->offset){
@@ -1878,9 +2167,13 @@ fragment_defragment_and_free (fragment_head *fd_head, const packet_info *pinfo)
 
 	/* store old data in case the fd_i->data pointers refer to it */
 	old_tvb_data=fd_head->tvb_data;
-	data = (uint8_t *) g_malloc(size);
-	fd_head->tvb_data = tvb_new_real_data(data, size, size);
-	tvb_set_free_cb(fd_head->tvb_data, g_free);
+	if (fd_head->flags & FD_ZERO_COPY) {
+		pieces = g_array_new(false, false, sizeof(reassembly_piece));
+	} else {
+		data = (uint8_t *) g_malloc(size);
+		fd_head->tvb_data = tvb_new_real_data(data, size, size);
+		tvb_set_free_cb(fd_head->tvb_data, g_free);
+	}
 	fd_head->len = size;		/* record size for caller	*/
 
 	/* add all data fragments */
@@ -1889,7 +2182,10 @@ fragment_defragment_and_free (fragment_head *fd_head, const packet_info *pinfo)
 		if (fd_i->len) {
 			if(!last_fd || last_fd->offset != fd_i->offset) {
 				/* First fragment or in-sequence fragment */
-				memcpy(data+dfpos, tvb_get_ptr(fd_i->tvb_data, 0, fd_i->len), fd_i->len);
+				if (pieces)
+					pieces_add(pieces, fd_i->tvb_data, 0, dfpos, fd_i->len);
+				else
+					memcpy(data+dfpos, tvb_get_ptr(fd_i->tvb_data, 0, fd_i->len), fd_i->len);
 				dfpos += fd_i->len;
 			} else {
 				/* duplicate/retransmission/overlap */
@@ -1905,16 +2201,25 @@ fragment_defragment_and_free (fragment_head *fd_head, const packet_info *pinfo)
 		last_fd=fd_i;
 	}
 
-	/* we have defragmented the pdu, now free all fragments*/
+	/* we have defragmented the pdu, now free all fragments
+	 * (or, without copying, the ones that aren't part of it) */
+	last_fd=NULL;
 	for (fd_i=fd_head->next;fd_i;fd_i=fd_i->next) {
 		if (fd_i->flags & FD_SUBSET_TVB)
 			fd_i->flags &= ~FD_SUBSET_TVB;
+		else if (pieces && fd_i->len && (!last_fd || last_fd->offset != fd_i->offset))
+			owned = g_slist_prepend(owned, fd_i->tvb_data);
 		else if (fd_i->tvb_data)
 			tvb_free(fd_i->tvb_data);
 		fd_i->tvb_data=NULL;
+		last_fd=fd_i;
 	}
-	if (old_tvb_data)
+	if (pieces) {
+		fd_head->tvb_data = pieces_to_tvb(pieces, size, owned, old_tvb_data);
+		g_array_free(pieces, true);
+	} else if (old_tvb_data) {
 		tvb_free(old_tvb_data);
+	}
 
 	/* mark this packet as defragmented.
 	 * allows us to skip any trailing fragments.
@@ -2211,7 +2516,7 @@ fragment_add_seq_common(reassembly_table *table, tvbuff_t *tvb,
 		/* not found, this must be the first snooped fragment for this
 		 * packet. Create list-head.
 		 */
-		fd_head= new_head(FD_BLOCKSEQUENCE);
+		fd_head= new_head(table, FD_BLOCKSEQUENCE);
 
 		if((flags & (REASSEMBLE_FLAGS_NO_FRAG_NUMBER|REASSEMBLE_FLAGS_802_11_HACK))
 		   && !more_frags) {
@@ -2521,7 +2826,7 @@ fragment_add_seq_single_work(reassembly_table *table, tvbuff_t *tvb,
 		}
 		if (fh == NULL) {
 			/* Not found. Create list-head. */
-			fh = new_head(FD_BLOCKSEQUENCE);
+			fh = new_head(table, FD_BLOCKSEQUENCE);
 			insert_fd_head(table, fh, pinfo, id-frag_number, data);
 		}
 		/* As this is the first fragment, we might have added segments
@@ -2607,7 +2912,7 @@ fragment_add_seq_single_work(reassembly_table *table, tvbuff_t *tvb,
 		if (fh == NULL) { /* Didn't find location, use default */
 			frag_number = 1;
 			/* Already looked for frag_number 1, so just create */
-			fh = new_head(FD_BLOCKSEQUENCE);
+			fh = new_head(table, FD_BLOCKSEQUENCE);
 			insert_fd_head(table, fh, pinfo, id-frag_number, data);
 		}
 	}
@@ -2654,7 +2959,7 @@ fragment_add_seq_single_work(reassembly_table *table, tvbuff_t *tvb,
 			new_fh = lookup_fd_head(table, pinfo, id+1, data, NULL);
 			if (new_fh==NULL) {
 				/* Not found. Create list-head. */
-				new_fh = new_head(FD_BLOCKSEQUENCE);
+				new_fh = new_head(table, FD_BLOCKSEQUENCE);
 				insert_fd_head(table, new_fh, pinfo, id+1, data);
 			}
 			tmp_offset = 0;
@@ -3171,10 +3476,35 @@ reassembly_table_cleanup_reg_tables(void)
 	g_list_foreach(reassembly_table_list, reassembly_table_cleanup_reg_table, NULL);
 }
 
+static size_t
+reassembly_tables_memory_usage(void)
+{
+	reassembly_table_memory_t usage;
+	size_t total = 0;
+
+	for (GList *l = reassembly_table_list; l; l = l->next) {
+		reassembly_table_get_memory_usage(((register_reassembly_table_t *)l->data)->table, &usage);
+		total += usage.fragment_bytes + usage.reassembled_bytes;
+	}
+	return total;
+}
+
+void
+reassembly_tables_expire(const uint32_t before_frame)
+{
+	for (GList *l = reassembly_table_list; l; l = l->next)
+		reassembly_table_expire(((register_reassembly_table_t *)l->data)->table, before_frame);
+}
+
+static const ws_mem_usage_t reassembly_memory_usage = {
+	"Reassembly", reassembly_tables_memory_usage, NULL
+};
+
 void reassembly_tables_init(void)
 {
 	register_init_routine(&reassembly_table_init_reg_tables);
 	register_cleanup_routine(&reassembly_table_cleanup_reg_tables);
+	memory_usage_component_register(&reassembly_memory_usage);
 }
 
 static void
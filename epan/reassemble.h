@@ -49,6 +49,10 @@
  */
 #define FD_DATALEN_SET		0x0400
 
+/* only in fd_head: the reassembled data is a composite tvbuff referring to
+ * the data of the fragments, see reassembly_table_set_zero_copy() */
+#define FD_ZERO_COPY		0x0800
+
 typedef struct _fragment_item {
 	struct _fragment_item *next;
 	uint32_t frame;			/**< frame number where the fragment is from */
@@ -141,6 +145,7 @@ typedef struct {
 	fragment_temporary_key temporary_key_func;
 	fragment_persistent_key persistent_key_func;
 	GDestroyNotify free_temporary_key_func;		/* temporary key destruction function */
+	bool zero_copy;					/* see reassembly_table_set_zero_copy() */
 } reassembly_table;
 
 /*
@@ -186,6 +191,57 @@ reassembly_table_init(reassembly_table *table,
 WS_DLL_PUBLIC void
 reassembly_table_destroy(reassembly_table *table);
 
+/*
+ * Set whether the reassemblies started from now on build their reassembled
+ * data as a read-only view of the data of the fragments (a composite
+ * tvbuff), rather than copying the fragments into a new buffer.
+ *
+ * This saves copying large PDUs reassembled from many fragments. Only the
+ * ranges for which a dissector asks for a contiguous pointer, with
+ * tvb_get_ptr() and the like, are copied, once for all the times the PDU
+ * is dissected. Whether a reassembly uses it is recorded in the
+ * FD_ZERO_COPY flag of its fd_head.
+ */
+WS_DLL_PUBLIC void
+reassembly_table_set_zero_copy(reassembly_table *table, bool zero_copy);
+
+/*
+ * Memory used by the data of a reassembly table.
+ */
+typedef struct {
+	unsigned in_progress;		/* reassemblies that are not complete */
+	unsigned reassembled;		/* reassemblies that are complete */
+	size_t fragment_bytes;		/* data of the fragments that is kept,
+					 * including the data that zero-copy
+					 * reassemblies refer to */
+	size_t reassembled_bytes;	/* data copied into reassembled buffers,
+					 * including the ranges of zero-copy
+					 * reassemblies that were made contiguous */
+} reassembly_table_memory_t;
+
+WS_DLL_PUBLIC void
+reassembly_table_get_memory_usage(const reassembly_table *table,
+				  reassembly_table_memory_t *usage);
+
+/*
+ * Free the reassemblies in progress that no fragment was added to since
+ * before a frame, and the reassembled data of the frames before it.
+ *
+ * This is meant for single-pass dissection of unbounded captures, where
+ * earlier frames are never dissected again. Reassemblies that got a
+ * fragment in that frame or later, or that were started without any
+ * fragment (with fragment_start_seq_check()), are kept.
+ */
+WS_DLL_PUBLIC void
+reassembly_table_expire(reassembly_table *table, const uint32_t before_frame);
+
+/*
+ * Call reassembly_table_expire() for all the tables registered with
+ * reassembly_table_register().
+ */
+WS_DLL_PUBLIC void
+reassembly_tables_expire(const uint32_t before_frame);
+
 /*
  * This function adds a new fragment to the reassembly table
  * If this is the first fragment seen for this datagram, a new entry
@@ -40,6 +40,7 @@
 #include <epan/packet_info.h>
 #include <epan/proto.h>
 #include <epan/tvbuff.h>
+#include <epan/tvbuff-int.h>
 #include <epan/reassemble.h>
 
 #include "exceptions.h"
@@ -104,6 +105,7 @@ static struct _fd_flags {
     {FD_OVERLAPCONFLICT      ,"OC"},
     {FD_MULTIPLETAILS        ,"MT"},
     {FD_TOOLONGFRAGMENT      ,"TL"},
+    {FD_ZERO_COPY            ,"ZC"},
 };
 #define N_FD_FLAGS array_length(fd_flags)
 
@@ -3203,6 +3205,323 @@ test_fragment_add_check_duplicate_conflict(void)
         print_fragment_table();
     }
 }
+/* Test case for the keys of the built-in tables: reassemblies with the same
+ * ID are told apart by their addresses, including addresses that are too
+ * long to be held in the key.
+ */
+static void
+test_fragment_add_addresses(void)
+{
+    fragment_head *fd_head;
+    address saved_src = pinfo.src;
+    static const char long_src[] = "a rather long source address";
+
+    printf("Starting test test_fragment_add_addresses\n");
+
+    pinfo.num = 1;
+    fd_head=fragment_add_check(&test_reassembly_table, tvb, 10, &pinfo, 12, NULL,
+                               0, 50, true);
+    ASSERT_EQ_POINTER(NULL,fd_head);
+
+    /* the same ID from another source */
+    set_address(&pinfo.src, AT_STRINGZ, (int)sizeof(long_src), long_src);
+    pinfo.num = 2;
+    fd_head=fragment_add_check(&test_reassembly_table, tvb, 20, &pinfo, 12, NULL,
+                               0, 50, true);
+    ASSERT_EQ_POINTER(NULL,fd_head);
+    ASSERT_EQ(2,g_hash_table_size(test_reassembly_table.fragment_table));
+
+    pinfo.num = 3;
+    fd_head=fragment_add_check(&test_reassembly_table, tvb, 70, &pinfo, 12, NULL,
+                               50, 10, false);
+    ASSERT_NE_POINTER(NULL,fd_head);
+    ASSERT_EQ(60,fd_head->datalen);
+    ASSERT(!tvb_memeql(fd_head->tvb_data,0,data+20,60));
+    ASSERT_EQ(1,g_hash_table_size(test_reassembly_table.fragment_table));
+
+    pinfo.src = saved_src;
+    pinfo.num = 4;
+    fd_head=fragment_add_check(&test_reassembly_table, tvb, 60, &pinfo, 12, NULL,
+                               50, 10, false);
+    ASSERT_NE_POINTER(NULL,fd_head);
+    ASSERT_EQ(60,fd_head->datalen);
+    ASSERT(!tvb_memeql(fd_head->tvb_data,0,data+10,60));
+    ASSERT_EQ(0,g_hash_table_size(test_reassembly_table.fragment_table));
+}
+
+/* Test case for reassembly_table_expire.
+ * Starts a reassembly in frame 1, completes one in frames 2 and 3, and
+ * starts another in frame 4, then expires everything before frame 3, and
+ * then everything.
+ */
+static void
+test_reassembly_table_expire(void)
+{
+    fragment_head *fd_head;
+
+    printf("Starting test test_reassembly_table_expire\n");
+
+    pinfo.num = 1;
+    fd_head=fragment_add_check(&test_reassembly_table, tvb, 10, &pinfo, 12, NULL,
+                               0, 50, true);
+    ASSERT_EQ_POINTER(NULL,fd_head);
+
+    pinfo.num = 2;
+    fd_head=fragment_add_check(&test_reassembly_table, tvb, 20, &pinfo, 13, NULL,
+                               0, 50, true);
+    ASSERT_EQ_POINTER(NULL,fd_head);
+
+    pinfo.num = 3;
+    fd_head=fragment_add_check(&test_reassembly_table, tvb, 70, &pinfo, 13, NULL,
+                               50, 10, false);
+    ASSERT_NE_POINTER(NULL,fd_head);
+
+    pinfo.num = 4;
+    fd_head=fragment_add_check(&test_reassembly_table, tvb, 30, &pinfo, 14, NULL,
+                               0, 50, true);
+    ASSERT_EQ_POINTER(NULL,fd_head);
+    ASSERT_EQ(2,g_hash_table_size(test_reassembly_table.fragment_table));
+    ASSERT_EQ(2,g_hash_table_size(test_reassembly_table.reassembled_table));
+
+    /* The reassembly of frame 1 is dropped, and frame 3 still has its
+     * reassembled data. */
+    reassembly_table_expire(&test_reassembly_table, 3);
+    ASSERT_EQ(1,g_hash_table_size(test_reassembly_table.fragment_table));
+    ASSERT_EQ(1,g_hash_table_size(test_reassembly_table.reassembled_table));
+    pinfo.num = 1;
+    ASSERT_EQ_POINTER(NULL,fragment_get(&test_reassembly_table, &pinfo, 12, NULL));
+    pinfo.num = 3;
+    fd_head=fragment_get_reassembled_id(&test_reassembly_table, &pinfo, 13);
+    ASSERT_NE_POINTER(NULL,fd_head);
+    ASSERT(!tvb_memeql(fd_head->tvb_data,0,data+20,50));
+    pinfo.num = 4;
+    ASSERT_NE_POINTER(NULL,fragment_get(&test_reassembly_table, &pinfo, 14, NULL));
+
+    reassembly_table_expire(&test_reassembly_table, 5);
+    ASSERT_EQ(0,g_hash_table_size(test_reassembly_table.fragment_table));
+    ASSERT_EQ(0,g_hash_table_size(test_reassembly_table.reassembled_table));
+}
+
+/**********************************************************************************
+ *
+ * zero-copy reassembly
+ *
+ *********************************************************************************/
+
+/* Test case for fragment_add with a zero-copy table.
+ * Adds four fragments, the third one a conflicting duplicate of the second
+ * and the last one overlapping the second, and checks that the reassembled
+ * data refers to them and is only copied when a contiguous pointer is
+ * needed.
+ */
+/*   visit  id  frame  frag_offset  len  more  tvb_offset
+       0    12     1       0        50   T      10
+       0    12     2      50        60   T       5
+       0    12     3      50        60   T      15
+       0    12     4     100        50   F      55
+*/
+static void
+test_fragment_add_zero_copy(void)
+{
+    fragment_head *fd_head;
+    fragment_item *fd;
+    reassembly_table_memory_t usage;
+    uint8_t expected[150];
+
+    printf("Starting test test_fragment_add_zero_copy\n");
+
+    reassembly_table_set_zero_copy(&test_reassembly_table, true);
+
+    pinfo.num = 1;
+    fd_head=fragment_add(&test_reassembly_table, tvb, 10, &pinfo, 12, NULL,
+                         0, 50, true);
+    ASSERT_EQ_POINTER(NULL,fd_head);
+
+    pinfo.num = 2;
+    fd_head=fragment_add(&test_reassembly_table, tvb, 5, &pinfo, 12, NULL,
+                         50, 60, true);
+    ASSERT_EQ_POINTER(NULL,fd_head);
+
+    pinfo.num = 3;
+    fd_head=fragment_add(&test_reassembly_table, tvb, 15, &pinfo, 12, NULL,
+                         50, 60, true);
+    ASSERT_EQ_POINTER(NULL,fd_head);
+
+    reassembly_table_get_memory_usage(&test_reassembly_table, &usage);
+    ASSERT_EQ(1,usage.in_progress);
+    ASSERT_EQ(0,usage.reassembled);
+    ASSERT_EQ(170,usage.fragment_bytes);
+    ASSERT_EQ(0,usage.reassembled_bytes);
+
+    pinfo.num = 4;
+    fd_head=fragment_add(&test_reassembly_table, tvb, 55, &pinfo, 12, NULL,
+                         100, 50, false);
+    ASSERT_NE_POINTER(NULL,fd_head);
+
+    /* check the contents of the structure */
+    ASSERT_EQ(150,fd_head->datalen);
+    ASSERT_EQ(4,fd_head->reassembled_in);
+    ASSERT_EQ(FD_DEFRAGMENTED|FD_DATALEN_SET|FD_OVERLAP|FD_OVERLAPCONFLICT|FD_ZERO_COPY,fd_head->flags);
+    ASSERT_NE_POINTER(NULL,fd_head->tvb_data);
+
+    fd = fd_head->next;
+    ASSERT_EQ(1,fd->frame);
+    ASSERT_EQ(0,fd->flags);
+    ASSERT_EQ_POINTER(NULL,fd->tvb_data);
+
+    fd = fd->next;
+    ASSERT_EQ(2,fd->frame);
+    ASSERT_EQ(0,fd->flags);
+    ASSERT_EQ_POINTER(NULL,fd->tvb_data);
+
+    fd = fd->next;
+    ASSERT_EQ(3,fd->frame);
+    ASSERT_EQ(FD_OVERLAP|FD_OVERLAPCONFLICT,fd->flags);
+    ASSERT_EQ_POINTER(NULL,fd->tvb_data);
+
+    fd = fd->next;
+    ASSERT_EQ(4,fd->frame);
+    ASSERT_EQ(FD_OVERLAP,fd->flags);
+    ASSERT_EQ_POINTER(NULL,fd->tvb_data);
+    ASSERT_EQ_POINTER(NULL,fd->next);
+
+    /* nothing has been copied yet */
+    reassembly_table_get_memory_usage(&test_reassembly_table, &usage);
+    ASSERT_EQ(0,usage.in_progress);
+    ASSERT_EQ(1,usage.reassembled);
+    ASSERT_EQ(150,usage.fragment_bytes);
+    ASSERT_EQ(0,usage.reassembled_bytes);
+
+    /* test the actual reassembly */
+    memcpy(expected, data+10, 50);
+    memcpy(expected+50, data+5, 60);
+    memcpy(expected+110, data+65, 40);
+    ASSERT(!tvb_memeql(fd_head->tvb_data,0,expected,150));
+    ASSERT_EQ(expected[110],tvb_get_uint8(fd_head->tvb_data,110));
+
+    /* a pointer within a fragment isn't a copy, ... */
+    ASSERT(!memcmp(tvb_get_ptr(fd_head->tvb_data,5,10),expected+5,10));
+    reassembly_table_get_memory_usage(&test_reassembly_table, &usage);
+    ASSERT_EQ(0,usage.reassembled_bytes);
+
+    /* ... one across fragments is */
+    ASSERT(!memcmp(tvb_get_ptr(fd_head->tvb_data,45,10),expected+45,10));
+    reassembly_table_get_memory_usage(&test_reassembly_table, &usage);
+    ASSERT_EQ(10,usage.reassembled_bytes);
+
+    reassembly_table_set_zero_copy(&test_reassembly_table, false);
+
+    if (debug) {
+        print_fragment_table();
+    }
+}
+
+/* Test case for fragment_add_seq with a zero-copy table, with a partial
+ * reassembly whose data the extended reassembly refers to.
+ */
+static void
+test_fragment_add_seq_zero_copy(void)
+{
+    fragment_head *fd_head;
+    fragment_item *fd;
+
+    printf("Starting test test_fragment_add_seq_zero_copy\n");
+
+    reassembly_table_set_zero_copy(&test_reassembly_table, true);
+
+    pinfo.num = 1;
+    fd_head=fragment_add_seq(&test_reassembly_table, tvb, 10, &pinfo, 12, NULL,
+                             0, 50, false, 0);
+    ASSERT_NE_POINTER(NULL,fd_head);
+    ASSERT_EQ(50,fd_head->len);
+    ASSERT_EQ(FD_DEFRAGMENTED|FD_BLOCKSEQUENCE|FD_DATALEN_SET|FD_ZERO_COPY,fd_head->flags);
+    ASSERT(!tvb_memeql(fd_head->tvb_data,0,data+10,50));
+
+    /* the reassembly wasn't complete after all */
+    fragment_set_partial_reassembly(&test_reassembly_table, &pinfo, 12, NULL);
+
+    pinfo.num = 2;
+    fd_head=fragment_add_seq(&test_reassembly_table, tvb, 0, &pinfo, 12, NULL,
+                             1, 40, true, 0);
+    ASSERT_EQ_POINTER(NULL,fd_head);
+
+    /* a duplicate of the first fragment */
+    pinfo.num = 3;
+    fd_head=fragment_add_seq(&test_reassembly_table, tvb, 10, &pinfo, 12, NULL,
+                             0, 50, true, 0);
+    ASSERT_EQ_POINTER(NULL,fd_head);
+
+    pinfo.num = 4;
+    fd_head=fragment_add_seq(&test_reassembly_table, tvb, 20, &pinfo, 12, NULL,
+                             2, 100, false, 0);
+    ASSERT_NE_POINTER(NULL,fd_head);
+
+    ASSERT_EQ(190,fd_head->len);
+    ASSERT_EQ(2,fd_head->datalen);
+    ASSERT_EQ(4,fd_head->reassembled_in);
+    ASSERT_EQ(FD_DEFRAGMENTED|FD_BLOCKSEQUENCE|FD_DATALEN_SET|FD_OVERLAP|FD_ZERO_COPY,fd_head->flags);
+    for (fd = fd_head->next; fd; fd = fd->next) {
+        ASSERT_EQ_POINTER(NULL,fd->tvb_data);
+    }
+
+    /* test the actual reassembly */
+    ASSERT_EQ(190,tvb_captured_length(fd_head->tvb_data));
+    ASSERT(!tvb_memeql(fd_head->tvb_data,0,data+10,50));
+    ASSERT(!tvb_memeql(fd_head->tvb_data,50,data,40));
+    ASSERT(!tvb_memeql(fd_head->tvb_data,90,data+20,100));
+
+    reassembly_table_set_zero_copy(&test_reassembly_table, false);
+}
+
+/* Test case for fragment_add with a zero-copy table, with a PDU that is
+ * extended by one fragment many times, as TCP does when a dissector keeps
+ * asking for one more segment.
+ */
+static void
+test_fragment_add_zero_copy_extended(void)
+{
+    fragment_head *fd_head;
+    tvbuff_t *chain;
+    const uint8_t *ptr;
+    unsigned i, chain_len;
+    const unsigned n = 200, len = 10;
+
+    printf("Starting test test_fragment_add_zero_copy_extended\n");
+
+    reassembly_table_set_zero_copy(&test_reassembly_table, true);
+
+    for (i = 0; i < n; i++) {
+        pinfo.num = i + 1;
+        fd_head=fragment_add(&test_reassembly_table, tvb, (i % 20) * len, &pinfo, 12, NULL,
+                             i * len, len, false);
+        ASSERT_NE_POINTER(NULL,fd_head);
+        ASSERT_EQ((i + 1) * len,fd_head->datalen);
+        ASSERT(!tvb_memeql(fd_head->tvb_data,i * len,data+(i % 20) * len,len));
+        /* a pointer across the last two fragments is a copy */
+        if (i > 0) {
+            ptr = tvb_get_ptr(fd_head->tvb_data,i * len - 1,2);
+            ASSERT_EQ(data[((i - 1) % 20) * len + len - 1],ptr[0]);
+            ASSERT_EQ(data[(i % 20) * len],ptr[1]);
+        }
+        fragment_set_partial_reassembly(&test_reassembly_table, &pinfo, 12, NULL);
+    }
+
+    ASSERT_EQ(n * len,tvb_captured_length(fd_head->tvb_data));
+    for (i = 0; i < n; i++) {
+        ASSERT(!tvb_memeql(fd_head->tvb_data,i * len,data+(i % 20) * len,len));
+    }
+
+    /* The reassembled data that was superseded has been freed, and with
+     * it the fragments' views of it, so the data doesn't grow with the
+     * square of the number of fragments. */
+    chain_len = 0;
+    for (chain = fd_head->tvb_data; chain; chain = chain->next)
+        chain_len++;
+    ASSERT(chain_len <= 4 * n);
+
+    reassembly_table_set_zero_copy(&test_reassembly_table, false);
+}
+
 /**********************************************************************************
  *
  * main
@@ -3251,6 +3570,11 @@ main(int argc _U_, char **argv _U_)
         test_fragment_add_check_duplicate_last,
 #endif
         test_fragment_add_check_duplicate_conflict,
+        test_fragment_add_addresses,
+        test_reassembly_table_expire,
+        test_fragment_add_zero_copy,
+        test_fragment_add_seq_zero_copy,
+        test_fragment_add_zero_copy_extended,
     };
 
     /* a tvbuff for testing with */
@@ -580,6 +580,77 @@ stats_tree_create_node_by_pname(stats_tree *st, const char *name,
     return stats_tree_create_node(st,name,stats_tree_parent_id_by_name(st,parent_name),datatype,with_children);
 }
 
+/* adds the values of other to those of node, and the children of other
+   that node doesn't have yet as new children of node */
+static void
+// NOLINTNEXTLINE(misc-no-recursion)
+merge_stat_node(stat_node *node, const stat_node *other)
+{
+    const stat_node *other_child;
+    stat_node *child;
+
+    node->counter += other->counter;
+    switch (node->datatype)
+    {
+    case STAT_DT_INT:
+        node->total.int_total += other->total.int_total;
+        node->minvalue.int_min = MIN(node->minvalue.int_min, other->minvalue.int_min);
+        node->maxvalue.int_max = MAX(node->maxvalue.int_max, other->maxvalue.int_max);
+        break;
+    case STAT_DT_FLOAT:
+        node->total.float_total += other->total.float_total;
+        node->minvalue.float_min = MIN(node->minvalue.float_min, other->minvalue.float_min);
+        node->maxvalue.float_max = MAX(node->maxvalue.float_max, other->maxvalue.float_max);
+        break;
+    }
+    node->st_flags |= other->st_flags;
+
+    /* The packets of a burst may be split between the trees, so this is
+       only the largest burst that either of them saw. */
+    if (other->max_burst > node->max_burst) {
+        node->max_burst = other->max_burst;
+        node->burst_time = other->burst_time;
+    }
+
+    for (other_child = other->children; other_child; other_child = other_child->next) {
+        if (node->hash) {
+            child = (stat_node *)g_hash_table_lookup(node->hash, other_child->name);
+        } else {
+            for (child = node->children; child; child = child->next) {
+                if (strcmp(child->name, other_child->name) == 0)
+                    break;
+            }
+        }
+
+        if (child == NULL) {
+            child = new_stat_node(node->st, other_child->name, node->id, other_child->datatype,
+                                  other_child->hash != NULL, other_child->id >= 0);
+            if (other_child->rng)
+                child->rng = (range_pair_t *)g_memdup2(other_child->rng, sizeof(range_pair_t));
+        }
+
+        // Recursion is limited by proto.c checks
+        merge_stat_node(child, other_child);
+    }
+}
+
+/* adds the statistics of another tree of the same kind, fed other packets */
+extern void
+stats_tree_merge(void *p, const void *p_other)
+{
+    stats_tree *st = (stats_tree *)p;
+    const stats_tree *other = (const stats_tree *)p_other;
+
+    if (other->start >= 0.0 && (st->start < 0.0 || other->start < st->start))
+        st->start = other->start;
+    if (other->now > st->now)
+        st->now = other->now;
+    if (st->start >= 0.0)
+        st->elapsed = st->now - st->start;
+
+    merge_stat_node(&st->root, &other->root);
+}
+
 /* Internal function to update the burst calculation data - add entry to bucket */
 static void
 update_burst_calc(stat_node *node, int value)
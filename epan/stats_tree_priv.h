@@ -185,6 +185,10 @@ WS_DLL_PUBLIC tap_packet_status stats_tree_packet(void*, packet_info*, epan_diss
 /** callback for reset */
 WS_DLL_PUBLIC void stats_tree_reset(void *p_st);
 
+/** callback for merge: adds the statistics of another instance of the
+    same stats_tree that was fed a disjoint set of packets */
+WS_DLL_PUBLIC void stats_tree_merge(void *p_st, const void *p_other);
+
 /** callback for clear */
 WS_DLL_PUBLIC void stats_tree_reinit(void *p_st);
 
@@ -0,0 +1,145 @@
+/* stats_tree_test.c
+ * Standalone program to test merging the partial results of stats_trees
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include <epan/stats_tree_priv.h>
+#include <epan/stats_tree.h>
+#include <epan/tap.h>
+
+#define TEST_TAP "stats_tree_test"
+
+static stats_tree_cfg *test_cfg;
+
+static void
+test_tree_init(stats_tree *st)
+{
+    stats_tree_create_node(st, "Packets", 0, STAT_DT_INT, false);
+    stats_tree_create_node(st, "Values", 0, STAT_DT_INT, false);
+    stats_tree_create_pivot(st, "Parity", 0);
+    stats_tree_create_range_node(st, "Sizes", 0, "0-3", "4-7", "8-", NULL);
+}
+
+static tap_packet_status
+test_tree_packet(stats_tree *st _U_, packet_info *pinfo _U_, epan_dissect_t *edt _U_,
+                 const void *p _U_, tap_flags_t flags _U_)
+{
+    return TAP_PACKET_DONT_REDRAW;
+}
+
+/* What the packet callback of a real tree would do for a packet. */
+static void
+test_tree_feed(stats_tree *st, int value)
+{
+    tick_stat_node(st, "Packets", 0, false);
+    avg_stat_node_add_value_int(st, "Values", 0, false, value);
+    stats_tree_tick_pivot(st, stats_tree_parent_id_by_name(st, "Parity"),
+                          value % 2 ? "odd" : "even");
+    tick_stat_node(st, "Sizes", 0, false);
+    stats_tree_tick_range(st, "Sizes", 0, value);
+}
+
+static stats_tree *
+test_tree_new(void)
+{
+    stats_tree *st = stats_tree_new(test_cfg, NULL, NULL);
+
+    test_tree_init(st);
+    return st;
+}
+
+static char *
+test_tree_format(stats_tree *st)
+{
+    return g_string_free(stats_tree_format_as_str(st, ST_FORMAT_PLAIN,
+                                                  stats_tree_get_default_sort_col(st),
+                                                  stats_tree_is_default_sort_DESC(st)), FALSE);
+}
+
+/* Two trees fed the odd and the even values give, once merged, the same
+ * statistics as one tree fed all of them, including the nodes that only
+ * the second tree created. */
+static void
+stats_tree_test_merge(void)
+{
+    stats_tree *all = test_tree_new();
+    stats_tree *odd = test_tree_new();
+    stats_tree *even = test_tree_new();
+    char *expected, *merged;
+    int value;
+
+    for (value = 1; value <= 10; value++) {
+        test_tree_feed(all, value);
+        test_tree_feed(value % 2 ? odd : even, value);
+    }
+
+    g_assert_null(register_tap_listener(TEST_TAP, odd, NULL, 0, stats_tree_reset,
+                                        stats_tree_packet, NULL, NULL));
+    set_tap_merge(odd, stats_tree_merge);
+    g_assert_true(tap_listeners_can_merge());
+    g_assert_true(merge_tap_listener(odd, even));
+    remove_tap_listener(odd);
+
+    expected = test_tree_format(all);
+    merged = test_tree_format(odd);
+    g_assert_cmpstr(merged, ==, expected);
+
+    g_free(expected);
+    g_free(merged);
+    stats_tree_free(all);
+    stats_tree_free(odd);
+    stats_tree_free(even);
+}
+
+/* A listener without a merge callback can't be merged. */
+static void
+stats_tree_test_no_merge(void)
+{
+    stats_tree *st = test_tree_new();
+    stats_tree *other = test_tree_new();
+
+    g_assert_null(register_tap_listener(TEST_TAP, st, NULL, 0, stats_tree_reset,
+                                        stats_tree_packet, NULL, NULL));
+    g_assert_false(tap_listeners_can_merge());
+    g_assert_false(merge_tap_listener(st, other));
+    remove_tap_listener(st);
+
+    stats_tree_free(st);
+    stats_tree_free(other);
+}
+
+int
+main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/stats_tree/merge", stats_tree_test_merge);
+    g_test_add_func("/stats_tree/no_merge", stats_tree_test_no_merge);
+
+    register_tap(TEST_TAP);
+    test_cfg = stats_tree_register(TEST_TAP, "stats_tree_test", "Test", 0,
+                                   test_tree_packet, NULL, NULL);
+    return g_test_run();
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 4
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=4 tabstop=8 expandtab:
+ * :indentSize=4:tabSize=8:noTabs=true:
+ */
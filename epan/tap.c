@@ -24,11 +24,12 @@
 #include <glib.h>
 
 #include <epan/packet_info.h>
+#include <epan/epan_dissect.h>
 #include <epan/dfilter/dfilter.h>
 #include <epan/tap.h>
+#include <wsutil/wmem/wmem.h>
 #include <wsutil/wslog.h>
 
-static bool tapping_is_active=false;
 static dfilter_t *main_filter;
 
 typedef struct _tap_dissector_t {
@@ -38,12 +39,17 @@ typedef struct _tap_dissector_t {
 static tap_dissector_t *tap_dissector_list;
 
 /*
- * This is the list of free and used packets queued for a tap.
+ * This is the list of packets queued for the taps while dissecting a packet.
  * It is implemented here explicitly instead of using GLib objects
  * in order to be as fast as possible as we need to build and tear down the
  * queued list at least once for each packet we see and thus we must be able
  * to build and tear it down as fast as possible.
  *
+ * The queue belongs to the packet being dissected: it hangs off its
+ * packet_info and is allocated from the packet's pinfo->pool, so it is
+ * freed along with the rest of the packet's data and several
+ * epan_dissect_t's can be dissecting and tapping packets at once.
+ *
  * XXX - some fields in packet_info get overwritten in the dissection
  * process, such as the addresses and the "this is an error packet" flag.
  * A packet may be queued at multiple protocol layers, but the packet_info
@@ -75,9 +81,15 @@ typedef struct _tap_packet_t {
 
 #define TAP_PACKET_IS_ERROR_PACKET	0x00000001	/* packet being queued is an error packet */
 
-#define TAP_PACKET_QUEUE_LEN 5000
-static tap_packet_t tap_packet_array[TAP_PACKET_QUEUE_LEN];
-static unsigned tap_packet_index;
+/* Initial number of entries; the queue doubles in size when it is full. */
+#define TAP_PACKET_QUEUE_INITIAL_LEN 32
+
+struct tap_packet_queue {
+	wmem_allocator_t *pool;
+	tap_packet_t *packets;
+	unsigned len;
+	unsigned size;
+};
 
 typedef struct _tap_listener_t {
 	struct _tap_listener_t *next;
@@ -87,15 +99,24 @@ typedef struct _tap_listener_t {
 	unsigned flags;
 	char *fstring;
 	dfilter_t *code;
+	unsigned filter_idx;	/* Of code in tap_filter_group */
 	void *tapdata;
 	tap_reset_cb reset;
 	tap_packet_cb packet;
 	tap_draw_cb draw;
 	tap_finish_cb finish;
+	tap_merge_cb merge;
 } tap_listener_t;
 
 static tap_listener_t *tap_listener_queue;
 
+/* The filters of the listeners and the main filter, evaluated together so
+ * that the fields they have in common are only read once per packet, and
+ * each filter at most once however many of its packets were queued. Built
+ * when first needed after a filter changes. */
+static dfilter_group_t *tap_filter_group;
+static unsigned main_filter_idx;
+
 static GSList *tap_plugins;
 
 #ifdef HAVE_PLUGINS
@@ -151,7 +172,6 @@ register_all_tap_listeners(tap_reg_t const *tap_reg_listeners)
 void
 tap_init(void)
 {
-	tap_packet_index=0;
 }
 
 /* **********************************************************************
@@ -229,34 +249,56 @@ register_tap(const char *name)
 void
 tap_queue_packet(int tap_id, packet_info *pinfo, const void *tap_specific_data)
 {
+	struct tap_packet_queue *queue = pinfo->tap_queue;
 	tap_packet_t *tpt;
 
-	if(!tapping_is_active){
+	if(!queue){
 		return;
 	}
-	/*
-	 * XXX - should we allocate this with an ep_allocator,
-	 * rather than having a fixed maximum number of entries?
-	 */
-	if(tap_packet_index >= TAP_PACKET_QUEUE_LEN){
-		ws_warning("Too many taps queued");
-		return;
+
+	if(queue->len == queue->size){
+		queue->size = queue->size ? queue->size * 2 : TAP_PACKET_QUEUE_INITIAL_LEN;
+		queue->packets = wmem_realloc(queue->pool, queue->packets,
+		    queue->size * sizeof(tap_packet_t));
 	}
 
-	tpt=&tap_packet_array[tap_packet_index];
+	tpt=&queue->packets[queue->len];
 	tpt->tap_id=tap_id;
 	tpt->flags = 0;
 	if (pinfo->flags.in_error_pkt)
 		tpt->flags |= TAP_PACKET_IS_ERROR_PACKET;
 	tpt->pinfo=pinfo;
 	tpt->tap_specific_data=tap_specific_data;
-	tap_packet_index++;
+	queue->len++;
 }
 
 
 
 
 
+static void
+tap_filter_group_invalidate(void)
+{
+	dfilter_group_free(tap_filter_group);
+	tap_filter_group = NULL;
+}
+
+static dfilter_group_t *
+tap_filter_group_get(void)
+{
+	tap_listener_t *tl;
+
+	if (tap_filter_group)
+		return tap_filter_group;
+
+	tap_filter_group = dfilter_group_new();
+	main_filter_idx = dfilter_group_add(tap_filter_group, main_filter);
+	for(tl=tap_listener_queue;tl;tl=tl->next){
+		tl->filter_idx = dfilter_group_add(tap_filter_group, tl->code);
+	}
+	return tap_filter_group;
+}
+
 /* **********************************************************************
  * Functions used by file.c to drive the tap subsystem
  * ********************************************************************** */
@@ -293,21 +335,25 @@ void tap_build_interesting (epan_dissect_t *edt)
 	}
 }
 
-/* This function is used to delete/initialize the tap queue and prime an
-   epan_dissect_t with all the filters for tap listeners.
-   To free the tap queue, we just prepend the used queue to the free queue.
+/* This function is used to initialize the tap queue of the packet about to
+   be dissected in an epan_dissect_t and prime the epan_dissect_t with all
+   the filters for tap listeners.
+   The queue is allocated from the packet's pool, so it doesn't need to be
+   freed explicitly.
 */
 void
 tap_queue_init(epan_dissect_t *edt)
 {
+	struct tap_packet_queue *queue;
+
 	/* nothing to do, just return */
 	if(!tap_listener_queue){
 		return;
 	}
 
-	tapping_is_active=true;
-
-	tap_packet_index=0;
+	queue = wmem_new0(edt->pi.pool, struct tap_packet_queue);
+	queue->pool = edt->pi.pool;
+	edt->pi.tap_queue = queue;
 
 	tap_build_interesting (edt);
 }
@@ -318,27 +364,30 @@ tap_queue_init(epan_dissect_t *edt)
 void
 tap_push_tapped_queue(epan_dissect_t *edt)
 {
+	struct tap_packet_queue *queue = edt->pi.tap_queue;
 	tap_packet_t *tp;
 	tap_listener_t *tl;
+	dfilter_group_t *group;
 	unsigned i;
 
 	/* nothing to do, just return */
-	if(!tapping_is_active){
+	if(!queue){
 		return;
 	}
 
-	tapping_is_active=false;
+	/* Packets queued from here on (e.g. by a listener) aren't tapped. */
+	edt->pi.tap_queue = NULL;
 
 	/* nothing to do, just return */
-	if(!tap_packet_index){
+	if(!queue->len){
 		return;
 	}
 
 	/* loop over all tap listeners and call the listener callback
 	   for all packets that match the filter. */
-	for(i=0;i<tap_packet_index;i++){
+	for(i=0;i<queue->len;i++){
 		for(tl=tap_listener_queue;tl;tl=tl->next){
-			tp=&tap_packet_array[i];
+			tp=&queue->packets[i];
 			/* Don't tap the packet if it's an "error packet"
 			 * unless the listener has requested that we do so.
 			 */
@@ -365,8 +414,8 @@ tap_push_tapped_queue(epan_dissect_t *edt)
 					 */
 					unsigned flags = tl->flags;
 					if((tl->flags & TL_LIMIT_TO_DISPLAY_FILTER) && main_filter) {
-
-						if (!dfilter_apply_edt(main_filter, edt)){
+						group = tap_filter_group_get();
+						if (!dfilter_group_test_edt(group, main_filter_idx, edt)){
 							/* The packet didn't
 							 * pass the filter. */
 							if (tl->flags & TL_IGNORE_DISPLAY_FILTER)
@@ -376,7 +425,8 @@ tap_push_tapped_queue(epan_dissect_t *edt)
 						}
 					}
 					if(tl->code){
-						if (!dfilter_apply_edt(tl->code, edt)){
+						group = tap_filter_group_get();
+						if (!dfilter_group_test_edt(group, tl->filter_idx, edt)){
 							/* The packet didn't
 							 * pass the filter. */
 							if (tl->flags & TL_IGNORE_DISPLAY_FILTER)
@@ -408,6 +458,10 @@ tap_push_tapped_queue(epan_dissect_t *edt)
 			}
 		}
 	}
+
+	/* The results only hold for this packet. */
+	if (tap_filter_group)
+		dfilter_group_reset(tap_filter_group);
 }
 
 
@@ -426,24 +480,20 @@ tap_push_tapped_queue(epan_dissect_t *edt)
  * the tap listener.
  */
 const void *
-fetch_tapped_data(int tap_id, int idx)
+fetch_tapped_data(packet_info *pinfo, int tap_id, int idx)
 {
+	struct tap_packet_queue *queue = pinfo->tap_queue;
 	tap_packet_t *tp;
 	unsigned i;
 
 	/* nothing to do, just return */
-	if(!tapping_is_active){
-		return NULL;
-	}
-
-	/* nothing to do, just return */
-	if(!tap_packet_index){
+	if(!queue){
 		return NULL;
 	}
 
 	/* loop over all tapped packets and return the one with index idx */
-	for(i=0;i<tap_packet_index;i++){
-		tp=&tap_packet_array[i];
+	for(i=0;i<queue->len;i++){
+		tp=&queue->packets[i];
 		if(tp->tap_id==tap_id){
 			if(!idx--){
 				return tp->tap_specific_data;
@@ -547,6 +597,7 @@ free_tap_listener(tap_listener_t *tl)
 	if (tl->finish) {
 		tl->finish(tl->tapdata);
 	}
+	tap_filter_group_invalidate();
 	dfilter_free(tl->code);
 	g_free(tl->fstring);
 	g_free(tl);
@@ -609,6 +660,7 @@ register_tap_listener(const char *tapname, void *tapdata, const char *fstring,
 	tl->next=tap_listener_queue;
 
 	tap_listener_queue=tl;
+	tap_filter_group_invalidate();
 
 	return NULL;
 }
@@ -640,6 +692,7 @@ set_tap_dfilter(void *tapdata, const char *fstring)
 	}
 
 	if(tl){
+		tap_filter_group_invalidate();
 		if(tl->code){
 			dfilter_free(tl->code);
 			tl->code=NULL;
@@ -699,6 +752,61 @@ set_tap_flags(void *tapdata, unsigned flags)
 	return NULL;
 }
 
+GString *
+set_tap_merge(void *tapdata, tap_merge_cb merge)
+{
+	/* Like set_tap_flags(), this never fails. */
+	tap_listener_t *tl;
+
+	for(tl=tap_listener_queue;tl;tl=tl->next){
+		if(tl->tapdata==tapdata){
+			tl->merge=merge;
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+bool
+merge_tap_listener(void *tapdata, const void *other_tapdata)
+{
+	tap_listener_t *tl;
+
+	for(tl=tap_listener_queue;tl;tl=tl->next){
+		if(tl->tapdata==tapdata){
+			if(!tl->merge){
+				return false;
+			}
+			tl->merge(tl->tapdata, other_tapdata);
+			tl->needs_redraw=true;
+			return true;
+		}
+	}
+
+	ws_warning("no listener found with that tap data");
+	return false;
+}
+
+/*
+ * Return true if every tap listener that requires dissection can merge
+ * partial results, false otherwise.
+ */
+bool
+tap_listeners_can_merge(void)
+{
+	tap_listener_t *tl;
+
+	for(tl=tap_listener_queue;tl;tl=tl->next){
+		if(tl->flags & TL_IS_DISSECTOR_HELPER)
+			continue;
+		if(tl->packet && !tl->merge)
+			return false;
+	}
+
+	return true;
+}
+
 /* this function recompiles dfilter for all registered tap listeners
  */
 void
@@ -707,6 +815,7 @@ tap_listeners_dfilter_recompile(void)
 	tap_listener_t *tl;
 	dfilter_t *code;
 
+	tap_filter_group_invalidate();
 	for(tl=tap_listener_queue;tl;tl=tl->next){
 		if(tl->code){
 			dfilter_free(tl->code);
@@ -891,6 +1000,7 @@ void tap_load_main_filter(dfilter_t *dfcode)
 	 * much of the dfilter API does not accept a const dfilter_t.
 	 */
 	main_filter = dfcode;
+	tap_filter_group_invalidate();
 }
 
 /*
@@ -34,6 +34,7 @@ typedef void (*tap_reset_cb)(void *tapdata);
 typedef tap_packet_status (*tap_packet_cb)(void *tapdata, packet_info *pinfo, epan_dissect_t *edt, const void *data, tap_flags_t flags);
 typedef void (*tap_draw_cb)(void *tapdata);
 typedef void (*tap_finish_cb)(void *tapdata);
+typedef void (*tap_merge_cb)(void *tapdata, const void *other_tapdata);
 
 /**
  * Flags to indicate what a tap listener's packet routine requires.
@@ -143,9 +144,10 @@ WS_DLL_PUBLIC void tap_queue_packet(int tap_id, packet_info *pinfo, const void *
 /** Functions used by file.c to drive the tap subsystem */
 WS_DLL_PUBLIC void tap_build_interesting(epan_dissect_t *edt);
 
-/** This function is used to delete/initialize the tap queue and prime an
- *  epan_dissect_t with all the filters for tap listeners.
- *  To free the tap queue, we just prepend the used queue to the free queue.
+/** This function is used to initialize the tap queue of the packet about to
+ *  be dissected in an epan_dissect_t and prime the epan_dissect_t with all
+ *  the filters for tap listeners.
+ *  Each epan_dissect_t has its own queue, which grows as needed.
  */
 extern void tap_queue_init(epan_dissect_t *edt);
 
@@ -263,6 +265,35 @@ WS_DLL_PUBLIC void remove_tap_listener(void *tapdata);
 /** This function sets new flags to a tap listener */
 WS_DLL_PUBLIC GString *set_tap_flags(void *tapdata, unsigned flags);
 
+/** This function sets the merge callback of a tap listener.
+ *
+ * A listener that can merge partial results lets a caller dissect packets
+ * in more than one dissection context, each feeding its own instance of
+ * the listener, and then combine the instances into one.
+ *
+ * @param tapdata    The instance identifier of the listener.
+ * @param tap_merge  void (*merge)(void *tapdata, const void *other_tapdata)
+ *                   Adds the state in other_tapdata, an instance of the same
+ *                   kind of listener that was fed a disjoint set of packets,
+ *                   to the state in tapdata. other_tapdata is not modified;
+ *                   it is still freed by its own finish callback.
+ */
+WS_DLL_PUBLIC GString *set_tap_merge(void *tapdata, tap_merge_cb tap_merge);
+
+/** Merge the partial results in other_tapdata into the tap listener
+ * identified by tapdata, using the listener's merge callback.
+ *
+ * @return true if the listener has a merge callback and the results
+ *         were merged, false otherwise.
+ */
+WS_DLL_PUBLIC bool merge_tap_listener(void *tapdata, const void *other_tapdata);
+
+/**
+ * Return true if every tap listener that requires dissection has a merge
+ * callback, false otherwise.
+ */
+WS_DLL_PUBLIC bool tap_listeners_can_merge(void);
+
 /**
  * Return true if we have one or more tap listeners that require dissection,
  * false otherwise.
@@ -307,7 +338,7 @@ WS_DLL_PUBLIC unsigned union_of_tap_listener_flags(void);
  * use "filters" and should specify the "filter" as NULL when registering
  * the tap listener.
  */
-WS_DLL_PUBLIC const void *fetch_tapped_data(int tap_id, int idx);
+WS_DLL_PUBLIC const void *fetch_tapped_data(packet_info *pinfo, int tap_id, int idx);
 
 /** Clean internal structures
  */
@@ -16,6 +16,7 @@
 #include <string.h>
 
 #include "tvbuff.h"
+#include "tvbuff-int.h"
 #include "proto.h"
 #include "exceptions.h"
 #include "wsutil/array.h"
@@ -379,6 +380,61 @@ test(tvbuff_t *tvb, const char* name,
 		}
 	}
 
+	/* Sweep across data in various sized increments checking
+	 * tvb_get_iovec(), tvb_get_ptr() and tvb_memeql(), with
+	 * fewer pieces than a composite tvb may need, so that the
+	 * pieces are fetched in several calls. */
+	for (incr = 1; incr < length; incr++) {
+		for (i = 0; i < length - incr; i += incr) {
+			tvb_iovec_t	iov[2];
+			unsigned	n, j, done = 0;
+
+			while (done < incr) {
+				n = tvb_get_iovec(tvb, i + done, incr - done, iov, array_length(iov));
+				if (n == 0) {
+					printf("14: Failed TVB=%s Offset=%u Length=%u "
+							"No iovec pieces\n",
+							name, i + done, incr - done);
+					failed = true;
+					return false;
+				}
+				for (j = 0; j < n; j++) {
+					if (iov[j].length == 0 || done + iov[j].length > incr ||
+					    memcmp(iov[j].data, &expected_data[i + done], iov[j].length) != 0) {
+						printf("14: Failed TVB=%s Offset=%u Length=%u "
+								"Bad iovec piece %u\n",
+								name, i, incr, j);
+						failed = true;
+						return false;
+					}
+					done += iov[j].length;
+				}
+			}
+
+			if (memcmp(tvb_get_ptr(tvb, i, incr), &expected_data[i], incr) != 0) {
+				printf("15: Failed TVB=%s Offset=%u Length=%u "
+						"Bad ptr\n",
+						name, i, incr);
+				failed = true;
+				return false;
+			}
+
+			if (tvb_memeql(tvb, i, &expected_data[i], incr) != 0) {
+				printf("16: Failed TVB=%s Offset=%u Length=%u "
+						"Bad memeql\n",
+						name, i, incr);
+				failed = true;
+				return false;
+			}
+		}
+	}
+
+	/* An empty range has no pieces. */
+	if (tvb_get_iovec(tvb, 0, 0, NULL, 0) != 0) {
+		printf("14: Failed TVB=%s Pieces for an empty range\n", name);
+		failed = true;
+		return false;
+	}
 
 	printf("Passed TVB=%s\n", name);
 
@@ -701,6 +757,52 @@ varint_tests(void)
 	tvb_free_chain(tvb_parent);  /* should free all tvb's and associated data */
 }
 
+static void
+data_source_tests(void)
+{
+	static const uint8_t data[] = "0123456789";
+	tvbuff_t	*tvb_ds, *tvb_subset, *tvb_subsubset, *tvb_child, *tvb_composite;
+	bool		ok = true;
+
+	tvb_ds = tvb_new_real_data(data, 10, 10);
+	tvb_subset = tvb_new_subset_length(tvb_ds, 2, 6);
+	tvb_subsubset = tvb_new_subset_remaining(tvb_subset, 1);
+	tvb_child = tvb_new_child_real_data(tvb_ds, data, 4, 4);
+	tvb_composite = tvb_new_composite();
+	tvb_composite_append(tvb_composite, tvb_subset);
+	tvb_composite_finalize(tvb_composite);
+
+	/* Nothing is a data source until it's been made one. */
+	ok &= !tvb_backed_by_data_source(tvb_ds);
+	ok &= !tvb_backed_by_data_source(tvb_subsubset);
+
+	/* Subsets of a data source are backed by it; other tvbuffs aren't. */
+	tvb_set_data_source(tvb_ds, true);
+	ok &= tvb_backed_by_data_source(tvb_ds);
+	ok &= tvb_backed_by_data_source(tvb_subset);
+	ok &= tvb_backed_by_data_source(tvb_subsubset);
+	ok &= !tvb_backed_by_data_source(tvb_child);
+	ok &= !tvb_backed_by_data_source(tvb_composite);
+
+	tvb_set_data_source(tvb_composite, true);
+	ok &= tvb_backed_by_data_source(tvb_composite);
+
+	/* Removing the data source is seen by the subsets. */
+	tvb_set_data_source(tvb_ds, false);
+	ok &= !tvb_backed_by_data_source(tvb_subset);
+	ok &= !tvb_backed_by_data_source(tvb_subsubset);
+	ok &= tvb_backed_by_data_source(tvb_composite);
+
+	if (ok) {
+		printf("Passed data source tests\n");
+	} else {
+		printf("Failed data source tests\n");
+		failed = true;
+	}
+
+	tvb_free_chain(tvb_ds);  /* the composite is chained to its first member */
+}
+
 #define DATA_AND_LEN(X) .data = X, .len = sizeof(X) - 1
 
 static void
@@ -815,6 +917,7 @@ main(void)
 	except_init();
 	run_tests();
 	varint_tests();
+	data_source_tests();
 	zstd_tests ();
 	except_deinit();
 	exit(failed?1:0);
@@ -25,12 +25,15 @@ struct tvb_ops {
 	int (*tvb_ws_mempbrk_pattern_uint8)(tvbuff_t *tvb, unsigned abs_offset, unsigned limit, const ws_mempbrk_pattern* pattern, unsigned char *found_needle);
 
 	tvbuff_t *(*tvb_clone)(tvbuff_t *tvb, unsigned abs_offset, unsigned abs_length);
+
+	unsigned (*tvb_get_iovec)(tvbuff_t *tvb, unsigned abs_offset, unsigned abs_length, tvb_iovec_t *iov, unsigned max_iov);
 };
 
 /*
  * Tvbuff flags.
  */
 #define TVBUFF_FRAGMENT		0x00000001	/* this is a fragment */
+#define TVBUFF_DATA_SOURCE	0x00000002	/* a data source of the packet */
 
 struct tvbuff {
 	/* Doubly linked list pointers */
@@ -94,5 +97,22 @@ void tvb_add_to_chain(tvbuff_t *parent, tvbuff_t *child);
 
 unsigned tvb_offset_from_real_beginning_counter(const tvbuff_t *tvb, const unsigned counter);
 
+tvbuff_t *tvb_new_composite_detached(void);
+
+unsigned tvb_composite_copied_bytes(const tvbuff_t *tvb);
+
+void tvb_composite_append_range(tvbuff_t *tvb, tvbuff_t *src, unsigned offset, unsigned length);
+
+void tvb_composite_free_detached(tvbuff_t *tvb, const tvbuff_t *keep);
+
+tvbuff_t *tvb_subset_backing(tvbuff_t *tvb, unsigned *offset);
+
+unsigned tvb_get_iovec_abs(tvbuff_t *tvb, unsigned abs_offset, unsigned abs_length, tvb_iovec_t *iov, unsigned max_iov);
+
 void tvb_check_offset_length(const tvbuff_t *tvb, const int offset, int const length_val, unsigned *offset_ptr, unsigned *length_ptr);
+
+/* These are marked with WS_DLL_PUBLIC so that tvbtest can test them. */
+WS_DLL_PUBLIC void tvb_set_data_source(tvbuff_t *tvb, bool is_data_source);
+
+WS_DLL_PUBLIC bool tvb_backed_by_data_source(const tvbuff_t *tvb);
 #endif
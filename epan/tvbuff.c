@@ -29,6 +29,7 @@
 
 #include <glib.h>
 
+#include "wsutil/array.h"
 #include "wsutil/pint.h"
 #include "wsutil/sign_ext.h"
 #include "wsutil/strtoi.h"
@@ -1003,6 +1004,40 @@ tvb_get_ptr(tvbuff_t *tvb, const int offset, const int length)
 	return ensure_contiguous(tvb, offset, length);
 }
 
+unsigned
+tvb_get_iovec_abs(tvbuff_t *tvb, unsigned abs_offset, unsigned abs_length, tvb_iovec_t *iov, unsigned max_iov)
+{
+	if (abs_length == 0 || max_iov == 0)
+		return 0;
+
+	if (tvb->real_data) {
+		iov[0].data = tvb->real_data + abs_offset;
+		iov[0].length = abs_length;
+		return 1;
+	}
+
+	if (tvb->ops->tvb_get_iovec)
+		return tvb->ops->tvb_get_iovec(tvb, abs_offset, abs_length, iov, max_iov);
+
+	/* The range is contiguous in this tvbuff. */
+	DISSECTOR_ASSERT(tvb->ops->tvb_get_ptr);
+	iov[0].data = tvb->ops->tvb_get_ptr(tvb, abs_offset, abs_length);
+	iov[0].length = abs_length;
+	return 1;
+}
+
+unsigned
+tvb_get_iovec(tvbuff_t *tvb, const int offset, const int length, tvb_iovec_t *iov, unsigned max_iov)
+{
+	unsigned abs_offset = 0, abs_length = 0;
+
+	DISSECTOR_ASSERT(tvb && tvb->initialized);
+
+	check_offset_length(tvb, offset, length, &abs_offset, &abs_length);
+
+	return tvb_get_iovec_abs(tvb, abs_offset, abs_length, iov, max_iov);
+}
+
 /* ---------------- */
 uint8_t
 tvb_get_uint8(tvbuff_t *tvb, const int offset)
@@ -2749,24 +2784,34 @@ tvb_strncaseeql(tvbuff_t *tvb, const int offset, const char *str, const size_t s
 int
 tvb_memeql(tvbuff_t *tvb, const int offset, const uint8_t *str, size_t size)
 {
-	const uint8_t *ptr;
-
-	ptr = ensure_contiguous_no_exception(tvb, offset, (int) size, NULL);
-
-	if (ptr) {
-		int cmp = memcmp(ptr, str, size);
+	unsigned     abs_offset = 0, abs_length = 0;
+	tvb_iovec_t iov[4];
+	unsigned     n, i;
 
-		/*
-		 * Return 0 if equal, -1 otherwise.
-		 */
-		return (cmp == 0 ? 0 : -1);
-	} else {
+	if (size == 0 ||
+	    check_offset_length_no_exception(tvb, offset, (int) size, &abs_offset, &abs_length)) {
 		/*
 		 * Not enough characters in the tvbuff to match the
 		 * string.
 		 */
 		return -1;
 	}
+
+	/*
+	 * Compare the data piece by piece, so that a composite
+	 * tvbuff doesn't have to be made contiguous.
+	 */
+	while (abs_length > 0) {
+		n = tvb_get_iovec_abs(tvb, abs_offset, abs_length, iov, array_length(iov));
+		for (i = 0; i < n; i++) {
+			if (memcmp(iov[i].data, str, iov[i].length) != 0)
+				return -1;
+			str += iov[i].length;
+			abs_offset += iov[i].length;
+			abs_length -= iov[i].length;
+		}
+	}
+	return 0;
 }
 
 /**
@@ -4781,6 +4826,27 @@ tvb_get_ds_tvb(tvbuff_t *tvb)
 	return(tvb->ds_tvb);
 }
 
+/*
+ * Record whether a tvbuff is one of the data sources of its packet, so
+ * that tvb_backed_by_data_source() doesn't have to search the packet's
+ * list of data sources.
+ */
+void
+tvb_set_data_source(tvbuff_t *tvb, bool is_data_source)
+{
+	if (is_data_source)
+		tvb->flags |= TVBUFF_DATA_SOURCE;
+	else
+		tvb->flags &= ~TVBUFF_DATA_SOURCE;
+}
+
+/* Whether the data source top-level tvbuff of a tvbuff is a data source. */
+bool
+tvb_backed_by_data_source(const tvbuff_t *tvb)
+{
+	return tvb->ds_tvb != NULL && (tvb->ds_tvb->flags & TVBUFF_DATA_SOURCE);
+}
+
 unsigned
 tvb_get_varint(tvbuff_t *tvb, unsigned offset, unsigned maxlen, uint64_t *value, const unsigned encoding)
 {
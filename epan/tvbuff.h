@@ -590,13 +590,36 @@ WS_DLL_PUBLIC void *tvb_memdup(wmem_allocator_t *scope, tvbuff_t *tvb,
  *
  * Return a pointer into our buffer if the data asked for via 'offset'/'length'
  * is contiguous (which might not be the case for a "composite" tvbuff). If the
- * data is not contiguous, a tvb_memdup() is called for the entire buffer
+ * data is not contiguous, the requested range is copied into a new buffer
  * and the pointer to the newly-contiguous data is returned. This dynamically-
  * allocated memory will be freed when the tvbuff is freed, after the
- * tvbuff_free_cb_t() is called, if any. */
+ * tvbuff_free_cb_t() is called, if any. To read data that may span the
+ * members of a composite tvbuff without copying it, use tvb_get_iovec(). */
 WS_DLL_PUBLIC const uint8_t *tvb_get_ptr(tvbuff_t *tvb, const int offset,
     const int length);
 
+/** A contiguous piece of the data of a tvbuff. */
+typedef struct {
+    const uint8_t *data;
+    unsigned length;
+} tvb_iovec_t;
+
+/** Get the data asked for via 'offset'/'length' as a list of contiguous
+ * pieces, without copying it, even if it isn't contiguous (for instance
+ * if it spans several members of a composite tvbuff).
+ *
+ * Fills in at most max_iov pieces, and returns the number of pieces filled
+ * in; if the range has more pieces than that, the data that follows the
+ * sum of the lengths of the returned pieces can be had with another call.
+ * A length of 0 returns 0 pieces.
+ *
+ * As with tvb_get_ptr(), the data is internal to the tvbuff: don't free
+ * or modify it, and don't read past the length of each piece.
+ *
+ * Throws an exception if the tvbuff ends before the requested data does. */
+WS_DLL_PUBLIC unsigned tvb_get_iovec(tvbuff_t *tvb, const int offset,
+    const int length, tvb_iovec_t *iov, unsigned max_iov);
+
 /** Find first occurrence of needle in tvbuff, starting at offset. Searches
  * at most maxlength number of bytes; if maxlength is -1, searches to
  * end of tvbuff.
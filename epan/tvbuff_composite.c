@@ -18,22 +18,46 @@
 typedef struct {
 	GQueue		*tvbs;
 
-	/* Used for quick testing to see if this
-	 * is the tvbuff that a COMPOSITE is
-	 * interested in. */
+	/* The members, and the offsets of their first and last bytes,
+	 * in order; filled in by tvb_composite_finalize(). The offsets
+	 * are searched with a binary search to find the member that
+	 * holds a given offset. */
+	unsigned	num_members;
+	tvbuff_t	**members;
 	unsigned		*start_offsets;
 	unsigned		*end_offsets;
 
-	unsigned	recursion_depth;
+	/* Copies of the ranges that tvb_get_ptr() was asked for
+	 * and that span several members. */
+	GSList		*windows;
+	unsigned	window_bytes;
+
+	/* Not added to the chain of the first member. */
+	bool		detached;
 
 } tvb_comp_t;
 
+typedef struct {
+	unsigned	offset;
+	unsigned	length;
+	uint8_t		*data;
+} tvb_comp_window_t;
+
 struct tvb_composite {
 	struct tvbuff tvb;
 
 	tvb_comp_t	composite;
 };
 
+static void
+composite_free_window(void *data)
+{
+	tvb_comp_window_t *window = (tvb_comp_window_t *)data;
+
+	g_free(window->data);
+	g_free(window);
+}
+
 static void
 composite_free(tvbuff_t *tvb)
 {
@@ -42,8 +66,10 @@ composite_free(tvbuff_t *tvb)
 
 	g_queue_free(composite->tvbs);
 
+	g_free(composite->members);
 	g_free(composite->start_offsets);
 	g_free(composite->end_offsets);
+	g_slist_free_full(composite->windows, composite_free_window);
 	g_free((void *)tvb->real_data);
 }
 
@@ -53,36 +79,48 @@ composite_offset(const tvbuff_t *tvb _U_, const unsigned counter)
 	return counter;
 }
 
+/* Returns the index of the member that holds abs_offset, or
+ * num_members if abs_offset is at the end of the tvbuff. */
+static unsigned
+composite_find_member(const tvb_comp_t *composite, unsigned abs_offset)
+{
+	unsigned lo = 0, hi = composite->num_members, mid;
+
+	/* Find the first member that ends at or after abs_offset. */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (composite->end_offsets[mid] < abs_offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
 static const uint8_t*
 composite_get_ptr(tvbuff_t *tvb, unsigned abs_offset, unsigned abs_length)
 {
 	struct tvb_composite *composite_tvb = (struct tvb_composite *) tvb;
 	unsigned	    i;
 	tvb_comp_t *composite;
-	tvbuff_t   *member_tvb = NULL;
+	tvbuff_t   *member_tvb;
 	unsigned	member_offset;
+	tvb_comp_window_t *window;
 
 	/* DISSECTOR_ASSERT(tvb->ops == &tvb_composite_ops); */
 
 	/* Maybe the range specified by offset/length
 	 * is contiguous inside one of the member tvbuffs */
 	composite = &composite_tvb->composite;
-	GList *item = (GList*)composite->tvbs->head;
-
-
-	for (i = 0; i < g_queue_get_length(composite->tvbs); i++, item=item->next) {
-		if (abs_offset <= composite->end_offsets[i]) {
-			member_tvb = (tvbuff_t *)item->data;
-			break;
-		}
-	}
+	i = composite_find_member(composite, abs_offset);
 
 	/* special case */
-	if (!member_tvb) {
+	if (i == composite->num_members) {
 		DISSECTOR_ASSERT(abs_offset == tvb->length && abs_length == 0);
 		return "";
 	}
 
+	member_tvb = composite->members[i];
 	member_offset = abs_offset - composite->start_offsets[i];
 
 	if (tvb_bytes_exist(member_tvb, member_offset, abs_length)) {
@@ -92,20 +130,42 @@ composite_get_ptr(tvbuff_t *tvb, unsigned abs_offset, unsigned abs_length)
 		DISSECTOR_ASSERT(!tvb->real_data);
 		return tvb_get_ptr(member_tvb, member_offset, abs_length);
 	}
-	else {
-		/* Use a temporary variable as tvb_memcpy is also checking tvb->real_data pointer */
+
+	/* The last copy may hold the range already. */
+	if (composite->windows) {
+		window = (tvb_comp_window_t *)composite->windows->data;
+		if (abs_offset >= window->offset &&
+		    abs_offset - window->offset + abs_length <= window->length)
+			return window->data + (abs_offset - window->offset);
+	}
+
+	if (composite->window_bytes + abs_length > tvb->length) {
+		/*
+		 * We have copied as much as the whole tvbuff already;
+		 * make it contiguous once and for all, so that the
+		 * copies don't grow without bounds.
+		 *
+		 * Use a temporary variable as tvb_memcpy is also
+		 * checking tvb->real_data pointer.
+		 */
 		void *real_data = g_malloc(tvb->length);
 		tvb_memcpy(tvb, real_data, 0, tvb->length);
 		tvb->real_data = (const uint8_t *)real_data;
 		return tvb->real_data + abs_offset;
 	}
 
-	DISSECTOR_ASSERT_NOT_REACHED();
+	/* Copy only the requested range. */
+	window = g_new(tvb_comp_window_t, 1);
+	window->offset = abs_offset;
+	window->length = abs_length;
+	window->data = (uint8_t *)g_malloc(abs_length);
+	tvb_memcpy(tvb, window->data, abs_offset, abs_length);
+	composite->windows = g_slist_prepend(composite->windows, window);
+	composite->window_bytes += abs_length;
+	return window->data;
 }
 
-#define MAX_RECURSION_DEPTH 500 // Arbitrary; matches prefs.gui_max_tree_depth
 static void *
-// NOLINTNEXTLINE(misc-no-recursion)
 composite_memcpy(tvbuff_t *tvb, void* _target, unsigned abs_offset, unsigned abs_length)
 {
 	struct tvb_composite *composite_tvb = (struct tvb_composite *) tvb;
@@ -113,64 +173,121 @@ composite_memcpy(tvbuff_t *tvb, void* _target, unsigned abs_offset, unsigned abs
 
 	unsigned	    i;
 	tvb_comp_t *composite;
-	tvbuff_t   *member_tvb = NULL;
+	tvbuff_t   *member_tvb;
 	unsigned	    member_offset, member_length;
 
 	/* DISSECTOR_ASSERT(tvb->ops == &tvb_composite_ops); */
 
-	/* Maybe the range specified by offset/length
-	 * is contiguous inside one of the member tvbuffs */
 	composite   = &composite_tvb->composite;
-
-	GList *item = (GList*)composite->tvbs->head;
-	for (i = 0; i < g_queue_get_length(composite->tvbs); i++, item=item->next) {
-		if (abs_offset <= composite->end_offsets[i]) {
-			member_tvb = (tvbuff_t *)item->data;
-			break;
-		}
-	}
+	i = composite_find_member(composite, abs_offset);
 
 	/* special case */
-	if (!member_tvb) {
+	if (i == composite->num_members) {
 		DISSECTOR_ASSERT(abs_offset == tvb->length && abs_length == 0);
 		return target;
 	}
 
-	member_offset = abs_offset - composite->start_offsets[i];
-
-	if (tvb_bytes_exist(member_tvb, member_offset, abs_length)) {
-		DISSECTOR_ASSERT(!tvb->real_data);
-		return tvb_memcpy(member_tvb, target, member_offset, abs_length);
-	}
-	else {
-		/* The requested data is non-contiguous inside
-		 * the member tvb. We have to memcpy() the part that's in the member tvb,
-		 * then iterate across the other member tvb's, copying their portions
-		 * until we have copied all data.
-		 */
-		member_length = tvb_captured_length_remaining(member_tvb, member_offset);
+	DISSECTOR_ASSERT(!tvb->real_data);
 
-		/* composite_memcpy() can't handle a member_length of zero. */
-		DISSECTOR_ASSERT(member_length > 0);
-		/* make sure we don't underflow below */
-		DISSECTOR_ASSERT(member_length <= abs_length);
+	/* Copy the part that's in each member tvb in turn,
+	 * until we have copied all data.
+	 */
+	while (abs_length > 0) {
+		DISSECTOR_ASSERT(i < composite->num_members);
+		member_tvb = composite->members[i];
+		member_offset = abs_offset - composite->start_offsets[i];
+		member_length = MIN(member_tvb->length - member_offset, abs_length);
 
 		tvb_memcpy(member_tvb, target, member_offset, member_length);
+		target		+= member_length;
 		abs_offset	+= member_length;
 		abs_length	-= member_length;
+		i++;
+	}
 
-		/* Recurse */
-		if (abs_length > 0) {
-			composite->recursion_depth++;
-			DISSECTOR_ASSERT(composite->recursion_depth < MAX_RECURSION_DEPTH);
-			composite_memcpy(tvb, target + member_length, abs_offset, abs_length);
-			composite->recursion_depth--;
-		}
+	return _target;
+}
 
-		return target;
+static int
+composite_find_uint8(tvbuff_t *tvb, unsigned abs_offset, unsigned limit, uint8_t needle)
+{
+	struct tvb_composite *composite_tvb = (struct tvb_composite *) tvb;
+	tvb_comp_t *composite = &composite_tvb->composite;
+	unsigned    i;
+	tvbuff_t   *member_tvb;
+	unsigned    member_offset, member_length;
+	int         result;
+
+	/* Search each member in turn, rather than making the range contiguous. */
+	for (i = composite_find_member(composite, abs_offset); limit > 0 && i < composite->num_members; i++) {
+		member_tvb = composite->members[i];
+		member_offset = abs_offset - composite->start_offsets[i];
+		member_length = MIN(member_tvb->length - member_offset, limit);
+
+		result = tvb_find_uint8(member_tvb, member_offset, member_length, needle);
+		if (result != -1)
+			return composite->start_offsets[i] + result;
+
+		abs_offset += member_length;
+		limit -= member_length;
+	}
+	return -1;
+}
+
+static int
+composite_pbrk_uint8(tvbuff_t *tvb, unsigned abs_offset, unsigned limit, const ws_mempbrk_pattern* pattern, unsigned char *found_needle)
+{
+	struct tvb_composite *composite_tvb = (struct tvb_composite *) tvb;
+	tvb_comp_t *composite = &composite_tvb->composite;
+	unsigned    i;
+	tvbuff_t   *member_tvb;
+	unsigned    member_offset, member_length;
+	int         result;
+
+	for (i = composite_find_member(composite, abs_offset); limit > 0 && i < composite->num_members; i++) {
+		member_tvb = composite->members[i];
+		member_offset = abs_offset - composite->start_offsets[i];
+		member_length = MIN(member_tvb->length - member_offset, limit);
+
+		result = tvb_ws_mempbrk_pattern_uint8(member_tvb, member_offset, member_length, pattern, found_needle);
+		if (result != -1)
+			return composite->start_offsets[i] + result;
+
+		abs_offset += member_length;
+		limit -= member_length;
 	}
+	return -1;
+}
+
+static unsigned
+composite_get_iovec(tvbuff_t *tvb, unsigned abs_offset, unsigned abs_length, tvb_iovec_t *iov, unsigned max_iov)
+{
+	struct tvb_composite *composite_tvb = (struct tvb_composite *) tvb;
+	tvb_comp_t *composite = &composite_tvb->composite;
+	unsigned    i, n = 0, member_n, j;
+	tvbuff_t   *member_tvb;
+	unsigned    member_offset, member_length, got;
+
+	for (i = composite_find_member(composite, abs_offset); abs_length > 0 && n < max_iov; i++) {
+		DISSECTOR_ASSERT(i < composite->num_members);
+		member_tvb = composite->members[i];
+		member_offset = abs_offset - composite->start_offsets[i];
+		member_length = MIN(member_tvb->length - member_offset, abs_length);
+
+		member_n = tvb_get_iovec_abs(member_tvb, member_offset, member_length, iov + n, max_iov - n);
+		got = 0;
+		for (j = 0; j < member_n; j++)
+			got += iov[n + j].length;
+		n += member_n;
+
+		/* The member has more pieces than there's room for. */
+		if (got < member_length)
+			break;
 
-	DISSECTOR_ASSERT_NOT_REACHED();
+		abs_offset += member_length;
+		abs_length -= member_length;
+	}
+	return n;
 }
 
 static const struct tvb_ops tvb_composite_ops = {
@@ -180,9 +297,10 @@ static const struct tvb_ops tvb_composite_ops = {
 	composite_offset,     /* offset */
 	composite_get_ptr,    /* get_ptr */
 	composite_memcpy,     /* memcpy */
-	NULL,                 /* find_uint8 XXX */
-	NULL,                 /* pbrk_uint8 XXX */
+	composite_find_uint8, /* find_uint8 */
+	composite_pbrk_uint8, /* pbrk_uint8 */
 	NULL,                 /* clone */
+	composite_get_iovec,  /* get_iovec */
 };
 
 /*
@@ -205,13 +323,144 @@ tvb_new_composite(void)
 	tvb_comp_t *composite = &composite_tvb->composite;
 
 	composite->tvbs		 = g_queue_new();
+	composite->num_members	 = 0;
+	composite->members	 = NULL;
 	composite->start_offsets = NULL;
 	composite->end_offsets	 = NULL;
-	composite->recursion_depth = 0;
+	composite->windows	 = NULL;
+	composite->window_bytes	 = 0;
+	composite->detached	 = false;
+
+	return tvb;
+}
+
+/*
+ * Like tvb_new_composite(), but the composite TVB isn't added to the chain
+ * of its first member, so its members need not be part of the same chain:
+ * the caller frees it, and can add the TVBs that must live as long as it
+ * (such as the ones its members refer to) to its chain.
+ */
+tvbuff_t *
+tvb_new_composite_detached(void)
+{
+	tvbuff_t *tvb = tvb_new_composite();
+	struct tvb_composite *composite_tvb = (struct tvb_composite *) tvb;
+
+	composite_tvb->composite.detached = true;
 
 	return tvb;
 }
 
+/*
+ * The number of bytes a composite TVB has copied to hand out contiguous
+ * pointers; 0 for other TVBs.
+ */
+unsigned
+tvb_composite_copied_bytes(const tvbuff_t *tvb)
+{
+	const struct tvb_composite *composite_tvb = (const struct tvb_composite *) tvb;
+
+	if (tvb->ops != &tvb_composite_ops)
+		return 0;
+
+	if (tvb->real_data)
+		return composite_tvb->composite.window_bytes + tvb->length;
+	return composite_tvb->composite.window_bytes;
+}
+
+/*
+ * Append length bytes of src at offset to a composite TVB. If they are part
+ * of another composite TVB (even through subsets of it), the members of that
+ * one that hold them are appended instead, so that composites built from
+ * other composites, such as a reassembly that is extended again and again,
+ * don't nest. A member is appended itself if all of it is in the range,
+ * otherwise a subset of the TVB its data is in.
+ */
+void
+tvb_composite_append_range(tvbuff_t *tvb, tvbuff_t *src, unsigned offset, unsigned length)
+{
+	struct tvb_composite *src_composite_tvb;
+	tvb_comp_t *src_composite;
+	tvbuff_t   *backing, *member_tvb;
+	unsigned    i, backing_offset, member_offset, member_length;
+
+	if (length == 0)
+		return;
+
+	backing_offset = offset;
+	backing = tvb_subset_backing(src, &backing_offset);
+	if (backing->ops != &tvb_composite_ops) {
+		if (offset == 0 && length == src->length)
+			tvb_composite_append(tvb, src);
+		else
+			tvb_composite_append(tvb, tvb_new_subset_length_caplen(backing,
+			    backing_offset, length, length));
+		return;
+	}
+
+	src_composite_tvb = (struct tvb_composite *) backing;
+	src_composite = &src_composite_tvb->composite;
+	offset = backing_offset;
+	DISSECTOR_ASSERT(backing->initialized);
+	for (i = composite_find_member(src_composite, offset); length > 0; i++) {
+		DISSECTOR_ASSERT(i < src_composite->num_members);
+		member_tvb = src_composite->members[i];
+		member_offset = offset - src_composite->start_offsets[i];
+		member_length = MIN(member_tvb->length - member_offset, length);
+
+		tvb_composite_append_range(tvb, member_tvb, member_offset, member_length);
+
+		offset += member_length;
+		length -= member_length;
+	}
+}
+
+/*
+ * Free the detached composite TVBs in the chain of tvb, other than tvb and
+ * keep, and the subsets of them, unlinking them from the chain. They must
+ * no longer be used, nor be the members of other composites; their members,
+ * and the other TVBs in the chain, aren't freed.
+ */
+void
+tvb_composite_free_detached(tvbuff_t *tvb, const tvbuff_t *keep)
+{
+	GHashTable *doomed;
+	tvbuff_t   *prev, *cur, *backing;
+	unsigned    offset;
+
+	doomed = g_hash_table_new(g_direct_hash, g_direct_equal);
+	for (cur = tvb->next; cur; cur = cur->next) {
+		if (cur != keep && cur->ops == &tvb_composite_ops &&
+		    ((struct tvb_composite *) cur)->composite.detached)
+			g_hash_table_add(doomed, cur);
+	}
+	if (g_hash_table_size(doomed) == 0) {
+		g_hash_table_destroy(doomed);
+		return;
+	}
+
+	/* A subset follows the TVB it is a subset of in the chain, so look
+	 * them all up before freeing any. */
+	for (cur = tvb->next; cur; cur = cur->next) {
+		offset = 0;
+		backing = tvb_subset_backing(cur, &offset);
+		if (backing != cur && g_hash_table_contains(doomed, backing))
+			g_hash_table_add(doomed, cur);
+	}
+
+	prev = tvb;
+	while ((cur = prev->next) != NULL) {
+		if (g_hash_table_contains(doomed, cur)) {
+			prev->next = cur->next;
+			cur->next = NULL;
+			tvb_free(cur);
+		} else {
+			prev = cur;
+		}
+	}
+	g_hash_table_destroy(doomed);
+}
+
 void
 tvb_composite_append(tvbuff_t *tvb, tvbuff_t *member)
 {
@@ -221,7 +470,7 @@ tvb_composite_append(tvbuff_t *tvb, tvbuff_t *member)
 	DISSECTOR_ASSERT(tvb && !tvb->initialized);
 	DISSECTOR_ASSERT(tvb->ops == &tvb_composite_ops);
 
-	/* Don't allow zero-length TVBs: composite_memcpy() can't handle them
+	/* Don't allow zero-length TVBs: the offset search can't handle them
 	 * and anyway it makes no sense.
 	 */
 	if (member && member->length) {
@@ -229,7 +478,7 @@ tvb_composite_append(tvbuff_t *tvb, tvbuff_t *member)
 		g_queue_push_tail(composite->tvbs, member);
 
 		/* Attach the composite TVB to the first TVB only. */
-		if (g_queue_get_length(composite->tvbs) == 1) {
+		if (!composite->detached && g_queue_get_length(composite->tvbs) == 1) {
 			tvb_add_to_chain((tvbuff_t *)g_queue_peek_head(composite->tvbs), tvb);
 		}
 	}
@@ -244,7 +493,7 @@ tvb_composite_prepend(tvbuff_t *tvb, tvbuff_t *member)
 	DISSECTOR_ASSERT(tvb && !tvb->initialized);
 	DISSECTOR_ASSERT(tvb->ops == &tvb_composite_ops);
 
-	/* Don't allow zero-length TVBs: composite_memcpy() can't handle them
+	/* Don't allow zero-length TVBs: the offset search can't handle them
 	 * and anyway it makes no sense.
 	 */
 	if (member && member->length) {
@@ -252,7 +501,7 @@ tvb_composite_prepend(tvbuff_t *tvb, tvbuff_t *member)
 		g_queue_push_head(composite->tvbs, member);
 
 		/* Attach the composite TVB to the first TVB only. */
-		if (g_queue_get_length(composite->tvbs) == 1) {
+		if (!composite->detached && g_queue_get_length(composite->tvbs) == 1) {
 			tvb_add_to_chain((tvbuff_t *)g_queue_peek_head(composite->tvbs), tvb);
 		}
 	}
@@ -284,12 +533,15 @@ tvb_composite_finalize(tvbuff_t *tvb)
 	 */
 	DISSECTOR_ASSERT(num_members);
 
+	composite->num_members = num_members;
+	composite->members = g_new(tvbuff_t *, num_members);
 	composite->start_offsets = g_new(unsigned, num_members);
 	composite->end_offsets = g_new(unsigned, num_members);
 
 	GList *item = (GList*)composite->tvbs->head;
 	for (i=0; i < num_members; i++, item=item->next) {
 		member_tvb = (tvbuff_t *)item->data;
+		composite->members[i] = member_tvb;
 		composite->start_offsets[i] = tvb->length;
 		tvb->length += member_tvb->length;
 		tvb->reported_length += member_tvb->reported_length;
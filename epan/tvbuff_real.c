@@ -52,6 +52,7 @@ static const struct tvb_ops tvb_real_ops = {
 	NULL,                 /* find_uint8 */
 	NULL,                 /* pbrk_uint8 */
 	NULL,                 /* clone */
+	NULL,                 /* get_iovec */
 };
 
 tvbuff_t *
@@ -102,6 +102,14 @@ subset_clone(tvbuff_t *tvb, unsigned abs_offset, unsigned abs_length)
 	return tvb_clone_offset_len(subset_tvb->subset.tvb, subset_tvb->subset.offset + abs_offset, abs_length);
 }
 
+static unsigned
+subset_get_iovec(tvbuff_t *tvb, unsigned abs_offset, unsigned abs_length, tvb_iovec_t *iov, unsigned max_iov)
+{
+	struct tvb_subset *subset_tvb = (struct tvb_subset *) tvb;
+
+	return tvb_get_iovec_abs(subset_tvb->subset.tvb, subset_tvb->subset.offset + abs_offset, abs_length, iov, max_iov);
+}
+
 static const struct tvb_ops tvb_subset_ops = {
 	sizeof(struct tvb_subset), /* size */
 
@@ -112,6 +120,7 @@ static const struct tvb_ops tvb_subset_ops = {
 	subset_find_uint8,   /* find_uint8 */
 	subset_pbrk_uint8,   /* pbrk_uint8 */
 	subset_clone,         /* clone */
+	subset_get_iovec,     /* get_iovec */
 };
 
 static tvbuff_t *
@@ -151,6 +160,23 @@ tvb_new_with_subset(tvbuff_t *backing, const unsigned reported_length,
 	return tvb;
 }
 
+/*
+ * If tvb is a subset TVB, return the TVB that it is (ultimately) a subset
+ * of, and add the offset of the subset in it to *offset; otherwise return
+ * tvb.
+ */
+tvbuff_t *
+tvb_subset_backing(tvbuff_t *tvb, unsigned *offset)
+{
+	while (tvb->ops == &tvb_subset_ops) {
+		struct tvb_subset *subset_tvb = (struct tvb_subset *) tvb;
+
+		*offset += subset_tvb->subset.offset;
+		tvb = subset_tvb->subset.tvb;
+	}
+	return tvb;
+}
+
 tvbuff_t *
 tvb_new_subset_length_caplen(tvbuff_t *backing, const int backing_offset, const int backing_length, const int reported_length)
 {
@@ -11363,14 +11363,14 @@ dissect_ARBlockReq_block(tvbuff_t *tvb, int offset,
             if (apdu_status_switch == NULL) {
                 /* apdu status switch information is valid for whole file*/
                 apdu_status_switch = wmem_new0(wmem_file_scope(), apduStatusSwitch);
-                copy_address_shallow(&apdu_status_switch->dl_src, conversation_key_addr1(conversation->key_ptr));
-                copy_address_shallow(&apdu_status_switch->dl_dst, conversation_key_addr2(conversation->key_ptr));
+                copy_address_shallow(&apdu_status_switch->dl_src, conversation_key_addr1(conversation));
+                copy_address_shallow(&apdu_status_switch->dl_dst, conversation_key_addr2(conversation));
                 apdu_status_switch->isRedundancyActive = true;
                 conversation_add_proto_data(conversation, proto_pn_io_apdu_status, apdu_status_switch);
             }
             else {
-                copy_address_shallow(&apdu_status_switch->dl_src, conversation_key_addr1(conversation->key_ptr));
-                copy_address_shallow(&apdu_status_switch->dl_dst, conversation_key_addr2(conversation->key_ptr));
+                copy_address_shallow(&apdu_status_switch->dl_src, conversation_key_addr1(conversation));
+                copy_address_shallow(&apdu_status_switch->dl_dst, conversation_key_addr2(conversation));
                 apdu_status_switch->isRedundancyActive = true;
             }
         }
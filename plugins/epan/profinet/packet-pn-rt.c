@@ -179,12 +179,12 @@ dissect_DataStatus(tvbuff_t *tvb, int offset, proto_tree *tree, packet_info *pin
         apdu_status_switch = (apduStatusSwitch*)conversation_get_proto_data(conversation, proto_pn_io_apdu_status);
         if (apdu_status_switch != NULL && apdu_status_switch->isRedundancyActive) {
             /* IOC -> IOD: OutputCR */
-            if (addresses_equal(&(pinfo->dst), conversation_key_addr1(conversation->key_ptr)) && addresses_equal(&(pinfo->src), conversation_key_addr2(conversation->key_ptr))) {
+            if (addresses_equal(&(pinfo->dst), conversation_key_addr1(conversation)) && addresses_equal(&(pinfo->src), conversation_key_addr2(conversation))) {
                 outputFlag = true;
                 inputFlag = false;
             }
             /* IOD -> IOC: InputCR */
-            if (addresses_equal(&(pinfo->src), conversation_key_addr1(conversation->key_ptr)) && addresses_equal(&(pinfo->dst), conversation_key_addr2(conversation->key_ptr))) {
+            if (addresses_equal(&(pinfo->src), conversation_key_addr1(conversation)) && addresses_equal(&(pinfo->dst), conversation_key_addr2(conversation))) {
                 inputFlag = true;
                 outputFlag = false;
             }
@@ -533,14 +533,14 @@ dissect_PNIO_C_SDU_RTC1(tvbuff_t *tvb, int offset,
                 col_set_str(pinfo->cinfo, COL_PROTOCOL, "PNIO_PS");    /* set PROFISsafe protocol name */
             }
 
-            if (addresses_equal(&(pinfo->src), conversation_key_addr1(conversation->key_ptr)) && addresses_equal(&(pinfo->dst), conversation_key_addr2(conversation->key_ptr))) {
+            if (addresses_equal(&(pinfo->src), conversation_key_addr1(conversation)) && addresses_equal(&(pinfo->dst), conversation_key_addr2(conversation))) {
                 inputFlag = true;
                 outputFlag = false;
                 number_io_data_objects_input_cr = station_info->ioDataObjectNr_in;
                 number_iocs_input_cr = station_info->iocsNr_in;
             }
 
-            if (addresses_equal(&(pinfo->dst), conversation_key_addr1(conversation->key_ptr)) && addresses_equal(&(pinfo->src), conversation_key_addr2(conversation->key_ptr))) {
+            if (addresses_equal(&(pinfo->dst), conversation_key_addr1(conversation)) && addresses_equal(&(pinfo->src), conversation_key_addr2(conversation))) {
                 outputFlag = true;
                 inputFlag = false;
                 number_io_data_objects_output_cr = station_info->ioDataObjectNr_out;
@@ -40,12 +40,14 @@
 #include <epan/column.h>
 #include <epan/print.h>
 #include <epan/addr_resolv.h>
+#include <epan/dfilter/dfilter-batch.h>
 #include "ui/util.h"
 #include "ui/ws_ui_util.h"
 #include "ui/decode_as_utils.h"
 #include "wsutil/filter_files.h"
 #include "ui/tap_export_pdu.h"
 #include "ui/failure_message.h"
+#include "ui/packet_index.h"
 #include <wiretap/wtap.h>
 #include <epan/epan_dissect.h>
 #include <epan/tap.h>
@@ -55,6 +57,7 @@
 #include <wsutil/codecs.h>
 
 #include <wsutil/str_util.h>
+#include <wsutil/strtoi.h>
 #include <wsutil/utf8_entities.h>
 
 #ifdef HAVE_PLUGINS
@@ -70,6 +73,9 @@ capture_file cfile;
 
 static uint32_t cum_bytes;
 static frame_data ref_frame;
+static uint32_t first_pass_count;   /* frames dissected once, in order */
+
+static void filter_columns_init(void);
 
 static void
 print_current_user(void)
@@ -175,6 +181,7 @@ main(int argc, char *argv[])
     }
 
     cap_file_init(&cfile);
+    filter_columns_init();
 
     /* Notify all registered modules that have had any of their preferences
        changed either from one of the preferences file or from the command
@@ -294,13 +301,16 @@ process_packet(capture_file *cf, epan_dissect_t *edt, int64_t offset,
 
 
 static int
-load_cap_file(capture_file *cf, int max_packet_count, int64_t max_byte_count)
+load_cap_file(capture_file *cf, int max_packet_count, int64_t max_byte_count,
+              bool use_index)
 {
     int          err;
     char        *err_info = NULL;
     int64_t      data_offset;
     wtap_rec     rec;
     epan_dissect_t *edt = NULL;
+    bool         read_all = (max_packet_count == 0 && max_byte_count == 0);
+    bool         from_index = false;
 
     {
         /* Allocate a frame_data_sequence for all the frames. */
@@ -333,6 +343,13 @@ load_cap_file(capture_file *cf, int max_packet_count, int64_t max_byte_count)
         while (wtap_read(cf->provider.wth, &rec, &err, &err_info, &data_offset)) {
             if (process_packet(cf, edt, data_offset, &rec)) {
                 wtap_rec_reset(&rec);
+                /* Once the first frame has been read, the rest of them
+                 * can come from the index, if there's a valid one. */
+                if (use_index && read_all && cf->count == 1 && packet_index_load(cf)) {
+                    from_index = true;
+                    err = 0;
+                    break;
+                }
                 /* Stop reading if we have the maximum number of packets;
                  * When the -c option has not been used, max_packet_count
                  * starts at 0, which practically means, never stop reading.
@@ -352,12 +369,20 @@ load_cap_file(capture_file *cf, int max_packet_count, int64_t max_byte_count)
 
         wtap_rec_cleanup(&rec);
 
+        if (use_index && read_all && !from_index && err == 0)
+            packet_index_save(cf);
+
+        /* The frames loaded from the index haven't been dissected yet;
+         * first_pass_to() does that when they are first needed. */
+        first_pass_count = from_index ? 1 : cf->count;
+
         /* Close the sequential I/O side, to free up memory it requires. */
         wtap_sequential_close(cf->provider.wth);
 
         /* Allow the protocol dissectors to free up memory that they
          * don't need after the sequential run-through of the packets. */
-        postseq_cleanup_all_protocols();
+        if (first_pass_count == cf->count)
+            postseq_cleanup_all_protocols();
 
         cf->provider.prev_dis = NULL;
         cf->provider.prev_cap = NULL;
@@ -424,16 +449,19 @@ fail:
     return CF_ERROR;
 }
 
+static void filter_columns_clear(void);
+
 cf_status_t
 sharkd_cf_open(const char *fname, unsigned int type, bool is_tempfile, int *err)
 {
+    filter_columns_clear();
     return cf_open(&cfile, fname, type, is_tempfile, err);
 }
 
 int
-sharkd_load_cap_file(void)
+sharkd_load_cap_file(bool use_index)
 {
-    return load_cap_file(&cfile, 0, 0);
+    return load_cap_file(&cfile, 0, 0, use_index);
 }
 
 frame_data *
@@ -442,6 +470,56 @@ sharkd_get_frame(uint32_t framenum)
     return frame_data_sequence_find(cfile.provider.frames, framenum);
 }
 
+/*
+ * Dissect the frames up to framenum that were loaded from a packet index
+ * and haven't been dissected yet. The first dissection of a frame is what
+ * sets up the dissectors' state for it (conversations, TCP analysis,
+ * reassembly, resolved names), so it must be done in file order, as on the
+ * sequential pass, before any of those frames is dissected on request.
+ */
+static bool
+first_pass_to(uint32_t framenum, int *err, char **err_info)
+{
+    frame_data *fdata;
+    wtap_rec rec;
+    epan_dissect_t edt;
+    bool ok = true;
+
+    if (framenum <= first_pass_count)
+        return true;
+
+    wtap_rec_init(&rec, 1514);
+    epan_dissect_init(&edt, cfile.epan, postdissectors_want_hfids(), false);
+
+    while (first_pass_count < framenum) {
+        fdata = sharkd_get_frame(first_pass_count + 1);
+
+        if (!wtap_seek_read(cfile.provider.wth, fdata->file_off, &rec, err, err_info)) {
+            ok = false;
+            break;
+        }
+
+        if (gbl_resolv_flags.mac_name || gbl_resolv_flags.network_name ||
+                gbl_resolv_flags.transport_name)
+            /* Grab any resolved addresses */
+            host_name_lookup_process();
+
+        prime_epan_dissect_with_postdissector_wanted_hfids(&edt);
+        epan_dissect_run(&edt, cfile.cd_t, &rec, fdata, NULL);
+        wtap_rec_reset(&rec);
+        epan_dissect_reset(&edt);
+        first_pass_count++;
+    }
+
+    wtap_rec_cleanup(&rec);
+    epan_dissect_cleanup(&edt);
+
+    if (first_pass_count == cfile.count)
+        postseq_cleanup_all_protocols();
+
+    return ok;
+}
+
 enum dissect_request_status
 sharkd_dissect_request(uint32_t framenum, uint32_t frame_ref_num,
         uint32_t prev_dis_num, wtap_rec *rec,
@@ -457,7 +535,8 @@ sharkd_dissect_request(uint32_t framenum, uint32_t frame_ref_num,
     if (fdata == NULL)
         return DISSECT_REQUEST_NO_SUCH_FRAME;
 
-    if (!wtap_seek_read(cfile.provider.wth, fdata->file_off, rec, err, err_info)) {
+    if (!first_pass_to(framenum, err, err_info) ||
+            !wtap_seek_read(cfile.provider.wth, fdata->file_off, rec, err, err_info)) {
         if (cinfo != NULL)
             col_fill_in_error(cinfo, fdata, false, false /* fill_fd_columns */);
         return DISSECT_REQUEST_READ_ERROR; /* error reading the record */
@@ -530,6 +609,9 @@ sharkd_retap(void)
     create_proto_tree =
         (have_filtering_tap_listeners() || (tap_flags & TL_REQUIRES_PROTO_TREE));
 
+    /* If a frame can't be read, the loop below stops at it as well. */
+    first_pass_to(cfile.count, &err, &err_info);
+
     wtap_rec_init(&rec, 1514);
     epan_dissect_init(&edt, cfile.epan, create_proto_tree, false);
 
@@ -557,13 +639,214 @@ sharkd_retap(void)
     return 0;
 }
 
+/*
+ * The values of the fields tested by the filters, extracted while
+ * filtering every frame, so that a later filter that only tests fields
+ * already extracted, in a way dfilter_batch_new() supports, can be
+ * evaluated over those columns instead of dissecting every frame again.
+ */
+typedef struct {
+    int field;
+    dfilter_batch_kind_t kind;
+    GArray *offsets;            /* uint32_t, cfile.count + 1 entries */
+    GArray *values;
+} filter_column_t;
+
+/*
+ * Default limit, in bytes, on the memory used by the columns. A column
+ * that would go over the limit isn't kept; the filters that need it are
+ * then evaluated frame by frame, as if they couldn't be batched. The
+ * WIRESHARK_SHARKD_FILTER_COLUMNS_LIMIT environment variable overrides it.
+ */
+#define FILTER_COLUMNS_MAX_SIZE (64 * 1024 * 1024)
+#define FILTER_COLUMNS_LIMIT_ENV "WIRESHARK_SHARKD_FILTER_COLUMNS_LIMIT"
+
+static GHashTable *filter_columns;      /* field -> filter_column_t */
+static size_t filter_columns_size;
+static size_t filter_columns_limit = FILTER_COLUMNS_MAX_SIZE;
+static uint64_t filter_columns_batched; /* filters evaluated over the columns */
+static uint64_t filter_columns_dropped; /* columns not kept because of the limit */
+
+static void
+filter_columns_init(void)
+{
+    const char *env = g_getenv(FILTER_COLUMNS_LIMIT_ENV);
+    uint64_t limit;
+
+    if (env == NULL)
+        return;
+    if (!ws_strtou64(env, NULL, &limit) || limit > SIZE_MAX) {
+        fprintf(stderr, "sharkd: Invalid %s \"%s\", using %u\n",
+                FILTER_COLUMNS_LIMIT_ENV, env, FILTER_COLUMNS_MAX_SIZE);
+        return;
+    }
+    filter_columns_limit = (size_t) limit;
+}
+
+static filter_column_t *
+filter_column_new(int field, dfilter_batch_kind_t kind)
+{
+    filter_column_t *col = g_new(filter_column_t, 1);
+    unsigned elt_size;
+    uint32_t zero = 0;
+
+    switch (kind) {
+    case DF_BATCH_COLUMN_UNSIGNED:
+    case DF_BATCH_COLUMN_SIGNED:
+        elt_size = sizeof(uint64_t);
+        break;
+    case DF_BATCH_COLUMN_IPV4:
+        elt_size = sizeof(uint32_t);
+        break;
+    case DF_BATCH_COLUMN_PRESENCE:
+    default:
+        elt_size = 1;
+        break;
+    }
+
+    col->field = field;
+    col->kind = kind;
+    col->offsets = g_array_sized_new(false, false, sizeof(uint32_t), cfile.count + 1);
+    col->values = g_array_new(false, false, elt_size);
+    g_array_append_val(col->offsets, zero);
+    return col;
+}
+
+static size_t
+filter_column_size(const filter_column_t *col)
+{
+    return g_array_get_element_size(col->offsets) * col->offsets->len +
+           g_array_get_element_size(col->values) * col->values->len;
+}
+
+static void
+filter_column_free(void *data)
+{
+    filter_column_t *col = (filter_column_t *) data;
+
+    g_array_free(col->offsets, true);
+    g_array_free(col->values, true);
+    g_free(col);
+}
+
+static void
+filter_columns_clear(void)
+{
+    if (filter_columns)
+        g_hash_table_remove_all(filter_columns);
+    filter_columns_size = 0;
+}
+
+/* Get the extracted column a filter needs, if there is one. */
+static filter_column_t *
+filter_columns_lookup(int field, dfilter_batch_kind_t kind)
+{
+    filter_column_t *col;
+
+    if (filter_columns == NULL)
+        return NULL;
+    col = (filter_column_t *) g_hash_table_lookup(filter_columns, GINT_TO_POINTER(field));
+    if (col == NULL)
+        return NULL;
+    /* Any column tells whether the field is present. */
+    if (kind != DF_BATCH_COLUMN_PRESENCE && col->kind != kind)
+        return NULL;
+    return col;
+}
+
+static void
+filter_columns_add(filter_column_t *col)
+{
+    filter_column_t *old;
+    size_t size = filter_column_size(col);
+
+    if (filter_columns == NULL)
+        filter_columns = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, filter_column_free);
+
+    /* This replaces a presence column with one that has the values too. */
+    old = (filter_column_t *) g_hash_table_lookup(filter_columns, GINT_TO_POINTER(col->field));
+    if (old)
+        filter_columns_size -= filter_column_size(old);
+
+    if (filter_columns_size + size > filter_columns_limit) {
+        if (old)
+            filter_columns_size += filter_column_size(old);
+        filter_column_free(col);
+        filter_columns_dropped++;
+        return;
+    }
+    g_hash_table_insert(filter_columns, GINT_TO_POINTER(col->field), col);
+    filter_columns_size += size;
+}
+
+void
+sharkd_filter_columns_stats(sharkd_filter_columns_stats_t *stats)
+{
+    stats->columns = filter_columns ? g_hash_table_size(filter_columns) : 0;
+    stats->bytes = filter_columns_size;
+    stats->limit = filter_columns_limit;
+    stats->batched = filter_columns_batched;
+    stats->dropped = filter_columns_dropped;
+}
+
+/*
+ * Evaluate a filter over the extracted columns, if they are all there.
+ * Returns the same as sharkd_filter(), or -1 if some are missing.
+ */
+static int
+sharkd_filter_batch(const dfilter_batch_t *batch, uint32_t frames_count,
+        const uint8_t *candidates, uint8_t **result)
+{
+    unsigned num_columns = dfilter_batch_num_columns(batch);
+    dfilter_batch_column_t *columns;
+    dfilter_batch_kind_t kind;
+    filter_column_t *col;
+    uint64_t *selected;
+    uint8_t *result_bits;
+    uint32_t framenum;
+
+    columns = g_new(dfilter_batch_column_t, num_columns);
+    for (unsigned i = 0; i < num_columns; i++) {
+        col = filter_columns_lookup(dfilter_batch_column_field(batch, i, &kind), kind);
+        if (col == NULL || col->offsets->len != frames_count + 1) {
+            g_free(columns);
+            return -1;
+        }
+        columns[i].offsets = (const uint32_t *)(void *) col->offsets->data;
+        columns[i].values = col->values->data;
+    }
+
+    selected = g_new(uint64_t, (frames_count + 63) / 64);
+    dfilter_batch_apply(batch, columns, frames_count, selected);
+
+    result_bits = (uint8_t *) g_malloc0(2 + (frames_count / 8));
+    for (framenum = 1; framenum <= frames_count; framenum++) {
+        if (candidates && !(candidates[framenum / 8] & (1 << (framenum % 8))))
+            continue;
+        if (selected[(framenum - 1) / 64] & (UINT64_C(1) << ((framenum - 1) % 64)))
+            result_bits[framenum / 8] |= 1 << (framenum % 8);
+    }
+    if ((framenum & 7) == 0)
+        framenum--;
+
+    g_free(selected);
+    g_free(columns);
+
+    *result = result_bits;
+
+    return framenum;
+}
+
 int
-sharkd_filter(const char *dftext, uint8_t **result)
+sharkd_filter(const char *dftext, const uint8_t *candidates, uint8_t **result)
 {
     dfilter_t  *dfcode = NULL;
+    dfilter_batch_t *batch;
+    GPtrArray *extract = NULL;
 
     uint32_t framenum, prev_dis_num = 0;
     uint32_t frames_count;
+    int ret;
     wtap_rec rec;
     int err;
     char *err_info = NULL;
@@ -585,6 +868,33 @@ sharkd_filter(const char *dftext, uint8_t **result)
 
     frames_count = cfile.count;
 
+    batch = dfilter_batch_new(dfcode);
+    if (batch && frames_count > 0) {
+        ret = sharkd_filter_batch(batch, frames_count, candidates, result);
+        if (ret >= 0) {
+            filter_columns_batched++;
+            dfilter_batch_free(batch);
+            dfilter_free(dfcode);
+            return ret;
+        }
+
+        /* Extract the missing columns, if this goes through every frame. */
+        if (candidates == NULL) {
+            extract = g_ptr_array_new_with_free_func(filter_column_free);
+            for (unsigned i = 0; i < dfilter_batch_num_columns(batch); i++) {
+                dfilter_batch_kind_t kind;
+                int field = dfilter_batch_column_field(batch, i, &kind);
+
+                if (filter_columns_lookup(field, kind) == NULL)
+                    g_ptr_array_add(extract, filter_column_new(field, kind));
+            }
+        }
+    }
+    dfilter_batch_free(batch);
+
+    /* If a frame can't be read, the loop below stops at it as well. */
+    first_pass_to(frames_count, &err, &err_info);
+
     wtap_rec_init(&rec, 1514);
     epan_dissect_init(&edt, cfile.epan, true, false);
 
@@ -599,6 +909,11 @@ sharkd_filter(const char *dftext, uint8_t **result)
             passed_bits = 0;
         }
 
+        /* Frames that don't match a filter this one narrows down
+         * can't match this one either. */
+        if (candidates && !(candidates[framenum / 8] & (1 << (framenum % 8))))
+            continue;
+
         if (!wtap_seek_read(cfile.provider.wth, fdata->file_off, &rec, &err, &err_info))
             break;
 
@@ -615,12 +930,28 @@ sharkd_filter(const char *dftext, uint8_t **result)
             prev_dis_num = framenum;
         }
 
+        if (extract) {
+            for (unsigned i = 0; i < extract->len; i++) {
+                filter_column_t *col = (filter_column_t *) g_ptr_array_index(extract, i);
+
+                dfilter_batch_extract(edt.tree, col->field, col->kind, col->offsets, col->values);
+            }
+        }
+
         /* if passed or ref -> frame_data_set_after_dissect */
 
         wtap_rec_reset(&rec);
         epan_dissect_reset(&edt);
     }
 
+    /* Keep the columns only if every frame could be read. */
+    if (extract && framenum > frames_count) {
+        while (extract->len > 0)
+            filter_columns_add((filter_column_t *) g_ptr_array_steal_index_fast(extract, extract->len - 1));
+    }
+    if (extract)
+        g_ptr_array_free(extract, true);
+
     if ((framenum & 7) == 0)
         framenum--;
     result_bits[framenum / 8] = passed_bits;
@@ -30,10 +30,18 @@ typedef void (*sharkd_dissect_func_t)(epan_dissect_t *edt, proto_tree *tree, str
 
 /* sharkd.c */
 cf_status_t sharkd_cf_open(const char *fname, unsigned int type, bool is_tempfile, int *err);
-int sharkd_load_cap_file(void);
+int sharkd_load_cap_file(bool use_index);
 int sharkd_retap(void);
-int sharkd_filter(const char *dftext, uint8_t **result);
+int sharkd_filter(const char *dftext, const uint8_t *candidates, uint8_t **result);
 frame_data *sharkd_get_frame(uint32_t framenum);
+typedef struct {
+  unsigned columns;     /* number of extracted field columns */
+  size_t bytes;         /* memory used by the columns */
+  size_t limit;         /* maximum memory used by the columns */
+  uint64_t batched;     /* filters evaluated over the columns */
+  uint64_t dropped;     /* columns not kept because of the limit */
+} sharkd_filter_columns_stats_t;
+void sharkd_filter_columns_stats(sharkd_filter_columns_stats_t *stats);
 enum dissect_request_status {
   DISSECT_REQUEST_SUCCESS,
   DISSECT_REQUEST_NO_SUCH_FRAME,
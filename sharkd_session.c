@@ -78,12 +78,34 @@
 
 #include "sharkd.h"
 
+/*
+ * Results of the filters used in this session, keyed on the syntax tree of
+ * the compiled filter, so different spellings of the same filter share an
+ * entry. Each result is kept either as a bitmap or as a list of runs of
+ * matching frames, whichever is smaller, and the least recently used
+ * results are dropped to keep the cache within SHARKD_FILTER_CACHE_SIZE.
+ */
+#define SHARKD_FILTER_CACHE_SIZE (64 * 1024 * 1024)
+
 struct sharkd_filter_item
 {
-    uint8_t *filtered; /* can be NULL if all frames are matching for given filter. */
+    char *key;
+    GList lru_link;
+    size_t size;       /* memory used by the result */
+    uint8_t *filtered; /* bitmap of the matching frames, or NULL */
+    uint32_t *runs;    /* (first frame, number of frames) pairs of the matching frames, or NULL */
+    unsigned num_runs;
+    /* filtered and runs are both NULL if all frames are matching for given filter. */
 };
 
-static GHashTable *filter_table;
+static struct {
+    GHashTable *table;
+    GQueue lru;        /* most recently used first */
+    size_t size;
+    uint64_t hits;
+    uint64_t narrowed; /* misses evaluated on the result of a cached filter */
+    uint64_t misses;
+} filter_cache;
 
 static int mode;
 static uint32_t rpcid;
@@ -451,6 +473,7 @@ json_prep(char* buf, const jsmntok_t* tokens, int count)
         {"iograph",    "aot8",           2, JSMN_PRIMITIVE,    SHARKD_JSON_BOOLEAN,  SHARKD_OPTIONAL},
         {"iograph",    "aot9",           2, JSMN_PRIMITIVE,    SHARKD_JSON_BOOLEAN,  SHARKD_OPTIONAL},
         {"load",       "file",           2, JSMN_STRING,       SHARKD_JSON_STRING,   SHARKD_MANDATORY},
+        {"load",       "index",          2, JSMN_PRIMITIVE,    SHARKD_JSON_BOOLEAN,  SHARKD_OPTIONAL},
         {"setcomment", "frame",          2, JSMN_PRIMITIVE,    SHARKD_JSON_UINTEGER, SHARKD_MANDATORY},
         {"setcomment", "comment",        2, JSMN_STRING,       SHARKD_JSON_STRING,   SHARKD_OPTIONAL},
         {"setconf",    "name",           2, JSMN_STRING,       SHARKD_JSON_STRING,   SHARKD_MANDATORY},
@@ -738,31 +761,227 @@ sharkd_session_filter_free(void *data)
 {
     struct sharkd_filter_item *l = (struct sharkd_filter_item *) data;
 
+    g_free(l->key);
     g_free(l->filtered);
+    g_free(l->runs);
     g_free(l);
 }
 
+static void
+sharkd_session_filter_cache_clear(void)
+{
+    g_hash_table_remove_all(filter_cache.table);
+    g_queue_init(&filter_cache.lru);
+    filter_cache.size = 0;
+}
+
+static bool
+sharkd_session_filter_matches(const struct sharkd_filter_item *l, uint32_t framenum)
+{
+    unsigned lo, hi;
+
+    if (l->filtered)
+        return (l->filtered[framenum / 8] & (1 << (framenum % 8))) != 0;
+
+    if (!l->runs)
+        return true;
+
+    /* Find the last run starting at or before framenum. */
+    lo = 0;
+    hi = l->num_runs;
+    while (lo < hi)
+    {
+        unsigned mid = lo + (hi - lo) / 2;
+
+        if (l->runs[2 * mid] <= framenum)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo > 0 && framenum - l->runs[2 * (lo - 1)] < l->runs[2 * (lo - 1) + 1];
+}
+
+/* Get the result as a bitmap, as taken by sharkd_filter(). */
+static uint8_t *
+sharkd_session_filter_bitmap(const struct sharkd_filter_item *l)
+{
+    uint8_t *bitmap;
+
+    if (l->filtered)
+        return (uint8_t *) g_memdup2(l->filtered, 2 + (cfile.count / 8));
+
+    bitmap = (uint8_t *) g_malloc0(2 + (cfile.count / 8));
+    for (unsigned i = 0; i < l->num_runs; i++)
+    {
+        for (uint32_t framenum = l->runs[2 * i]; framenum - l->runs[2 * i] < l->runs[2 * i + 1]; framenum++)
+            bitmap[framenum / 8] |= 1 << (framenum % 8);
+    }
+    return bitmap;
+}
+
+/* Store the result of a filter, compressed into runs if that is smaller. */
+static void
+sharkd_session_filter_set_result(struct sharkd_filter_item *l, uint8_t *filtered)
+{
+    size_t bitmap_size = 2 + (cfile.count / 8);
+    unsigned num_runs = 0;
+    bool in_run = false;
+
+    l->filtered = NULL;
+    l->runs = NULL;
+    l->num_runs = 0;
+    l->size = 0;
+
+    if (!filtered)
+        return;
+
+    for (uint32_t framenum = 1; framenum <= cfile.count; framenum++)
+    {
+        bool match = (filtered[framenum / 8] & (1 << (framenum % 8))) != 0;
+
+        if (match && !in_run)
+            num_runs++;
+        in_run = match;
+    }
+
+    if (num_runs * 2 * sizeof(uint32_t) >= bitmap_size)
+    {
+        l->filtered = filtered;
+        l->size = bitmap_size;
+        return;
+    }
+
+    l->runs = g_new(uint32_t, 2 * num_runs + 1);
+    in_run = false;
+    for (uint32_t framenum = 1; framenum <= cfile.count; framenum++)
+    {
+        bool match = (filtered[framenum / 8] & (1 << (framenum % 8))) != 0;
+
+        if (match && !in_run)
+        {
+            l->runs[2 * l->num_runs] = framenum;
+            l->runs[2 * l->num_runs + 1] = 0;
+            l->num_runs++;
+        }
+        if (match)
+            l->runs[2 * l->num_runs - 1]++;
+        in_run = match;
+    }
+    l->size = num_runs * 2 * sizeof(uint32_t);
+    g_free(filtered);
+}
+
+static void
+sharkd_session_filter_touch(struct sharkd_filter_item *l)
+{
+    g_queue_unlink(&filter_cache.lru, &l->lru_link);
+    g_queue_push_head_link(&filter_cache.lru, &l->lru_link);
+}
+
+/* Compile a filter and get its key in the cache. */
+static bool
+sharkd_session_filter_compile(const char *filter, dfilter_t **dfcode, const char **key)
+{
+    if (!dfilter_compile_full(filter, dfcode, NULL, DF_EXPAND_MACROS|DF_OPTIMIZE|DF_SAVE_TREE, __func__))
+        return false;
+
+    /* An empty filter compiles to NULL; it matches all frames. */
+    *key = *dfcode ? dfilter_syntax_tree(*dfcode) : "";
+    return true;
+}
+
+/*
+ * Find the cached result of a filter that the given one narrows down,
+ * that is, one of the sub-expressions it "and"s together, so that only
+ * the frames matching that one need to be dissected.
+ */
+static struct sharkd_filter_item *
+sharkd_session_filter_find_base(const char *filter)
+{
+    struct sharkd_filter_item *base = NULL;
+    GPtrArray *subexprs;
+
+    subexprs = dfilter_and_subexpressions(filter);
+    if (!subexprs)
+        return NULL;
+
+    for (unsigned i = 0; i < subexprs->len && !base; i++)
+    {
+        dfilter_t *dfcode = NULL;
+        const char *key;
+
+        if (sharkd_session_filter_compile((const char *) g_ptr_array_index(subexprs, i), &dfcode, &key))
+        {
+            base = (struct sharkd_filter_item *) g_hash_table_lookup(filter_cache.table, key);
+            dfilter_free(dfcode);
+        }
+    }
+
+    g_ptr_array_unref(subexprs);
+    return base;
+}
+
 static const struct sharkd_filter_item *
 sharkd_session_filter_data(const char *filter)
 {
-    struct sharkd_filter_item *l;
+    struct sharkd_filter_item *l, *base;
+    uint8_t *candidates = NULL;
+    uint8_t *filtered = NULL;
+    dfilter_t *dfcode = NULL;
+    const char *key;
+    int ret;
+
+    if (!sharkd_session_filter_compile(filter, &dfcode, &key))
+        return NULL;
+
+    l = (struct sharkd_filter_item *) g_hash_table_lookup(filter_cache.table, key);
+    if (l)
+    {
+        filter_cache.hits++;
+        sharkd_session_filter_touch(l);
+        dfilter_free(dfcode);
+        return l;
+    }
 
-    l = (struct sharkd_filter_item *) g_hash_table_lookup(filter_table, filter);
-    if (!l)
+    base = dfcode ? sharkd_session_filter_find_base(filter) : NULL;
+    if (base)
     {
-        uint8_t *filtered = NULL;
+        filter_cache.narrowed++;
+        sharkd_session_filter_touch(base);
+        candidates = sharkd_session_filter_bitmap(base);
+    }
+    else
+        filter_cache.misses++;
 
-        int ret = sharkd_filter(filter, &filtered);
+    ret = sharkd_filter(filter, candidates, &filtered);
+    g_free(candidates);
 
-        if (ret == -1)
-            return NULL;
+    if (ret == -1)
+    {
+        dfilter_free(dfcode);
+        return NULL;
+    }
 
-        l = g_new(struct sharkd_filter_item, 1);
-        l->filtered = filtered;
+    l = g_new0(struct sharkd_filter_item, 1);
+    l->key = g_strdup(key);
+    l->lru_link.data = l;
+    sharkd_session_filter_set_result(l, filtered);
+    dfilter_free(dfcode);
 
-        g_hash_table_insert(filter_table, g_strdup(filter), l);
+    /* Make room for the new result. */
+    while (filter_cache.size + l->size > SHARKD_FILTER_CACHE_SIZE && filter_cache.lru.tail)
+    {
+        struct sharkd_filter_item *old = (struct sharkd_filter_item *) filter_cache.lru.tail->data;
+
+        g_queue_unlink(&filter_cache.lru, &old->lru_link);
+        filter_cache.size -= old->size;
+        g_hash_table_remove(filter_cache.table, old->key);
     }
 
+    g_hash_table_insert(filter_cache.table, l->key, l);
+    g_queue_push_head_link(&filter_cache.lru, &l->lru_link);
+    filter_cache.size += l->size;
+
     return l;
 }
 
@@ -1284,7 +1503,10 @@ sharkd_session_process_field(const char* buf, const jsmntok_t* tokens, int count
  * Process load request
  *
  * Input:
- *   (m) file - file to be loaded
+ *   (m) file  - file to be loaded
+ *   (o) index - if true, load the frames from the file's packet index
+ *               (the file name with ".wsidx" appended) if it is valid,
+ *               and write the index after reading the file otherwise
  *
  * Output object with attributes:
  *   (m) err - error code
@@ -1293,6 +1515,7 @@ static void
 sharkd_session_process_load(const char *buf, const jsmntok_t *tokens, int count)
 {
     const char *tok_file = json_find_attr(buf, tokens, count, "file");
+    const char *tok_index = json_find_attr(buf, tokens, count, "index");
     int err = 0;
 
     if (!tok_file)
@@ -1300,6 +1523,9 @@ sharkd_session_process_load(const char *buf, const jsmntok_t *tokens, int count)
 
     fprintf(stderr, "load: filename=%s\n", tok_file);
 
+    /* The cached filter results are for the previous file. */
+    sharkd_session_filter_cache_clear();
+
     if (sharkd_cf_open(tok_file, WTAP_TYPE_AUTO, false, &err) != CF_OK)
     {
         sharkd_json_error(
@@ -1311,7 +1537,7 @@ sharkd_session_process_load(const char *buf, const jsmntok_t *tokens, int count)
 
     TRY
     {
-        err = sharkd_load_cap_file();
+        err = sharkd_load_cap_file(tok_index && !strcmp(tok_index, "true"));
     }
     CATCH(OutOfMemoryError)
     {
@@ -1348,6 +1574,19 @@ sharkd_session_process_load(const char *buf, const jsmntok_t *tokens, int count)
  *   (m) duration    - time difference between time of first frame, and last loaded frame
  *   (o) filename    - capture filename
  *   (o) filesize    - capture filesize
+ *   (m) filter_cache - object with attributes:
+ *                      'entries'  - number of cached filter results
+ *                      'bytes'    - memory used by the cached filter results
+ *                      'limit'    - maximum memory used by the cached filter results
+ *                      'hits'     - number of filters found in the cache
+ *                      'narrowed' - number of filters evaluated only on the frames matching a cached filter
+ *                      'misses'   - number of filters evaluated on all frames
+ *   (m) filter_columns - object with attributes:
+ *                      'columns'  - number of field columns extracted by the filters
+ *                      'bytes'    - memory used by the columns
+ *                      'limit'    - maximum memory used by the columns
+ *                      'batched'  - number of filters evaluated over the columns
+ *                      'dropped'  - number of columns not kept because of the limit
  *   (o) columns     - array of column titles
  *   (o) column_info - array of column infos, array of object with attributes:
  *                      'title'    - column title
@@ -1358,6 +1597,8 @@ sharkd_session_process_load(const char *buf, const jsmntok_t *tokens, int count)
 static void
 sharkd_session_process_status(void)
 {
+    sharkd_filter_columns_stats_t columns_stats;
+
     sharkd_json_result_prologue(rpcid);
 
     sharkd_json_value_anyf("frames", "%u", cfile.count);
@@ -1379,6 +1620,24 @@ sharkd_session_process_status(void)
             sharkd_json_value_anyf("filesize", "%" PRId64, file_size);
     }
 
+    sharkd_json_object_open("filter_cache");
+    sharkd_json_value_anyf("entries", "%u", g_hash_table_size(filter_cache.table));
+    sharkd_json_value_anyf("bytes", "%zu", filter_cache.size);
+    sharkd_json_value_anyf("limit", "%u", SHARKD_FILTER_CACHE_SIZE);
+    sharkd_json_value_anyf("hits", "%" PRIu64, filter_cache.hits);
+    sharkd_json_value_anyf("narrowed", "%" PRIu64, filter_cache.narrowed);
+    sharkd_json_value_anyf("misses", "%" PRIu64, filter_cache.misses);
+    sharkd_json_object_close();
+
+    sharkd_filter_columns_stats(&columns_stats);
+    sharkd_json_object_open("filter_columns");
+    sharkd_json_value_anyf("columns", "%u", columns_stats.columns);
+    sharkd_json_value_anyf("bytes", "%zu", columns_stats.bytes);
+    sharkd_json_value_anyf("limit", "%zu", columns_stats.limit);
+    sharkd_json_value_anyf("batched", "%" PRIu64, columns_stats.batched);
+    sharkd_json_value_anyf("dropped", "%" PRIu64, columns_stats.dropped);
+    sharkd_json_object_close();
+
     if (cfile.cinfo.num_cols > 0)
     {
         sharkd_json_array_open("columns");
@@ -1684,7 +1943,7 @@ sharkd_session_process_frames(const char *buf, const jsmntok_t *tokens, int coun
     const char *tok_limit  = json_find_attr(buf, tokens, count, "limit");
     const char *tok_refs   = json_find_attr(buf, tokens, count, "refs");
 
-    const uint8_t *filter_data = NULL;
+    const struct sharkd_filter_item *filter_item = NULL;
 
     uint32_t prev_dis_num = 0;
     uint32_t current_ref_frame = 0, next_ref_frame = UINT32_MAX;
@@ -1711,8 +1970,6 @@ sharkd_session_process_frames(const char *buf, const jsmntok_t *tokens, int coun
 
     if (tok_filter)
     {
-        const struct sharkd_filter_item *filter_item;
-
         filter_item = sharkd_session_filter_data(tok_filter);
         if (!filter_item)
         {
@@ -1723,7 +1980,6 @@ sharkd_session_process_frames(const char *buf, const jsmntok_t *tokens, int coun
             return;
         }
 
-        filter_data = filter_item->filtered;
     }
 
     skip = 0;
@@ -1758,7 +2014,7 @@ sharkd_session_process_frames(const char *buf, const jsmntok_t *tokens, int coun
         int err;
         char *err_info;
 
-        if (filter_data && !(filter_data[framenum / 8] & (1 << (framenum % 8))))
+        if (filter_item && !sharkd_session_filter_matches(filter_item, framenum))
             continue;
 
         if (skip)
@@ -4809,7 +5065,7 @@ sharkd_session_process_intervals(char *buf, const jsmntok_t *tokens, int count)
     const char *tok_interval = json_find_attr(buf, tokens, count, "interval");
     const char *tok_filter = json_find_attr(buf, tokens, count, "filter");
 
-    const uint8_t *filter_data = NULL;
+    const struct sharkd_filter_item *filter_item = NULL;
 
     struct
     {
@@ -4829,8 +5085,6 @@ sharkd_session_process_intervals(char *buf, const jsmntok_t *tokens, int count)
 
     if (tok_filter)
     {
-        const struct sharkd_filter_item *filter_item;
-
         filter_item = sharkd_session_filter_data(tok_filter);
         if (!filter_item)
         {
@@ -4840,7 +5094,6 @@ sharkd_session_process_intervals(char *buf, const jsmntok_t *tokens, int count)
                     );
             return;
         }
-        filter_data = filter_item->filtered;
     }
 
     st_total.frames = 0;
@@ -4862,7 +5115,7 @@ sharkd_session_process_intervals(char *buf, const jsmntok_t *tokens, int count)
         int64_t msec_rel;
         int64_t new_idx;
 
-        if (filter_data && !(filter_data[framenum / 8] & (1 << (framenum % 8))))
+        if (filter_item && !sharkd_session_filter_matches(filter_item, framenum))
             continue;
 
         fdata = sharkd_get_frame(framenum);
@@ -6113,7 +6366,8 @@ sharkd_session_main(int mode_setting)
 
     dumper.output_file = stdout;
 
-    filter_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, sharkd_session_filter_free);
+    filter_cache.table = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, sharkd_session_filter_free);
+    g_queue_init(&filter_cache.lru);
 
 #ifdef HAVE_MAXMINDDB
     /* mmdbresolve was stopped before fork(), force starting it */
@@ -6163,7 +6417,8 @@ sharkd_session_main(int mode_setting)
         sharkd_session_process(buf, tokens, ret);
     }
 
-    g_hash_table_destroy(filter_table);
+    g_hash_table_destroy(filter_cache.table);
+    filter_cache.table = NULL;
     g_free(tokens);
 
     return 0;
@@ -11,6 +11,7 @@
 import json
 import sys
 import os.path
+import struct
 import subprocess
 import subprocesstest
 from subprocesstest import ExitCodes, grep_output, count_output
@@ -168,6 +169,243 @@ class TestTsharkNameResolutionClopts:
 
     # XXX Add invalid name resolution.
 
+def check_same_output(cmd_tshark, test_env, options, args):
+    '''Check that tshark prints the same output with and without the given options.'''
+    plain = subprocesstest.check_run((cmd_tshark, *args), capture_output=True, env=test_env)
+    optional = subprocesstest.check_run((cmd_tshark, *options, *args), capture_output=True, env=test_env)
+    assert plain.stdout
+    assert optional.stdout == plain.stdout
+
+
+class TestTsharkReadAhead:
+    def test_tshark_read_ahead_details(self, cmd_tshark, capture_file, test_env):
+        '''--read-ahead produces the same packet details as reading on the main thread'''
+        check_same_output(cmd_tshark, test_env, ('--read-ahead',), ('-r', capture_file('dhcp.pcapng'), '-V'))
+
+    def test_tshark_read_ahead_reassembly(self, cmd_tshark, capture_file, test_env):
+        '''--read-ahead keeps cross-packet state such as reassembly and -z taps'''
+        check_same_output(cmd_tshark, test_env, ('--read-ahead',), ('-r', capture_file('http-ooo.pcap'),
+            '-Y', 'http', '-z', 'conv,tcp'))
+
+    def test_tshark_read_ahead_dsb(self, cmd_tshark, capture_file, test_env):
+        '''--read-ahead hands decryption secrets blocks to epan in file order'''
+        check_same_output(cmd_tshark, test_env, ('--read-ahead',), ('-r', capture_file('dtls12-aes128ccm8-dsb.pcapng'),
+            '-x', '-Y', 'dtls'))
+
+    def test_tshark_read_ahead_packet_count(self, cmd_tshark, capture_file, test_env):
+        '''--read-ahead stops after -c packets'''
+        process = subprocesstest.check_run((cmd_tshark, '--read-ahead', '-r', capture_file('rsasnakeoil2.pcap'),
+            '-c', '3', '-Tfields', '-eframe.number'), capture_output=True, env=test_env)
+        assert process.stdout.split() == ['1', '2', '3']
+
+    def test_tshark_read_ahead_two_pass(self, cmd_tshark, capture_file, test_env):
+        '''--read-ahead cannot be combined with -2'''
+        process = subprocesstest.run((cmd_tshark, '--read-ahead', '-2', '-r', capture_file('dhcp.pcap')),
+            capture_output=True, env=test_env)
+        assert process.returncode == ExitCodes.COMMAND_LINE
+        assert grep_output(process.stderr, 'two-pass')
+
+
+class TestTsharkFlowShard:
+    def test_tshark_flow_shard_partition(self, cmd_tshark, capture_file, test_env):
+        '''--flow-shard processes every packet exactly once and keeps flows together'''
+        args = ('-r', capture_file('dns+icmp.pcapng.gz'), '-Tfields', '-eframe.number')
+        whole = subprocesstest.check_run((cmd_tshark, *args, '-etcp.stream', '-eudp.stream'),
+            capture_output=True, env=test_env)
+        stream_of = {}
+        for row in whole.stdout.splitlines():
+            number, tcp_stream, udp_stream = row.split('\t')
+            stream_of[int(number)] = (tcp_stream, udp_stream)
+        shard_of = {}
+        for shard in ('1/3', '2/3', '3/3'):
+            process = subprocesstest.check_run((cmd_tshark, '--flow-shard', shard, *args),
+                capture_output=True, env=test_env)
+            for number in process.stdout.split():
+                assert int(number) not in shard_of
+                shard_of[int(number)] = shard
+        # Frame numbers are unchanged and every packet is in exactly one shard.
+        assert sorted(shard_of) == sorted(stream_of)
+        # All packets of a stream are in the same shard.
+        shards_of_stream = {}
+        for number, stream in stream_of.items():
+            if stream != ('', ''):
+                shards_of_stream.setdefault(stream, set()).add(shard_of[number])
+        assert all(len(shards) == 1 for shards in shards_of_stream.values())
+
+    def test_tshark_flow_shard_invalid(self, cmd_tshark, capture_file, test_env):
+        '''--flow-shard rejects shard numbers out of range'''
+        process = subprocesstest.run((cmd_tshark, '--flow-shard', '4/3', '-r', capture_file('dhcp.pcap')),
+            capture_output=True, env=test_env)
+        assert process.returncode == ExitCodes.COMMAND_LINE
+
+    def test_tshark_flow_shard_stats(self, cmd_tshark, capture_file, test_env):
+        '''--flow-shard rejects -z, whose per-shard results can't be merged'''
+        process = subprocesstest.run((cmd_tshark, '--flow-shard', '1/2', '-z', 'conv,ip',
+            '-r', capture_file('dhcp.pcap')), capture_output=True, env=test_env)
+        assert process.returncode == ExitCodes.COMMAND_LINE
+        assert grep_output(process.stderr, '-z')
+
+    def test_tshark_flow_shard_cum_bytes(self, cmd_tshark, capture_file, test_env):
+        '''--flow-shard keeps frame.cum_bytes the same as an unsharded run'''
+        args = ('-r', capture_file('dns+icmp.pcapng.gz'), '-Tfields', '-eframe.number', '-eframe.cum_bytes')
+        whole = subprocesstest.check_run((cmd_tshark, *args), capture_output=True, env=test_env)
+        expected = dict(row.split('\t') for row in whole.stdout.splitlines())
+        for shard in ('1/2', '2/2'):
+            process = subprocesstest.check_run((cmd_tshark, '--flow-shard', shard, *args),
+                capture_output=True, env=test_env)
+            for row in process.stdout.splitlines():
+                number, cum_bytes = row.split('\t')
+                assert expected[number] == cum_bytes
+
+
+class TestTsharkFields:
+    def run_fields(self, cmd_tshark, capture_file, test_env, *args):
+        process = subprocesstest.check_run((cmd_tshark, '-r', capture_file('dns+icmp.pcapng.gz'),
+            '-Tfields', '-eframe.number', '-edns.a', '-eip.src', *args), capture_output=True, env=test_env)
+        return [row.split('\t') for row in process.stdout.splitlines()]
+
+    def test_tshark_fields_occurrence(self, cmd_tshark, capture_file, test_env):
+        '''-T fields gives fields that occur once or several times in tree order'''
+        all_rows = self.run_fields(cmd_tshark, capture_file, test_env)
+        first_rows = self.run_fields(cmd_tshark, capture_file, test_env, '-Eoccurrence=f')
+        last_rows = self.run_fields(cmd_tshark, capture_file, test_env, '-Eoccurrence=l')
+        assert all_rows
+        assert len(first_rows) == len(all_rows) and len(last_rows) == len(all_rows)
+        for all_row, first_row, last_row in zip(all_rows, first_rows, last_rows):
+            assert first_row[0] == all_row[0] and last_row[0] == all_row[0]
+            for column in (1, 2):
+                assert first_row[column] == all_row[column].split(',')[0]
+                assert last_row[column] == all_row[column].split(',')[-1]
+
+    def run_arrow(self, cmd_tshark, capture_file, test_env, *args):
+        process = subprocesstest.check_run((cmd_tshark, '-r', capture_file('dns+icmp.pcapng.gz'),
+            '-Tarrow', '-eframe.number', '-edns.a', '-eip.src', *args), capture_output=True, encoding=None, env=test_env)
+        return process.stdout
+
+    def test_tshark_fields_arrow_stream(self, cmd_tshark, capture_file, test_env):
+        '''-T arrow writes an Arrow IPC stream'''
+        stream = self.run_arrow(cmd_tshark, capture_file, test_env, '-Ebatch=2')
+        # A schema message, record batches and the end of stream marker.
+        assert stream.startswith(b'\xff\xff\xff\xff')
+        assert stream.endswith(b'\xff\xff\xff\xff\x00\x00\x00\x00')
+        assert b'dns.a' in stream
+
+    def test_tshark_fields_arrow_values(self, cmd_tshark, capture_file, test_env):
+        '''-T arrow gives the same values as -T fields'''
+        ipc = pytest.importorskip('pyarrow.ipc')
+        rows = self.run_fields(cmd_tshark, capture_file, test_env, '-Eoccurrence=f')
+        stream = self.run_arrow(cmd_tshark, capture_file, test_env, '-Eoccurrence=f', '-Ebatch=3', '-Etext=ip.src')
+        table = ipc.open_stream(stream).read_all()
+        assert str(table.schema.field('frame.number').type) == 'uint32'
+        assert str(table.schema.field('dns.a').type) == 'string'
+        assert table.column('frame.number').to_pylist() == [int(row[0]) for row in rows]
+        assert table.column('ip.src').to_pylist() == [row[2] or None for row in rows]
+
+        stream = self.run_arrow(cmd_tshark, capture_file, test_env)
+        table = ipc.open_stream(stream).read_all()
+        assert table.column('frame.number').to_pylist() == [[int(row[0])] for row in rows]
+
+    @pytest.mark.skipif(not os.path.exists('/dev/full'), reason='Needs /dev/full')
+    def test_tshark_fields_arrow_write_error(self, cmd_tshark, capture_file, test_env):
+        '''-T arrow fails if the stream can't be written'''
+        with open('/dev/full', 'wb') as full:
+            process = subprocesstest.run((cmd_tshark, '-r', capture_file('dns+icmp.pcapng.gz'),
+                '-Tarrow', '-eframe.number'), stdout=full, stderr=subprocess.PIPE, env=test_env)
+        assert process.returncode != 0
+
+
+def gre_capture(path):
+    '''Write a pcap file with an Ethernet/IPv4/GRE/IPv4/UDP frame.'''
+    def ipv4(proto, src, dst, payload):
+        return struct.pack('>BBHHHBBH4s4s', 0x45, 0, 20 + len(payload), 1, 0, 64, proto, 0,
+            bytes(src), bytes(dst)) + payload
+    udp = struct.pack('>HHHH', 1234, 5678, 8 + 5, 0) + b'inner'
+    inner = ipv4(17, (192, 168, 1, 1), (192, 168, 1, 2), udp)
+    outer = ipv4(47, (10, 0, 0, 1), (10, 0, 0, 2), struct.pack('>HH', 0, 0x0800) + inner)
+    frame = bytes(6) + bytes((0, 1, 2, 3, 4, 5)) + b'\x08\x00' + outer
+    with open(path, 'wb') as f:
+        f.write(struct.pack('<IHHiIII', 0xa1b2c3d4, 2, 4, 0, 0, 65535, 1))
+        f.write(struct.pack('<IIII', 1, 0, len(frame), len(frame)))
+        f.write(frame)
+    return path
+
+
+class TestTsharkPruneDissection:
+    def test_tshark_prune_dissection_fields(self, cmd_tshark, capture_file, test_env):
+        '''--prune-dissection gives the same fields for a filter on lower layers'''
+        check_same_output(cmd_tshark, test_env, ('--prune-dissection',), ('-r', capture_file('http.pcap'),
+            '-Y', 'ip.src == 10.0.0.5', '-Tfields', '-eframe.number', '-etcp.srcport'))
+
+    def test_tshark_prune_dissection_upper_layer(self, cmd_tshark, capture_file, test_env):
+        '''--prune-dissection still dissects protocols that are referenced'''
+        check_same_output(cmd_tshark, test_env, ('--prune-dissection',), ('-r', capture_file('http.pcap'),
+            '-Y', 'http.request', '-Tfields', '-eframe.number', '-ehttp.request.uri'))
+
+    def test_tshark_prune_dissection_tunnel(self, cmd_tshark, result_file, test_env):
+        '''--prune-dissection doesn't prune tunnels that carry a referenced protocol'''
+        # IP is already in the packet when GRE is dispatched, but the filter
+        # only matches the inner header.
+        check_same_output(cmd_tshark, test_env, ('--prune-dissection',), ('-r', gre_capture(result_file('gre.pcap')),
+            '-Y', 'ip.dst == 192.168.1.2', '-Tfields', '-eframe.number', '-eip.dst'))
+
+    def test_tshark_prune_dissection_two_pass(self, cmd_tshark, capture_file, test_env):
+        '''--prune-dissection cannot be combined with -2'''
+        process = subprocesstest.run((cmd_tshark, '--prune-dissection', '-2', '-r', capture_file('dhcp.pcap')),
+            capture_output=True, env=test_env)
+        assert process.returncode == ExitCodes.COMMAND_LINE
+        assert grep_output(process.stderr, 'two-pass')
+
+
+def tcp_reuse_capture(path):
+    '''Write a pcap file with two Ethernet/IPv4/TCP data segments of the
+    same flow, 99 seconds apart.'''
+    with open(path, 'wb') as f:
+        f.write(struct.pack('<IHHiIII', 0xa1b2c3d4, 2, 4, 0, 0, 65535, 1))
+        for secs, seq in ((1, 1000), (100, 1004)):
+            tcp = struct.pack('>HHIIBBHHH', 1234, 80, seq, 2000, 5 << 4, 0x18, 8192, 0, 0) + b'data'
+            ip = struct.pack('>BBHHHBBH4s4s', 0x45, 0, 20 + len(tcp), 1, 0, 64, 6, 0,
+                bytes((10, 0, 0, 1)), bytes((10, 0, 0, 2))) + tcp
+            frame = bytes(6) + bytes((0, 1, 2, 3, 4, 5)) + b'\x08\x00' + ip
+            f.write(struct.pack('<IIII', secs, 0, len(frame), len(frame)))
+            f.write(frame)
+    return path
+
+
+class TestTsharkConversationTimeout:
+    def test_tshark_conversation_timeout_active(self, cmd_tshark, capture_file, test_env):
+        '''--conversation-timeout keeps the state of conversations that are still in use'''
+        args = ('-r', capture_file('rsasnakeoil2.pcap'), '-Tfields', '-eframe.number', '-etcp.stream',
+            '-etcp.seq', '-etcp.analysis.flags', '-etls.record.content_type')
+        full = subprocesstest.check_run((cmd_tshark, *args), capture_output=True, env=test_env)
+        expiring = subprocesstest.check_run((cmd_tshark, '--conversation-timeout', '60,5', *args),
+            capture_output=True, env=test_env)
+        assert full.stdout
+        assert expiring.stdout == full.stdout
+
+    def test_tshark_conversation_timeout_expired(self, cmd_tshark, result_file, test_env):
+        '''--conversation-timeout frees idle conversations, so a flow that reuses their addresses and ports is a new one'''
+        args = ('-r', tcp_reuse_capture(result_file('tcp_reuse.pcap')), '-Tfields', '-etcp.stream')
+        full = subprocesstest.check_run((cmd_tshark, *args), capture_output=True, env=test_env)
+        expiring = subprocesstest.check_run((cmd_tshark, '--conversation-timeout', '10', *args),
+            capture_output=True, env=test_env)
+        assert full.stdout.split() == ['0', '0']
+        assert expiring.stdout.split() == ['0', '1']
+
+    def test_tshark_conversation_timeout_incompatible(self, cmd_tshark, capture_file, test_env):
+        '''--conversation-timeout cannot be combined with -2 or -M'''
+        for option in ('-2', '-M100'):
+            process = subprocesstest.run((cmd_tshark, '--conversation-timeout', '60', option, '-r', capture_file('dhcp.pcap')),
+                capture_output=True, env=test_env)
+            assert process.returncode == ExitCodes.COMMAND_LINE
+
+    def test_tshark_conversation_timeout_closed_longer(self, cmd_tshark, capture_file, test_env):
+        '''--conversation-timeout rejects a closed timeout longer than the idle one'''
+        process = subprocesstest.run((cmd_tshark, '--conversation-timeout', '10,60', '-r', capture_file('dhcp.pcap')),
+            capture_output=True, env=test_env)
+        assert process.returncode == ExitCodes.COMMAND_LINE
+        assert grep_output(process.stderr, 'closed timeout')
+
+
 class TestTsharkUnicodeClopts:
     def test_tshark_unicode_display_filter(self, cmd_tshark, capture_file, test_env):
         '''Unicode (UTF-8) display filter'''
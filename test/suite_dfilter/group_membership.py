@@ -125,3 +125,58 @@ class TestDfilterMembership:
     def test_membership_rhs_field(self, checkDFilterCount):
         dfilter = 'eth.src in { eth.addr }'
         checkDFilterCount(dfilter, 1)
+
+    def test_membership_large_set(self, checkDFilterCount):
+        ports = ', '.join(str(p) for p in range(1000, 1030))
+        dfilter = 'tcp.port in {%s, 80}' % ports
+        checkDFilterCount(dfilter, 1)
+
+    def test_membership_large_set_all(self, checkDFilterCount):
+        ports = ', '.join(str(p) for p in range(1000, 1030))
+        dfilter = 'all tcp.port in {%s, 80}' % ports
+        checkDFilterCount(dfilter, 0)
+
+    def test_membership_large_set_ranges(self, checkDFilterCount):
+        ranges = ', '.join('%d..%d' % (p, p + 5) for p in range(1000, 1300, 10))
+        dfilter = 'tcp.port in {%s, 3260..3270}' % ranges
+        checkDFilterCount(dfilter, 1)
+
+    def test_membership_large_set_subnets(self, checkDFilterCount):
+        subnets = ', '.join('192.168.%d.0/24' % n for n in range(30))
+        dfilter = 'ip.addr in {%s, 10.0.0.0/24}' % subnets
+        checkDFilterCount(dfilter, 1)
+
+    def test_membership_large_set_strings(self, checkDFilterCount):
+        methods = ', '.join('"M%d"' % n for n in range(30))
+        dfilter = 'http.request.method in {%s, "GET"}' % methods
+        checkDFilterCount(dfilter, 1)
+
+    def test_membership_large_set_indexed(self, checkDFilterSucceed):
+        ports = ', '.join(str(p) for p in range(1000, 1030))
+        dfilter = 'tcp.port in {%s}' % ports
+        checkDFilterSucceed(dfilter, 'in {30 values}')
+
+    def test_membership_file(self, checkDFilterCount, tmp_path):
+        set_file = tmp_path / 'ports.txt'
+        set_file.write_text('# Web servers\n8080\n\n  80  \n443\n')
+        dfilter = 'tcp.port in @"%s"' % set_file.as_posix()
+        checkDFilterCount(dfilter, 1)
+
+    def test_membership_file_missing(self, checkDFilterFail, tmp_path):
+        set_file = tmp_path / 'missing.txt'
+        dfilter = 'tcp.port in @"%s"' % set_file.as_posix()
+        error = 'Could not read the set file'
+        checkDFilterFail(dfilter, error)
+
+    def test_membership_file_invalid(self, dftest_cmd, dfilter_env, tmp_path):
+        set_file = tmp_path / 'ports.txt'
+        set_file.write_text('80\n\nsecret-value\n')
+        dfilter = 'tcp.port in @"%s"' % set_file.as_posix()
+        proc = subprocesstest.run(dftest_cmd(dfilter),
+                                capture_output=True,
+                                universal_newlines=True,
+                                env=dfilter_env)
+        assert proc.returncode == 4
+        # The file and line are reported, not the value.
+        assert 'Invalid value for tcp.port at %s:3.' % set_file.as_posix() in proc.stderr
+        assert 'secret-value' not in proc.stderr
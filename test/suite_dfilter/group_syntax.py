@@ -2,6 +2,7 @@
 #
 # SPDX-License-Identifier: GPL-2.0-or-later
 
+import re
 import pytest
 from suite_dfilter.dfiltertest import *
 
@@ -76,6 +77,29 @@ class TestDfilterSyntax:
         dfilter = 'http.request.method matches "^head"'
         checkDFilterSucceed(dfilter)
 
+    def test_matches_6(self, checkDFilterCount):
+        # case insensitive, with a required literal string
+        dfilter = r'http.host matches r"MICROSOFT\.COM"'
+        checkDFilterCount(dfilter, 1)
+
+    def test_matches_7(self, checkDFilterCount):
+        dfilter = r'http.host matches r"[a-z]+\.microsoft\.org"'
+        checkDFilterCount(dfilter, 0)
+
+    def test_matches_8(self, checkDFilterCount):
+        # POSIX class in a bracket expression, before a required literal string
+        dfilter = r'http.host matches r"[[:alpha:]]pdate\.micro"'
+        checkDFilterCount(dfilter, 1)
+
+    def test_matches_9(self, checkDFilterCount):
+        dfilter = r'http.host matches r"[[:alpha:]]xyz"'
+        checkDFilterCount(dfilter, 0)
+
+    def test_matches_10(self, checkDFilterCount):
+        # A literal '[' in a bracket expression
+        dfilter = r'http.host matches r"[[u]pdate\.micro"'
+        checkDFilterCount(dfilter, 1)
+
     def test_equal_1(self, checkDFilterCount):
         dfilter = 'ip.addr == 10.0.0.5'
         checkDFilterCount(dfilter, 1)
@@ -567,3 +591,71 @@ class TestDfilterValueString:
     def test_value_string_func_layer(self, checkDFilterCount):
         dfilter = 'vals(tls.handshake.type#1) contains "Client"'
         checkDFilterCount(dfilter, 2)
+
+class TestDfilterOptimizer:
+    trace_file = "http.pcap"
+
+    @staticmethod
+    def dump_insns(cmd_dftest, dfilter_env, dfilter, *args):
+        '''Return the instructions of a filter, without their numbers and without no-ops.'''
+        proc = subprocesstest.run([cmd_dftest, *args, '--', dfilter],
+                                capture_output=True,
+                                universal_newlines=True,
+                                env=dfilter_env)
+        assert proc.returncode == 0
+        listing = proc.stdout.split('Instructions:', 1)[1]
+        insns = [m.group(1) for m in re.finditer(r'^ \d{4} (.*)$', listing, re.MULTILINE)]
+        return [insn for insn in insns if insn.strip() != 'NO_OP']
+
+    @staticmethod
+    def first_index(insns, text):
+        return next(i for i, insn in enumerate(insns) if text in insn)
+
+    def test_reorder_and(self, checkDFilterCount):
+        # The regular expression is moved after the cheaper tests.
+        dfilter = 'http.host matches "microsoft" && ip.proto == 6 && (tcp.port == 80 || tcp.port == 443)'
+        checkDFilterCount(dfilter, 1)
+
+    def test_reorder_or(self, checkDFilterCount):
+        dfilter = 'http.host contains "example" || !tcp || tcp.port == 81 || ip.proto == 6'
+        checkDFilterCount(dfilter, 1)
+
+    def test_reread_field(self, checkDFilterCount):
+        # The second read of tcp.port is redundant on every path.
+        dfilter = 'tcp.port == 80 && (tcp.port == 443 || tcp.port == 80)'
+        checkDFilterCount(dfilter, 1)
+
+    def test_reread_missing_field(self, checkDFilterCount):
+        dfilter = 'udp.port == 53 || (!(udp.port == 80) && ip.proto == 6)'
+        checkDFilterCount(dfilter, 1)
+
+    def test_reorder_and_insns(self, cmd_dftest, dfilter_env):
+        dfilter = 'http.host matches "microsoft" && ip.proto == 6 && (tcp.port == 80 || tcp.port == 443)'
+        insns = self.dump_insns(cmd_dftest, dfilter_env, dfilter, '-0')
+        assert self.first_index(insns, ' matches ') < self.first_index(insns, 'ip.proto')
+        insns = self.dump_insns(cmd_dftest, dfilter_env, dfilter)
+        assert self.first_index(insns, 'ip.proto') < self.first_index(insns, 'tcp.port')
+        assert self.first_index(insns, 'tcp.port') < self.first_index(insns, ' matches ')
+
+    def test_reorder_or_insns(self, cmd_dftest, dfilter_env):
+        dfilter = 'http.host contains "example" || tcp.port > 81'
+        insns = self.dump_insns(cmd_dftest, dfilter_env, dfilter, '-0')
+        assert self.first_index(insns, ' contains ') < self.first_index(insns, 'tcp.port')
+        insns = self.dump_insns(cmd_dftest, dfilter_env, dfilter)
+        assert self.first_index(insns, 'tcp.port') < self.first_index(insns, ' contains ')
+
+    def test_reread_field_insns(self, cmd_dftest, dfilter_env):
+        dfilter = 'tcp.port == 80 && (tcp.port == 443 || tcp.port == 80)'
+        insns = self.dump_insns(cmd_dftest, dfilter_env, dfilter, '-0')
+        assert sum(1 for insn in insns if insn.startswith('READ_TREE') and 'tcp.port' in insn) > 1
+        insns = self.dump_insns(cmd_dftest, dfilter_env, dfilter)
+        assert sum(1 for insn in insns if insn.startswith('READ_TREE') and 'tcp.port' in insn) == 1
+
+    def test_insn_count(self, cmd_dftest, dfilter_env):
+        dfilter = 'tcp.port == 80 && tcp.port == 80'
+        proc = subprocesstest.run([cmd_dftest, '--insn-count', '--', dfilter],
+                                capture_output=True,
+                                universal_newlines=True,
+                                env=dfilter_env)
+        assert proc.returncode == 0
+        assert 'Instruction count: 6 (8 before optimization)' in proc.stdout
@@ -0,0 +1,43 @@
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+
+import pytest
+from suite_dfilter.dfiltertest import *
+
+
+class TestDfilterTapFilters:
+    trace_file = "rsasnakeoil2.pcap"
+
+    # The filters of tap listeners are evaluated as a group, sharing the
+    # fields they read; they must match the same packets as the display
+    # filter does on its own.
+    tap_filters = (
+        'tcp.srcport == 443',
+        'tcp.srcport == 443',
+        'tcp.len > 0 && tcp.srcport == 443',
+        'tcp.len > 0',
+        '!tcp.flags.syn || tcp.len > 1000',
+        'tls.record.content_type == 23',
+    )
+
+    def test_tap_filters_group(self, cmd_tshark, capture_file, dfilter_cmd, dfilter_env):
+        proc = subprocesstest.run((cmd_tshark, '-n', '-q',
+                                '-r', capture_file(self.trace_file),
+                                '-z', 'io,stat,0,' + ','.join(self.tap_filters)),
+                                capture_output=True,
+                                universal_newlines=True,
+                                env=dfilter_env)
+        assert proc.returncode == 0
+        # | 0.0 <> 1.2 | Frames | Bytes | Frames | Bytes | ...
+        row = next(line for line in proc.stdout.splitlines() if '<>' in line)
+        cells = [cell.strip() for cell in row.split('|') if cell.strip()]
+        tap_counts = [int(cell) for cell in cells[1::2]]
+        assert len(tap_counts) == len(self.tap_filters)
+
+        for dfilter, tap_count in zip(self.tap_filters, tap_counts):
+            proc = subprocesstest.run(dfilter_cmd(dfilter),
+                                    capture_output=True,
+                                    universal_newlines=True,
+                                    env=dfilter_env)
+            assert proc.returncode == 0
+            assert count_output(proc.stdout) == tap_count, dfilter
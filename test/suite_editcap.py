@@ -0,0 +1,102 @@
+#
+# Wireshark tests
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+'''Editcap tests'''
+
+import struct
+import subprocess
+import pytest
+from subprocesstest import check_packet_count, grep_output
+
+testout_pcap = 'testout.pcap'
+
+
+def write_pcap(path, frames):
+    '''Write Ethernet frames to a pcap file, one second apart.'''
+    with open(path, 'wb') as f:
+        f.write(struct.pack('<IHHiIII', 0xa1b2c3d4, 2, 4, 0, 0, 65535, 1))
+        for secs, frame in enumerate(frames, start=1):
+            f.write(struct.pack('<IIII', secs, 0, len(frame), len(frame)))
+            f.write(frame)
+
+
+def ipv4_udp_frame(ttl, payload):
+    '''An Ethernet/IPv4/UDP frame; the TTL is at offset 22, the IP checksum at 24.'''
+    udp = struct.pack('>HHHH', 1234, 5678, 8 + len(payload), 0) + payload
+    ip = struct.pack('>BBHHHBBH4s4s', 0x45, 0, 20 + len(udp), 1, 0, ttl, 17, ttl,
+        bytes((10, 0, 0, 1)), bytes((10, 0, 0, 2)))
+    return bytes(6) + bytes((0, 1, 2, 3, 4, 5)) + b'\x08\x00' + ip + udp
+
+
+@pytest.fixture
+def dup_capture(result_file):
+    '''Frames 2 and 4 are exact duplicates of frames 1 and 3; frame 5 only
+    differs from frame 1 in its TTL and IP checksum.'''
+    path = result_file('dups.pcap')
+    write_pcap(path, (
+        ipv4_udp_frame(64, b'first'),
+        ipv4_udp_frame(64, b'first'),
+        ipv4_udp_frame(64, b'second'),
+        ipv4_udp_frame(64, b'second'),
+        ipv4_udp_frame(63, b'first'),
+    ))
+    return path
+
+
+class TestEditcapDuplicates:
+    def run_editcap(self, cmd_editcap, result_file, test_env, in_file, *args):
+        testout_file = result_file(testout_pcap)
+        process = subprocess.run((cmd_editcap, *args, in_file, testout_file),
+            check=True, capture_output=True, encoding='utf-8', env=test_env)
+        return process, testout_file
+
+    @pytest.mark.parametrize('digest', ['md5', 'crc32c', 'murmur64'])
+    def test_editcap_dup_digest(self, cmd_editcap, cmd_capinfos, result_file, dup_capture, test_env, digest):
+        '''-D removes exact duplicates with every --dup-digest'''
+        process, testout_file = self.run_editcap(cmd_editcap, result_file, test_env,
+            dup_capture, '-D', '5', '--dup-digest', digest)
+        assert grep_output(process.stderr, '5 packets seen, 2 packets skipped')
+        check_packet_count(cmd_capinfos, 3, testout_file)
+
+    def test_editcap_dup_window(self, cmd_editcap, cmd_capinfos, result_file, dup_capture, test_env):
+        '''-D only compares packets within the duplicate window'''
+        process, testout_file = self.run_editcap(cmd_editcap, result_file, test_env,
+            dup_capture, '-D', '1', '--dup-digest', 'murmur64')
+        assert grep_output(process.stderr, '5 packets seen, 2 packets skipped')
+        # Frame 5 matches frame 1 when the TTL and checksum are ignored,
+        # but frame 1 is outside of the window.
+        process, testout_file = self.run_editcap(cmd_editcap, result_file, test_env,
+            dup_capture, '-D', '1', '--dup-ignore', '22:1', '--dup-ignore', '24:2')
+        assert grep_output(process.stderr, '5 packets seen, 2 packets skipped')
+
+    @pytest.mark.parametrize('digest', ['md5', 'crc32c', 'murmur64'])
+    def test_editcap_dup_ignore(self, cmd_editcap, cmd_capinfos, result_file, dup_capture, test_env, digest):
+        '''--dup-ignore makes packets that only differ in the ignored bytes duplicates'''
+        process, testout_file = self.run_editcap(cmd_editcap, result_file, test_env,
+            dup_capture, '-D', '5', '--dup-digest', digest, '--dup-ignore', '22:1', '--dup-ignore', '24:2')
+        assert grep_output(process.stderr, '5 packets seen, 3 packets skipped')
+        check_packet_count(cmd_capinfos, 2, testout_file)
+
+    def test_editcap_dup_ignore_partial(self, cmd_editcap, cmd_capinfos, result_file, dup_capture, test_env):
+        '''--dup-ignore doesn't ignore bytes outside of the given ranges'''
+        process, testout_file = self.run_editcap(cmd_editcap, result_file, test_env,
+            dup_capture, '-D', '5', '--dup-ignore', '22:1')
+        assert grep_output(process.stderr, '5 packets seen, 2 packets skipped')
+        check_packet_count(cmd_capinfos, 3, testout_file)
+
+    def test_editcap_dup_time_window(self, cmd_editcap, cmd_capinfos, result_file, dup_capture, test_env):
+        '''-w with --dup-ignore finds duplicates within the time window'''
+        process, testout_file = self.run_editcap(cmd_editcap, result_file, test_env,
+            dup_capture, '-w', '1.5', '--dup-ignore', '22:1', '--dup-ignore', '24:2')
+        # Frame 5 is four seconds after frame 1, outside the window.
+        assert grep_output(process.stderr, '5 packets seen, 2 packets skipped')
+        check_packet_count(cmd_capinfos, 3, testout_file)
+
+    def test_editcap_dup_invalid(self, cmd_editcap, result_file, dup_capture, test_env):
+        '''--dup-digest and --dup-ignore reject invalid arguments'''
+        for args in (('--dup-digest', 'sha1'), ('--dup-ignore', '22'), ('--dup-ignore', '22:0')):
+            process = subprocess.run((cmd_editcap, '-D', '5', *args, dup_capture, result_file(testout_pcap)),
+                capture_output=True, encoding='utf-8', env=test_env)
+            assert process.returncode != 0
@@ -8,6 +8,7 @@
 #
 '''File I/O tests'''
 
+import gzip
 import io
 import os.path
 import subprocess
@@ -67,6 +68,27 @@ class TestTsharkIO:
         '''Read direct and write direct using TShark'''
         check_io_4_packets(capture_file, result_file, cmd_tshark, cmd_capinfos, env=test_env)
 
+    def test_tshark_io_mapped_file(self, cmd_tshark, capture_file, result_file, test_env):
+        '''Read an uncompressed file through a memory mapping using TShark'''
+        # TShark maps uncompressed files named with -r; compressed files and
+        # pipes are read with read(). -2 also makes it seek back to packets.
+        uncompressed_file = result_file('dns+icmp.pcapng')
+        with gzip.open(capture_file('dns+icmp.pcapng.gz'), 'rb') as gz_f, open(uncompressed_file, 'wb') as out_f:
+            out_f.write(gz_f.read())
+        for args in (('-V',), ('-2', '-V')):
+            compressed = subprocess.run((cmd_tshark, '-r', capture_file('dns+icmp.pcapng.gz'), *args),
+                capture_output=True, check=True, env=test_env)
+            mapped = subprocess.run((cmd_tshark, '-r', uncompressed_file, *args),
+                capture_output=True, check=True, env=test_env)
+            assert compressed.stdout
+            assert mapped.stdout == compressed.stdout
+        with open(uncompressed_file, 'rb') as in_f:
+            piped = subprocess.run((cmd_tshark, '-r', '-', '-V'), stdin=in_f,
+                capture_output=True, check=True, env=test_env)
+        mapped = subprocess.run((cmd_tshark, '-r', uncompressed_file, '-V'),
+            capture_output=True, check=True, env=test_env)
+        assert mapped.stdout == piped.stdout
+
 
 @pytest.mark.skipif(sys.byteorder != 'little', reason='Requires a little endian system')
 class TestRawsharkIO:
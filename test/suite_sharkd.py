@@ -9,6 +9,8 @@
 '''sharkd tests'''
 
 import json
+import os
+import shutil
 import subprocess
 import pytest
 from matchers import *
@@ -75,7 +77,10 @@ class TestSharkd:
         check_sharkd_session((
             {"jsonrpc":"2.0", "id":1, "method":"status"},
         ), (
-            {"jsonrpc":"2.0","id":1,"result":{"frames":0,"duration":0.000000000,"columns":["No.","Time","Source","Destination","Protocol","Length","Info"],
+            {"jsonrpc":"2.0","id":1,"result":{"frames":0,"duration":0.000000000,
+                "filter_cache":{"entries":0,"bytes":0,"limit":67108864,"hits":0,"narrowed":0,"misses":0},
+                "filter_columns":{"columns":0,"bytes":0,"limit":67108864,"batched":0,"dropped":0},
+                "columns":["No.","Time","Source","Destination","Protocol","Length","Info"],
                 "column_info":[{
                     "title":"No.","format": "%m","visible":True, "display": "R"
                 },{
@@ -104,6 +109,8 @@ class TestSharkd:
             {"jsonrpc":"2.0","id":1,"result":{"status":"OK"}},
             {"jsonrpc":"2.0","id":2,"result":{"frames": 4, "duration": 0.070345000,
                 "filename": "dhcp.pcap", "filesize": 1400,
+                "filter_cache":{"entries":0,"bytes":0,"limit":67108864,"hits":0,"narrowed":0,"misses":0},
+                "filter_columns":{"columns":0,"bytes":0,"limit":67108864,"batched":0,"dropped":0},
                 "columns":["No.","Time","Source","Destination","Protocol","Length","Info"],
                 "column_info":[{
                     "title":"No.","format": "%m","visible":True, "display": "R"
@@ -178,6 +185,15 @@ class TestSharkd:
             {"jsonrpc":"2.0","id":5,"result":{"status":"OK"}},
         ))
 
+    def test_sharkd_req_check_set_file(self, check_sharkd_session, tmp_path):
+        set_file = tmp_path / 'ports.txt'
+        set_file.write_text('67\n68\n')
+        check_sharkd_session((
+            {"jsonrpc":"2.0", "id":1, "method":"check", "params":{"filter": 'udp.port in @"%s"' % set_file.as_posix()}},
+        ), (
+            {"jsonrpc":"2.0","id":1,"error":{"code":-5001,"message":"Filter invalid - Sets can't be read from files here."}},
+        ))
+
     def test_sharkd_req_complete_field(self, check_sharkd_session):
         check_sharkd_session((
             {"jsonrpc":"2.0", "id":1, "method":"complete"},
@@ -254,6 +270,148 @@ class TestSharkd:
              },
         ))
 
+    def test_sharkd_req_frames_filter_cache(self, check_sharkd_session, capture_file):
+        frame = MatchObject({
+            "c": MatchList(MatchAny(str)),
+            "num": MatchAny(int),
+            "bg": MatchAny(str),
+            "fg": MatchAny(str),
+        })
+        check_sharkd_session((
+            {"jsonrpc":"2.0", "id":1, "method":"load",
+             "params":{"file": capture_file('dhcp.pcap')}
+             },
+            {"jsonrpc":"2.0", "id":2, "method":"frames","params":{"filter":"udp.port==67"}},
+            # Same filter, spelled differently: found in the cache.
+            {"jsonrpc":"2.0", "id":3, "method":"frames","params":{"filter":"udp.port == 67"}},
+            # Narrows down the cached filter.
+            {"jsonrpc":"2.0", "id":4, "method":"frames","params":{"filter":"udp.port==67 && frame.number >= 3"}},
+            {"jsonrpc":"2.0", "id":5, "method":"status"},
+        ), (
+            {"jsonrpc":"2.0","id":1,"result":{"status":"OK"}},
+            {"jsonrpc":"2.0","id":2,"result":[frame, frame, frame, frame]},
+            {"jsonrpc":"2.0","id":3,"result":[frame, frame, frame, frame]},
+            {"jsonrpc":"2.0","id":4,"result":[
+                MatchObject({"num": 3}),
+                MatchObject({"num": 4}),
+            ]},
+            {"jsonrpc":"2.0","id":5,"result":MatchObject({
+                "filter_cache":{"entries":2,"bytes":MatchAny(int),"limit":67108864,"hits":1,"narrowed":1,"misses":1},
+            })},
+        ))
+
+    # Filters that only compare integer, boolean and IPv4 fields with
+    # constants, evaluated over the columns extracted by batch_prime_filter.
+    batch_prime_filter = 'tcp.srcport == 0 || tcp.dstport == 0 || tcp.len == 0 || tcp.flags.syn == 1 || ip.src == 0.0.0.0 || ip.dst == 0.0.0.0'
+    batch_filters = (
+        'tcp.srcport == 443',
+        'tcp.dstport in {443 38714}',
+        'tcp.srcport == 38713 && tcp.len > 0',
+        'tcp.flags.syn == 1 || tcp.len >= 1000',
+        '!(tcp.len == 0)',
+        'tcp.len in {1..100 500..2000}',
+        'ip.dst == 127.0.0.0/8 && !tcp.flags.syn',
+        'ip.src != 127.0.0.1 || tcp.dstport < 1024',
+    )
+
+    def run_batch_filters(self, run_sharkd_session, capture_file):
+        commands = [
+            {"jsonrpc":"2.0", "id":1, "method":"load",
+             "params":{"file": capture_file('rsasnakeoil2.pcap')}
+             },
+            {"jsonrpc":"2.0", "id":2, "method":"frames","params":{"filter": self.batch_prime_filter}},
+        ]
+        for i, dfilter in enumerate(self.batch_filters):
+            commands.append({"jsonrpc":"2.0", "id":3 + i, "method":"frames","params":{"filter": dfilter}})
+        commands.append({"jsonrpc":"2.0", "id":3 + len(self.batch_filters), "method":"status"})
+        outputs = run_sharkd_session([json.dumps(x) for x in commands])
+        assert len(outputs) == len(commands)
+        frames = [[frame["num"] for frame in output["result"]] for output in outputs[2:-1]]
+        return frames, outputs[-1]["result"]["filter_columns"]
+
+    def tshark_frames(self, cmd_tshark, capture_file, base_env, dfilter):
+        process = subprocess.run((cmd_tshark, '-r', capture_file('rsasnakeoil2.pcap'),
+            '-Y', dfilter, '-T', 'fields', '-e', 'frame.number'),
+            check=True, capture_output=True, encoding='utf-8', env=base_env)
+        return [int(line) for line in process.stdout.split()]
+
+    def test_sharkd_req_frames_filter_batch(self, run_sharkd_session, cmd_tshark, capture_file, base_env):
+        '''Filters evaluated over the extracted columns match the same frames as tshark'''
+        frames, stats = self.run_batch_filters(run_sharkd_session, capture_file)
+        for dfilter, batch_frames in zip(self.batch_filters, frames):
+            assert batch_frames == self.tshark_frames(cmd_tshark, capture_file, base_env, dfilter), dfilter
+        assert stats["columns"] == 6
+        assert stats["batched"] == len(self.batch_filters)
+        assert stats["dropped"] == 0
+
+    def test_sharkd_req_frames_filter_batch_limit(self, run_sharkd_session, cmd_tshark, capture_file, base_env):
+        '''Columns over the limit are dropped, and the filters are evaluated frame by frame'''
+        base_env['WIRESHARK_SHARKD_FILTER_COLUMNS_LIMIT'] = '100'
+        frames, stats = self.run_batch_filters(run_sharkd_session, capture_file)
+        for dfilter, batch_frames in zip(self.batch_filters, frames):
+            assert batch_frames == self.tshark_frames(cmd_tshark, capture_file, base_env, dfilter), dfilter
+        assert stats["columns"] == 0
+        assert stats["bytes"] == 0
+        assert stats["limit"] == 100
+        assert stats["batched"] == 0
+        assert stats["dropped"] > 0
+
+    def test_sharkd_req_load_index(self, run_sharkd_session, capture_file, result_file):
+        capture = result_file('logistics_multicast.pcapng')
+        shutil.copyfile(capture_file('logistics_multicast.pcapng'), capture)
+        index = capture + '.wsidx'
+
+        def load_and_list(use_index):
+            params = {"file": capture}
+            if use_index:
+                params["index"] = True
+            return run_sharkd_session([json.dumps(x) for x in (
+                {"jsonrpc":"2.0", "id":1, "method":"load", "params":params},
+                {"jsonrpc":"2.0", "id":2, "method":"status"},
+                {"jsonrpc":"2.0", "id":3, "method":"frames"},
+            )])
+
+        expected = load_and_list(False)
+        assert not os.path.exists(index)
+        # The first load reads the file and writes the index, the second
+        # one loads the frames from it.
+        assert load_and_list(True) == expected
+        assert os.path.getsize(index) > 0
+        assert load_and_list(True) == expected
+        # A damaged index is ignored.
+        with open(index, 'r+b') as f:
+            f.truncate(100)
+        assert load_and_list(True) == expected
+
+    def test_sharkd_req_load_index_frame_out_of_order(self, run_sharkd_session, capture_file, result_file):
+        '''A frame loaded from the index that is asked for first still gets the TCP analysis and reassembly of the frames before it'''
+        capture = result_file('http-ooo.pcap')
+        shutil.copyfile(capture_file('http-ooo.pcap'), capture)
+
+        def load_and_dissect(use_index, frames):
+            params = {"file": capture}
+            if use_index:
+                params["index"] = True
+            return run_sharkd_session([json.dumps(x) for x in (
+                {"jsonrpc":"2.0", "id":1, "method":"load", "params":params},
+                *({"jsonrpc":"2.0", "id":2 + i, "method":"frame", "params":{"frame":num, "proto":True}}
+                    for i, num in enumerate(frames)),
+            )])
+
+        status = run_sharkd_session([json.dumps(x) for x in (
+            {"jsonrpc":"2.0", "id":1, "method":"load", "params":{"file": capture}},
+            {"jsonrpc":"2.0", "id":2, "method":"status"},
+        )])
+        count = status[1]["result"]["frames"]
+        assert count > 2
+        # Ask for the last frame, then the first one.
+        frames = (count, 1)
+        expected = load_and_dissect(False, frames)
+        # The first load writes the index, the second one loads the frames from it.
+        assert load_and_dissect(True, frames) == expected
+        assert os.path.exists(capture + '.wsidx')
+        assert load_and_dissect(True, frames) == expected
+
     def test_sharkd_req_tap_invalid(self, check_sharkd_session, capture_file):
         # XXX Unrecognized taps result in an empty line, modify
         #     run_sharkd_session such that checking for it is possible.
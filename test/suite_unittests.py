@@ -15,6 +15,10 @@ import pytest
 
 
 class TestUnitTests:
+    def test_unit_conversation_test(self, program, base_env):
+        '''conversation_test'''
+        subprocess.check_call(program('conversation_test'), env=base_env)
+
     def test_unit_exntest(self, program, base_env):
         '''exntest'''
         subprocess.check_call(program('exntest'), env=base_env)
@@ -27,6 +31,10 @@ class TestUnitTests:
         '''reassemble_test'''
         subprocess.check_call(program('reassemble_test'), env=base_env)
 
+    def test_unit_stats_tree_test(self, program, base_env):
+        '''stats_tree_test'''
+        subprocess.check_call(program('stats_tree_test'), env=base_env)
+
     def test_unit_tvbtest(self, program, base_env):
         '''tvbtest'''
         subprocess.check_call(program('tvbtest'), env=base_env)
@@ -84,6 +84,7 @@
 #include "ui/ssl_key_export.h"
 #include "ui/failure_message.h"
 #include "ui/capture_opts.h"
+#include "ui/flow_shard.h"
 #if defined(HAVE_LIBSMI)
 #include "epan/oids.h"
 #endif
@@ -91,12 +92,14 @@
 #include <epan/epan_dissect.h>
 #include <epan/tap.h>
 #include <epan/stat_tap_ui.h>
+#include <epan/conversation.h>
 #include <epan/conversation_table.h>
 #include <epan/srt_table.h>
 #include <epan/rtd_table.h>
 #include <epan/ex-opt.h>
 #include <epan/exported_pdu.h>
 #include <epan/secrets.h>
+#include <epan/reassemble.h>
 
 #include "capture/capture-pcap-util.h"
 
@@ -142,6 +145,10 @@
 #define LONGOPT_PRINT_TIMERS            LONGOPT_BASE_APPLICATION+9
 #define LONGOPT_GLOBAL_PROFILE          LONGOPT_BASE_APPLICATION+10
 #define LONGOPT_COMPRESS                LONGOPT_BASE_APPLICATION+11
+#define LONGOPT_READ_AHEAD              LONGOPT_BASE_APPLICATION+12
+#define LONGOPT_FLOW_SHARD              LONGOPT_BASE_APPLICATION+13
+#define LONGOPT_PRUNE_DISSECTION        LONGOPT_BASE_APPLICATION+14
+#define LONGOPT_CONVERSATION_TIMEOUT    LONGOPT_BASE_APPLICATION+15
 
 capture_file cfile;
 
@@ -153,6 +160,28 @@ static frame_data prev_cap_frame;
 static bool perform_two_pass_analysis;
 static uint32_t epan_auto_reset_count;
 static bool epan_auto_reset;
+static bool read_ahead_enabled;
+static flow_shard_t flow_shard;
+static bool prune_dissection;
+
+/*
+ * Conversations that no packet used for this many seconds of capture time,
+ * or for the shorter closed timeout once their endpoints have closed them,
+ * are freed along with their reassemblies (--conversation-timeout).
+ */
+static unsigned conversation_idle_timeout;
+static unsigned conversation_closed_timeout;
+#define DEFAULT_CONVERSATION_CLOSED_TIMEOUT 10
+
+/* The first frame of each second of capture time, for mapping timeouts
+ * to frame numbers. */
+typedef struct {
+    time_t secs;
+    uint32_t frame;
+} frame_checkpoint_t;
+
+static GArray *frame_checkpoints;
+static time_t last_conversation_expiry;
 
 static uint32_t selected_frame_number;
 
@@ -166,7 +195,8 @@ typedef enum {
     WRITE_FIELDS,   /* User defined list of fields */
     WRITE_JSON,     /* JSON */
     WRITE_JSON_RAW, /* JSON only raw hex */
-    WRITE_EK        /* JSON bulk insert to Elasticsearch */
+    WRITE_EK,       /* JSON bulk insert to Elasticsearch */
+    WRITE_ARROW     /* Apache Arrow IPC stream of user defined fields */
         /* Add CSV and the like here */
 } output_action_e;
 
@@ -245,6 +275,7 @@ static void report_counts_siginfo(int);
 #endif /* HAVE_LIBPCAP */
 
 static void reset_epan_mem(capture_file *cf, epan_dissect_t *edt, bool tree, bool visual);
+static void expire_conversations(capture_file *cf, const wtap_rec *rec);
 
 typedef enum {
     PROCESS_FILE_SUCCEEDED,
@@ -256,6 +287,8 @@ static process_file_status_t process_cap_file(capture_file *, char *, int, bool,
 
 static bool process_packet_single_pass(capture_file *cf,
         epan_dissect_t *edt, int64_t offset, wtap_rec *rec, unsigned tap_flags);
+static void skip_packet_single_pass(capture_file *cf, int64_t offset,
+        wtap_rec *rec);
 static void show_print_file_io_error(void);
 static bool write_preamble(capture_file *cf);
 static bool print_packet(capture_file *cf, epan_dissect_t *edt);
@@ -482,6 +515,15 @@ print_usage(FILE *output)
     fprintf(output, "Processing:\n");
     fprintf(output, "  -2                       perform a two-pass analysis\n");
     fprintf(output, "  -M <packet count>        perform session auto reset\n");
+    fprintf(output, "  --read-ahead             read the capture file in a separate thread\n");
+    fprintf(output, "                           (single-pass only)\n");
+    fprintf(output, "  --flow-shard <k>/<n>     only dissect the flows in shard k of n, split by\n");
+    fprintf(output, "                           IP addresses and ports (single-pass only)\n");
+    fprintf(output, "  --prune-dissection       don't dissect protocols that no filter or field\n");
+    fprintf(output, "                           output needs (single-pass only)\n");
+    fprintf(output, "  --conversation-timeout <idle>[,<closed>]\n");
+    fprintf(output, "                           free conversations idle for <idle> seconds, or\n");
+    fprintf(output, "                           <closed> seconds once closed (single-pass only)\n");
     fprintf(output, "  -R <read filter>, --read-filter <read filter>\n");
     fprintf(output, "                           packet Read filter in Wireshark display filter syntax\n");
     fprintf(output, "                           (requires -2)\n");
@@ -537,7 +579,7 @@ print_usage(FILE *output)
     fprintf(output, "     time                  include frame timestamp preamble\n");
     fprintf(output, "     notime                do not include frame timestamp preamble (-x default)\n");
     fprintf(output, "     help                  display help for --hexdump and exit\n");
-    fprintf(output, "  -T pdml|ps|psml|json|jsonraw|ek|tabs|text|fields|?\n");
+    fprintf(output, "  -T pdml|ps|psml|json|jsonraw|ek|tabs|text|fields|arrow|?\n");
     fprintf(output, "                           format of text output (def: text)\n");
     fprintf(output, "  -j <protocolfilter>      protocols layers filter if -T ek|pdml|json selected\n");
     fprintf(output, "                           (e.g. \"ip ip.flags text\", filter does not expand child\n");
@@ -555,6 +597,10 @@ print_usage(FILE *output)
     fprintf(output, "     aggregator=,|/s|<char> select comma, space, printable character as\n");
     fprintf(output, "                           aggregator\n");
     fprintf(output, "     quote=d|s|n           select double, single, no quotes for values\n");
+    fprintf(output, "     batch=<rows>          rows per record batch with -Tarrow\n");
+    fprintf(output, "     compression=none|lz4|zstd\n");
+    fprintf(output, "                           compression of record batches with -Tarrow\n");
+    fprintf(output, "     text=<field>          write a field as text with -Tarrow\n");
     fprintf(output, "  -t (a|ad|adoy|d|dd|e|r|u|ud|udoy)[.[N]]|.[N]\n");
     fprintf(output, "                           output format of time stamps (def: r: rel. to first)\n");
     fprintf(output, "  -u s|hms                 output format of seconds (def: s: seconds)\n");
@@ -729,7 +775,7 @@ _compile_dfilter(const char *text, dfilter_t **dfp, const char *caller)
     tshark_elapsed.dfilter_expand = g_get_monotonic_time() - elapsed_start;
 
     elapsed_start = g_get_monotonic_time();
-    ok = dfilter_compile_full(expanded, dfp, &df_err, DF_OPTIMIZE, caller);
+    ok = dfilter_compile_full(expanded, dfp, &df_err, DF_OPTIMIZE|DF_SET_FILES, caller);
     if (!ok ) {
         cmdarg_err("%s", df_err->msg);
 
@@ -1060,10 +1106,15 @@ main(int argc, char *argv[])
         {"print-timers", ws_no_argument, NULL, LONGOPT_PRINT_TIMERS},
         {"global-profile", ws_no_argument, NULL, LONGOPT_GLOBAL_PROFILE},
         {"compress", ws_required_argument, NULL, LONGOPT_COMPRESS},
+        {"read-ahead", ws_no_argument, NULL, LONGOPT_READ_AHEAD},
+        {"flow-shard", ws_required_argument, NULL, LONGOPT_FLOW_SHARD},
+        {"prune-dissection", ws_no_argument, NULL, LONGOPT_PRUNE_DISSECTION},
+        {"conversation-timeout", ws_required_argument, NULL, LONGOPT_CONVERSATION_TIMEOUT},
         {0, 0, 0, 0}
     };
     bool                 arg_error = false;
     bool                 has_extcap_options = false;
+    bool                 stat_args_specified = false;
     volatile bool        is_capturing = true;
 
     int                  err;
@@ -1731,11 +1782,17 @@ main(int argc, char *argv[])
                     output_action = WRITE_JSON_RAW;
                     print_details = true;   /* Need details */
                     print_summary = false;  /* Don't allow summary */
+                } else if (strcmp(ws_optarg, "arrow") == 0) {
+                    output_action = WRITE_ARROW;
+                    print_details = true;   /* Need full tree info */
+                    print_summary = false;  /* Don't allow summary */
                 }
                 else {
                     cmdarg_err("Invalid -T parameter \"%s\"; it must be one of:", ws_optarg);                   /* x */
                     cmdarg_err_cont("\t\"fields\"  The values of fields specified with the -e option, in a form\n"
                             "\t          specified by the -E option.\n"
+                            "\t\"arrow\"   The values of fields specified with the -e option, as an\n"
+                            "\t          Apache Arrow IPC stream with a typed column per field.\n"
                             "\t\"pdml\"    Packet Details Markup Language, an XML-based format for the\n"
                             "\t          details of a decoded packet. This information is equivalent to\n"
                             "\t          the packet details printed with the -V flag.\n"
@@ -1825,6 +1882,7 @@ main(int argc, char *argv[])
                     exit_status = WS_EXIT_INVALID_OPTION;
                     goto clean_exit;
                 }
+                stat_args_specified = true;
                 break;
             case 'd':        /* Decode as rule */
             case 'K':        /* Kerberos keytab file */
@@ -1934,6 +1992,41 @@ main(int argc, char *argv[])
                     goto clean_exit;
                 }
                 break;
+            case LONGOPT_READ_AHEAD:
+                read_ahead_enabled = true;
+                break;
+            case LONGOPT_FLOW_SHARD:
+            {
+                const char *shard_err = flow_shard_parse(ws_optarg, &flow_shard);
+
+                if (shard_err != NULL) {
+                    cmdarg_err("Invalid --flow-shard \"%s\": %s.", ws_optarg, shard_err);
+                    exit_status = WS_EXIT_INVALID_OPTION;
+                    goto clean_exit;
+                }
+                break;
+            }
+            case LONGOPT_PRUNE_DISSECTION:
+                prune_dissection = true;
+                break;
+            case LONGOPT_CONVERSATION_TIMEOUT:
+            {
+                char **timeouts = g_strsplit(ws_optarg, ",", 2);
+
+                conversation_idle_timeout = get_positive_int(timeouts[0], "conversation timeout");
+                if (timeouts[1] != NULL) {
+                    conversation_closed_timeout = get_positive_int(timeouts[1], "closed conversation timeout");
+                } else {
+                    conversation_closed_timeout = MIN(conversation_idle_timeout, DEFAULT_CONVERSATION_CLOSED_TIMEOUT);
+                }
+                g_strfreev(timeouts);
+                if (conversation_closed_timeout > conversation_idle_timeout) {
+                    cmdarg_err("--conversation-timeout: the closed timeout can't be longer than the idle timeout.");
+                    exit_status = WS_EXIT_INVALID_OPTION;
+                    goto clean_exit;
+                }
+                break;
+            }
             default:
             case '?':        /* Bad flag - print usage message */
                 switch(ws_optopt) {
@@ -1982,14 +2075,14 @@ main(int argc, char *argv[])
      * This also doesn't distinguish PDML from PSML, but shouldn't allow the
      * latter.
      */
-    if ((WRITE_FIELDS != output_action && WRITE_XML != output_action && WRITE_JSON != output_action && WRITE_EK != output_action) && 0 != output_fields_num_fields(output_fields)) {
+    if ((WRITE_FIELDS != output_action && WRITE_XML != output_action && WRITE_JSON != output_action && WRITE_EK != output_action && WRITE_ARROW != output_action) && 0 != output_fields_num_fields(output_fields)) {
         cmdarg_err("Output fields were specified with \"-e\", "
-                "but \"-Tek, -Tfields, -Tjson or -Tpdml\" was not specified.");
+                "but \"-Tarrow, -Tek, -Tfields, -Tjson or -Tpdml\" was not specified.");
         exit_status = WS_EXIT_INVALID_OPTION;
         goto clean_exit;
-    } else if (WRITE_FIELDS == output_action && 0 == output_fields_num_fields(output_fields)) {
-        cmdarg_err("\"-Tfields\" was specified, but no fields were "
-                "specified with \"-e\".");
+    } else if ((WRITE_FIELDS == output_action || WRITE_ARROW == output_action) && 0 == output_fields_num_fields(output_fields)) {
+        cmdarg_err("\"-T%s\" was specified, but no fields were "
+                "specified with \"-e\".", WRITE_ARROW == output_action ? "arrow" : "fields");
 
         exit_status = WS_EXIT_INVALID_OPTION;
         goto clean_exit;
@@ -2152,6 +2245,61 @@ main(int argc, char *argv[])
         goto clean_exit;
     }
 
+    if (read_ahead_enabled) {
+        if (perform_two_pass_analysis) {
+            cmdarg_err("--read-ahead does not support two-pass analysis.");
+            exit_status = WS_EXIT_INVALID_OPTION;
+            goto clean_exit;
+        }
+        if (cf_name == NULL) {
+            cmdarg_err("--read-ahead requires a capture file (specify with -r).");
+            exit_status = WS_EXIT_INVALID_OPTION;
+            goto clean_exit;
+        }
+    }
+
+    if (flow_shard.count > 1) {
+        if (perform_two_pass_analysis) {
+            cmdarg_err("--flow-shard does not support two-pass analysis.");
+            exit_status = WS_EXIT_INVALID_OPTION;
+            goto clean_exit;
+        }
+        if (cf_name == NULL) {
+            cmdarg_err("--flow-shard requires a capture file (specify with -r).");
+            exit_status = WS_EXIT_INVALID_OPTION;
+            goto clean_exit;
+        }
+        /*
+         * Each shard would only report on its own flows, and there is
+         * no way to merge the per-shard statistics.
+         */
+        if (stat_args_specified) {
+            cmdarg_err("--flow-shard cannot be used with -z statistics.");
+            exit_status = WS_EXIT_INVALID_OPTION;
+            goto clean_exit;
+        }
+    }
+
+    if (prune_dissection && perform_two_pass_analysis) {
+        cmdarg_err("--prune-dissection does not support two-pass analysis.");
+        exit_status = WS_EXIT_INVALID_OPTION;
+        goto clean_exit;
+    }
+
+    if (conversation_idle_timeout > 0) {
+        if (perform_two_pass_analysis) {
+            cmdarg_err("--conversation-timeout does not support two-pass analysis.");
+            exit_status = WS_EXIT_INVALID_OPTION;
+            goto clean_exit;
+        }
+        if (epan_auto_reset) {
+            cmdarg_err("--conversation-timeout does not support auto session reset.");
+            exit_status = WS_EXIT_INVALID_OPTION;
+            goto clean_exit;
+        }
+        frame_checkpoints = g_array_new(false, false, sizeof(frame_checkpoint_t));
+    }
+
 #ifdef HAVE_LIBPCAP
     if (caps_queries) {
         /* We're supposed to list the link-layer/timestamp types for an interface;
@@ -2568,8 +2716,11 @@ main(int argc, char *argv[])
     if (cf_name) {
         ws_debug("tshark: Opening capture file: %s", cf_name);
         /*
-         * We're reading a capture file.
+         * We're reading a capture file.  It's expected to be complete,
+         * or at most still growing, so it can be read through a memory
+         * mapping.
          */
+        wtap_set_file_mapping(true);
         if (cf_open(&cfile, cf_name, in_file_type, false, &err) != CF_OK) {
             epan_cleanup();
             extcap_cleanup();
@@ -2594,6 +2745,9 @@ main(int argc, char *argv[])
         do_dissection = must_do_dissection(rfcode, dfcode, pdu_export_arg);
         ws_debug("tshark: do_dissection = %s", do_dissection ? "TRUE" : "FALSE");
 
+        /* Taps may need protocols that nothing else references. */
+        set_prune_unreferenced_protocols(prune_dissection && !tap_listeners_require_dissection());
+
         /* Process the packets in the file */
         ws_debug("tshark: invoking process_cap_file() to process the packets");
         TRY {
@@ -2784,6 +2938,9 @@ main(int argc, char *argv[])
         do_dissection = must_do_dissection(rfcode, dfcode, pdu_export_arg);
         ws_debug("tshark: do_dissection = %s", do_dissection ? "TRUE" : "FALSE");
 
+        /* Taps may need protocols that nothing else references. */
+        set_prune_unreferenced_protocols(prune_dissection && !tap_listeners_require_dissection());
+
         /* We're doing live capture; if the capture child is writing to a pipe,
            we can't do dissection, because that would mean two readers for
            the pipe, tshark and whatever else. */
@@ -2916,19 +3073,352 @@ clean_exit:
     free_progdirs();
     dfilter_free(dfcode);
     g_free(dfilter);
+    if (frame_checkpoints) {
+        g_array_free(frame_checkpoints, true);
+    }
     return exit_status;
 }
 
 bool loop_running;
 uint32_t packet_count;
 
+/*
+ * Read-ahead for single-pass processing ("--read-ahead").
+ *
+ * A reader thread calls wtap_read() into a ring of records while the
+ * main thread dissects, filters and prints the records that have already
+ * been read, so reading (and decompressing) the file overlaps with
+ * dissection.  Records are handed over in the order in which they were
+ * read, so the output is identical to that of the unthreaded loop.
+ *
+ * Dissection itself stays on the main thread: conversations, reassembly
+ * and the tap queues are not thread-safe, and dissecting records out of
+ * order would change the results.
+ *
+ * Reading a record may also add entries to wiretap's interface and
+ * decryption secrets arrays, and may hand name resolution and decryption
+ * secrets blocks to epan.  The former are protected by read_ahead_wth_lock,
+ * which the reader holds while reading and the main thread holds while
+ * looking at the wtap; the latter are queued up and handed to epan by the
+ * main thread just before the record that followed them in the file.
+ */
+#define READ_AHEAD_DEPTH    256
+
+typedef enum {
+    DEFERRED_IPV4_NAME,
+    DEFERRED_IPV6_NAME,
+    DEFERRED_SECRETS
+} deferred_block_type_e;
+
+typedef struct {
+    deferred_block_type_e type;
+    unsigned    ipv4_addr;
+    ws_in6_addr ipv6_addr;
+    char       *name;
+    uint32_t    secrets_type;
+    void       *secrets;
+    unsigned    secrets_len;
+} deferred_block_t;
+
+typedef struct {
+    wtap_rec    rec;
+    int64_t     data_offset;
+    GSList     *deferred;   /* deferred_block_t's read before this record */
+} read_ahead_slot_t;
+
+static struct {
+    GThread    *thread;
+    wtap       *wth;
+    GMutex      lock;       /* protects everything below */
+    GCond       cond;
+    read_ahead_slot_t *slots;
+    unsigned    head;       /* oldest record not yet processed */
+    unsigned    count;      /* number of records read but not yet processed */
+    bool        done;       /* the reader hit EOF or an error */
+    bool        stop;       /* the main thread wants the reader to quit */
+    int         err;
+    char       *err_info;
+    GSList     *tail_deferred; /* deferred blocks read after the last record */
+} read_ahead;
+
+/* Only touched by whichever thread is calling wtap_read(). */
+static GSList *read_ahead_pending;
+
+static GMutex read_ahead_wth_lock;
+static bool read_ahead_active;
+
+static void
+read_ahead_lock_wth(void)
+{
+    if (read_ahead_active)
+        g_mutex_lock(&read_ahead_wth_lock);
+}
+
+static void
+read_ahead_unlock_wth(void)
+{
+    if (read_ahead_active)
+        g_mutex_unlock(&read_ahead_wth_lock);
+}
+
+static const char *
+tshark_get_interface_name(struct packet_provider_data *prov, uint32_t interface_id, unsigned section_number)
+{
+    const char *name;
+
+    read_ahead_lock_wth();
+    name = cap_file_provider_get_interface_name(prov, interface_id, section_number);
+    read_ahead_unlock_wth();
+    return name;
+}
+
+static const char *
+tshark_get_interface_description(struct packet_provider_data *prov, uint32_t interface_id, unsigned section_number)
+{
+    const char *description;
+
+    read_ahead_lock_wth();
+    description = cap_file_provider_get_interface_description(prov, interface_id, section_number);
+    read_ahead_unlock_wth();
+    return description;
+}
+
+static void
+read_ahead_defer_ipv4(const unsigned addr, const char *name, const bool static_entry _U_)
+{
+    deferred_block_t *db = g_new0(deferred_block_t, 1);
+
+    db->type = DEFERRED_IPV4_NAME;
+    db->ipv4_addr = addr;
+    db->name = g_strdup(name);
+    read_ahead_pending = g_slist_prepend(read_ahead_pending, db);
+}
+
+static void
+read_ahead_defer_ipv6(const ws_in6_addr *addrp, const char *name, const bool static_entry _U_)
+{
+    deferred_block_t *db = g_new0(deferred_block_t, 1);
+
+    db->type = DEFERRED_IPV6_NAME;
+    db->ipv6_addr = *addrp;
+    db->name = g_strdup(name);
+    read_ahead_pending = g_slist_prepend(read_ahead_pending, db);
+}
+
+static void
+read_ahead_defer_secrets(uint32_t secrets_type, const void *secrets, unsigned size)
+{
+    deferred_block_t *db = g_new0(deferred_block_t, 1);
+
+    db->type = DEFERRED_SECRETS;
+    db->secrets_type = secrets_type;
+    db->secrets = g_memdup2(secrets, size);
+    db->secrets_len = size;
+    read_ahead_pending = g_slist_prepend(read_ahead_pending, db);
+}
+
+static void
+deferred_block_free(void *data)
+{
+    deferred_block_t *db = (deferred_block_t *)data;
+
+    g_free(db->name);
+    g_free(db->secrets);
+    g_free(db);
+}
+
+/*
+ * Hand the deferred blocks to epan, in the order in which they were read,
+ * and free them.
+ */
+static void
+read_ahead_apply_deferred(GSList *deferred)
+{
+    for (GSList *item = deferred; item != NULL; item = g_slist_next(item)) {
+        deferred_block_t *db = (deferred_block_t *)item->data;
+
+        switch (db->type) {
+
+            case DEFERRED_IPV4_NAME:
+                add_ipv4_name(db->ipv4_addr, db->name, false);
+                break;
+
+            case DEFERRED_IPV6_NAME:
+                add_ipv6_name(&db->ipv6_addr, db->name, false);
+                break;
+
+            case DEFERRED_SECRETS:
+                secrets_wtap_callback(db->secrets_type, db->secrets, db->secrets_len);
+                break;
+        }
+    }
+    g_slist_free_full(deferred, deferred_block_free);
+}
+
+static void *
+read_ahead_worker(void *arg _U_)
+{
+    read_ahead_slot_t *slot;
+    bool got_record;
+    int err = 0;
+    char *err_info = NULL;
+
+    for (;;) {
+        /* Wait for a free slot. */
+        g_mutex_lock(&read_ahead.lock);
+        while (read_ahead.count == READ_AHEAD_DEPTH && !read_ahead.stop)
+            g_cond_wait(&read_ahead.cond, &read_ahead.lock);
+        if (read_ahead.stop) {
+            g_mutex_unlock(&read_ahead.lock);
+            break;
+        }
+        slot = &read_ahead.slots[(read_ahead.head + read_ahead.count) % READ_AHEAD_DEPTH];
+        g_mutex_unlock(&read_ahead.lock);
+
+        /* The slot is ours until we publish it, so read without the lock. */
+        g_mutex_lock(&read_ahead_wth_lock);
+        got_record = wtap_read(read_ahead.wth, &slot->rec, &err, &err_info, &slot->data_offset);
+        g_mutex_unlock(&read_ahead_wth_lock);
+
+        g_mutex_lock(&read_ahead.lock);
+        if (got_record) {
+            slot->deferred = g_slist_reverse(read_ahead_pending);
+            read_ahead_pending = NULL;
+            read_ahead.count++;
+        } else {
+            read_ahead.tail_deferred = g_slist_reverse(read_ahead_pending);
+            read_ahead_pending = NULL;
+            read_ahead.err = err;
+            read_ahead.err_info = err_info;
+            read_ahead.done = true;
+        }
+        g_cond_broadcast(&read_ahead.cond);
+        g_mutex_unlock(&read_ahead.lock);
+
+        if (!got_record)
+            break;
+    }
+    return NULL;
+}
+
+static void
+read_ahead_start(capture_file *cf)
+{
+    read_ahead.wth = cf->provider.wth;
+    read_ahead.slots = g_new(read_ahead_slot_t, READ_AHEAD_DEPTH);
+    for (unsigned i = 0; i < READ_AHEAD_DEPTH; i++) {
+        wtap_rec_init(&read_ahead.slots[i].rec, 1514);
+        read_ahead.slots[i].data_offset = 0;
+        read_ahead.slots[i].deferred = NULL;
+    }
+    read_ahead.head = 0;
+    read_ahead.count = 0;
+    read_ahead.done = false;
+    read_ahead.stop = false;
+    read_ahead.err = 0;
+    read_ahead.err_info = NULL;
+    read_ahead.tail_deferred = NULL;
+    g_mutex_init(&read_ahead.lock);
+    g_cond_init(&read_ahead.cond);
+    g_mutex_init(&read_ahead_wth_lock);
+
+    /*
+     * From now on, name resolution and decryption secrets blocks are
+     * queued up rather than handed directly to epan.  (Any blocks read
+     * so far are handed over again; adding them twice is harmless.)
+     */
+    wtap_set_cb_new_ipv4(cf->provider.wth, read_ahead_defer_ipv4);
+    wtap_set_cb_new_ipv6(cf->provider.wth, read_ahead_defer_ipv6);
+    wtap_set_cb_new_secrets(cf->provider.wth, read_ahead_defer_secrets);
+
+    read_ahead_active = true;
+    read_ahead.thread = g_thread_new("Read ahead", read_ahead_worker, NULL);
+}
+
+/*
+ * Get the next record from the reader thread; returns false, with *err
+ * and *err_info set, at the end of the file or on a read error.
+ */
+static bool
+read_ahead_next(wtap_rec **recp, int *err, char **err_info, int64_t *data_offset)
+{
+    read_ahead_slot_t *slot;
+    GSList *deferred;
+
+    g_mutex_lock(&read_ahead.lock);
+    while (read_ahead.count == 0 && !read_ahead.done)
+        g_cond_wait(&read_ahead.cond, &read_ahead.lock);
+    if (read_ahead.count == 0) {
+        deferred = read_ahead.tail_deferred;
+        read_ahead.tail_deferred = NULL;
+        *err = read_ahead.err;
+        *err_info = read_ahead.err_info;
+        read_ahead.err_info = NULL;
+        g_mutex_unlock(&read_ahead.lock);
+        read_ahead_apply_deferred(deferred);
+        return false;
+    }
+    slot = &read_ahead.slots[read_ahead.head];
+    g_mutex_unlock(&read_ahead.lock);
+
+    read_ahead_apply_deferred(slot->deferred);
+    slot->deferred = NULL;
+    *recp = &slot->rec;
+    *data_offset = slot->data_offset;
+    return true;
+}
+
+/* We're done with the record returned by read_ahead_next(). */
+static void
+read_ahead_release(void)
+{
+    g_mutex_lock(&read_ahead.lock);
+    wtap_rec_reset(&read_ahead.slots[read_ahead.head].rec);
+    read_ahead.head = (read_ahead.head + 1) % READ_AHEAD_DEPTH;
+    read_ahead.count--;
+    g_cond_broadcast(&read_ahead.cond);
+    g_mutex_unlock(&read_ahead.lock);
+}
+
+/*
+ * Stop the reader thread, if it hasn't already stopped, and discard
+ * whatever it read that we didn't process.
+ */
+static void
+read_ahead_finish(void)
+{
+    g_mutex_lock(&read_ahead.lock);
+    read_ahead.stop = true;
+    g_cond_broadcast(&read_ahead.cond);
+    g_mutex_unlock(&read_ahead.lock);
+    g_thread_join(read_ahead.thread);
+    read_ahead.thread = NULL;
+    read_ahead_active = false;
+
+    for (unsigned i = 0; i < READ_AHEAD_DEPTH; i++) {
+        g_slist_free_full(read_ahead.slots[i].deferred, deferred_block_free);
+        wtap_rec_cleanup(&read_ahead.slots[i].rec);
+    }
+    g_free(read_ahead.slots);
+    read_ahead.slots = NULL;
+    g_slist_free_full(read_ahead.tail_deferred, deferred_block_free);
+    read_ahead.tail_deferred = NULL;
+    g_slist_free_full(read_ahead_pending, deferred_block_free);
+    read_ahead_pending = NULL;
+    g_free(read_ahead.err_info);
+    read_ahead.err_info = NULL;
+    g_mutex_clear(&read_ahead.lock);
+    g_cond_clear(&read_ahead.cond);
+    g_mutex_clear(&read_ahead_wth_lock);
+}
+
 static epan_t *
 tshark_epan_new(capture_file *cf)
 {
     static const struct packet_provider_funcs funcs = {
         cap_file_provider_get_frame_ts,
-        cap_file_provider_get_interface_name,
-        cap_file_provider_get_interface_description,
+        tshark_get_interface_name,
+        tshark_get_interface_description,
         NULL,
     };
 
@@ -3228,6 +3718,7 @@ capture_input_new_packets(capture_session *cap_session, int to_read)
                 wtap_close(cf->provider.wth);
                 cf->provider.wth = NULL;
             } else {
+                expire_conversations(cf, &rec);
                 ret = process_packet_single_pass(cf, edt, data_offset, &rec,
                         tap_flags);
             }
@@ -3899,6 +4390,7 @@ process_cap_file_single_pass(capture_file *cf, wtap_dumper *pdh,
         volatile uint32_t *err_framenum)
 {
     wtap_rec        rec;
+    wtap_rec       *recp;
     bool create_proto_tree = false;
     bool            filtering_tap_listeners;
     unsigned        tap_flags;
@@ -3961,8 +4453,14 @@ process_cap_file_single_pass(capture_file *cf, wtap_dumper *pdh,
      */
     set_resolution_synchrony(true);
 
+    if (read_ahead_enabled)
+        read_ahead_start(cf);
+
     *err = 0;
-    while (wtap_read(cf->provider.wth, &rec, err, err_info, &data_offset)) {
+    recp = &rec;
+    while (read_ahead_active ?
+            read_ahead_next(&recp, err, err_info, &data_offset) :
+            wtap_read(cf->provider.wth, recp, err, err_info, &data_offset)) {
         if (read_interrupted) {
             status = PASS_INTERRUPTED;
             break;
@@ -3972,25 +4470,38 @@ process_cap_file_single_pass(capture_file *cf, wtap_dumper *pdh,
         /*
          * Process whatever IDBs we haven't seen yet.
          */
+        read_ahead_lock_wth();
         if (!process_new_idbs(cf->provider.wth, pdh, err, err_info)) {
+            read_ahead_unlock_wth();
             *err_framenum = framenum;
             status = PASS_WRITE_ERROR;
             break;
         }
+        read_ahead_unlock_wth();
 
         ws_debug("tshark: processing packet #%d", framenum);
 
         reset_epan_mem(cf, edt, create_proto_tree, visible);
+        expire_conversations(cf, recp);
 
-        if (process_packet_single_pass(cf, edt, data_offset, &rec, tap_flags)) {
+        if (!flow_shard_selected(&flow_shard, recp)) {
+            /* Another shard dissects this record. */
+            skip_packet_single_pass(cf, data_offset, recp);
+        } else if (process_packet_single_pass(cf, edt, data_offset, recp, tap_flags)) {
             /* Either there's no read filtering or this packet passed the
                filter, so, if we're writing to a capture file, write
                this packet out. */
             write_framenum++;
             if (pdh != NULL) {
+                bool dumped;
+
                 ws_debug("tshark: writing packet #%d to outfile as #%d",
                         framenum, write_framenum);
-                if (!wtap_dump(pdh, &rec, err, err_info)) {
+                /* The dumper looks at the input file's secrets blocks. */
+                read_ahead_lock_wth();
+                dumped = wtap_dump(pdh, recp, err, err_info);
+                read_ahead_unlock_wth();
+                if (!dumped) {
                     /* Error writing to the output file. */
                     ws_debug("tshark: error writing to a capture file (%d)", *err);
                     *err_framenum = framenum;
@@ -4016,8 +4527,13 @@ process_cap_file_single_pass(capture_file *cf, wtap_dumper *pdh,
             *err = 0; /* This is not an error */
             break;
         }
-        wtap_rec_reset(&rec);
+        if (read_ahead_active)
+            read_ahead_release();
+        else
+            wtap_rec_reset(recp);
     }
+    if (read_ahead_active)
+        read_ahead_finish();
     if (status == PASS_SUCCEEDED) {
         if (*err != 0) {
             /* Error reading from the input file. */
@@ -4449,6 +4965,35 @@ process_packet_single_pass(capture_file *cf, epan_dissect_t *edt, int64_t offset
     return passed;
 }
 
+/*
+ * Account for a record that belongs to another flow shard without
+ * dissecting it, so that frame numbers and relative times match those
+ * of an unsharded run.
+ */
+static void
+skip_packet_single_pass(capture_file *cf, int64_t offset, wtap_rec *rec)
+{
+    frame_data      fdata;
+
+    cf->count++;
+
+    frame_data_init(&fdata, cf->count, rec, offset, cum_bytes);
+    frame_data_set_before_dissect(&fdata, &cf->elapsed_time,
+            &cf->provider.ref, cf->provider.prev_dis);
+    if (cf->provider.ref == &fdata) {
+        ref_frame = fdata;
+        cf->provider.ref = &ref_frame;
+    }
+
+    /* Keep frame.cum_bytes the same as in an unsharded run. */
+    frame_data_set_after_dissect(&fdata, &cum_bytes);
+
+    prev_cap_frame = fdata;
+    cf->provider.prev_cap = &prev_cap_frame;
+
+    frame_data_destroy(&fdata);
+}
+
 static bool
 write_preamble(capture_file *cf)
 {
@@ -4468,6 +5013,15 @@ write_preamble(capture_file *cf)
             write_fields_preamble(output_fields, stdout);
             return !ferror(stdout);
 
+        case WRITE_ARROW:
+#ifdef _WIN32
+            /* The stream is binary; avoid the text-mode processing of CR/LF */
+            fflush(stdout);
+            _setmode(1, O_BINARY);
+#endif
+            write_arrow_preamble(output_fields, stdout);
+            return !ferror(stdout);
+
         case WRITE_JSON:
         case WRITE_JSON_RAW:
             jdumper = write_json_preamble(stdout);
@@ -4823,6 +5377,15 @@ print_packet(capture_file *cf, epan_dissect_t *edt)
             }
             break;
 
+        case WRITE_ARROW:
+            if (print_summary)
+                ws_assert_not_reached();
+            if (print_details) {
+                write_arrow_proto_tree(output_fields, edt, &cf->cinfo);
+                return !ferror(stdout);
+            }
+            break;
+
         case WRITE_JSON:
             if (print_summary)
                 ws_assert_not_reached();
@@ -4884,6 +5447,9 @@ write_finale(void)
             write_fields_finale(output_fields, stdout);
             return !ferror(stdout);
 
+        case WRITE_ARROW:
+            return write_arrow_finale(output_fields) && !ferror(stdout);
+
         case WRITE_JSON:
         case WRITE_JSON_RAW:
             write_json_finale(&jdumper);
@@ -5064,3 +5630,66 @@ reset_epan_mem(capture_file *cf,epan_dissect_t *edt, bool tree, bool visual)
     epan_dissect_init(edt, cf->epan, tree, visual);
     cf->count = 0;
 }
+
+/*
+ * Get the index of the first checkpoint that is not more than timeout
+ * seconds before now; the frames before its frame are older.
+ */
+static unsigned
+frame_checkpoint_index(time_t now, unsigned timeout)
+{
+    const frame_checkpoint_t *checkpoints = (const frame_checkpoint_t *)(void *)frame_checkpoints->data;
+    unsigned lo = 0, hi = frame_checkpoints->len, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (checkpoints[mid].secs < now - (time_t)timeout)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/*
+ * Expire the conversations and reassemblies that the packets of the last
+ * seconds of capture time didn't use, so that the memory used by a long
+ * single-pass session doesn't grow with the number of flows it has seen.
+ * Only the data of the protocols that register a release function with
+ * conversation_register_proto_data_release() is freed with a conversation.
+ * Called before dissecting each record.
+ */
+static void
+expire_conversations(capture_file *cf, const wtap_rec *rec)
+{
+    frame_checkpoint_t checkpoint;
+    const frame_checkpoint_t *checkpoints;
+    unsigned idle_index, closed_index;
+    time_t now;
+
+    if (conversation_idle_timeout == 0 || !(rec->presence_flags & WTAP_HAS_TS))
+        return;
+
+    now = rec->ts.secs;
+    if (frame_checkpoints->len > 0 &&
+            now <= g_array_index(frame_checkpoints, frame_checkpoint_t, frame_checkpoints->len - 1).secs)
+        return;
+    checkpoint.secs = now;
+    checkpoint.frame = cf->count + 1;
+    g_array_append_val(frame_checkpoints, checkpoint);
+
+    /* Look for expired conversations twice per closed timeout. */
+    if (now - last_conversation_expiry < (time_t)MAX(conversation_closed_timeout / 2, 1))
+        return;
+    last_conversation_expiry = now;
+
+    idle_index = frame_checkpoint_index(now, conversation_idle_timeout);
+    closed_index = frame_checkpoint_index(now, conversation_closed_timeout);
+    checkpoints = (const frame_checkpoint_t *)(void *)frame_checkpoints->data;
+    conversation_expire(checkpoints[idle_index].frame, checkpoints[closed_index].frame);
+    reassembly_tables_expire(checkpoints[idle_index].frame);
+
+    /* The earlier checkpoints won't be needed again; the closed timeout
+     * isn't longer than the idle one. */
+    g_array_remove_range(frame_checkpoints, 0, idle_index);
+}
@@ -98,6 +98,7 @@ init_stats_tree(const char *opt_arg, void *userdata _U_)
 		report_failure("stats_tree for: %s failed to attach to the tap: %s", cfg->path, error_string->str);
 		return false;
 	}
+	set_tap_merge(st, stats_tree_merge);
 
 	if (cfg->init)
 		cfg->init(st);
@@ -0,0 +1,303 @@
+/* flow_shard.c
+ * Assign capture records to flow shards, so that several processes can
+ * each dissect a disjoint set of flows from the same capture file.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <wsutil/buffer.h>
+#include <wsutil/pint.h>
+#include <wsutil/strtoi.h>
+
+#include "ui/flow_shard.h"
+
+#define ETHERTYPE_IPv4      0x0800
+#define ETHERTYPE_IPv6      0x86dd
+#define ETHERTYPE_VLAN      0x8100
+#define ETHERTYPE_QINQ_OLD  0x9100
+#define ETHERTYPE_IEEE_8021AD 0x88a8
+
+#define IP_PROTO_HOPOPTS    0
+#define IP_PROTO_ROUTING    43
+#define IP_PROTO_FRAGMENT   44
+#define IP_PROTO_DSTOPTS    60
+
+/* Address family values used by the various BSD loopback headers. */
+#define BSD_AF_INET         2
+#define BSD_AF_INET6_BSD    24
+#define BSD_AF_INET6_FREEBSD 28
+#define BSD_AF_INET6_DARWIN 30
+#define LINUX_AF_INET6      10
+
+/*
+ * The two endpoints of a flow. Ports are deliberately left out: only the
+ * first fragment of a datagram carries them, and keying fragments and
+ * whole datagrams differently would split a flow across shards.
+ */
+typedef struct {
+    uint8_t  addr[2][16];
+    unsigned addr_len;
+    uint8_t  proto;
+} flow_key_t;
+
+const char *
+flow_shard_parse(const char *spec, flow_shard_t *shard)
+{
+    const char *endp;
+    uint32_t index, count;
+
+    if (!ws_strtou32(spec, &endp, &index) || *endp != '/')
+        return "the shard must be given as <shard>/<number of shards>";
+    if (!ws_strtou32(endp + 1, NULL, &count))
+        return "the shard must be given as <shard>/<number of shards>";
+    if (count == 0)
+        return "the number of shards must be at least 1";
+    if (index < 1 || index > count)
+        return "the shard must be between 1 and the number of shards";
+
+    shard->index = index - 1;
+    shard->count = count;
+    return NULL;
+}
+
+static bool
+flow_key_ipv4(flow_key_t *key, const uint8_t *pd, unsigned len)
+{
+    unsigned hlen;
+
+    if (len < 20 || (pd[0] >> 4) != 4)
+        return false;
+    hlen = (pd[0] & 0x0f) * 4;
+    if (hlen < 20 || hlen > len)
+        return false;
+
+    key->addr_len = 4;
+    memcpy(key->addr[0], pd + 12, 4);
+    memcpy(key->addr[1], pd + 16, 4);
+    key->proto = pd[9];
+    return true;
+}
+
+static bool
+flow_key_ipv6(flow_key_t *key, const uint8_t *pd, unsigned len)
+{
+    unsigned offset = 40;
+    uint8_t nxt;
+
+    if (len < 40 || (pd[0] >> 4) != 6)
+        return false;
+
+    key->addr_len = 16;
+    memcpy(key->addr[0], pd + 8, 16);
+    memcpy(key->addr[1], pd + 24, 16);
+
+    /* Skip the extension headers that can precede the transport header. */
+    nxt = pd[6];
+    for (;;) {
+        switch (nxt) {
+
+        case IP_PROTO_HOPOPTS:
+        case IP_PROTO_ROUTING:
+        case IP_PROTO_DSTOPTS:
+            if (offset + 2 > len) {
+                key->proto = nxt;
+                return true;
+            }
+            nxt = pd[offset];
+            offset += (pd[offset + 1] + 1) * 8;
+            continue;
+
+        case IP_PROTO_FRAGMENT:
+            /* Key fragments on the upper-layer protocol, like whole datagrams. */
+            key->proto = (offset + 1 <= len) ? pd[offset] : nxt;
+            return true;
+
+        default:
+            key->proto = nxt;
+            return true;
+        }
+    }
+}
+
+static bool
+flow_key_ethertype(flow_key_t *key, uint16_t ethertype, const uint8_t *pd, unsigned len)
+{
+    switch (ethertype) {
+
+    case ETHERTYPE_IPv4:
+        return flow_key_ipv4(key, pd, len);
+
+    case ETHERTYPE_IPv6:
+        return flow_key_ipv6(key, pd, len);
+
+    default:
+        return false;
+    }
+}
+
+static bool
+flow_key_ethernet(flow_key_t *key, const uint8_t *pd, unsigned len)
+{
+    unsigned offset = 12;
+    uint16_t ethertype;
+
+    if (len < 14)
+        return false;
+    ethertype = pntoh16(pd + offset);
+    offset += 2;
+    /* Skip any 802.1Q / 802.1ad tags. */
+    while (ethertype == ETHERTYPE_VLAN || ethertype == ETHERTYPE_IEEE_8021AD ||
+           ethertype == ETHERTYPE_QINQ_OLD) {
+        if (offset + 4 > len)
+            return false;
+        ethertype = pntoh16(pd + offset + 2);
+        offset += 4;
+    }
+    return flow_key_ethertype(key, ethertype, pd + offset, len - offset);
+}
+
+static bool
+flow_key_raw_ip(flow_key_t *key, const uint8_t *pd, unsigned len)
+{
+    if (len < 1)
+        return false;
+    switch (pd[0] >> 4) {
+
+    case 4:
+        return flow_key_ipv4(key, pd, len);
+
+    case 6:
+        return flow_key_ipv6(key, pd, len);
+
+    default:
+        return false;
+    }
+}
+
+static bool
+flow_key_bsd_loopback(flow_key_t *key, uint32_t af, const uint8_t *pd, unsigned len)
+{
+    switch (af) {
+
+    case BSD_AF_INET:
+        return flow_key_ipv4(key, pd, len);
+
+    case BSD_AF_INET6_BSD:
+    case BSD_AF_INET6_FREEBSD:
+    case BSD_AF_INET6_DARWIN:
+    case LINUX_AF_INET6:
+        return flow_key_ipv6(key, pd, len);
+
+    default:
+        return false;
+    }
+}
+
+static bool
+flow_key_from_rec(flow_key_t *key, const wtap_rec *rec)
+{
+    const uint8_t *pd;
+    unsigned len;
+
+    if (rec->rec_type != REC_TYPE_PACKET)
+        return false;
+
+    pd = ws_buffer_start_ptr(&rec->data);
+    len = rec->rec_header.packet_header.caplen;
+
+    switch (rec->rec_header.packet_header.pkt_encap) {
+
+    case WTAP_ENCAP_ETHERNET:
+        return flow_key_ethernet(key, pd, len);
+
+    case WTAP_ENCAP_RAW_IP:
+    case WTAP_ENCAP_RAW_IP4:
+    case WTAP_ENCAP_RAW_IP6:
+        return flow_key_raw_ip(key, pd, len);
+
+    case WTAP_ENCAP_SLL:
+        if (len < 16)
+            return false;
+        return flow_key_ethertype(key, pntoh16(pd + 14), pd + 16, len - 16);
+
+    case WTAP_ENCAP_SLL2:
+        if (len < 20)
+            return false;
+        return flow_key_ethertype(key, pntoh16(pd), pd + 20, len - 20);
+
+    case WTAP_ENCAP_NULL:
+        /* The address family is in the byte order of the capturing host. */
+        if (len < 4)
+            return false;
+        return flow_key_bsd_loopback(key, pletoh32(pd), pd + 4, len - 4) ||
+               flow_key_bsd_loopback(key, pntoh32(pd), pd + 4, len - 4);
+
+    case WTAP_ENCAP_LOOP:
+        if (len < 4)
+            return false;
+        return flow_key_bsd_loopback(key, pntoh32(pd), pd + 4, len - 4);
+
+    default:
+        return false;
+    }
+}
+
+/* FNV-1a; stable across processes and platforms, unlike the wmem hashes. */
+static uint32_t
+flow_hash_bytes(uint32_t hash, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+bool
+flow_shard_hash(const wtap_rec *rec, uint32_t *hash)
+{
+    flow_key_t key;
+    unsigned lo, hi;
+    uint32_t h = 2166136261U;
+
+    memset(&key, 0, sizeof key);
+    if (!flow_key_from_rec(&key, rec))
+        return false;
+
+    /* Hash the endpoints in a canonical order, so the hash is symmetric. */
+    lo = (memcmp(key.addr[0], key.addr[1], key.addr_len) <= 0) ? 0 : 1;
+    hi = 1 - lo;
+
+    h = flow_hash_bytes(h, &key.proto, 1);
+    h = flow_hash_bytes(h, key.addr[lo], key.addr_len);
+    h = flow_hash_bytes(h, key.addr[hi], key.addr_len);
+
+    /* FNV-1a's low bits are weak; fold in the high bits before "mod N". */
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+
+    *hash = h;
+    return true;
+}
+
+bool
+flow_shard_selected(const flow_shard_t *shard, const wtap_rec *rec)
+{
+    uint32_t hash;
+
+    if (shard->count <= 1)
+        return true;
+    if (!flow_shard_hash(rec, &hash))
+        return shard->index == 0;
+    return hash % shard->count == shard->index;
+}
+
@@ -0,0 +1,67 @@
+/** @file
+ *
+ * Assign capture records to flow shards, so that several processes can
+ * each dissect a disjoint set of flows from the same capture file.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef __FLOW_SHARD_H__
+#define __FLOW_SHARD_H__
+
+#include <wiretap/wtap.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Which shard to process, out of how many. */
+typedef struct {
+    unsigned index;     /**< 0-based index of the selected shard */
+    unsigned count;     /**< total number of shards; 0 or 1 means "no sharding" */
+} flow_shard_t;
+
+/**
+ * Parse a shard specification of the form "K/N", where 1 <= K <= N.
+ *
+ * @param spec The specification.
+ * @param shard Filled in on success.
+ * @return NULL on success or an error description on failure.
+ */
+const char *flow_shard_parse(const char *spec, flow_shard_t *shard);
+
+/**
+ * Compute the flow hash of a record.
+ *
+ * The addresses and upper-layer protocol of the record's outer IPv4/IPv6
+ * header are hashed in a direction-independent way, so both directions of
+ * a flow get the same hash. Ports are not hashed, so that every fragment
+ * of a datagram gets the same hash as an unfragmented datagram of the same
+ * flow. The hash does not depend on the process or the platform.
+ *
+ * @param rec The record, with its packet data.
+ * @param hash Set to the flow hash if the record carries IP.
+ * @return true if the record carries IP, false otherwise.
+ */
+bool flow_shard_hash(const wtap_rec *rec, uint32_t *hash);
+
+/**
+ * Check whether a record belongs to the selected shard. Records that
+ * don't carry IP (ARP, spanning tree, ...) belong to the first shard,
+ * so that every record is processed by exactly one shard.
+ *
+ * @param shard The selected shard.
+ * @param rec The record, with its packet data.
+ * @return true if the record should be processed.
+ */
+bool flow_shard_selected(const flow_shard_t *shard, const wtap_rec *rec);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FLOW_SHARD_H__ */
@@ -0,0 +1,349 @@
+/* packet_index.c
+ * Persistent packet index ("sidecar") for capture files, so that a large
+ * capture file can be reopened without reading it sequentially
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+#define WS_LOG_DOMAIN LOG_DOMAIN_MAIN
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <glib.h>
+
+#include <epan/frame_data.h>
+#include <epan/frame_data_sequence.h>
+#include <wiretap/wtap.h>
+#include <wsutil/crc32.h>
+#include <wsutil/file_util.h>
+#include <wsutil/pint.h>
+#include <wsutil/wslog.h>
+
+#include "ui/packet_index.h"
+
+/*
+ * The index is a header followed by one record per frame, all in
+ * little-endian byte order:
+ *
+ *  header:
+ *     0  magic
+ *     8  version
+ *    12  number of interfaces
+ *    16  number of frames
+ *    20  checksum of the start and the end of the capture file
+ *    24  size of the capture file
+ *    32  modification time of the capture file
+ *    40  elapsed time, seconds
+ *    48  elapsed time, nanoseconds
+ *    52  size of a frame record
+ *    56  reserved
+ *
+ *  frame record:
+ *     0  file offset
+ *     8  absolute time stamp, seconds
+ *    16  absolute time stamp, nanoseconds
+ *    20  packet length
+ *    24  captured length
+ *    28  cumulative bytes
+ *    32  previous reference frame
+ *    36  previous displayed frame
+ *    40  flags
+ *    44  reserved
+ */
+static const uint8_t packet_index_magic[8] = { 'w', 's', 'i', 'd', 'x', '\r', '\n', 0x1a };
+
+#define PACKET_INDEX_VERSION        1
+#define PACKET_INDEX_HEADER_LEN     64
+#define PACKET_INDEX_RECORD_LEN     48
+
+#define PACKET_INDEX_HAS_TS         0x00000001
+#define PACKET_INDEX_ENCODING       0x00000002
+#define PACKET_INDEX_TSPREC_SHIFT   8
+#define PACKET_INDEX_TSPREC_MASK    0x00000f00
+
+/* How much of each end of the capture file goes into the checksum. */
+#define PACKET_INDEX_CHECKSUM_LEN   65536
+
+typedef struct {
+    uint64_t file_size;
+    int64_t mtime;
+    uint32_t checksum;
+} capture_file_id_t;
+
+char *
+packet_index_filename(const char *filename)
+{
+    return g_strconcat(filename, PACKET_INDEX_SUFFIX, NULL);
+}
+
+/*
+ * We can only skip the sequential pass for file types whose random access
+ * reads don't depend on anything but what was seen before the first
+ * record, and only if the file isn't compressed, as seeking in a
+ * compressed file relies on the fast seek points collected during the
+ * sequential pass.
+ */
+static bool
+packet_index_supported(wtap *wth)
+{
+    int file_type_subtype = wtap_file_type_subtype(wth);
+
+    if (file_type_subtype != wtap_pcap_file_type_subtype() &&
+        file_type_subtype != wtap_pcap_nsec_file_type_subtype() &&
+        file_type_subtype != wtap_pcapng_file_type_subtype())
+        return false;
+
+    if (wtap_get_compression_type(wth) != WTAP_UNCOMPRESSED)
+        return false;
+
+    return wtap_file_get_num_shbs(wth) <= 1;
+}
+
+static unsigned
+packet_index_num_interfaces(wtap *wth)
+{
+    wtapng_iface_descriptions_t *idb_info;
+    unsigned num_interfaces;
+
+    idb_info = wtap_file_get_idb_info(wth);
+    num_interfaces = idb_info->interface_data->len;
+    g_free(idb_info);
+    return num_interfaces;
+}
+
+static bool
+capture_file_get_id(const char *filename, capture_file_id_t *id)
+{
+    ws_statb64 st;
+    FILE *fh;
+    uint8_t *buf;
+    size_t len;
+    bool ok = false;
+
+    if (ws_stat64(filename, &st) != 0)
+        return false;
+    id->file_size = st.st_size;
+    id->mtime = st.st_mtime;
+
+    fh = ws_fopen(filename, "rb");
+    if (fh == NULL)
+        return false;
+
+    buf = g_malloc(PACKET_INDEX_CHECKSUM_LEN);
+    len = fread(buf, 1, PACKET_INDEX_CHECKSUM_LEN, fh);
+    id->checksum = crc32_ccitt_seed(buf, (unsigned)len, 0xffffffff);
+    if (id->file_size > 2 * PACKET_INDEX_CHECKSUM_LEN) {
+        if (ws_fseek64(fh, -PACKET_INDEX_CHECKSUM_LEN, SEEK_END) != 0)
+            goto done;
+        len = fread(buf, 1, PACKET_INDEX_CHECKSUM_LEN, fh);
+        id->checksum = crc32_ccitt_seed(buf, (unsigned)len, id->checksum);
+    }
+    ok = !ferror(fh);
+
+done:
+    g_free(buf);
+    fclose(fh);
+    return ok;
+}
+
+bool
+packet_index_save(capture_file *cf)
+{
+    wtap *wth = cf->provider.wth;
+    capture_file_id_t id;
+    char *index_name, *tmp_name;
+    uint8_t header[PACKET_INDEX_HEADER_LEN];
+    uint8_t record[PACKET_INDEX_RECORD_LEN];
+    FILE *fh;
+    bool ok;
+
+    if (wth == NULL || !packet_index_supported(wth))
+        return false;
+
+    /*
+     * Name resolution and decryption secrets blocks are only handed to
+     * epan when they are read sequentially.
+     */
+    if (wtap_file_get_nrb(wth) != NULL || wtap_file_get_num_dsbs(wth) != 0)
+        return false;
+
+    if (!capture_file_get_id(cf->filename, &id))
+        return false;
+
+    memset(header, 0, sizeof header);
+    memcpy(header, packet_index_magic, sizeof packet_index_magic);
+    phtole32(header + 8, PACKET_INDEX_VERSION);
+    phtole32(header + 12, packet_index_num_interfaces(wth));
+    phtole32(header + 16, cf->count);
+    phtole32(header + 20, id.checksum);
+    phtole64(header + 24, id.file_size);
+    phtole64(header + 32, (uint64_t)id.mtime);
+    phtole64(header + 40, (uint64_t)cf->elapsed_time.secs);
+    phtole32(header + 48, (uint32_t)cf->elapsed_time.nsecs);
+    phtole32(header + 52, PACKET_INDEX_RECORD_LEN);
+
+    /* Write to a temporary file, so a reader never sees a partial index. */
+    index_name = packet_index_filename(cf->filename);
+    tmp_name = g_strconcat(index_name, ".tmp", NULL);
+    fh = ws_fopen(tmp_name, "wb");
+    if (fh == NULL) {
+        ws_debug("Can't create %s: %s", tmp_name, g_strerror(errno));
+        g_free(tmp_name);
+        g_free(index_name);
+        return false;
+    }
+
+    ok = fwrite(header, sizeof header, 1, fh) == 1;
+    for (uint32_t framenum = 1; ok && framenum <= cf->count; framenum++) {
+        const frame_data *fd = frame_data_sequence_find(cf->provider.frames, framenum);
+        uint32_t flags = 0;
+
+        if (fd->has_ts)
+            flags |= PACKET_INDEX_HAS_TS;
+        if (fd->encoding)
+            flags |= PACKET_INDEX_ENCODING;
+        flags |= (fd->tsprec << PACKET_INDEX_TSPREC_SHIFT) & PACKET_INDEX_TSPREC_MASK;
+
+        memset(record, 0, sizeof record);
+        phtole64(record + 0, (uint64_t)fd->file_off);
+        phtole64(record + 8, (uint64_t)fd->abs_ts.secs);
+        phtole32(record + 16, (uint32_t)fd->abs_ts.nsecs);
+        phtole32(record + 20, fd->pkt_len);
+        phtole32(record + 24, fd->cap_len);
+        phtole32(record + 28, fd->cum_bytes);
+        phtole32(record + 32, fd->frame_ref_num);
+        phtole32(record + 36, fd->prev_dis_num);
+        phtole32(record + 40, flags);
+        ok = fwrite(record, sizeof record, 1, fh) == 1;
+    }
+    if (fclose(fh) != 0)
+        ok = false;
+
+    if (ok && ws_rename(tmp_name, index_name) != 0) {
+        ws_debug("Can't rename %s to %s: %s", tmp_name, index_name, g_strerror(errno));
+        ok = false;
+    }
+    if (!ok)
+        ws_unlink(tmp_name);
+
+    g_free(tmp_name);
+    g_free(index_name);
+    return ok;
+}
+
+bool
+packet_index_load(capture_file *cf)
+{
+    wtap *wth = cf->provider.wth;
+    capture_file_id_t id;
+    char *index_name;
+    GMappedFile *mapped;
+    const uint8_t *data, *record;
+    size_t len;
+    uint32_t count;
+    frame_data fdlocal;
+    bool ok = false;
+
+    /*
+     * The frames read so far must include the first one, so that
+     * everything that precedes it (the section header and interface
+     * descriptions, for pcapng) has been read.
+     */
+    if (wth == NULL || cf->count == 0 || !packet_index_supported(wth))
+        return false;
+
+    if (!capture_file_get_id(cf->filename, &id))
+        return false;
+
+    index_name = packet_index_filename(cf->filename);
+    mapped = g_mapped_file_new(index_name, false, NULL);
+    g_free(index_name);
+    if (mapped == NULL)
+        return false;
+
+    data = (const uint8_t *)g_mapped_file_get_contents(mapped);
+    len = g_mapped_file_get_length(mapped);
+
+    if (len < PACKET_INDEX_HEADER_LEN ||
+        memcmp(data, packet_index_magic, sizeof packet_index_magic) != 0 ||
+        pletoh32(data + 8) != PACKET_INDEX_VERSION ||
+        pletoh32(data + 52) != PACKET_INDEX_RECORD_LEN) {
+        ws_debug("%s" PACKET_INDEX_SUFFIX " is not a packet index", cf->filename);
+        goto done;
+    }
+
+    if (pletoh32(data + 20) != id.checksum ||
+        pletoh64(data + 24) != id.file_size ||
+        (int64_t)pletoh64(data + 32) != id.mtime) {
+        ws_debug("%s" PACKET_INDEX_SUFFIX " is out of date", cf->filename);
+        goto done;
+    }
+
+    count = pletoh32(data + 16);
+    if (count < cf->count ||
+        len != PACKET_INDEX_HEADER_LEN + (size_t)count * PACKET_INDEX_RECORD_LEN)
+        goto done;
+
+    /*
+     * If there are interfaces that were described after the first
+     * record, we can't read the records that use them at random.
+     */
+    if (pletoh32(data + 12) != packet_index_num_interfaces(wth))
+        goto done;
+
+    /* The frames we have must be the ones in the index. */
+    for (uint32_t framenum = 1; framenum <= cf->count; framenum++) {
+        const frame_data *fd = frame_data_sequence_find(cf->provider.frames, framenum);
+
+        record = data + PACKET_INDEX_HEADER_LEN + (size_t)(framenum - 1) * PACKET_INDEX_RECORD_LEN;
+        if ((int64_t)pletoh64(record) != fd->file_off)
+            goto done;
+    }
+
+    /* Check all of the offsets before adding any frame. */
+    for (uint32_t framenum = cf->count + 1; framenum <= count; framenum++) {
+        record = data + PACKET_INDEX_HEADER_LEN + (size_t)(framenum - 1) * PACKET_INDEX_RECORD_LEN;
+        if (pletoh64(record) >= id.file_size)
+            goto done;
+    }
+
+    for (uint32_t framenum = cf->count + 1; framenum <= count; framenum++) {
+        uint32_t flags;
+
+        record = data + PACKET_INDEX_HEADER_LEN + (size_t)(framenum - 1) * PACKET_INDEX_RECORD_LEN;
+        flags = pletoh32(record + 40);
+
+        memset(&fdlocal, 0, sizeof fdlocal);
+        fdlocal.num = framenum;
+        fdlocal.dis_num = framenum;
+        fdlocal.file_off = (int64_t)pletoh64(record + 0);
+        fdlocal.abs_ts.secs = (time_t)pletoh64(record + 8);
+        fdlocal.abs_ts.nsecs = (int)pletoh32(record + 16);
+        fdlocal.pkt_len = pletoh32(record + 20);
+        fdlocal.cap_len = pletoh32(record + 24);
+        fdlocal.cum_bytes = pletoh32(record + 28);
+        fdlocal.frame_ref_num = pletoh32(record + 32);
+        fdlocal.prev_dis_num = pletoh32(record + 36);
+        fdlocal.has_ts = (flags & PACKET_INDEX_HAS_TS) ? 1 : 0;
+        fdlocal.encoding = (flags & PACKET_INDEX_ENCODING) ? 1 : 0;
+        fdlocal.tsprec = (flags & PACKET_INDEX_TSPREC_MASK) >> PACKET_INDEX_TSPREC_SHIFT;
+        fdlocal.passed_dfilter = 1;
+        frame_data_sequence_add(cf->provider.frames, &fdlocal);
+    }
+
+    cf->count = count;
+    cf->elapsed_time.secs = (time_t)pletoh64(data + 40);
+    cf->elapsed_time.nsecs = (int)pletoh32(data + 48);
+    ok = true;
+
+done:
+    g_mapped_file_unref(mapped);
+    return ok;
+}
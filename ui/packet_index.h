@@ -0,0 +1,74 @@
+/** @file
+ *
+ * Persistent packet index ("sidecar") for capture files, so that a large
+ * capture file can be reopened without reading it sequentially
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef __PACKET_INDEX_H__
+#define __PACKET_INDEX_H__
+
+#include "cfile.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Suffix appended to a capture file's name to get its index's name. */
+#define PACKET_INDEX_SUFFIX ".wsidx"
+
+/**
+ * Get the name of the index of a capture file.
+ *
+ * @param filename The name of the capture file.
+ * @return The name of the index, which must be g_free'd.
+ */
+char *packet_index_filename(const char *filename);
+
+/**
+ * Write an index of a capture file that has been read completely.
+ *
+ * The index records the frame_data of every frame, the number of
+ * interfaces and the size, modification time and a checksum of the
+ * capture file, so that packet_index_load() can tell whether it is
+ * still valid. This is done only for capture files that
+ * packet_index_load() can reopen from an index; for other files, or
+ * if the index can't be written, nothing is written.
+ *
+ * Call this after the sequential pass, before wtap_sequential_close().
+ *
+ * @param cf The capture file.
+ * @return true if an index was written.
+ */
+bool packet_index_save(capture_file *cf);
+
+/**
+ * Load the rest of the frames of a capture file from its index instead of
+ * reading the file sequentially.
+ *
+ * Call this once the first frame has been read sequentially, so that
+ * everything that precedes it in the file (such as the interface
+ * descriptions) has been read. If it succeeds, this fills in the remaining
+ * frames of cf->provider.frames, cf->count and cf->elapsed_time, and the
+ * sequential pass can be stopped. Those frames have not been dissected,
+ * so the first dissection of each one is what builds the dissectors'
+ * per-conversation state. The caller must dissect them once in order,
+ * as the sequential pass would have, before it dissects any of them out
+ * of order, and call postseq_cleanup_all_protocols() only after that.
+ *
+ * @param cf The capture file, with at least its first frame read.
+ * @return true if the frames were loaded, false if there is no valid index
+ *         for the file, in which case the sequential pass must go on.
+ */
+bool packet_index_load(capture_file *cf);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __PACKET_INDEX_H__ */
@@ -258,19 +258,27 @@ struct wtap_reader {
     /* fast seeking */
     GPtrArray *fast_seek;
     void *fast_seek_cur;
+
+    /*
+     * Memory-mapped uncompressed file.  While out.buf points into the
+     * mapping, unmapped_out holds our own output buffer.
+     */
+    GMappedFile *map;           /* mapping of the file, or NULL */
+    unsigned char *unmapped_out; /* our output buffer, if out.buf is mapped */
 };
 
 /* Current read offset within a buffer. */
-static unsigned
+static int64_t
 offset_in_buffer(struct wtap_reader_buf *buf)
 {
     /* buf->next points to the next byte to read, and buf->buf points
        to the first byte in the buffer, so the difference between them
        is the offset.
 
-       This will fit in an unsigned int, because it can't be bigger
-       than the size of the buffer, which is an unsigned int. */
-    return (unsigned)(buf->next - buf->buf);
+       For our own buffers this is at most the size of the buffer, but
+       if the buffer is a mapping of the file it can be as large as the
+       file, so it's returned as a 64-bit value. */
+    return (int64_t)(buf->next - buf->buf);
 }
 
 /* Number of bytes of data that are in a buffer. */
@@ -504,9 +512,105 @@ fast_seek_reset(FILE_T state)
     }
 }
 
+/*
+ * Whether files may be read through a mapping; see wtap_set_file_mapping().
+ */
+static bool file_mapping_enabled;
+
+void
+wtap_set_file_mapping(bool enable)
+{
+    file_mapping_enabled = enable;
+}
+
+/*
+ * Try to map an uncompressed file into memory, so that the data can be
+ * handed out from the mapping rather than read into our buffers.
+ *
+ * This is only done if the program has said that the files it reads
+ * are complete (if a mapped file is truncated, accessing the part that
+ * was cut off raises SIGBUS on UN*X, which we can't recover from), and
+ * only for a regular file whose uncompressed data starts at the beginning
+ * of the file, so that a position in the uncompressed data is also an
+ * offset in the mapping.  Data appended to the file after it's been
+ * mapped is read with ws_read() as usual.
+ */
+static bool
+buf_map(FILE_T state)
+{
+    ws_statb64 st;
+
+    if (!file_mapping_enabled)
+        return false;
+    if (state->start != 0 || state->pos != 0)
+        return false;
+    if (state->map == NULL) {
+        if (ws_fstat64(state->fd, &st) == -1 || !S_ISREG(st.st_mode) ||
+            st.st_size == 0)
+            return false;
+        state->map = g_mapped_file_new_from_fd(state->fd, false, NULL);
+        if (state->map == NULL)
+            return false;
+        if (g_mapped_file_get_length(state->map) == 0) {
+            g_mapped_file_unref(state->map);
+            state->map = NULL;
+            return false;
+        }
+    }
+
+    if (state->unmapped_out == NULL) {
+        state->unmapped_out = state->out.buf;
+        state->out.buf = (unsigned char *)g_mapped_file_get_contents(state->map);
+    }
+    return true;
+}
+
+/* Go back to reading into our own output buffer, discarding its contents. */
+static void
+buf_unmap(FILE_T state)
+{
+    if (state->unmapped_out != NULL) {
+        state->out.buf = state->unmapped_out;
+        state->unmapped_out = NULL;
+    }
+    buf_reset(&state->out);
+}
+
 static bool
 uncompressed_fill_out_buffer(FILE_T state)
 {
+    if (state->unmapped_out != NULL) {
+        int64_t map_len = (int64_t)g_mapped_file_get_length(state->map);
+
+        if (state->raw_pos < map_len) {
+            /*
+             * Hand out the next part of the mapping, without copying it.
+             * out.buf is the start of the mapping, so the whole file
+             * before the current position is "in the buffer", and seeking
+             * backwards, or forwards within this part, is just pointer
+             * arithmetic.
+             */
+            int64_t avail = map_len - state->raw_pos;
+
+            if (avail > MAX_READ_BUF_SIZE)
+                avail = MAX_READ_BUF_SIZE;
+            state->out.next = state->out.buf + state->raw_pos;
+            state->out.avail = (unsigned)avail;
+            state->raw_pos += avail;
+            return true;
+        }
+
+        /*
+         * We've handed out all of the mapping; read whatever has been
+         * appended to the file since it was mapped.
+         */
+        buf_unmap(state);
+        if (ws_lseek64(state->fd, state->raw_pos, SEEK_SET) == -1) {
+            state->err = errno;
+            state->err_info = NULL;
+            return false;
+        }
+    }
     if (buf_read(state, &state->out) < 0)
         return false;
     return true;
@@ -1473,6 +1577,16 @@ check_for_compression(FILE_T state)
        the input buffer, which also assures space for gzungetc() */
     state->raw = state->pos;
     state->out.next = state->out.buf;
+    if (buf_map(state)) {
+        /* the data will come from the mapping, starting at the beginning
+           of the file, so just discard what's in the input buffer */
+        buf_reset(&state->in);
+        buf_reset(&state->out);
+        state->raw_pos = 0;
+        state->eof = false;
+        state->compression = UNCOMPRESSED;
+        return 0;
+    }
     /* not a compressed file -- copy everything we've read into the
        input buffer to the output buffer and fall to raw i/o */
     if (state->in.avail) {
@@ -1584,7 +1698,7 @@ gz_skip(FILE_T state, int64_t len)
 static void
 gz_reset(FILE_T state)
 {
-    buf_reset(&state->out);       /* no output data available */
+    buf_unmap(state);             /* no output data available */
     state->eof = false;           /* not at end of file */
     state->compression = UNKNOWN; /* look for compression header */
 
@@ -1900,6 +2014,26 @@ file_seek(FILE_T file, int64_t offset, int whence, int *err)
          * buffer that we can seek backwards within the buffer?
          */
         if (-offset <= offset_in_buffer(&file->out)) {
+            if (file->unmapped_out != NULL) {
+                /*
+                 * We're reading from a mapping, which starts at the
+                 * beginning of the file, so the target is at that
+                 * offset in the mapping.  The distance can be larger
+                 * than an unsigned, so don't just add it to out.avail;
+                 * hand out the mapping again from the target onward.
+                 */
+                int64_t target = file->pos + offset;
+                int64_t avail = file->raw_pos - target;
+
+                if (avail > MAX_READ_BUF_SIZE)
+                    avail = MAX_READ_BUF_SIZE;
+                file->out.next = file->out.buf + target;
+                file->out.avail = (unsigned)avail;
+                file->raw_pos = target + avail;
+                file->pos = target;
+                return file->pos;
+            }
+
             /*
              * Yes.  Adjust appropriately.
              *
@@ -2134,9 +2268,11 @@ file_seek(FILE_T file, int64_t offset, int whence, int *err)
         && (file->fast_seek != NULL))
     {
         /*
-         * Yes.  Just seek there within the file.
+         * Yes.  Just seek there within the file.  (If we're reading
+         * from a mapping, the descriptor's offset isn't raw_pos, so
+         * don't seek relative to it.)
          */
-        if (ws_lseek64(file->fd, offset - file->out.avail, SEEK_CUR) == -1) {
+        if (ws_lseek64(file->fd, file->raw_pos + (offset - file->out.avail), SEEK_SET) == -1) {
             *err = errno;
             return -1;
         }
@@ -2212,6 +2348,12 @@ file_tell(FILE_T stream)
 int64_t
 file_tell_raw(FILE_T stream)
 {
+    /*
+     * If we're reading from a mapping, raw_pos is the end of the part
+     * we've handed out, which can be far beyond what's been read.
+     */
+    if (stream->unmapped_out != NULL)
+        return stream->pos;
     return stream->raw_pos;
 }
 
@@ -2515,6 +2657,19 @@ file_clearerr(FILE_T stream)
 void
 file_fdclose(FILE_T file)
 {
+    /*
+     * The mapping keeps the file open (and, on Windows, prevents it
+     * from being renamed), so drop it; continue with ws_read() from
+     * where we are now.
+     */
+    if (file->unmapped_out != NULL) {
+        buf_unmap(file);
+        file->raw_pos = file->pos;
+    }
+    if (file->map != NULL) {
+        g_mapped_file_unref(file->map);
+        file->map = NULL;
+    }
     if (file->fd != -1)
         ws_close(file->fd);
     file->fd = -1;
@@ -2527,6 +2682,10 @@ file_fdreopen(FILE_T file, const char *path)
 
     if ((fd = ws_open(path, O_RDONLY|O_BINARY, 0000)) == -1)
         return false;
+    if (file->raw_pos != 0 && ws_lseek64(fd, file->raw_pos, SEEK_SET) == -1) {
+        ws_close(fd);
+        return false;
+    }
     file->fd = fd;
     return true;
 }
@@ -2547,9 +2706,12 @@ file_close(FILE_T file)
 #ifdef HAVE_LZ4FRAME_H
         LZ4F_freeDecompressionContext(file->lz4_dctx);
 #endif /* HAVE_LZ4FRAME_H */
+        buf_unmap(file);
         g_free(file->out.buf);
         g_free(file->in.buf);
     }
+    if (file->map != NULL)
+        g_mapped_file_unref(file->map);
     g_free(file->fast_seek_cur);
     file->err = 0;
     file->err_info = NULL;
@@ -18,6 +18,7 @@
 #include "merge.h"
 
 #include <stdlib.h>
+#include <limits.h>
 #include <errno.h>
 
 #ifndef _WIN32
@@ -303,27 +304,152 @@ merge_select_frame_type(const int file_type, int in_file_count, merge_in_file_t
 }
 
 /*
- * returns true if first argument is earlier than second
+ * State for reading records from the input files.
+ */
+typedef struct {
+    /*
+     * The files that have a record present, as a binary heap, with
+     * the file whose record is to be written next at the top.
+     */
+    merge_in_file_t **heap;
+    unsigned heap_len;
+    /*
+     * When merging, the index of the next file whose first record has
+     * to be read; when appending, the index of the file being read.
+     */
+    unsigned next_file;
+    /* File from which a record was returned, and which needs another one. */
+    merge_in_file_t *refill;
+    /* Files read from since the last check for new IDBs: [read_first, read_end) */
+    unsigned read_first;
+    unsigned read_end;
+} merge_read_state_t;
+
+static void
+merge_read_state_init(merge_read_state_t *rs, unsigned in_file_count, bool do_append)
+{
+    rs->heap = do_append ? NULL : g_new(merge_in_file_t *, in_file_count);
+    rs->heap_len = 0;
+    rs->next_file = 0;
+    rs->refill = NULL;
+    rs->read_first = UINT_MAX;
+    rs->read_end = 0;
+}
+
+static void
+merge_read_state_cleanup(merge_read_state_t *rs)
+{
+    g_free(rs->heap);
+    rs->heap = NULL;
+}
+
+/*
+ * Read the next record from a file, noting that the file may now have new
+ * IDBs. Returns false on a read error.
  */
 static bool
-is_earlier(nstime_t *l, nstime_t *r) /* XXX, move to nstime.c */
+merge_read_next(merge_read_state_t *rs, merge_in_file_t in_files[],
+                merge_in_file_t *in_file, int *err, char **err_info)
 {
-    if (l->secs > r->secs) {  /* left is later */
-        return false;
-    } else if (l->secs < r->secs) { /* left is earlier */
-        return true;
-    } else if (l->nsecs > r->nsecs) { /* tv_sec equal, l.usec later */
-        return false;
-    }
-    /* either one < two or one == two
-     * either way, return one
-     */
+    unsigned i = (unsigned)(in_file - in_files);
+    int64_t data_offset;
+
+    rs->read_first = MIN(rs->read_first, i);
+    rs->read_end = MAX(rs->read_end, i + 1);
+
+    if (!wtap_read(in_file->wth, &in_file->rec, err, err_info, &data_offset)) {
+        if (*err != 0) {
+            in_file->state = GOT_ERROR;
+            return false;
+        }
+        in_file->state = AT_EOF;
+    } else
+        in_file->state = RECORD_PRESENT;
     return true;
 }
 
+/*
+ * Returns true if the present record of the first file is to be written
+ * before that of the second.
+ *
+ * Records with no time stamp are treated as earlier than all other records.
+ * Yes, this means you won't get a chronological merge of those records,
+ * but you obviously *can't* get that. Ties go to the first such file for
+ * records with no time stamp, and to the last such file for records with
+ * the same time stamp, as they always have.
+ */
+static bool
+merge_rec_precedes(const merge_in_file_t *a, const merge_in_file_t *b)
+{
+    bool a_has_ts = (a->rec.presence_flags & WTAP_HAS_TS) != 0;
+    bool b_has_ts = (b->rec.presence_flags & WTAP_HAS_TS) != 0;
+
+    if (!a_has_ts || !b_has_ts) {
+        if (a_has_ts != b_has_ts)
+            return !a_has_ts;
+        return a < b;
+    }
+    if (a->rec.ts.secs != b->rec.ts.secs)
+        return a->rec.ts.secs < b->rec.ts.secs;
+    if (a->rec.ts.nsecs != b->rec.ts.nsecs)
+        return a->rec.ts.nsecs < b->rec.ts.nsecs;
+    return a > b;
+}
+
+static void
+merge_heap_sift_up(merge_read_state_t *rs, unsigned i)
+{
+    merge_in_file_t *in_file = rs->heap[i];
+
+    while (i > 0) {
+        unsigned parent = (i - 1) / 2;
+
+        if (!merge_rec_precedes(in_file, rs->heap[parent]))
+            break;
+        rs->heap[i] = rs->heap[parent];
+        i = parent;
+    }
+    rs->heap[i] = in_file;
+}
+
+static void
+merge_heap_sift_down(merge_read_state_t *rs, unsigned i)
+{
+    merge_in_file_t *in_file = rs->heap[i];
+
+    for (;;) {
+        unsigned child = 2 * i + 1;
+
+        if (child >= rs->heap_len)
+            break;
+        if (child + 1 < rs->heap_len &&
+            merge_rec_precedes(rs->heap[child + 1], rs->heap[child]))
+            child++;
+        if (!merge_rec_precedes(rs->heap[child], in_file))
+            break;
+        rs->heap[i] = rs->heap[child];
+        i = child;
+    }
+    rs->heap[i] = in_file;
+}
+
+static void
+merge_heap_remove_top(merge_read_state_t *rs)
+{
+    rs->heap[0] = rs->heap[--rs->heap_len];
+    if (rs->heap_len != 0)
+        merge_heap_sift_down(rs, 0);
+}
+
 /** Read the next packet, in chronological order, from the set of files to
  * be merged.
  *
+ * The files with a record present are kept in a heap ordered by the time
+ * stamp of that record, so this takes O(log n) time for n files, rather
+ * than O(n). If the files don't overlap in time, as with the files of a
+ * ring buffer, the file just read from stays at the top of the heap, and
+ * that takes only a comparison or two per record.
+ *
  * On success, set *err to 0 and return a pointer to the merge_in_file_t
  * for the file from which the packet was read.
  *
@@ -333,6 +459,7 @@ is_earlier(nstime_t *l, nstime_t *r) /* XXX, move to nstime.c */
  * On an EOF (meaning all the files are at EOF), set *err to 0 and return
  * NULL.
  *
+ * @param rs read state
  * @param in_file_count number of entries in in_files
  * @param in_files input file array
  * @param err wiretap error, if failed
@@ -342,79 +469,60 @@ is_earlier(nstime_t *l, nstime_t *r) /* XXX, move to nstime.c */
  * all files
  */
 static merge_in_file_t *
-merge_read_packet(int in_file_count, merge_in_file_t in_files[],
-                  int *err, char **err_info)
+merge_read_packet(merge_read_state_t *rs, unsigned in_file_count,
+                  merge_in_file_t in_files[], int *err, char **err_info)
 {
-    int i;
-    int ei = -1;
-    nstime_t tv = NSTIME_INIT_MAX;
-    wtap_rec *rec;
+    merge_in_file_t *in_file;
+
+    /* Read the first record of each file that we haven't read from yet. */
+    while (rs->next_file < in_file_count) {
+        in_file = &in_files[rs->next_file++];
+        if (!merge_read_next(rs, in_files, in_file, err, err_info))
+            return in_file;
+        if (in_file->state == RECORD_PRESENT) {
+            rs->heap[rs->heap_len++] = in_file;
+            merge_heap_sift_up(rs, rs->heap_len - 1);
+        }
+    }
 
     /*
-     * Make sure we have a record available from each file that's not at
-     * EOF, and search for the record with the earliest time stamp or
-     * with no time stamp (those records are treated as earlier than
-     * all other records).  Yes, this means you won't get a chronological
-     * merge of those records, but you obviously *can't* get that.
+     * Replace the record we returned last time, which was at the top
+     * of the heap, with the next one from the same file.
      */
-    for (i = 0; i < in_file_count; i++) {
-        int64_t data_offset;
-
-        if (in_files[i].state == RECORD_NOT_PRESENT) {
-            /*
-             * No packet available, and we haven't seen an error or EOF yet,
-             * so try to read the next packet.
-             */
-            if (!wtap_read(in_files[i].wth, &in_files[i].rec, err, err_info,
-                           &data_offset)) {
-                if (*err != 0) {
-                    in_files[i].state = GOT_ERROR;
-                    return &in_files[i];
-                }
-                in_files[i].state = AT_EOF;
-            } else
-                in_files[i].state = RECORD_PRESENT;
-        }
-
-        if (in_files[i].state == RECORD_PRESENT) {
-            rec = &in_files[i].rec;
-            if (!(rec->presence_flags & WTAP_HAS_TS)) {
-                /*
-                 * No time stamp.  Pick this record, and stop looking.
-                 */
-                ei = i;
-                break;
-            }
-            if (is_earlier(&rec->ts, &tv)) {
-                /*
-                 * This record's time stamp is earlier than any of the
-                 * records we've seen so far.  Pick it, for now, but
-                 * keep looking.
-                 */
-                tv = rec->ts;
-                ei = i;
-            }
+    if (rs->refill != NULL) {
+        in_file = rs->refill;
+        rs->refill = NULL;
+        ws_assert(rs->heap[0] == in_file);
+        if (!merge_read_next(rs, in_files, in_file, err, err_info)) {
+            merge_heap_remove_top(rs);
+            return in_file;
         }
+        if (in_file->state == RECORD_PRESENT)
+            merge_heap_sift_down(rs, 0);
+        else
+            merge_heap_remove_top(rs);
     }
 
-    if (ei == -1) {
+    if (rs->heap_len == 0) {
         /* All the streams are at EOF.  Return an EOF indication. */
         *err = 0;
         return NULL;
     }
 
     /* We'll need to read another packet from this file. */
-    in_files[ei].state = RECORD_NOT_PRESENT;
+    in_file = rs->heap[0];
+    in_file->state = RECORD_NOT_PRESENT;
+    rs->refill = in_file;
 
     /* Count this packet. */
-    in_files[ei].packet_num++;
+    in_file->packet_num++;
 
     /*
      * Return a pointer to the merge_in_file_t of the file from which the
      * packet was read.
      */
     *err = 0;
-    return &in_files[ei];
+    return in_file;
 }
 
 /** Read the next packet, in file sequence order, from the set of files
@@ -429,6 +537,7 @@ merge_read_packet(int in_file_count, merge_in_file_t in_files[],
  * On an EOF (meaning all the files are at EOF), set *err to 0 and return
  * NULL.
  *
+ * @param rs read state
  * @param in_file_count number of entries in in_files
  * @param in_files input file array
  * @param err wiretap error, if failed
@@ -438,41 +547,32 @@ merge_read_packet(int in_file_count, merge_in_file_t in_files[],
  * all files
  */
 static merge_in_file_t *
-merge_append_read_packet(int in_file_count, merge_in_file_t in_files[],
-                         int *err, char **err_info)
+merge_append_read_packet(merge_read_state_t *rs, unsigned in_file_count,
+                         merge_in_file_t in_files[], int *err, char **err_info)
 {
-    int i;
-    int64_t data_offset;
+    merge_in_file_t *in_file;
 
     /*
-     * Find the first file not at EOF, and read the next packet from it.
+     * Read the next packet from the first file not at EOF; the files
+     * before rs->next_file are all at EOF.
      */
-    for (i = 0; i < in_file_count; i++) {
-        if (in_files[i].state == AT_EOF)
-            continue; /* This file is already at EOF */
-        if (wtap_read(in_files[i].wth, &in_files[i].rec, err, err_info,
-                      &data_offset))
-            break; /* We have a packet */
-        if (*err != 0) {
+    for (; rs->next_file < in_file_count; rs->next_file++) {
+        in_file = &in_files[rs->next_file];
+        if (!merge_read_next(rs, in_files, in_file, err, err_info)) {
             /* Read error - quit immediately. */
-            in_files[i].state = GOT_ERROR;
-            return &in_files[i];
+            return in_file;
         }
-        /* EOF - flag this file as being at EOF, and try the next one. */
-        in_files[i].state = AT_EOF;
-    }
-    if (i == in_file_count) {
-        /* All the streams are at EOF.  Return an EOF indication. */
-        *err = 0;
-        return NULL;
+        if (in_file->state == RECORD_PRESENT) {
+            /* We have a packet */
+            *err = 0;
+            return in_file;
+        }
+        /* EOF - try the next one. */
     }
 
-    /*
-     * Return a pointer to the merge_in_file_t of the file from which the
-     * packet was read.
-     */
+    /* All the streams are at EOF.  Return an EOF indication. */
     *err = 0;
-    return &in_files[i];
+    return NULL;
 }
 
 
@@ -838,13 +938,14 @@ add_idb_to_merged_file(wtapng_iface_descriptions_t *merged_idb_list,
  * input files while processing.
  */
 static bool
-process_new_idbs(wtap_dumper *pdh, merge_in_file_t *in_files, const unsigned in_file_count, const idb_merge_mode mode, wtapng_iface_descriptions_t *merged_idb_list, int *err, char **err_info)
+process_new_idbs(wtap_dumper *pdh, merge_in_file_t *in_files, const unsigned first, const unsigned end, const idb_merge_mode mode, wtapng_iface_descriptions_t *merged_idb_list, int *err, char **err_info)
 {
     wtap_block_t                 input_file_idb;
     unsigned                     itf_count, merged_index;
     unsigned                     i;
 
-    for (i = 0; i < in_file_count; i++) {
+    /* Only files in [first, end) can have IDBs we haven't seen yet. */
+    for (i = first; i < end; i++) {
 
         /*
          * The number below is the global interface number within wth,
@@ -1028,18 +1129,21 @@ merge_process_packets(wtap_dumper *pdh, const int file_type,
 {
     merge_result        status = MERGE_OK;
     merge_in_file_t    *in_file;
+    merge_read_state_t  rs;
     int                 count = 0;
     bool                stop_flag = false;
 
+    merge_read_state_init(&rs, in_file_count, do_append);
+
     for (;;) {
         *err = 0;
 
         if (do_append) {
-            in_file = merge_append_read_packet(in_file_count, in_files, err,
-                                               err_info);
+            in_file = merge_append_read_packet(&rs, in_file_count, in_files,
+                                               err, err_info);
         }
         else {
-            in_file = merge_read_packet(in_file_count, in_files, err,
+            in_file = merge_read_packet(&rs, in_file_count, in_files, err,
                                         err_info);
         }
 
@@ -1082,10 +1186,12 @@ merge_process_packets(wtap_dumper *pdh, const int file_type,
 
         if (wtap_file_type_subtype_supports_block(file_type,
                                                   WTAP_BLOCK_IF_ID_AND_INFO) != BLOCK_NOT_SUPPORTED) {
-            if (!process_new_idbs(pdh, in_files, in_file_count, mode, idb_inf, err, err_info)) {
+            if (!process_new_idbs(pdh, in_files, rs.read_first, rs.read_end, mode, idb_inf, err, err_info)) {
                 status = MERGE_ERR_CANT_WRITE_OUTFILE;
                 break;
             }
+            rs.read_first = UINT_MAX;
+            rs.read_end = 0;
         }
 
         /*
@@ -1146,6 +1252,8 @@ merge_process_packets(wtap_dumper *pdh, const int file_type,
         wtap_rec_reset(&in_file->rec);
     }
 
+    merge_read_state_cleanup(&rs);
+
     if (cb)
         cb->callback_func(MERGE_EVENT_DONE, count, in_files, in_file_count, cb->data);
 
@@ -1153,7 +1261,7 @@ merge_process_packets(wtap_dumper *pdh, const int file_type,
         /* Check for IDBs, NRBs, or DSBs read after the last packet records. */
         if (wtap_file_type_subtype_supports_block(file_type,
                                                   WTAP_BLOCK_IF_ID_AND_INFO) != BLOCK_NOT_SUPPORTED) {
-            if (!process_new_idbs(pdh, in_files, in_file_count, mode, idb_inf, err, err_info)) {
+            if (!process_new_idbs(pdh, in_files, 0, in_file_count, mode, idb_inf, err, err_info)) {
                 status = MERGE_ERR_CANT_WRITE_OUTFILE;
             }
         }
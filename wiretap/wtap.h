@@ -1888,6 +1888,19 @@ WS_DLL_PUBLIC
 struct wtap* wtap_open_offline(const char *filename, unsigned int type, int *err,
     char **err_info, bool do_random);
 
+/**
+ * Allow uncompressed regular files opened after this call to be read
+ * through a memory mapping rather than with read() calls.
+ *
+ * This is off by default. Only turn it on if the files won't be truncated
+ * while they're open; reading from a mapping past the new end of the file
+ * raises SIGBUS on UN*X. Files that grow while they're open are fine.
+ *
+ * @param enable true to allow mapping files, false to always use read().
+ */
+WS_DLL_PUBLIC
+void wtap_set_file_mapping(bool enable);
+
 /**
  * If we were compiled with zlib and we're at EOF, unset EOF so that
  * wtap_read/gzread has a chance to succeed. This is necessary if
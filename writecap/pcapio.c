@@ -51,10 +51,36 @@
 
 typedef void* WFILE_T;
 
+/*
+ * When writing to an uncompressed file from a writer thread, data is
+ * collected in chunks of WRITER_CHUNK_SIZE bytes, and at most
+ * WRITER_NUM_CHUNKS chunks are in use at a time.
+ */
+#define WRITER_CHUNK_SIZE   (1024 * 1024)
+#define WRITER_NUM_CHUNKS   8
+
+typedef struct {
+    uint8_t *data;
+    size_t   len;
+} writer_chunk;
+
+/* Pushed to the writer thread to tell it to finish. */
+static writer_chunk writer_stop;
+
 struct pcapio_writer {
     WFILE_T fh;
     char* io_buffer;
     wtap_compression_type ctype;
+
+    /* writer thread, if any */
+    GThread *writer;
+    GAsyncQueue *full_chunks;   /* chunks to write, in order */
+    GAsyncQueue *free_chunks;   /* chunks that have been written */
+    writer_chunk *cur;          /* chunk being filled, if any */
+    GMutex writer_mtx;
+    GCond writer_cond;
+    unsigned pending;           /* chunks handed to the writer thread and not yet written */
+    int writer_err;             /* first error from the writer thread */
 };
 
 /* Magic numbers in "libpcap" files.
@@ -336,9 +362,148 @@ writecap_open_stdout(wtap_compression_type ctype, int *err)
     return pfile;
 }
 
+static void *
+writecap_writer_thread(void *arg)
+{
+    pcapio_writer *pfile = (pcapio_writer *)arg;
+    writer_chunk *chunk;
+    int err;
+
+    while ((chunk = (writer_chunk *)g_async_queue_pop(pfile->full_chunks)) != &writer_stop) {
+        err = 0;
+        if (fwrite(chunk->data, chunk->len, 1, (FILE *)pfile->fh) != 1) {
+            err = ferror((FILE *)pfile->fh) ? errno : WTAP_ERR_SHORT_WRITE;
+        } else if (fflush((FILE *)pfile->fh) == EOF) {
+            err = errno;
+        }
+        chunk->len = 0;
+        g_async_queue_push(pfile->free_chunks, chunk);
+
+        g_mutex_lock(&pfile->writer_mtx);
+        if (err != 0 && pfile->writer_err == 0) {
+            pfile->writer_err = err;
+        }
+        if (--pfile->pending == 0) {
+            g_cond_broadcast(&pfile->writer_cond);
+        }
+        g_mutex_unlock(&pfile->writer_mtx);
+    }
+    return NULL;
+}
+
+bool
+writecap_start_writer_thread(pcapio_writer* pfile)
+{
+    if (pfile->writer != NULL) {
+        return false;
+    }
+    switch (pfile->ctype) {
+#if defined (HAVE_ZLIB) || defined (HAVE_ZLIBNG)
+        case WTAP_GZIP_COMPRESSED:
+            return false;
+#endif
+#ifdef HAVE_LZ4FRAME_H
+        case WTAP_LZ4_COMPRESSED:
+            return false;
+#endif /* HAVE_LZ4FRAME_H */
+        default:
+            break;
+    }
+
+    pfile->full_chunks = g_async_queue_new();
+    pfile->free_chunks = g_async_queue_new();
+    for (int i = 0; i < WRITER_NUM_CHUNKS; i++) {
+        writer_chunk *chunk = g_new(writer_chunk, 1);
+
+        chunk->data = (uint8_t *)g_malloc(WRITER_CHUNK_SIZE);
+        chunk->len = 0;
+        g_async_queue_push(pfile->free_chunks, chunk);
+    }
+    g_mutex_init(&pfile->writer_mtx);
+    g_cond_init(&pfile->writer_cond);
+    pfile->writer = g_thread_new("pcapio writer", writecap_writer_thread, pfile);
+    return true;
+}
+
+/* Hand the chunk being filled to the writer thread. */
+static void
+writecap_submit_chunk(pcapio_writer* pfile)
+{
+    g_mutex_lock(&pfile->writer_mtx);
+    pfile->pending++;
+    g_mutex_unlock(&pfile->writer_mtx);
+    g_async_queue_push(pfile->full_chunks, pfile->cur);
+    pfile->cur = NULL;
+}
+
+static int
+writecap_writer_error(pcapio_writer* pfile)
+{
+    int err;
+
+    g_mutex_lock(&pfile->writer_mtx);
+    err = pfile->writer_err;
+    g_mutex_unlock(&pfile->writer_mtx);
+    return err;
+}
+
+/* Stop the writer thread, once it has written everything. */
+static int
+writecap_stop_writer_thread(pcapio_writer* pfile)
+{
+    writer_chunk *chunk;
+
+    if (pfile->cur != NULL && pfile->cur->len != 0) {
+        writecap_submit_chunk(pfile);
+    }
+    g_async_queue_push(pfile->full_chunks, &writer_stop);
+    g_thread_join(pfile->writer);
+    pfile->writer = NULL;
+
+    if (pfile->cur != NULL) {
+        g_async_queue_push(pfile->free_chunks, pfile->cur);
+        pfile->cur = NULL;
+    }
+    while ((chunk = (writer_chunk *)g_async_queue_try_pop(pfile->free_chunks)) != NULL) {
+        g_free(chunk->data);
+        g_free(chunk);
+    }
+    g_async_queue_unref(pfile->free_chunks);
+    g_async_queue_unref(pfile->full_chunks);
+    g_cond_clear(&pfile->writer_cond);
+    g_mutex_clear(&pfile->writer_mtx);
+    return pfile->writer_err;
+}
+
 bool
 writecap_flush(pcapio_writer* pfile, int *err)
 {
+    if (pfile->writer != NULL) {
+        int writer_err;
+        bool idle;
+
+        /*
+         * Don't wait for the data to be written. If the writer thread
+         * is busy, keep filling the current chunk; it'll be written
+         * when it's full, when the writer thread is idle at the next
+         * flush, or at the next writecap_sync().
+         */
+        g_mutex_lock(&pfile->writer_mtx);
+        writer_err = pfile->writer_err;
+        idle = (pfile->pending == 0);
+        g_mutex_unlock(&pfile->writer_mtx);
+        if (writer_err != 0) {
+            if (err) {
+                *err = writer_err;
+            }
+            return false;
+        }
+        if (idle && pfile->cur != NULL && pfile->cur->len != 0) {
+            writecap_submit_chunk(pfile);
+        }
+        return true;
+    }
+
     switch (pfile->ctype) {
 #if defined (HAVE_ZLIB) || defined (HAVE_ZLIBNG)
         case WTAP_GZIP_COMPRESSED:
@@ -371,11 +536,42 @@ writecap_flush(pcapio_writer* pfile, int *err)
     return true;
 }
 
+bool
+writecap_sync(pcapio_writer* pfile, int *err)
+{
+    int writer_err;
+
+    if (pfile->writer == NULL) {
+        return writecap_flush(pfile, err);
+    }
+
+    if (pfile->cur != NULL && pfile->cur->len != 0) {
+        writecap_submit_chunk(pfile);
+    }
+    g_mutex_lock(&pfile->writer_mtx);
+    while (pfile->pending != 0) {
+        g_cond_wait(&pfile->writer_cond, &pfile->writer_mtx);
+    }
+    writer_err = pfile->writer_err;
+    g_mutex_unlock(&pfile->writer_mtx);
+    if (writer_err != 0) {
+        if (err) {
+            *err = writer_err;
+        }
+        return false;
+    }
+    return true;
+}
+
 bool
 writecap_close(pcapio_writer* pfile, int *errp)
 {
     int err = 0;
 
+    if (pfile->writer != NULL) {
+        err = writecap_stop_writer_thread(pfile);
+    }
+
     errno = WTAP_ERR_CANT_CLOSE;
     switch (pfile->ctype) {
 #if defined (HAVE_ZLIB) || defined (HAVE_ZLIBNG)
@@ -389,7 +585,7 @@ writecap_close(pcapio_writer* pfile, int *errp)
             break;
 #endif /* HAVE_LZ4FRAME_H */
         default:
-            if (fclose(pfile->fh) == EOF) {
+            if (fclose(pfile->fh) == EOF && err == 0) {
                 err = errno;
             }
     }
@@ -409,6 +605,33 @@ write_to_file(pcapio_writer* pfile, const uint8_t* data, size_t data_length,
 {
     size_t nwritten;
 
+    if (pfile->writer != NULL) {
+        int writer_err = writecap_writer_error(pfile);
+
+        if (writer_err != 0) {
+            *err = writer_err;
+            return false;
+        }
+        while (data_length != 0) {
+            size_t n;
+
+            if (pfile->cur == NULL) {
+                /* Waits only if the writer thread is a long way behind. */
+                pfile->cur = (writer_chunk *)g_async_queue_pop(pfile->free_chunks);
+            }
+            n = MIN(data_length, WRITER_CHUNK_SIZE - pfile->cur->len);
+            memcpy(pfile->cur->data + pfile->cur->len, data, n);
+            pfile->cur->len += n;
+            data += n;
+            data_length -= n;
+            (*bytes_written) += n;
+            if (pfile->cur->len == WRITER_CHUNK_SIZE) {
+                writecap_submit_chunk(pfile);
+            }
+        }
+        return true;
+    }
+
     switch (pfile->ctype) {
 #if defined (HAVE_ZLIB) || defined (HAVE_ZLIBNG)
         case WTAP_GZIP_COMPRESSED:
@@ -27,9 +27,28 @@ writecap_fdopen(int fd, wtap_compression_type ctype, int *err);
 extern pcapio_writer*
 writecap_open_stdout(wtap_compression_type ctype, int *err);
 
+/* Write an uncompressed file from a separate thread, so that writing to
+ * pfile doesn't wait for the file system.  Call this before writing
+ * anything.
+ *
+ * Return true if the thread was started, false if pfile is compressed. */
+extern bool
+writecap_start_writer_thread(pcapio_writer* pfile);
+
+/* Push buffered data to the file.  With a writer thread, this doesn't wait
+ * for the data to be written, and, if the thread is busy, leaves the data
+ * to be written later; use writecap_sync() to wait for it.
+ *
+ * Return true on success, returns false and sets err (optional) on failure,
+ * which, with a writer thread, may be the failure of an earlier write. */
 extern bool
 writecap_flush(pcapio_writer* pfile, int *err);
 
+/* Like writecap_flush(), but wait until everything written to pfile so far
+ * is in the file, so that another process can read it. */
+extern bool
+writecap_sync(pcapio_writer* pfile, int *err);
+
 /* Close open file handles and frees memory associated with pfile.
  *
  * Return true on success, returns false and sets err (optional) on failure.
@@ -10,6 +10,8 @@
 
 #include "regex.h"
 
+#include <string.h>
+
 #include <wsutil/str_util.h>
 #include <pcre2.h>
 
@@ -17,8 +19,40 @@
 struct _ws_regex {
     pcre2_code *code;
     char *pattern;
+    /* A string that every match contains, or NULL. */
+    char *literal;
+    size_t literal_len;
+    /* The string is in lower case and the match is ASCII caseless. */
+    bool literal_caseless;
 };
 
+/*
+ * Match data is only used to get the offsets of the whole match, so one
+ * per thread is shared by all the regexes instead of creating one for
+ * each match.
+ */
+static void
+free_match_data(void *data)
+{
+    pcre2_match_data_free((pcre2_match_data *)data);
+}
+
+static GPrivate match_data_key = G_PRIVATE_INIT(free_match_data);
+
+static pcre2_match_data *
+get_match_data(void)
+{
+    pcre2_match_data *match_data = g_private_get(&match_data_key);
+
+    if (match_data == NULL) {
+        /* We don't use the matched substring but pcre2_match requires
+         * at least one pair of offsets. */
+        match_data = pcre2_match_data_create(1, NULL);
+        g_private_set(&match_data_key, match_data);
+    }
+    return match_data;
+}
+
 #define ERROR_MAXLEN_IN_CODE_UNITS   128
 
 static char *
@@ -76,10 +110,195 @@ compile_pcre2(const char *patt, ssize_t size, char **errmsg, unsigned flags)
         return NULL;
     }
 
+    /*
+     * pcre2_match() uses the JIT-compiled code if there is some. If JIT
+     * isn't supported or fails (e.g. it runs out of executable memory),
+     * the pattern is interpreted, so the error is ignored.
+     */
+    errorcode = pcre2_jit_compile(code, PCRE2_JIT_COMPLETE);
+    if (errorcode != 0 && errorcode != PCRE2_ERROR_JIT_BADOPTION) {
+        char *msg = get_error_msg(errorcode);
+        ws_debug("pcre2_jit_compile() failed: %s.", msg);
+        g_free(msg);
+    }
+
     return code;
 }
 
 
+/*
+ * Find the longest string of literal characters that any match of the
+ * pattern must contain, so that subjects without it can be rejected
+ * with a memory search instead of running the regex. This only looks
+ * at the top level of patterns without alternatives or option settings
+ * and gives up on anything it doesn't understand; PCRE2 itself already
+ * checks for a required single character, so shorter strings are not
+ * worth it.
+ */
+static void
+string_assign_len(GString *dst, const GString *src)
+{
+    g_string_truncate(dst, 0);
+    g_string_append_len(dst, src->str, src->len);
+}
+
+/*
+ * Set *ip to the index just past the character class that starts at *ip.
+ * POSIX classes such as [:alpha:], and [=x=] and [.x.], are skipped as a
+ * whole, so their closing bracket doesn't end the class. Returns false for
+ * any other '[' inside the class, which we don't try to parse.
+ */
+static bool
+skip_class(const char *patt, size_t size, size_t *ip)
+{
+    size_t i = *ip + 1;
+
+    /* A ']' first in the class is literal. */
+    if (i < size && patt[i] == '^')
+        i++;
+    if (i < size && patt[i] == ']')
+        i++;
+    while (i < size && patt[i] != ']') {
+        if (patt[i] == '\\') {
+            i += 2;
+        } else if (patt[i] == '[') {
+            const char delim[2] = { i + 1 < size ? patt[i + 1] : '\0', ']' };
+            const uint8_t *end;
+
+            if (delim[0] != ':' && delim[0] != '=' && delim[0] != '.')
+                return false;
+            end = ws_memmem(patt + i + 2, size - (i + 2), delim, 2);
+            if (end == NULL)
+                return false;
+            i = (const char *)end - patt + 2;
+        } else {
+            i++;
+        }
+    }
+    *ip = i + 1;
+    return true;
+}
+
+static void
+find_required_literal(ws_regex_t *re, const char *patt, size_t size, unsigned flags)
+{
+    GString *run = g_string_new(NULL);
+    GString *best = g_string_new(NULL);
+    unsigned depth = 0;
+    size_t i = 0;
+
+    if (memchr(patt, '|', size) != NULL || ws_memmem(patt, size, "(?", 2) != NULL ||
+            ws_memmem(patt, size, "(*", 2) != NULL)
+        goto done;
+
+    while (i < size) {
+        char c = patt[i];
+        bool literal = false;
+
+        if (depth > 0) {
+            /* Anything inside a group may be optional. */
+            if (c == '\\') {
+                i++;
+            } else if (c == '[') {
+                if (!skip_class(patt, size, &i))
+                    goto done;
+                continue;
+            } else if (c == '(')
+                depth++;
+            else if (c == ')')
+                depth--;
+            i++;
+            continue;
+        }
+
+        switch (c) {
+
+        case '\\':
+            if (i + 1 >= size)
+                goto done;
+            c = patt[i + 1];
+            i += 2;
+            if (!g_ascii_isalnum(c)) {
+                literal = true;
+            } else if (strchr("dDwWsShHvVRXbBAzZGKnrtfea", c) == NULL) {
+                /* An escape with an argument (\x, \p, \Q, a back
+                 * reference...); don't try to parse it. */
+                goto done;
+            }
+            break;
+
+        case '[':
+            if (!skip_class(patt, size, &i))
+                goto done;
+            break;
+
+        case '(':
+            depth++;
+            i++;
+            break;
+
+        case '.': case '^': case '$': case ')':
+            i++;
+            break;
+
+        case '{':
+            /* Skip a quantifier, or braces that might be one. */
+            while (i < size && patt[i] != '}')
+                i++;
+            i++;
+            break;
+
+        case '?': case '*': case '+':
+            /* Quantifiers are handled with the character they follow. */
+            i++;
+            break;
+
+        default:
+            literal = true;
+            i++;
+            break;
+        }
+
+        if (literal && i < size && (patt[i] == '?' || patt[i] == '*' || patt[i] == '{')) {
+            /* The character may be absent. */
+            literal = false;
+        }
+        if (literal) {
+            g_string_append_c(run, c);
+            if (i < size && patt[i] == '+') {
+                /* Present, but what follows may not be adjacent to it. */
+                if (run->len > best->len)
+                    string_assign_len(best, run);
+                g_string_truncate(run, 0);
+            }
+        } else {
+            if (run->len > best->len)
+                string_assign_len(best, run);
+            g_string_truncate(run, 0);
+        }
+    }
+    if (run->len > best->len)
+        string_assign_len(best, run);
+
+    if (best->len >= 2) {
+        re->literal_len = best->len;
+        re->literal = g_string_free(best, FALSE);
+        best = NULL;
+        /* Without UTF-8 only ASCII letters have other cases. */
+        if (flags & WS_REGEX_CASELESS) {
+            re->literal_caseless = true;
+            for (size_t j = 0; j < re->literal_len; j++)
+                re->literal[j] = g_ascii_tolower(re->literal[j]);
+        }
+    }
+
+done:
+    g_string_free(run, TRUE);
+    if (best != NULL)
+        g_string_free(best, TRUE);
+}
+
+
 ws_regex_t *
 ws_regex_compile_ex(const char *patt, ssize_t size, char **errmsg, unsigned flags)
 {
@@ -92,6 +311,10 @@ ws_regex_compile_ex(const char *patt, ssize_t size, char **errmsg, unsigned flag
     ws_regex_t *re = g_new(ws_regex_t, 1);
     re->code = code;
     re->pattern = ws_escape_string_len(NULL, patt, size, false);
+    re->literal = NULL;
+    re->literal_len = 0;
+    re->literal_caseless = false;
+    find_required_literal(re, patt, size < 0 ? strlen(patt) : (size_t)size, flags);
     return re;
 }
 
@@ -104,7 +327,27 @@ ws_regex_compile(const char *patt, char **errmsg)
 
 
 static bool
-match_pcre2(pcre2_code *code, const char *subject, ssize_t subj_length,
+literal_found(const ws_regex_t *re, const char *subject, size_t length)
+{
+    if (!re->literal_caseless)
+        return ws_memmem(subject, length, re->literal, re->literal_len) != NULL;
+
+    for (size_t i = 0; i + re->literal_len <= length; i++) {
+        size_t j;
+
+        for (j = 0; j < re->literal_len; j++) {
+            if (g_ascii_tolower(subject[i + j]) != re->literal[j])
+                break;
+        }
+        if (j == re->literal_len)
+            return true;
+    }
+    return false;
+}
+
+
+static bool
+match_pcre2(const ws_regex_t *re, const char *subject, ssize_t subj_length,
                 size_t subj_offset, pcre2_match_data *match_data)
 {
     PCRE2_SIZE length;
@@ -115,7 +358,15 @@ match_pcre2(pcre2_code *code, const char *subject, ssize_t subj_length,
     else
         length = (PCRE2_SIZE)subj_length;
 
-    rc = pcre2_match(code,
+    if (re->literal != NULL) {
+        size_t len = subj_length < 0 ? strlen(subject) : (size_t)subj_length;
+
+        if (subj_offset > len ||
+                !literal_found(re, subject + subj_offset, len - subj_offset))
+            return false;
+    }
+
+    rc = pcre2_match(re->code,
                     subject,
                     length,
                     (PCRE2_SIZE)subj_offset,
@@ -151,18 +402,10 @@ bool
 ws_regex_matches_length(const ws_regex_t *re,
                         const char *subj, ssize_t subj_length)
 {
-    bool matched;
-    pcre2_match_data *match_data;
-
     ws_return_val_if(!re, false);
     ws_return_val_if(!subj, false);
 
-    /* We don't use the matched substring but pcre2_match requires
-     * at least one pair of offsets. */
-    match_data = pcre2_match_data_create(1, NULL);
-    matched = match_pcre2(re->code, subj, subj_length, 0, match_data);
-    pcre2_match_data_free(match_data);
-    return matched;
+    return match_pcre2(re, subj, subj_length, 0, get_match_data());
 }
 
 
@@ -177,14 +420,13 @@ ws_regex_matches_pos(const ws_regex_t *re,
     ws_return_val_if(!re, false);
     ws_return_val_if(!subj, false);
 
-    match_data = pcre2_match_data_create(1, NULL);
-    matched = match_pcre2(re->code, subj, subj_length, subj_offset, match_data);
+    match_data = get_match_data();
+    matched = match_pcre2(re, subj, subj_length, subj_offset, match_data);
     if (matched && pos_vect) {
         PCRE2_SIZE *ovect = pcre2_get_ovector_pointer(match_data);
         pos_vect[0] = ovect[0];
         pos_vect[1] = ovect[1];
     }
-    pcre2_match_data_free(match_data);
     return matched;
 }
 
@@ -194,6 +436,7 @@ ws_regex_free(ws_regex_t *re)
 {
     pcre2_code_free(re->code);
     g_free(re->pattern);
+    g_free(re->literal);
     g_free(re);
 }
 
@@ -151,6 +151,30 @@ wmem_map_new_autoreset(wmem_allocator_t *metadata_scope, wmem_allocator_t *data_
     return map;
 }
 
+void
+wmem_map_destroy(wmem_map_t *map, bool free_keys, bool free_values)
+{
+    wmem_map_item_t *cur, *nxt;
+    size_t           i;
+
+    if (map->table != NULL) {
+        for (i=0; i<CAPACITY(map); i++) {
+            for (cur = map->table[i]; cur; cur = nxt) {
+                nxt = cur->next;
+                if (free_keys) {
+                    wmem_free(map->data_allocator, (void *)cur->key);
+                }
+                if (free_values) {
+                    wmem_free(map->data_allocator, cur->value);
+                }
+                wmem_free(map->data_allocator, cur);
+            }
+        }
+        wmem_free(map->data_allocator, map->table);
+    }
+    wmem_free(map->metadata_allocator, map);
+}
+
 static inline void
 wmem_map_grow(wmem_map_t *map)
 {
@@ -355,6 +379,7 @@ wmem_map_steal(wmem_map_t *map, const void *key)
             /* found it */
             tmp     = (*item);
             (*item) = tmp->next;
+            wmem_free(map->data_allocator, tmp);
             map->count--;
             return true;
         }
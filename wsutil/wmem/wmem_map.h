@@ -77,6 +77,16 @@ wmem_map_new_autoreset(wmem_allocator_t *metadata_scope, wmem_allocator_t *data_
         GHashFunc hash_func, GEqualFunc eql_func)
 G_GNUC_MALLOC;
 
+/** Frees a map created with wmem_map_new() before its scope is emptied.
+ *
+ * @param map The map to free. Must not be used afterwards.
+ * @param free_keys Whether to free the keys with the map's allocator.
+ * @param free_values Whether to free the values with the map's allocator.
+ */
+WS_DLL_PUBLIC
+void
+wmem_map_destroy(wmem_map_t *map, bool free_keys, bool free_values);
+
 /** Inserts a value into the map.
  *
  * @param map The map to insert into. Must not be NULL.
@@ -1015,6 +1015,21 @@ wmem_test_map(void)
     }
     g_assert_true(wmem_map_size(map) == CONTAINER_ITERS/2);
 
+    /* test steal and destroy */
+    for (i=1; i<CONTAINER_ITERS; i+=2) {
+        g_assert_true(wmem_map_steal(map, GINT_TO_POINTER(i)));
+    }
+    g_assert_true(wmem_map_size(map) == 0);
+    wmem_map_destroy(map, false, false);
+
+    map = wmem_map_new(allocator, wmem_str_hash, g_str_equal);
+    for (i=0; i<CONTAINER_ITERS; i++) {
+        str_key = wmem_test_rand_string(allocator, 1, 64);
+        wmem_free(allocator, wmem_map_insert(map, str_key, wmem_strdup(allocator, str_key)));
+    }
+    wmem_map_destroy(map, true, true);
+    wmem_strict_check_canaries(allocator);
+
     wmem_destroy_allocator(extra_allocator);
     wmem_destroy_allocator(allocator);
 }